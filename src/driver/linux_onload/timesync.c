@@ -105,6 +105,9 @@ static void stabilize_cpu_khz_timer(unsigned long unused)
 
 static spinlock_t timesync_lock;
 
+#define ONE_SECOND_IN_NS 1000000000llu
+#define TEN_SECOND_IN_NS 10000000000llu
+
 int oo_timesync_ctor(struct oo_timesync *oo_ts)
 {
   ci_uint64 now_frc;
@@ -119,6 +122,11 @@ int oo_timesync_ctor(struct oo_timesync *oo_ts)
   oo_ts->mono_clock.tv_sec = mono_now.tv_sec;
   oo_ts->mono_clock.tv_nsec = mono_now.tv_nsec;
   oo_ts->clock_made = now_frc;
+  oo_ts->wall_ns = (ci_uint64) wall_now.tv_sec * ONE_SECOND_IN_NS +
+                   wall_now.tv_nsec;
+  oo_ts->mono_ns = (ci_uint64) mono_now.tv_sec * ONE_SECOND_IN_NS +
+                   mono_now.tv_nsec;
+  oo_ts->frc_to_ns_mult = 0;
 
   /* Set to zero to prevent smoothing when first set */
   oo_ts->smoothed_ticks = 0;
@@ -146,14 +154,27 @@ void oo_timesync_dtor(struct oo_timesync *oo_ts)
   del_timer_sync(&timer_node);
 }
 
+/* Returns ns per tick in 32.32 fixed point.  ns is scaled down to 31 bits
+ * first so that the shift cannot overflow.  It is then at least 2^30 (when
+ * it was that large to start with), so the result is good to about 1e-9.
+ */
+static ci_uint64 oo_timesync_frc_to_ns_mult(ci_uint64 ticks, ci_uint64 ns)
+{
+  while( ns >= (1ull << 31) ) {
+    ns >>= 1;
+    ticks >>= 1;
+  }
+  if( ticks == 0 )
+    return 0;
+  return div64_u64(ns << 32, ticks);
+}
+
 #define TIMESYNC_SMOOTH_SAMPLES 16
 #define TIMESYNC_SMOOTH_SAMPLES_MASK 0xf
 static ci_uint64 timesync_smooth_tick_samples[TIMESYNC_SMOOTH_SAMPLES];
 static ci_uint64 timesync_smooth_ns_samples[TIMESYNC_SMOOTH_SAMPLES];
 static int timesync_smooth_i = 0;
 
-#define ONE_SECOND_IN_NS 1000000000llu
-#define TEN_SECOND_IN_NS 10000000000llu
 
 void oo_timesync_update(struct oo_timesync *oo_ts)
 {
@@ -242,6 +263,12 @@ void oo_timesync_update(struct oo_timesync *oo_ts)
       oo_ts->mono_clock.tv_sec = mono_ts.tv_sec;
       oo_ts->mono_clock.tv_nsec = mono_ts.tv_nsec;
       oo_ts->clock_made = frc;
+      oo_ts->wall_ns = (ci_uint64) wall_ts.tv_sec * ONE_SECOND_IN_NS +
+                       wall_ts.tv_nsec;
+      oo_ts->mono_ns = (ci_uint64) mono_ts.tv_sec * ONE_SECOND_IN_NS +
+                       mono_ts.tv_nsec;
+      oo_ts->frc_to_ns_mult =
+        oo_timesync_frc_to_ns_mult(oo_ts->smoothed_ticks, oo_ts->smoothed_ns);
 
       oo_ts->update_jiffies = jiffies + msecs_to_jiffies(timesync_period);
 
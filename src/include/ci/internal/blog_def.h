@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_HEADER >
+**  \brief  Messages recorded in a stack's binary log
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*
+ * OO_BLOG_FMT(id, format)
+ *
+ * A record in the binary log holds the index of its message in this file,
+ * so the log may be decoded by a tool built from a different release.
+ * Only ever append to this file.
+ *
+ * Arguments are stored as 64-bit integers, so formats may use the integer
+ * conversions (d, i, u, x, X, o and c) with any flags, width and precision,
+ * and the following, which take the place of arguments that cannot be
+ * formatted by the reader:
+ *
+ *   %I  IPv4 address in network byte order
+ *   %M  MAC address, packed with oo_blog_mac()
+ *   %F  TCP header flags
+ *   %S  socket state, as in citp_waitable::state
+ *
+ * At most OO_BLOG_ARGS_MAX arguments are recorded.
+ */
+
+OO_BLOG_FMT(TCP_RX_SHOST_NOT_EFAB,
+            "ci_tcp_rx_checks: SHOST_NOT_EFAB:")
+OO_BLOG_FMT(TCP_RX_SHOST_BAD,
+            "ci_tcp_rx_checks: SHOST_BAD: expected=%M")
+OO_BLOG_FMT(TCP_RX_PKT,
+            "ci_tcp_rx_checks: pkt %I:%u=>%I:%u [%F]")
+OO_BLOG_FMT(TCP_RX_PKT_MAC,
+            "ci_tcp_rx_checks: pkt %M=>%M")
+OO_BLOG_FMT(TCP_RX_SOCK,
+            "ci_tcp_rx_checks: %d snd=%d inf=%d rcv=%d %S")
+OO_BLOG_FMT(TCP_RX_SOCK_ADDR,
+            "ci_tcp_rx_checks: %d %I:%u=>%I:%u")
+OO_BLOG_FMT(TCP_RX_SOCK_MAC,
+            "ci_tcp_rx_checks: %d %M=>%M hwport=%d stripe=%x")
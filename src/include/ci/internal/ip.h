@@ -401,7 +401,7 @@ typedef struct {
   ci_uint32     sack[8];         /* pointer to first block, host endian */
   ci_int32      sack_blocks;
   ci_uint32     ack,seq;         /* ACK and SEQ values in host endian */
-  ci_uint32     hash;            /* hash for l/r addr/port */
+  ci_uint32     hash;            /* ci_tcp_synrecv_hash() of l/r addr/port */
 } ciip_tcp_rx_pkt;
 
 
@@ -452,6 +452,7 @@ extern int  ci_netif_ctor(ci_netif**, const ci_netif_config_opts*,
 extern int  ci_netif_ctor(ci_netif*, ef_driver_handle, const char* name,
                           unsigned flags) CI_HF;
 extern void ci_netif_cluster_prefault(ci_netif* ni) CI_HF;
+extern void ci_netif_extra_eps_grow(ci_netif* ni, unsigned id) CI_HF;
 #endif
 extern int  ci_netif_restore_id(ci_netif*, unsigned stack_id) CI_HF;
 extern int citp_netif_by_id(ci_uint32 stack_id, ci_netif** out_ni, int locked) CI_HF;
@@ -498,6 +499,8 @@ ci_inline void ci_netif_send(ci_netif* ni, ci_ip_pkt_fmt* pkt)
   __ci_netif_send(ni, pkt);
 }
 extern void ci_netif_rx_post(ci_netif* netif, int nic_index) CI_HF;
+extern void ci_netif_rx_recycle_drain(ci_netif* ni) CI_HF;
+extern void ci_netif_tx_mag_drain(ci_netif* ni) CI_HF;
 #ifdef __KERNEL__
 extern int  ci_netif_set_rxq_limit(ci_netif*) CI_HF;
 extern int  ci_netif_init_fill_rx_rings(ci_netif*) CI_HF;
@@ -545,6 +548,14 @@ extern void ci_netif_config_opts_dump(ci_netif_config_opts* opts,
                                       void* log_arg) CI_HF;
 extern void ci_stack_time_dump(ci_netif* ni, oo_dump_log_fn_t logger,
                                void* log_arg) CI_HF;
+#ifndef __KERNEL__
+extern ci_uint32 ci_netif_blog_dump(ci_netif* ni, ci_uint32* pos,
+                                    oo_dump_log_fn_t logger,
+                                    void* log_arg) CI_HF;
+extern int ci_netif_ssnap_read(ci_netif* ni, ci_netif_ssnap* snap) CI_HF;
+extern int ci_netif_ssnap_sock_read(ci_netif* ni, ci_uint32 idx,
+                                    ci_netif_ssnap_sock* rec) CI_HF;
+#endif
 extern void ci_netif_pkt_dump_all(ci_netif* ni) CI_HF;
 extern void ci_netif_pkt_queue_dump(ci_netif* ni, ci_ip_pkt_queue* q,
                                     int is_recv, int dump) CI_HF;
@@ -638,6 +649,7 @@ CI_DEBUG(extern void ci_netif_verify_freepkts(ci_netif *, const char *, int);)
 
 
 extern int ci_netif_pktset_best(ci_netif* ni) CI_HF;
+extern void ci_netif_pktset_rebucket(ci_netif* ni, int bufset_id) CI_HF;
 extern void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
                               CI_KERNEL_ARG(int* p_netif_is_locked)) CI_HF;
 
@@ -728,6 +740,8 @@ extern void ci_sock_cmn_init(ci_netif*, ci_sock_cmn*, int can_poison) CI_HF;
 extern void ci_sock_cmn_reinit(ci_netif*, ci_sock_cmn*) CI_HF;
 extern void ci_sock_cmn_dump(ci_netif*, ci_sock_cmn*, const char* pf,
                              oo_dump_log_fn_t logger, void* log_arg) CI_HF;
+extern void ci_sock_rx_pkts_dump(ci_netif*, ci_sock_cmn*, const char* pf,
+                                 oo_dump_log_fn_t logger, void* log_arg) CI_HF;
 
 # define S_SP(ss)  ((ss)->s.b.bufid)
 # define SC_SP(s)  ((s)->b.bufid)
@@ -821,6 +835,11 @@ extern int __ci_icmp_send_error(ci_netif* ni, int af, ci_ipx_hdr_t* ipx,
 #define CI_UDP_MAX_PAYLOAD_BYTES(af) \
   (0xffff - sizeof(ci_udp_hdr) - (IS_AF_INET6(af) ? 0 : sizeof(ci_ip4_hdr)))
 
+/* Maximum number of datagrams a single UDP_SEGMENT send may be split into,
+ * and that UDP_GRO will coalesce into a single receive.  Matches Linux.
+ */
+#define CI_UDP_GSO_SEGS_MAX  64
+
 #define UDP_FLAGS(us)           ((us)->udpflags)
 
 #define UDP_SET_FLAG(us,f)      ((us)->udpflags|=(f))
@@ -934,7 +953,8 @@ struct cmsg_state {
 extern void ci_put_cmsg(struct cmsg_state *cmsg_state, int level, int type,
                         socklen_t len, const void *data) CI_HF;
 /* info_out contains a pointer to struct in_pktinfo or struct in6_pktinfo */
-extern int ci_ip_cmsg_send(const struct msghdr*, void** info_out) CI_HF;
+extern int ci_ip_cmsg_send(const struct msghdr*, void** info_out,
+                           int* gso_size_out) CI_HF;
 extern void ci_ip_cmsg_finish(struct cmsg_state* cmsg_state) CI_HF;
 
 #ifndef __KERNEL__
@@ -988,6 +1008,13 @@ extern int ci_udp_recvmmsg(ci_udp_iomsg_args *a, struct mmsghdr* mmsg,
 struct onload_zc_mmsg;
 extern int ci_tcp_zc_send(ci_netif* ni, ci_tcp_state* ts, 
                           struct onload_zc_mmsg* msgs, int flags);
+extern void ci_tcp_tx_pkt_fill_in_place(ci_netif* ni, ci_tcp_state* ts,
+                                        ci_ip_pkt_fmt* pkt, const void* data,
+                                        int len,
+                                        ci_ip_pkt_fmt** fill_list) CI_HF;
+extern void ci_tcp_sendmsg_enqueue_filled(ci_netif* ni, ci_tcp_state* ts,
+                                          ci_ip_pkt_fmt* fill_list,
+                                          int bytes, int flags) CI_HF;
 struct onload_zc_recv_args;
 int ci_udp_zc_recv(ci_udp_iomsg_args* a, struct onload_zc_recv_args* args);
 
@@ -1012,7 +1039,7 @@ ci_netif_raw_send(ci_netif* ni, int intf_i,
 
 extern void ci_ip_cmsg_recv(ci_netif*, ci_udp_state*, const ci_ip_pkt_fmt*,
                             struct msghdr*, int netif_locked,
-                            int *p_msg_flags) CI_HF;
+                            int *p_msg_flags, int gso_size) CI_HF;
 #ifdef __KERNEL__
 extern void ci_udp_all_fds_gone(ci_netif* netif, oo_sp, int do_free);
 #endif
@@ -1044,6 +1071,11 @@ extern int ci_pipe_zc_read(ci_netif* ni, struct oo_pipe* p, int len,
                            int flags, ci_pipe_zc_read_cb cb, void* ctx) CI_HF;
 extern int ci_pipe_zc_move(ci_netif* ni, struct oo_pipe* pipe_src,
                            struct oo_pipe* pipe_dest, int len, int flags) CI_HF;
+extern int ci_pipe_zc_move_to_tcp(ci_netif* ni, struct oo_pipe* p,
+                                  ci_tcp_state* ts, int len, int flags) CI_HF;
+extern int ci_pipe_zc_move_from_tcp(ci_netif* ni, struct oo_pipe* p,
+                                    ci_tcp_state* ts, int len,
+                                    int flags) CI_HF;
 extern int ci_pipe_zc_write(ci_netif* ni, struct oo_pipe* p,
                             struct ci_pipe_pkt_list* pkts,
                             int len, int flags) CI_HF;
@@ -1484,6 +1516,9 @@ extern void
 ci_tcp_syncookie_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
                      ciip_tcp_rx_pkt* rxp,
                      ci_tcp_state_synrecv **tsr_p);
+extern ci_uint32
+ci_tcp_synrecv_hash(ci_netif* netif, ci_addr_t laddr, ci_uint16 lport_be16,
+                    ci_addr_t raddr, ci_uint16 rport_be16);
 
 extern void ci_tcp_set_sndbuf(ci_netif* ni, ci_tcp_state* ts);
 extern void ci_tcp_set_sndbuf_from_sndbuf_pkts(ci_netif* ni, ci_tcp_state* ts);
@@ -1704,6 +1739,8 @@ ci_tcp_may_send_ack_ratelimited(ci_netif* netif, ci_tcp_state* ts) CI_HF;
 extern void ci_tcp_send_ack_loopback(ci_netif* netif, ci_tcp_state* ts) CI_HF;
 extern int  ci_tcp_send_wnd_update(ci_netif*, ci_tcp_state*,
                                    int sock_locked) CI_HF;
+extern void ci_tcp_recv_wnd_update_locked(ci_netif*, ci_tcp_state*) CI_HF;
+extern void ci_tcp_rcvbuf_drs(ci_netif*, ci_tcp_state*) CI_HF;
 
 
 /* TCP/UDP filter insertion */
@@ -1948,6 +1985,29 @@ extern void ci_tcp_sendmsg_enqueue_prequeue(ci_netif* ni,
                                             int/*bool*/ shutdown) CI_HF;
 extern void ci_tcp_perform_deferred_socket_work(ci_netif*, ci_tcp_state*)CI_HF;
 
+/* Shared-memory byte ring for accelerated loopback (EF_TCP_LOOPBACK_RING).
+ * ci_tcp_loop_ring_send() needs the stack lock, and returns the number of
+ * bytes taken from [piov], which may be zero if the ring can't be used.
+ * ci_tcp_loop_ring_recv() needs the socket lock.
+ */
+#ifndef __KERNEL__
+extern int ci_tcp_loop_ring_send(ci_netif*, ci_tcp_state*,
+                                 ci_iovec_ptr* piov) CI_HF;
+#endif
+extern int ci_tcp_loop_ring_recv(ci_netif*, ci_tcp_state*,
+                                 ci_iovec_ptr* piov, int flags) CI_HF;
+extern void ci_tcp_loop_ring_free(ci_netif*, ci_tcp_state*) CI_HF;
+
+ci_inline ci_uint32 ci_tcp_loop_ring_used(ci_tcp_state* ts)
+{ return ts->loop_ring.bytes_added - ts->loop_ring.bytes_removed; }
+
+/* Releases the buffers in the socket's send magazine (EF_TCP_SEND_MAGAZINE).
+ * Needs the stack lock, and no sendmsg() may be in progress. */
+extern void ci_tcp_tx_mag_drain(ci_netif*, ci_tcp_state*) CI_HF;
+/* As above, but does nothing if a sendmsg() has claimed the magazine.
+ * Returns the number of buffers released. */
+extern int ci_tcp_tx_mag_reclaim(ci_netif*, ci_tcp_state*) CI_HF;
+
 /* Guarantees that deferred work will be performed at some point in the
  * near future, either by the calling thread (in this call), or deferred to
  * another thread.
@@ -2215,6 +2275,111 @@ extern int ci_setup_ipstack_params(void);
 #define ci_trs_get_valid_ep(trs, sock_id)               \
   ci_netif_get_valid_ep(&(trs)->netif, (sock_id))
 
+#ifndef __KERNEL__
+/* Returns the process-private state of endpoint [id].  Entries are
+ * initialised on first use, so that creating a stack with a large
+ * EF_MAX_ENDPOINTS does not touch memory for endpoints that are never
+ * allocated. */
+ci_inline struct ci_extra_ep* ci_netif_extra_ep(ci_netif* ni, unsigned id)
+{
+  if(CI_UNLIKELY( id >= ni->eps_n ))
+    ci_netif_extra_eps_grow(ni, id);
+  ci_rmb();
+  return &ni->eps[id];
+}
+#endif
+
+
+/**********************************************************************
+***************************** Binary log ******************************
+**********************************************************************/
+
+/* OO_BLOG(ni, id, args...) records message OO_BLOG_ID_<id> (see
+ * blog_def.h) with up to OO_BLOG_ARGS_MAX integer arguments in the stack's
+ * binary log.  Nothing is formatted; "onload_stackdump blog" decodes the
+ * log.  Does nothing if the stack has no binary log, so call sites that
+ * would otherwise ci_log() should test ci_netif_blog_enabled() first.
+ */
+#define ci_netif_blog_enabled(ni)  ((ni)->state->blog_entries_n != 0)
+
+ci_inline void ci_netif_blog_write(ci_netif* ni, unsigned fmt_id,
+                                   const ci_uint64* args, unsigned n_args)
+{
+  ci_netif_state* ns = ni->state;
+  ci_uint32 idx = __sync_fetch_and_add(&ns->blog_head, 1);
+  ci_netif_blog_rec* rec = &ni->blog[idx & (ns->blog_entries_n - 1)];
+  unsigned i;
+
+  rec->seq = 0;
+  ci_wmb();
+  rec->fmt_id = fmt_id;
+  rec->n_args = n_args;
+  ci_frc64(&rec->frc);
+  for( i = 0; i < n_args; ++i )
+    rec->args[i] = args[i];
+  ci_wmb();
+  rec->seq = idx + 1;
+}
+
+#define OO_BLOG(ni, id, ...)                                            \
+  do {                                                                  \
+    if( ci_netif_blog_enabled(ni) ) {                                   \
+      const ci_uint64 __oo_blog_args[] = { 0, ##__VA_ARGS__ };          \
+      CI_BUILD_ASSERT(sizeof(__oo_blog_args) <=                         \
+                      sizeof(ci_uint64) * (OO_BLOG_ARGS_MAX + 1));      \
+      ci_netif_blog_write((ni), OO_BLOG_ID_##id, __oo_blog_args + 1,    \
+                          sizeof(__oo_blog_args) / sizeof(ci_uint64) - 1); \
+    }                                                                   \
+  } while(0)
+
+/* Packs a MAC address into an argument for the %M conversion. */
+ci_inline ci_uint64 oo_blog_mac(const void* mac)
+{
+  ci_uint64 v = 0;
+  memcpy(&v, mac, 6);
+  return v;
+}
+
+
+/**********************************************************************
+**************************** Stats snapshot ***************************
+**********************************************************************/
+
+#define ci_netif_ssnap_enabled(ni)  ((ni)->state->ssnap_sock_log_n != 0)
+
+/* The socket log follows the snapshot itself. */
+ci_inline ci_netif_ssnap_sock* ci_netif_ssnap_socks(ci_netif* ni)
+{
+  return (ci_netif_ssnap_sock*) (ni->ssnap + 1);
+}
+
+/* Records that socket [id] has been allocated or freed.  Freeing may happen
+ * without the stack lock, so slots are claimed atomically as for the binary
+ * log.
+ */
+ci_inline void ci_netif_ssnap_sock_write(ci_netif* ni, oo_sp id,
+                                         unsigned op, unsigned state)
+{
+  ci_netif_state* ns = ni->state;
+  ci_uint32 idx = __sync_fetch_and_add(&ns->ssnap_sock_head, 1);
+  ci_netif_ssnap_sock* rec =
+    &ci_netif_ssnap_socks(ni)[idx & (ns->ssnap_sock_log_n - 1)];
+
+  rec->seq = 0;
+  ci_wmb();
+  rec->sock_id = OO_SP_TO_INT(id);
+  rec->op = op;
+  rec->state = state;
+  ci_wmb();
+  rec->seq = idx + 1;
+}
+
+#define OO_SSNAP_SOCK(ni, id, op, state)                                \
+  do {                                                                  \
+    if( ci_netif_ssnap_enabled(ni) )                                    \
+      ci_netif_ssnap_sock_write((ni), (id), OO_SSNAP_SOCK_##op, (state)); \
+  } while(0)
+
 
 /**********************************************************************
 ***************************** Misc macros *****************************
@@ -2538,6 +2703,72 @@ ci_inline ci_uint32 ci_ip_time_freq_hz2tick(ci_netif* ni, ci_uint32 hz)
 }
 
 
+/* Returns (a * b) >> 32 without needing 128-bit arithmetic. */
+ci_inline ci_uint64 oo_timesync_scale(ci_uint64 a, ci_uint64 b)
+{
+  ci_uint64 a_hi = a >> 32, a_lo = (ci_uint32) a;
+  ci_uint64 b_hi = b >> 32, b_lo = (ci_uint32) b;
+  return ((a_hi * b_hi) << 32) + a_hi * b_lo + a_lo * b_hi +
+         ((a_lo * b_lo) >> 32);
+}
+
+
+/*! Convert an frc reading to CLOCK_REALTIME and CLOCK_MONOTONIC time in
+**  ns using the mapping that the driver keeps up to date in [ts].  Either
+**  output may be NULL.
+**  \return     0, or -EAGAIN if the driver has not yet calibrated the frc
+*/
+ci_inline int oo_timesync_frc_to_ns(const struct oo_timesync* ts,
+                                    ci_uint64 frc, ci_uint64* wall_ns,
+                                    ci_uint64* mono_ns)
+{
+  ci_uint64 made, wall, mono, mult, delta;
+  ci_uint32 gc;
+
+  do {
+    gc = OO_ACCESS_ONCE(ts->generation_count);
+    ci_rmb();
+    made = ts->clock_made;
+    wall = ts->wall_ns;
+    mono = ts->mono_ns;
+    mult = ts->frc_to_ns_mult;
+    ci_rmb();
+  } while( (gc & 1) || gc != OO_ACCESS_ONCE(ts->generation_count) );
+
+  if(CI_UNLIKELY( mult == 0 ))
+    return -EAGAIN;
+  if( (ci_int64) (frc - made) >= 0 ) {
+    delta = oo_timesync_scale(frc - made, mult);
+    wall += delta;
+    mono += delta;
+  }
+  else {
+    delta = oo_timesync_scale(made - frc, mult);
+    wall -= delta;
+    mono -= delta;
+  }
+  if( wall_ns != NULL )
+    *wall_ns = wall;
+  if( mono_ns != NULL )
+    *mono_ns = mono;
+  return 0;
+}
+
+
+#ifndef __KERNEL__
+/*! Convert an frc reading to CLOCK_REALTIME ns, without a system call.
+**  \return     0, or -EAGAIN if the mapping is not available
+*/
+ci_inline int ci_netif_frc_to_wall_ns(ci_netif* ni, ci_uint64 frc,
+                                      ci_uint64* ns)
+{
+  if(CI_UNLIKELY( ni->timesync == NULL ))
+    return -EAGAIN;
+  return oo_timesync_frc_to_ns(ni->timesync, frc, ns, NULL);
+}
+#endif
+
+
 ci_inline const cicp_hwport_mask_t ci_netif_get_hwport_mask(ci_netif* ni)
 {
 #ifdef __KERNEL__
@@ -2822,6 +3053,9 @@ ci_inline ci_ip_pkt_fmt* ci_netif_pkt_get(ci_netif* ni, int bufset_id)
   ni->packets->set[bufset_id].free = pkt->next;
   --ni->packets->set[bufset_id].n_free;
   --ni->packets->n_free;
+  if(CI_UNLIKELY( (ni->packets->set[bufset_id].n_free &
+                   OO_PKTSET_BUCKET_MASK) == 0 ))
+    ci_netif_pktset_rebucket(ni, bufset_id);
   pkt->refcount = 1;
   CI_DEBUG(pkt->intf_i = -1);
   CHECK_FREEPKTS(ni);
@@ -2836,6 +3070,9 @@ ci_inline void ci_netif_pkt_put(ci_netif* ni, ci_ip_pkt_fmt* pkt)
   ni->packets->set[bufset_id].free = OO_PKT_P(pkt);
   ++ni->packets->set[bufset_id].n_free;
   ++ni->packets->n_free;
+  if(CI_UNLIKELY( ((ni->packets->set[bufset_id].n_free - 1) &
+                   OO_PKTSET_BUCKET_MASK) == 0 ))
+    ci_netif_pktset_rebucket(ni, bufset_id);
   CHECK_FREEPKTS(ni);
 }
 
@@ -3085,6 +3322,41 @@ __ci_tcp_rx_buf_count(ci_netif* netif, ci_tcp_state* ts)
   return ts->recv1.num + ts->recv2.num + ts->rob.num;
 }
 
+/* Number of received packet buffers held in a socket's receive queues. */
+ci_inline int ci_netif_sock_rx_pkts(ci_netif* ni, citp_waitable* w)
+{
+  citp_waitable_obj* wo = CI_CONTAINER(citp_waitable_obj, waitable, w);
+  if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
+    return __ci_tcp_rx_buf_count(ni, &wo->tcp);
+#if CI_CFG_UDP
+  if( wo->waitable.state == CI_TCP_STATE_UDP )
+    return wo->udp.recv_q.pkts_added - wo->udp.recv_q.pkts_reaped;
+#endif
+  return 0;
+}
+
+/* Whether a socket holding [rx_pkts] received packet buffers may queue
+ * more while the stack is in critical memory pressure.
+ */
+ci_inline int ci_netif_mem_pressure_sock_may_queue(ci_netif* ni, int rx_pkts)
+{
+  return rx_pkts < NI_OPTS(ni).mem_pressure_sock_pkts;
+}
+
+/* Called during critical memory pressure for a received buffer for a
+ * socket holding [rx_pkts] buffers.  Returns true if the socket may queue
+ * it, taking it from the stack's budget for such buffers.
+ */
+ci_inline int ci_netif_mem_pressure_sock_accept(ci_netif* ni, int rx_pkts)
+{
+  if( ! ci_netif_mem_pressure_sock_may_queue(ni, rx_pkts) ||
+      ni->state->mem_pressure_sock_budget <= 0 )
+    return 0;
+  --ni->state->mem_pressure_sock_budget;
+  CITP_STATS_NETIF_INC(ni, memory_pressure_sock_accepts);
+  return 1;
+}
+
 ci_inline unsigned
 __ci_tcp_rx_reserved_bufs(ci_netif* netif, ci_tcp_state* ts, int allocated_pkts)
 {
@@ -4398,7 +4670,6 @@ static inline const char* ci_tcp_aux_type2str(int type)
 {
   switch(type) {
     case CI_TCP_AUX_TYPE_SYNRECV: return "syn-recv state";
-    case CI_TCP_AUX_TYPE_BUCKET:  return "syn-recv bucket";
     case CI_TCP_AUX_TYPE_EPOLL: return "epoll3 state";
     default: return "unknown";
   }
@@ -4416,12 +4687,6 @@ ci_inline ci_tcp_state_synrecv* ci_ni_aux_p2synrecv(ci_netif* ni, oo_p oop)
   ci_assert_equal(aux->type, CI_TCP_AUX_TYPE_SYNRECV);
   return &aux->u.synrecv;
 }
-ci_inline ci_tcp_listen_bucket* ci_ni_aux_p2bucket(ci_netif* ni, oo_p oop)
-{
-  ci_ni_aux_mem* aux = ci_ni_aux_p2aux(ni, oop);
-  ci_assert_equal(aux->type, CI_TCP_AUX_TYPE_BUCKET);
-  return &aux->u.bucket;
-}
 ci_inline ci_sb_epoll_state* ci_ni_aux_p2epoll(ci_netif* ni, oo_p oop)
 {
   ci_ni_aux_mem* aux = ci_ni_aux_p2aux(ni, oop);
@@ -4495,22 +4760,6 @@ ci_inline oo_p ci_ni_aux_alloc(ci_netif* ni, int type)
   return ret;
 }
 
-ci_inline oo_p ci_ni_aux_alloc_bucket(ci_netif* ni)
-{
-  ci_tcp_listen_bucket* bucket;
-  oo_p ret = ci_ni_aux_alloc(ni, CI_TCP_AUX_TYPE_BUCKET);
-  int i;
-
-  if( OO_P_IS_NULL(ret) ) {
-    CITP_STATS_NETIF(++ni->state->stats.aux_bucket_alloc_fails);
-    return ret;
-  }
-  bucket = ci_ni_aux_p2bucket(ni, ret);
-  for( i = 0; i < CI_TCP_LISTEN_BUCKET_SIZE; i++ )
-    bucket->bucket[i] = OO_P_NULL;
-  return ret;
-}
-
 ci_inline oo_p ci_tcp_synrecv2p(ci_netif* ni, ci_tcp_state_synrecv* tsr)
 {
   return ci_ni_aux2p(ni, CI_CONTAINER(ci_ni_aux_mem, u.synrecv, tsr));
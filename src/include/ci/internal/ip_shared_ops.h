@@ -182,6 +182,15 @@ ci_inline oo_p oo_ptr_to_statep(const ci_netif* ni, void* ptr) {
 # define ci_netif_ep_ofs(ni)  ((ni)->state->ep_ofs)
 #endif
 
+/* ...and of the sizes of the TX timestamp ring and the readiness bitmaps. */
+#if CI_CFG_NETIF_HARDEN
+# define ci_netif_tx_ts_ring_n(ni)     ((ni)->tx_ts_ring_n)
+# define ci_netif_sock_ready_words(ni) ((ni)->sock_ready_words)
+#else
+# define ci_netif_tx_ts_ring_n(ni)     ((ni)->state->tx_ts_ring_n)
+# define ci_netif_sock_ready_words(ni) ((ni)->state->sock_ready_words)
+#endif
+
 
 /* Both in the kernel and at UL, the logical stack address space is mapped as
  * a single contiguous region beginning at the base address of the shared
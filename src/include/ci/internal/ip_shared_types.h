@@ -221,7 +221,8 @@ typedef union {
     ci_uint32         start_seq;
     oo_pkt_p          block_end;     /* end of the current (un)sacked block */
     oo_sp             sock_id;       /* The socket this pkt is tx'd on:
-                                      * used in oo_deferred_arp_failed() */
+                                      * used in oo_deferred_arp_failed() and
+                                      * set for TX_TIMESTAMPED packets */
 #if CI_CFG_TIMESTAMPING
     struct oo_timespec first_tx_hw_stamp; /* Timestamp of the first transmit */
 #endif
@@ -755,6 +756,19 @@ typedef struct {
 } ci_pio_buddy_allocator;
 
 
+/* Packet sets that have free buffers are kept on one of OO_PKTSET_BUCKETS
+ * lists according to how many buffers they have free, so that a set with
+ * (nearly) the most free buffers can be found without scanning all sets.
+ * Bucket [b] holds the sets with ((n_free - 1) >> OO_PKTSET_BUCKET_SHIFT)
+ * equal to [b].  Sets with no free buffers are not on any list.
+ */
+#define OO_PKTSET_BUCKETS_S     4u
+#define OO_PKTSET_BUCKETS       (1u << OO_PKTSET_BUCKETS_S)
+#define OO_PKTSET_BUCKET_SHIFT  (CI_CFG_PKTS_PER_SET_S - OO_PKTSET_BUCKETS_S)
+#define OO_PKTSET_BUCKET_MASK   ((1 << OO_PKTSET_BUCKET_SHIFT) - 1)
+#define OO_PKTSET_BUCKET(n_free)                                    \
+  ((n_free) == 0 ? -1 : (int) (((n_free) - 1) >> OO_PKTSET_BUCKET_SHIFT))
+
 typedef struct {
   /* Fixme: compress these into ci_uint16 for each */
   oo_pkt_p              free;   /**< List of free packet buffers */
@@ -762,6 +776,9 @@ typedef struct {
 #if defined(CI_CFG_PKTS_AS_HUGE_PAGES)
   CI_ULCONST ci_int32   shm_id; /**< shared memory id for huge page  */
 #endif
+  ci_int32              bucket; /**< Free-count bucket, or -1 if none */
+  ci_int32              bucket_next; /**< Next set in bucket, or -1 */
+  ci_int32              bucket_prev; /**< Previous set in bucket, or -1 */
 } oo_pktbuf_set;
 
 typedef struct {
@@ -771,6 +788,8 @@ typedef struct {
   CI_ULCONST ci_uint32 sets_max; /**< max number of packet sets */
   /* Packet buffers allocated.  This is [sets_n * PKTS_PER_SET]. */
   CI_ULCONST ci_int32  n_pkts_allocated;
+  /* First set in each free-count bucket, or -1. */
+  ci_int32 bucket_head[OO_PKTSET_BUCKETS];
 
   oo_pktbuf_set set[0];
 } oo_pktbuf_manager;
@@ -936,6 +955,12 @@ typedef struct {
   ci_ni_dllist_t        tx_ready_list;
   /* Holds partially received RX packet fragments. */
   oo_pkt_p              rx_frags;
+  /* RX packet buffers released by the application and kept aside to be
+   * posted straight back to this interface's RX ring (EF_RX_RECYCLE).
+   * They are counted in [n_rx_pkts].  Linked by [next].
+   */
+  oo_pkt_p              rx_recycle;
+  ci_int32              rx_recycle_n;
   /* Owner of EFRM PD */
   ci_uint32             pd_owner;
 #if CI_CFG_TIMESTAMPING
@@ -958,6 +983,124 @@ typedef struct {
 } ci_netif_state_nic_t;
 
 
+/* Time taken by the phases of stack creation, in microseconds.  All but
+ * [prefault] are measured by the driver. */
+typedef struct {
+  ci_uint32             hw_resources;  /* VIs, event queues, shared state */
+  ci_uint32             ep_table;      /* endpoint table, first socket page */
+  ci_uint32             pkt_alloc;     /* parallel packet set allocation */
+  ci_uint32             rx_fill;       /* free pool and RX ring fill */
+  ci_uint32             kernel_total;
+  ci_uint32             prefault;      /* mapping packets into the process */
+  ci_uint16             pkt_sets;      /* sets added by [pkt_alloc] */
+  ci_uint16             threads;       /* EF_STACK_INIT_THREADS */
+} ci_netif_init_timing;
+
+
+/*!
+** ci_netif_blog_rec
+**
+** A record in the stack's binary log (EF_BINARY_LOG).  Writers claim a
+** slot by incrementing ci_netif_state::blog_head and publish the record by
+** setting [seq] to one more than the index they claimed.  Readers check
+** [seq] before and after copying a record to detect that it has been
+** overwritten.
+*/
+typedef enum {
+#define OO_BLOG_FMT(id, fmt)  OO_BLOG_ID_##id,
+#include <ci/internal/blog_def.h>
+#undef OO_BLOG_FMT
+  OO_BLOG_ID_N
+} oo_blog_id;
+
+#define OO_BLOG_ARGS_MAX  6
+
+typedef struct {
+  volatile ci_uint32 seq;
+  ci_uint16          fmt_id;
+  ci_uint8           n_args;
+  ci_uint8           rsvd;
+  ci_uint64          frc;
+  ci_uint64          args[OO_BLOG_ARGS_MAX];
+} ci_netif_blog_rec;
+CI_BUILD_ASSERT(sizeof(ci_netif_blog_rec) == 64);
+
+
+/*!
+** ci_netif_ssnap
+**
+** Stats snapshot (EF_STATS_SNAPSHOT), for monitors that poll a stack
+** frequently.  At the end of a poll, and at most once per
+** EF_STATS_SNAPSHOT_USEC, the stack copies its counters here.  The copy is
+** protected by [generation], which is odd while it is being written: a
+** reader copies the snapshot and then checks that [generation] was even
+** and has not changed.
+**
+** The snapshot is followed by a ring of [sock_log_n] ci_netif_ssnap_sock
+** records that log the sockets allocated and freed.  A record is
+** published by setting its [seq] to one more than its index.  [sock_head]
+** is the number of records written when the snapshot was taken, so a
+** monitor that keeps its own copy of the socket table only needs to look at
+** the records since its last snapshot.  If more than [sock_log_n] records
+** have been written since then, the monitor must rescan the sockets.
+*/
+#define OO_SSNAP_VERSION  1
+
+typedef struct {
+  volatile ci_uint32 seq;
+  ci_int32           sock_id;
+  ci_uint16          op;
+#define OO_SSNAP_SOCK_ALLOC  1
+#define OO_SSNAP_SOCK_FREE   2
+  ci_uint16          state;    /* CI_TCP_STATE_* when freed */
+  ci_uint32          rsvd;
+} ci_netif_ssnap_sock;
+CI_BUILD_ASSERT(sizeof(ci_netif_ssnap_sock) == 16);
+
+typedef struct {
+  volatile ci_uint32 generation;
+  CI_ULCONST ci_uint32 version;    /* OO_SSNAP_VERSION */
+  CI_ULCONST ci_uint32 size;       /* sizeof(ci_netif_ssnap) */
+  CI_ULCONST ci_uint32 sock_log_n; /* records in socket log; power of 2 */
+  ci_uint64          frc CI_ALIGN(8); /* when the snapshot was taken */
+  ci_uint32          sock_head;
+  ci_uint32          n_ep_bufs;
+  ci_int32           n_rx_pkts;
+  ci_int32           n_async_pkts;
+  ci_int32           n_free_pkts;
+  ci_uint32          pkt_sets_n;
+#if CI_CFG_STATS_NETIF
+  ci_netif_stats     stats CI_ALIGN(8);
+#endif
+} ci_netif_ssnap;
+
+
+/*!
+** Ring of TX timestamps (EF_TX_TIMESTAMP_RING).
+**
+** When a packet sent by a socket with ONLOAD_TIMESTAMPING_FLAG_TX_RING
+** completes, its timestamp is written to a ring of [tx_ts_ring_n]
+** oo_tx_timestamp and the packet is freed.  There is a single writer, which
+** holds the stack lock: it fills in the entry at
+** ci_netif_state::tx_ts_ring_added and then advances that index.  Readers
+** don't take the lock.  They copy entries from [tx_ts_ring_removed] and then
+** claim them by advancing it with compare-and-swap, trying again if another
+** reader got there first.
+*/
+typedef struct {
+  ci_uint32 sock_id;
+  ci_uint32 key;
+  ci_uint32 sec;
+  ci_uint32 nsec;
+  ci_uint32 flags;
+#define OO_TX_TS_F_IN_SYNC  0x1  /* == ONLOAD_TX_TIMESTAMP_F_IN_SYNC */
+#define OO_TX_TS_F_TCP      0x2  /* == ONLOAD_TX_TIMESTAMP_F_TCP */
+#define OO_TX_TS_F_LOST     0x4  /* == ONLOAD_TX_TIMESTAMP_F_LOST */
+  ci_uint32 reserved;
+} oo_tx_timestamp;
+CI_BUILD_ASSERT(sizeof(oo_tx_timestamp) == 24);
+
+
 struct ci_netif_state_s {
 
   ci_netif_state_nic_t  nic[CI_CFG_MAX_INTERFACES];
@@ -991,6 +1134,9 @@ struct ci_netif_state_s {
   /* oof subsystem is capable to work with some addresses which are blamed
    * to be non-local by cicp_user_addr_is_local_efab() */
 # define CI_NETIF_FLAG_USE_ALIEN_LADDRS  0x200
+  /* Stack has been mapped by more than one process, so threads can't
+   * rely on being woken through a futex. */
+# define CI_NETIF_FLAG_MULTI_PROCESS     0x400
 
 
   /* To give insight into runtime errors detected.  See also copy in
@@ -1077,6 +1223,9 @@ struct ci_netif_state_s {
   /* Pool of packet buffers used only when suffering mem_pressure. */
   oo_pkt_p              mem_pressure_pkt_pool;
   ci_int32              mem_pressure_pkt_pool_n;
+  /* Received buffers that sockets may still queue under
+   * EF_MEM_PRESSURE_SOCK_PKTS during this spell of critical pressure. */
+  ci_int32              mem_pressure_sock_budget;
 
   /* Number of packets that are in use by or available to threads not
   ** holding the netif lock.  This includes packets in the nonb_pkt_pool,
@@ -1104,6 +1253,11 @@ struct ci_netif_state_s {
   CI_ULCONST ci_uint32  ip6_table_ofs;   /**< offset of IPv6 s/w filter table */
 #endif
   CI_ULCONST ci_uint32  seq_table_ofs;   /**< offset of seq no table */
+  CI_ULCONST ci_uint32  synrecv_table_ofs; /**< offset of synrecv table */
+  CI_ULCONST ci_uint32  blog_ofs;        /**< offset of binary log */
+  CI_ULCONST ci_uint32  ssnap_ofs;       /**< offset of stats snapshot */
+  CI_ULCONST ci_uint32  tx_ts_ring_ofs;  /**< offset of TX timestamp ring */
+  CI_ULCONST ci_uint32  sock_ready_ofs;  /**< offset of readiness bitmaps */
   CI_ULCONST ci_uint32  deferred_pkts_ofs; /**< offset of deferred pkts array */
   CI_ULCONST ci_uint32  buf_ofs;         /**< offset of packet metadata */
 
@@ -1154,10 +1308,9 @@ struct ci_netif_state_s {
   CI_ULCONST ci_uint32  ep_ofs;          /**< Offset to endpoints array */
   
 #define CI_TCP_AUX_TYPE_SYNRECV 0
-#define CI_TCP_AUX_TYPE_BUCKET  1
-#define CI_TCP_AUX_TYPE_EPOLL   2
-#define CI_TCP_AUX_TYPE_PMTUS   3
-#define CI_TCP_AUX_TYPE_NUM     4
+#define CI_TCP_AUX_TYPE_EPOLL   1
+#define CI_TCP_AUX_TYPE_PMTUS   2
+#define CI_TCP_AUX_TYPE_NUM     3
   oo_p                  free_aux_mem;    /**< Free list of synrecv bufs. */
   ci_uint32             n_free_aux_bufs; /**< Number of free aux bufs */
   ci_uint32             n_aux_bufs[CI_TCP_AUX_TYPE_NUM];
@@ -1250,6 +1403,8 @@ struct ci_netif_state_s {
   CI_ULCONST ci_uint32  sock_alloc_numa_nodes;
   CI_ULCONST ci_uint32  interrupt_numa_nodes;
 
+  ci_netif_init_timing  init_timing;
+
 #if CI_CFG_FD_CACHING
   ci_socket_cache_t     active_cache;
   ci_uint32             active_cache_avail_stack;
@@ -1269,6 +1424,45 @@ struct ci_netif_state_s {
   /* Number of entries in the table of previously-used sequence numbers. */
   CI_ULCONST ci_uint32  seq_table_entries_n;
 
+  /* Number of entries in the synrecv lookup table.  Power of 2. */
+  CI_ULCONST ci_uint32  synrecv_table_entries_n;
+
+  /* Number of records in the binary log, or 0 if it is disabled.  Power of
+   * 2.  [blog_head] counts the records ever written. */
+  CI_ULCONST ci_uint32  blog_entries_n;
+  volatile ci_uint32    blog_head;
+
+  /* Number of records in the stats snapshot's socket log, or 0 if there is
+   * no stats snapshot.  [ssnap_sock_head] counts the records ever written.
+   */
+  CI_ULCONST ci_uint32  ssnap_sock_log_n;
+  volatile ci_uint32    ssnap_sock_head;
+  /* Minimum interval between snapshots, and when the last was taken. */
+  CI_ULCONST ci_uint64  ssnap_cycles CI_ALIGN(8);
+  ci_uint64             ssnap_last_frc CI_ALIGN(8);
+
+  /* Ring of TX timestamps.  [tx_ts_ring_n] is its size (power of 2), or 0
+   * if it is disabled.  [tx_ts_ring_lost] is set when a timestamp is
+   * discarded because the ring is full, and cleared when the next entry is
+   * written. */
+  CI_ULCONST ci_uint32  tx_ts_ring_n;
+  volatile ci_uint32    tx_ts_ring_added;
+  volatile ci_uint32    tx_ts_ring_removed;
+  ci_uint32             tx_ts_ring_lost;
+
+  /* Bitmaps, indexed by endpoint id, of endpoints that may be ready for
+   * receive and for transmit.  Each has [sock_ready_words] 32-bit words;
+   * the transmit bitmap follows the receive one.
+   *
+   * A bit is set whenever the endpoint is woken in that direction, after
+   * its [sleep_seq] has been bumped.  user-level poll() and select() clear
+   * a bit when they find the endpoint has no events of that kind (see
+   * OO_SOCK_READY_RX_EVENTS), and then check again.  So while a bit is
+   * clear, the endpoint is known not to be ready in that direction, and
+   * poll() and select() needn't look at the endpoint's state.
+   */
+  CI_ULCONST ci_uint32  sock_ready_words;
+
   CI_ULCONST ci_uint16  rss_instance;
   CI_ULCONST ci_uint16  cluster_size;
 
@@ -1334,6 +1528,14 @@ struct oo_timesync {
   ci_uint64 smoothed_ticks;         /* frc ticks during smoothed_ns time */
   ci_uint64 smoothed_ns;            /* ns to count smoothed_ticks */
   ci_uint64 update_jiffies;         /* time in jiffies of next update */
+  /* FRC to ns mapping derived from the above, so that user-level can
+   * convert without dividing:
+   *   ns = [wall,mono]_ns + ((frc - clock_made) * frc_to_ns_mult) >> 32
+   * frc_to_ns_mult is zero until the frequency estimate is available.
+   */
+  ci_uint64 wall_ns;                /* wall_clock in ns */
+  ci_uint64 mono_ns;                /* mono_clock in ns */
+  ci_uint64 frc_to_ns_mult;         /* ns per frc tick, 32.32 fixed point */
   ci_uint32 generation_count;       /* to synchronise with local copy */
 };
 
@@ -1404,6 +1606,13 @@ typedef struct {
   ci_uint32             wake_request;
 # define CI_SB_FLAG_WAKE_TX_B  0
 # define CI_SB_FLAG_WAKE_RX_B  1
+  /* Threads of the process that owns the stack may wait on a futex on
+  ** [sleep_seq] instead of in the kernel (EF_FUTEX_SLEEP_USEC).  They ask
+  ** to be woken with the CI_SB_FLAG_WAKE_* bits shifted up by
+  ** CI_SB_FLAG_WAKE_FUTEX_SHIFT.  The kernel neither acts on nor clears
+  ** them, so it must only ever clear the RX and TX bits. */
+# define CI_SB_FLAG_WAKE_FUTEX_SHIFT  8
+# define CI_SB_FLAG_WAKE_FUTEX_MASK   (3u << CI_SB_FLAG_WAKE_FUTEX_SHIFT)
 
   /* These flags are set to indicate that something has happened, that
   ** should maybe lead to someone being woken (if they're interested...see
@@ -1671,6 +1880,24 @@ struct oo_sock_cplane {
   ((cp_flags) & OO_SCP_TPROXY       ? "TPROXY ":"")
 
 
+/* Number of bytes covered by the fields [first] to [last] of a socket
+ * state.  Socket states live at the start of an endpoint buffer, so are
+ * aligned to a cache line, and this is used to check that the fields used
+ * on the fast paths stay within a few lines.
+ */
+#define OO_SOCK_FIELDS_SPAN(type, first, last)                   \
+  (CI_MEMBER_OFFSET(type, last) + CI_MEMBER_SIZE(type, last) -  \
+   CI_MEMBER_OFFSET(type, first))
+
+/* Cache lines of the endpoint buffer holding the first and last bytes of
+ * field [f] of a socket state.
+ */
+#define OO_SOCK_FIELD_LINE(type, f)                              \
+  (CI_MEMBER_OFFSET(type, f) / CI_CACHE_LINE_SIZE)
+#define OO_SOCK_FIELD_END_LINE(type, f)                          \
+  ((CI_MEMBER_OFFSET(type, f) + CI_MEMBER_SIZE(type, f) - 1) /  \
+   CI_CACHE_LINE_SIZE)
+
 struct ci_sock_cmn_s {
   citp_waitable         b;
 
@@ -1760,6 +1987,60 @@ struct ci_sock_cmn_s {
 #define CI_SOCK_AFLAG_TCP_INHERITED \
     (CI_SOCK_AFLAG_CORK | CI_SOCK_AFLAG_NODELAY)
 
+  /* The fields from here to [space_for_hdrs] are used on the send and
+   * receive fast paths.  Those after them are mostly used by socket
+   * calls and on slow paths.
+   */
+
+  ci_uint16            tx_errno;
+  /* Zero if transmits permitted by user, else error code to return to 'em. */
+
+  ci_uint16            rx_errno;
+  /* Zero if data can still arrive.  Otherwise low-order bits give error
+  ** code to return to user (which may be zero).
+  */
+
+  ci_uint32 os_sock_status; /*!< seq<<3 + (RX | TX | ERR) */
+#define OO_OS_STATUS_RX 1
+#define OO_OS_STATUS_TX 2
+#define OO_OS_STATUS_ERR 4
+#define OO_OS_STATUS_SEQ_SHIFT 3
+
+  ci_int32              so_error;
+
+  /* When set, these limit the RX path to only accept packets from the
+   * given interface.  Used by SO_BINDTODEVICE and also the
+   * EF_MCAST_JOIN_BINDTODEVICE option.  The base_ifindex and vlan are
+   * needed to make the RX-side check efficient.
+   */
+  ci_ifid_t             rx_bind2dev_ifindex;
+  cicp_hwport_mask_t    rx_bind2dev_hwports;
+  ci_int16              rx_bind2dev_vlan;
+
+  ci_uint16             cmsg_flags;
+
+# define CI_IP_CMSG_PKTINFO      0x01
+# define CI_IP_CMSG_TTL          0x02
+# define CI_IP_CMSG_TOS          0x04
+# define CI_IP_CMSG_RECVOPTS     0x08
+# define CI_IP_CMSG_RETOPTS      0x10
+# define CI_IP_CMSG_TIMESTAMP    0x20
+# define CI_IP_CMSG_TIMESTAMPNS  0x40
+# define CI_IP_CMSG_TIMESTAMPING 0x80
+# define CI_IP_CMSG_TIMESTAMP_ANY \
+  (CI_IP_CMSG_TIMESTAMP | CI_IP_CMSG_TIMESTAMPNS | CI_IP_CMSG_TIMESTAMPING )
+# define CI_IPV6_CMSG_PKTINFO    0x0100
+
+  ci_ip_cached_hdrs     pkt;
+  union {
+    ci_tcp_hdr          space_for_tcp_hdr;
+    ci_udp_hdr          space_for_udp_hdr;
+  } space_for_hdrs;
+  /* Headers.  Used as a template for outgoing packets, and also to match
+  ** addresses in the netif filter table.  NB. Not all fields are stored in
+  ** network byte-order.
+  */
+
   /* Bound-to local address.
    * - s.laddr is the bound-to address, unmodified.  Used by the filters.
    * - s.cp.laddr is the "preferred source" address when resolving
@@ -1780,30 +2061,6 @@ struct ci_sock_cmn_s {
   ci_uint8 tclass;
 #endif
 
-  ci_ip_cached_hdrs     pkt;
-  union {
-    ci_tcp_hdr          space_for_tcp_hdr;
-    ci_udp_hdr          space_for_udp_hdr;
-  } space_for_hdrs;
-  /* Headers.  Used as a template for outgoing packets, and also to match
-  ** addresses in the netif filter table.  NB. Not all fields are stored in
-  ** network byte-order.
-  */
-
-  ci_uint16            tx_errno;
-  /* Zero if transmits permitted by user, else error code to return to 'em. */
-
-  ci_uint16            rx_errno;
-  /* Zero if data can still arrive.  Otherwise low-order bits give error
-  ** code to return to user (which may be zero).
-  */
-
-  ci_uint32 os_sock_status; /*!< seq<<3 + (RX | TX | ERR) */
-#define OO_OS_STATUS_RX 1
-#define OO_OS_STATUS_TX 2
-#define OO_OS_STATUS_ERR 4
-#define OO_OS_STATUS_SEQ_SHIFT 3
-
   struct {
     /* This contains only sockopts that are inherited from the listening
     ** socket by newly accepted TCP sockets.
@@ -1831,30 +2088,6 @@ struct ci_sock_cmn_s {
   ** [so] above.
   */
   ci_pkt_priority_t     so_priority;
-  ci_int32              so_error;
-
-  /* When set, these limit the RX path to only accept packets from the
-   * given interface.  Used by SO_BINDTODEVICE and also the
-   * EF_MCAST_JOIN_BINDTODEVICE option.  The base_ifindex and vlan are
-   * needed to make the RX-side check efficient.
-   */
-  ci_ifid_t             rx_bind2dev_ifindex;
-  cicp_hwport_mask_t    rx_bind2dev_hwports;
-  ci_int16              rx_bind2dev_vlan;
-
-  ci_uint16             cmsg_flags;
-
-# define CI_IP_CMSG_PKTINFO      0x01
-# define CI_IP_CMSG_TTL          0x02
-# define CI_IP_CMSG_TOS          0x04
-# define CI_IP_CMSG_RECVOPTS     0x08
-# define CI_IP_CMSG_RETOPTS      0x10
-# define CI_IP_CMSG_TIMESTAMP    0x20
-# define CI_IP_CMSG_TIMESTAMPNS  0x40
-# define CI_IP_CMSG_TIMESTAMPING 0x80
-# define CI_IP_CMSG_TIMESTAMP_ANY \
-  (CI_IP_CMSG_TIMESTAMP | CI_IP_CMSG_TIMESTAMPNS | CI_IP_CMSG_TIMESTAMPING )
-# define CI_IPV6_CMSG_PKTINFO    0x0100
 
 #if CI_CFG_TIMESTAMPING
   /* timestamping_flags relate to flags provided with socket option
@@ -1963,15 +2196,17 @@ typedef struct {
   ci_uint32 n_tx_msg_confirm; /* onload send with MSG_CONFIRM          */
   ci_uint32 n_tx_os_late;     /* sent via OS, after copying            */
   ci_uint32 n_tx_unconnect_late; /* concurrent send and unconnect      */
+  ci_uint32 n_tx_gso;         /* UDP_SEGMENT sends split by onload     */
+  ci_uint32 n_rx_gro;         /* recvs that coalesced with UDP_GRO     */
 } ci_udp_socket_stats;
 
 struct  ci_udp_state_s {
   ci_sock_cmn           s;
 
-  /*! Cache used for "unconnected" destinations - i.e. where a dest. addr
-   * has been provided by the caller.  We use this cache regardless of 
-   * whether we are connected */
-  ci_ip_cached_hdrs     ephemeral_pkt CI_ALIGN(8);
+  /* The fields from [udpflags] to [tx_count] are used for every datagram
+   * sent or received.  The rest are used by unconnected sends, socket
+   * options and statistics.
+   */
 
   ci_uint32 udpflags;
 #define CI_UDPF_FILTERED        0x00000001  /*!< filter inserted         */
@@ -1988,6 +2223,7 @@ struct  ci_udp_state_s {
 #define CI_UDPF_MCAST_FILTER    0x00010000  /*!< mcast filter added */
 #define CI_UDPF_NO_UCAST_FILTER 0x00020000  /*!< don't add unicast filters */
 #define CI_UDPF_LAST_SEND_NOMAC 0x00040000  /*!< last send was via nomac path */
+#define CI_UDPF_GRO             0x00080000  /*!< UDP_GRO */
 
   ci_uint32 future_intf_i; /* Interface to check for incoming future packets */
 
@@ -1998,6 +2234,32 @@ struct  ci_udp_state_s {
 #endif
   ci_udp_recv_q recv_q;
 
+  /*! Receive timestamp (FRC) of last packet passed to the user */
+  ci_uint64 stamp CI_ALIGN(8); 
+
+  /* Linked list of UDP datagrams.  Datagrams to be sent are queued here
+   * (in reverse order) when the netif lock is contended in sendmsg().
+   * Manipulated atomically.  Link field is [pkt->netif.tx.dmaq_next].
+   */
+  ci_int32  tx_async_q;
+  oo_atomic_t tx_async_q_level;
+  /* Number of bytes "inflight".  i.e. Sent to interface (including
+   * overflow queue) and not yet had TX event.
+   */
+  ci_uint32 tx_count;
+
+  /* End of the hot fields. */
+
+  /*! Cache used for "unconnected" destinations - i.e. where a dest. addr
+   * has been provided by the caller.  We use this cache regardless of 
+   * whether we are connected */
+  ci_ip_cached_hdrs     ephemeral_pkt CI_ALIGN(8);
+
+  /* UDP_SEGMENT: payload bytes per datagram when splitting a large send,
+   * or 0 if disabled.  Can be overridden per-send by a cmsg.
+   */
+  ci_uint32 gso_size;
+
 #if CI_CFG_TIMESTAMPING
   ci_udp_recv_q timestamp_q;
 #endif
@@ -2012,22 +2274,10 @@ struct  ci_udp_state_s {
    * SIOCGSTAMP calls for the same packet
    */
   struct oo_timespec stamp_cache;
-  /*! Receive timestamp (FRC) of last packet passed to the user */
-  ci_uint64 stamp CI_ALIGN(8); 
+
   /*! Value of stamp before SO_TIMESTAMP enabled */
   ci_uint64 stamp_pre_sots CI_ALIGN(8); 
 
-  /* Linked list of UDP datagrams.  Datagrams to be sent are queued here
-   * (in reverse order) when the netif lock is contended in sendmsg().
-   * Manipulated atomically.  Link field is [pkt->netif.tx.dmaq_next].
-   */
-  ci_int32  tx_async_q;
-  oo_atomic_t tx_async_q_level;
-  /* Number of bytes "inflight".  i.e. Sent to interface (including
-   * overflow queue) and not yet had TX event.
-   */
-  ci_uint32 tx_count;
-
   /* Cache for IP_PKTINFO and IPV6_PKTINFO */
   struct {
     /* PKT info: */
@@ -2183,8 +2433,8 @@ typedef struct {
 
   oo_sp                local_peer;/* id of the peer for lo connection    */
 
-  ci_uint32            hash;        /* hash value for lookup table       */
-  oo_p                 bucket_link; /* link used in hash buckets         */
+  ci_uint32            hash;      /* hash value for lookup table         */
+  oo_sp                tls_id;    /* listening socket                    */
 } ci_tcp_state_synrecv;
 
 /* State for maintaining ci_netif_state::ready_eps_list[ready_list_id]
@@ -2211,12 +2461,13 @@ typedef struct ci_sb_epoll_state_s {
 } ci_sb_epoll_state;
 CI_BUILD_ASSERT(CI_CFG_N_READY_LISTS <= CI_EPOLL_SETS_PER_AUX_BUF);
 
-/* Hash table for synrecv embrionic connections. */
-#define CI_TCP_LISTEN_BUCKET_S    4
-#define CI_TCP_LISTEN_BUCKET_SIZE (1 << CI_TCP_LISTEN_BUCKET_S)
+/* Entry in the per-stack hash table of synrecv embrionic connections.
+ * The hash is kept next to the pointer so that a lookup only touches the
+ * synrecv state itself when the hash matches. */
 typedef struct {
-  oo_p bucket[CI_TCP_LISTEN_BUCKET_SIZE];
-} ci_tcp_listen_bucket;
+  ci_uint32 hash;
+  oo_p      tsr;
+} ci_tcp_synrecv_table_entry;
 
 /* This memory is cacheline-aligned for performance reasons. */
 #define CI_AUX_MEM_SIZE 128
@@ -2227,7 +2478,6 @@ typedef struct {
 
   union {
     ci_tcp_state_synrecv synrecv;
-    ci_tcp_listen_bucket bucket;
     ci_sb_epoll_state    epoll;
     ci_pmtu_state_t      pmtus;
   } u;
@@ -2272,6 +2522,8 @@ struct oo_tcp_socket_stats {
   ci_uint32  tx_msg_warm;     /* Number of MSG_WARM done           */
   ci_uint32  tx_tmpl_send_fast;  /* Number of fast tmpl sends      */
   ci_uint32  tx_tmpl_send_slow;  /* Number of slow tmpl sends      */
+  ci_uint32  tx_mag_hits;     /* Send bufs taken from magazine     */
+  ci_uint32  tx_mag_misses;   /* Send bufs not found in magazine   */
   ci_uint32  rx_isn;          /* initial sequence num              */
   ci_uint16  tx_tmpl_active;  /* Number of active tmpl sends       */
   ci_uint16  rtos;            /* RTO timeouts                      */
@@ -2284,15 +2536,55 @@ struct oo_tcp_socket_stats {
 };
 
 
+/* Byte ring carrying the data of an established loopback connection in
+ * EF_TCP_LOOPBACK_RING mode.  The ring belongs to the receiving socket.
+ * It is written by the peer with the stack lock held, and is read with
+ * the socket lock held.  The buffers are linked into a circle by
+ * pkt->next, and payload lives at pkt->dma_start.
+ */
+struct oo_tcp_loop_ring {
+  oo_pkt_p           wr_pp;      /* buffer being written (stack lock) */
+  oo_pkt_p           rd_pp;      /* buffer being read (socket lock)   */
+  ci_uint16          wr_off;
+  ci_uint16          rd_off;
+  ci_uint16          n_bufs;     /* zero if the ring is not allocated */
+  ci_uint16          flags;
+#define OO_TCP_LOOP_RING_FLAG_NOMEM  0x1  /* allocation failed: don't retry */
+  volatile ci_uint32 bytes_added;
+  volatile ci_uint32 bytes_removed;
+#define OO_TCP_LOOP_RING_BUF_SIZE  (CI_CFG_PKT_BUF_SIZE -                 \
+                                    CI_MEMBER_OFFSET(ci_ip_pkt_fmt, dma_start))
+};
+
+
+/* Packet buffers kept in reserve for the sending side of a TCP socket
+ * (EF_TCP_SEND_MAGAZINE).  sendmsg() may run concurrently on several
+ * threads without the socket lock, so whoever wants to touch [pkts] must
+ * first claim the magazine by setting OO_TCP_TX_MAG_CLAIMED in [n].
+ * Buffers are added only with the stack lock held.  The buffers are
+ * allocated to the socket (refcount 1), are linked by [next] and are
+ * counted in [n_async_pkts].  This is kept small as it sits in the hot
+ * part of ci_tcp_state.
+ */
+struct oo_tcp_tx_mag {
+  volatile ci_uint32 n;          /* buffers in [pkts] | CLAIMED */
+#define OO_TCP_TX_MAG_CLAIMED    0x80000000u
+#define OO_TCP_TX_MAG_N(mag)     ((int) ((mag)->n & ~OO_TCP_TX_MAG_CLAIMED))
+  oo_pkt_p           pkts;
+};
+
+
 struct ci_tcp_state_s {
   ci_sock_cmn         s;
   ci_tcp_socket_cmn   c;
 
-  /* Id of the local peer socket in case of loopback connection */
-  oo_sp                 local_peer;
-
-  /* List of allocated templated sends on this socket */
-  oo_pkt_p            tmpl_head;
+  /* The fields from [tcpflags] to [tx_mag] are touched when sending or
+   * receiving most segments, and are kept together so that the fast paths
+   * cover as few cache lines as possible.  Fields used only by loss
+   * recovery, timers, urgent data, connection setup and statistics follow
+   * them.  ci_netif_sanity_checks() asserts which cache line each hot field
+   * is on, so please think about which group a new field belongs in.
+   */
 
   /* Various options.  Should be updated under the stack lock only. */
   ci_uint32            tcpflags;
@@ -2352,51 +2644,12 @@ struct ci_tcp_state_s {
 # define CI_TCPT_NEG_FLAGS \
         (CI_TCPT_FLAG_TSO | CI_TCPT_FLAG_WSCL | CI_TCPT_FLAG_SACK | \
          CI_TCPT_FLAG_ECN)
-  /* Path MTU data: timer, value, etc */
-  oo_p pmtus;
-
-  /* SO_SNDBUF measured in packet buffers. */
-  ci_int32            so_sndbuf_pkts;
-
-  /* the part of SO_RVCBUF used as window */
-  ci_uint32           rcv_window_max;
-
-  ci_uint32           send_in;    /**< Packets added directly to send queue */
-  ci_uint32           send_out;   /**< Packets removed from send queue */
-  ci_ip_pkt_queue     send;       /**< Send queue. */
-
-  ci_ip_pkt_queue     retrans;    /**< Retransmit queue. */
 
-  ci_ip_pkt_queue     recv1;      /**< Receive queue. */
-  ci_ip_pkt_queue     recv2;      /**< Aux receive queue for urgent data */
-  oo_pkt_p            recv1_extract; 
-                                  /**< Next id in main receive queue to be 
-                                       extracted by recvmsg */
-  ci_uint16           recv_off;   /**< Offset to current recv queue
-                                       from base of [ci_tcp_state] */
-
-  ci_uint16           outgoing_hdrs_len;
-  /* Length of IP + TCP headers (inc TSO if any).
-   * Does not include Ethernet header len any more! */
-
-  ci_ip_pkt_queue     rob;        /**< Re-order buffer. */
-  oo_pkt_p            last_sack[CI_TCP_SACK_MAX_BLOCKS + 1];  
-                                  /**< First packets of last-received
-                                   * block (in [0]) and last-sent 
-                                   * SACKed blocks */
-  ci_uint32           dsack_start;/**< Start SEQ of DSACK option */
-  ci_uint32           dsack_end;  /**< End SEQ of DSACK option */
-  oo_pkt_p            dsack_block;/**< Second block packet id: 
-                                   * CI_ILL_END used for no second block;
-                                   * CI_ILL_UNUSED when no DSACK present */
-
-#if CI_CFG_TIMESTAMPING
-  ci_udp_recv_q       timestamp_q;/**< TX timestamp queue */
-#endif
-
-  /* Next field is needed to support PathMTU discovery functionality */
-  ci_uint32            snd_check;   /* equal to snd_nxt at beginning of
-                                       tested interval */
+  ci_uint32            fast_path_check;
+  /* If in a state in which we can execute the TCP receive fast path, then
+  ** this reflects the expected TCP header length and flags.  Otherwise it
+  ** is set to an invalid value that should never match a TCP packet.
+  */
 
   ci_uint32            snd_nxt;     /* next sequence number to send       */
   ci_uint32            snd_max;     /* maximum sequence number advertised */
@@ -2407,19 +2660,6 @@ struct ci_tcp_state_s {
 #endif
   ci_uint32            snd_delegated; /* bytes sent via delegated_send() */
 
-  ci_uint32            fast_path_check;
-  /* If in a state in which we can execute the TCP receive fast path, then
-  ** this reflects the expected TCP header length and flags.  Otherwise it
-  ** is set to an invalid value that should never match a TCP packet.
-  */
-
-  ci_uint32            snd_up;      /* send urgent pointer, holds the seq 
-                                       num of byte following the OOB byte */
-  ci_uint16            amss;        /* advertised mss to the sending side */
-  ci_uint16            smss;        /* sending MSS (excl IP & TCP hdrs)   */
-  ci_uint16            eff_mss;     /* PMTU-based mss, excl TCP options   */
-  ci_uint16            retransmits; /* number of retransmissions */
-
   ci_uint32            rcv_wnd_advertised; /* receive window to advertise in
                                               outgoing packets            */
   ci_uint32            rcv_wnd_right_edge_sent; /* the edge of the receive
@@ -2435,8 +2675,32 @@ struct ci_tcp_state_s {
                                         any packets from other side,
                                         or zero if unlimited */
 #endif
-  ci_uint32            rcv_up;      /* receive urgent pointer, holds the
-                                       seq num of the OOB byte            */
+
+  /* timestamp option fields see RFC1323 */
+  ci_uint32            tsrecent;    /* TS.Recent RFC1323                  */
+  ci_uint32            tslastack;   /* Last.ACK.sent RFC1323              */ 
+  ci_iptime_t          tspaws;      /* last active timestamp for tsrecent */
+#define CI_TCP_TSO_WORD (CI_BSWAPC_BE32((CI_TCP_OPT_NOP       << 24u)  | \
+                                        (CI_TCP_OPT_NOP       << 16u)  | \
+                                        (CI_TCP_OPT_TIMESTAMP <<  8u)  | \
+                                        (0xa                        )))
+
+  ci_uint16            amss;        /* advertised mss to the sending side */
+  ci_uint16            smss;        /* sending MSS (excl IP & TCP hdrs)   */
+  ci_uint16            eff_mss;     /* PMTU-based mss, excl TCP options   */
+  ci_uint16            outgoing_hdrs_len;
+  /* Length of IP + TCP headers (inc TSO if any).
+   * Does not include Ethernet header len any more! */
+
+  /* delayed acknowledgements */
+  ci_uint16            acks_pending;/* number of packets needing ack      */
+/* These bits are ORed into acks_pending */
+#define CI_TCP_DELACK_SOON_FLAG 0x8000
+#define CI_TCP_ACK_FORCED_FLAG  0x4000
+/* Mask to get the number of acks pending (includes ACK_FORCED but not
+ * DELACK_SOON bit)
+ */
+#define CI_TCP_ACKS_PENDING_MASK 0x7fff
 
   ci_uint8             rcv_wscl;    /* receive window scaling             */
   ci_uint8             snd_wscl;    /* send window scaling                */
@@ -2453,10 +2717,6 @@ struct ci_tcp_state_s {
 
   ci_uint8             incoming_tcp_hdr_len; /* expected TCP header length */
 
-  ci_uint32            congrecover; /* snd_nxt when loss detected         */
-  oo_pkt_p             retrans_ptr; /* next packet to retransmit          */
-  ci_uint32            retrans_seq; /* seq of next packet to retransmit   */
-
   ci_uint32            cwnd;        /* congestion window                  */
   ci_uint32            cwnd_extra;  /* adjustments when congested         */
   ci_uint32            ssthresh;    /* slow-start threshold               */
@@ -2466,12 +2726,6 @@ struct ci_tcp_state_s {
   ci_uint32            faststart_acks; /* Bytes to ack before leaving faststart */
 #endif
 
-#if CI_CFG_TAIL_DROP_PROBE
-  /* This is set to snd_nxt value when a Tail Loss Probe is sent.
-   * Valid iff CI_TCPT_FLAG_TAIL_DROP_MARKED flag is set. */
-  ci_uint32            taildrop_mark;
-#endif
-
   /* Keep alive probes, and sending ACKs after gaps that may cause
    * other end to validated its congetion window 
    */
@@ -2497,6 +2751,70 @@ struct ci_tcp_state_s {
    */
 #endif
 
+  /* SO_SNDBUF measured in packet buffers. */
+  ci_int32            so_sndbuf_pkts;
+
+  /* the part of SO_RVCBUF used as window */
+  ci_uint32           rcv_window_max;
+
+  ci_uint32           send_in;    /**< Packets added directly to send queue */
+  ci_uint32           send_out;   /**< Packets removed from send queue */
+  ci_ip_pkt_queue     send;       /**< Send queue. */
+  ci_ip_pkt_queue     retrans;    /**< Retransmit queue. */
+
+  ci_ip_pkt_queue     recv1;      /**< Receive queue. */
+  ci_ip_pkt_queue     rob;        /**< Re-order buffer. */
+  oo_pkt_p            recv1_extract; 
+                                  /**< Next id in main receive queue to be 
+                                       extracted by recvmsg */
+  ci_uint16           recv_off;   /**< Offset to current recv queue
+                                       from base of [ci_tcp_state] */
+
+  /* An extension of the send queue.  Packets are put here when the netif
+  ** lock is contended, and are later transferred to the sendq.  This is a
+  ** linked list of packets in reverse order. */
+  ci_int32             send_prequeue;
+  oo_atomic_t          send_prequeue_in;
+
+  /* Id of the local peer socket in case of loopback connection */
+  oo_sp                 local_peer;
+
+  struct oo_tcp_loop_ring loop_ring;
+                                  /**< Loopback data that precedes any
+                                       unread data in recv1 */
+
+  struct oo_tcp_tx_mag tx_mag;    /**< Buffers reserved for sendmsg() */
+
+  /* End of the hot fields. */
+
+#ifndef NDEBUG
+  ci_uint32            tslastseq;   /* Sequence no of packet that updated tsrecent
+                                       Just being used for debugging - purge at will */
+#endif
+
+  ci_ip_pkt_queue     recv2;      /**< Aux receive queue for urgent data */
+
+  oo_pkt_p            last_sack[CI_TCP_SACK_MAX_BLOCKS + 1];  
+                                  /**< First packets of last-received
+                                   * block (in [0]) and last-sent 
+                                   * SACKed blocks */
+  ci_uint32           dsack_start;/**< Start SEQ of DSACK option */
+  ci_uint32           dsack_end;  /**< End SEQ of DSACK option */
+  oo_pkt_p            dsack_block;/**< Second block packet id: 
+                                   * CI_ILL_END used for no second block;
+                                   * CI_ILL_UNUSED when no DSACK present */
+
+  ci_uint32            congrecover; /* snd_nxt when loss detected         */
+  oo_pkt_p             retrans_ptr; /* next packet to retransmit          */
+  ci_uint32            retrans_seq; /* seq of next packet to retransmit   */
+  ci_uint16            retransmits; /* number of retransmissions */
+
+#if CI_CFG_TAIL_DROP_PROBE
+  /* This is set to snd_nxt value when a Tail Loss Probe is sent.
+   * Valid iff CI_TCPT_FLAG_TAIL_DROP_MARKED flag is set. */
+  ci_uint32            taildrop_mark;
+#endif
+
   ci_iptime_t          t_last_invalid_ack; /* timestamp of last ACK for
                                               an invalid incoming packet */
 
@@ -2515,28 +2833,31 @@ struct ci_tcp_state_s {
   ci_uint32            timed_seq;   /* first byte of timed packet         */
   ci_iptime_t          timed_ts;    /* timestamp for timed packet         */
 
-  /* timestamp option fields see RFC1323 */
-  ci_uint32            tsrecent;    /* TS.Recent RFC1323                  */
-  ci_uint32            tslastack;   /* Last.ACK.sent RFC1323              */ 
-#ifndef NDEBUG
-  ci_uint32            tslastseq;   /* Sequence no of packet that updated tsrecent
-                                       Just being used for debugging - purge at will */
+  /* Additional stats for Dynamic Right Sizing */
+  struct {
+    ci_uint32          bytes;
+    ci_uint32          seq;
+    ci_iptime_t        time;
+  } rcvbuf_drs;
+
+#if CI_CFG_TIMESTAMPING
+  ci_udp_recv_q       timestamp_q;/**< TX timestamp queue */
 #endif
-  ci_iptime_t          tspaws;      /* last active timestamp for tsrecent */
-#define CI_TCP_TSO_WORD (CI_BSWAPC_BE32((CI_TCP_OPT_NOP       << 24u)  | \
-                                        (CI_TCP_OPT_NOP       << 16u)  | \
-                                        (CI_TCP_OPT_TIMESTAMP <<  8u)  | \
-                                        (0xa                        )))
 
-  /* delayed acknowledgements */
-  ci_uint16            acks_pending;/* number of packets needing ack      */
-/* These bits are ORed into acks_pending */
-#define CI_TCP_DELACK_SOON_FLAG 0x8000
-#define CI_TCP_ACK_FORCED_FLAG  0x4000
-/* Mask to get the number of acks pending (includes ACK_FORCED but not
- * DELACK_SOON bit)
- */
-#define CI_TCP_ACKS_PENDING_MASK 0x7fff
+  /* List of allocated templated sends on this socket */
+  oo_pkt_p            tmpl_head;
+
+  /* Path MTU data: timer, value, etc */
+  oo_p pmtus;
+
+  /* Next field is needed to support PathMTU discovery functionality */
+  ci_uint32            snd_check;   /* equal to snd_nxt at beginning of
+                                       tested interval */
+
+  ci_uint32            snd_up;      /* send urgent pointer, holds the seq 
+                                       num of byte following the OOB byte */
+  ci_uint32            rcv_up;      /* receive urgent pointer, holds the
+                                       seq num of the OOB byte            */
 
   ci_uint16 urg_data; /** out-of-band byte store & relevant flags */
 #define CI_TCP_URG_DATA_MASK    0x00ff
@@ -2544,12 +2865,12 @@ struct ci_tcp_state_s {
 #define CI_TCP_URG_IS_HERE      0x0200  /* oob byte is valid (got it) */
 #define CI_TCP_URG_PTR_VALID    0x0400  /* tcp_rcv_up is valid */
 
-  /* keepalive vailables */
-  ci_uint32            ka_probes;   /* number of probes sent              */
-
   ci_uint16            zwin_probes; /* zero window probes counter         */
   ci_uint16            zwin_acks;   /* zero window acks counter           */
 
+  /* keepalive vailables */
+  ci_uint32            ka_probes;   /* number of probes sent              */
+
   /* timer ids for timers */
   ci_ip_timer          rto_tid;     /* retransmit timer                   */
   ci_ip_timer          delack_tid;  /* delayed acknowledgement timer      */
@@ -2560,6 +2881,8 @@ struct ci_tcp_state_s {
 #endif
   ci_ip_timer          cork_tid;    /* TCP timer for TCP_CORK/MSG_MORE   */
 
+  ci_ni_dllist_link    timeout_q_link;
+  ci_ni_dllist_link    tx_ready_link;
 
 #if CI_CFG_TCP_SOCK_STATS
   ci_ip_sock_stats     stats_snapshot CI_ALIGN(8);   /**< statistics snapshot */
@@ -2579,22 +2902,6 @@ struct ci_tcp_state_s {
   ci_ni_dllist_link    epcache_fd_link;
 #endif
 
-  /* An extension of the send queue.  Packets are put here when the netif
-  ** lock is contended, and are later transferred to the sendq.  This is a
-  ** linked list of packets in reverse order. */
-  ci_int32             send_prequeue;
-  oo_atomic_t          send_prequeue_in;
-
-  ci_ni_dllist_link    timeout_q_link;
-  ci_ni_dllist_link    tx_ready_link;
-
-  /* Additional stats for Dynamic Right Sizing */
-  struct {
-    ci_uint32          bytes;
-    ci_uint32          seq;
-    ci_iptime_t        time;
-  } rcvbuf_drs;
-
   /* Destination address before NAT.  Required for getpeername(). */
   struct {
     ci_addr_t          daddr_be32;
@@ -2651,9 +2958,6 @@ struct ci_tcp_socket_listen_s {
   ci_ni_dllist_t       listenq[CI_CFG_TCP_SYNACK_RETRANS_MAX + 1];
   /* index is the number of retransmit. */
 
-  oo_p                 bucket;      /* Hash table for listenq lookup */
-  ci_uint32            n_buckets;   /* Number of "buckets" allocated */
-
 #if CI_CFG_FD_CACHING
   ci_socket_cache_t    epcache;
   /* We remember which EPs were accepted from this listening socket.  This is
@@ -35,7 +35,8 @@ enum {
 };
 
 enum {
-  ONLOAD_TIMESTAMPING_FLAG_TX_MASK = ONLOAD_TIMESTAMPING_FLAG_TX_NIC,
+  ONLOAD_TIMESTAMPING_FLAG_TX_MASK = ONLOAD_TIMESTAMPING_FLAG_TX_NIC |
+                                     ONLOAD_TIMESTAMPING_FLAG_TX_RING,
   ONLOAD_TIMESTAMPING_FLAG_RX_MASK = ONLOAD_TIMESTAMPING_FLAG_RX_NIC |
                                      ONLOAD_TIMESTAMPING_FLAG_RX_CPACKET,
 
@@ -58,6 +59,16 @@ onload_timestamping_want_tx_nic(unsigned flags)
   return flags & ONLOAD_SOF_TIMESTAMPING_TX_HARDWARE;
 }
 
+/* Indicates whether TX NIC timestamps go to the stack's TX timestamp ring
+ * rather than the socket's error queue */
+static inline int /*bool*/
+onload_timestamping_want_tx_ring(unsigned flags)
+{
+  return (flags & (ONLOAD_SOF_TIMESTAMPING_ONLOAD |
+                   ONLOAD_TIMESTAMPING_FLAG_TX_RING)) ==
+         (ONLOAD_SOF_TIMESTAMPING_ONLOAD | ONLOAD_TIMESTAMPING_FLAG_TX_RING);
+}
+
 static inline void
 onload_timestamp_to_timespec(const struct onload_timestamp* in,
                              struct timespec* out)
@@ -148,13 +148,24 @@ struct ci_netif_s {
 #endif
   ci_ni_dllist_t*      active_wild_table;
   ci_tcp_prev_seq_t*   seq_table;
+  ci_tcp_synrecv_table_entry* synrecv_table;
+  ci_netif_blog_rec*   blog;
+  ci_netif_ssnap*      ssnap;
+  oo_tx_timestamp*     tx_ts_ring;
+  volatile ci_uint32*  sock_ready;
 
   struct oo_deferred_pkt* deferred_pkts;
 
+  /* Interfaces with packets put on the DMA queue during the current poll
+   * whose doorbell is deferred until the end of the poll. */
+  unsigned             poll_tx_intf_mask;
+
 #ifdef __ci_driver__
   unsigned             pkt_sets_n;
   unsigned             pkt_sets_max;
   ci_uint32            ep_ofs;           /**< Copy from ci_netif_state_s */
+  ci_uint32            tx_ts_ring_n;     /**< Copy from ci_netif_state_s */
+  ci_uint32            sock_ready_words; /**< Copy from ci_netif_state_s */
 
   /*! Trusted per-socket state. */
   struct tcp_helper_endpoint_s**  ep_tbl;
@@ -253,10 +264,13 @@ struct ci_netif_s {
 #endif
 
 #ifndef __KERNEL__
-#define ID_TO_EPS(ni,id) (&(ni)->eps[id])
+#define ID_TO_EPS(ni,id) ci_netif_extra_ep((ni), (id))
 #define S_TO_EPS(ni,s) ID_TO_EPS(ni,S_ID(s))
 #define SC_TO_EPS(ni,s) ID_TO_EPS(ni,SC_ID(s))
+  /* Address space for max_ep_bufs entries is reserved when the stack is
+   * mapped, but only the first [eps_n] have been initialised. */
   struct ci_extra_ep* eps;
+  volatile ci_uint32  eps_n;
 #endif
 };
 
@@ -61,6 +61,9 @@ static inline void get_more_stats(ci_netif* ni, more_stats_t* s)
         ++s->tcp_has_recv_reorder;
         s->tcp_recv_reorder_pkts += ts->rob.num;
       }
+      s->tcp_tx_mag_hits += ts->stats.tx_mag_hits;
+      s->tcp_tx_mag_misses += ts->stats.tx_mag_misses;
+      s->tcp_tx_mag_pkts += OO_TCP_TX_MAG_N(&ts->tx_mag);
       if( SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_nxt(ts)) ) {
         ++s->tcp_has_sendq;
         s->tcp_sendq_bytes += SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_nxt(ts));
@@ -102,6 +102,17 @@ OO_STAT("The number of packets 'in-flight' - i.e. sent but Onload has not "
         "yet received an ACK for.  See also 'inflight=' in the "
         "per-socket stats.",
         unsigned, tcp_inflight_pkts, val)
+OO_STAT("The number of packet buffers taken from TCP send magazines (see "
+        "EF_TCP_SEND_MAGAZINE) without the stack lock.  See also "
+        "'mag_hits=' in the per-socket stats.",
+        unsigned, tcp_tx_mag_hits, count)
+OO_STAT("The number of packet buffers TCP sends needed when "
+        "EF_TCP_SEND_MAGAZINE is enabled that the socket's magazine could "
+        "not supply.",
+        unsigned, tcp_tx_mag_misses, count)
+OO_STAT("The number of packet buffers currently held in TCP send "
+        "magazines.",
+        unsigned, tcp_tx_mag_pkts, val)
 OO_STAT("Number of sockets in SYN-RECEIVED state.  The size of the listen "
         "queue is limited by EF_TCP_BACKLOG_MAX",
         unsigned, tcp_n_in_listenq, val)
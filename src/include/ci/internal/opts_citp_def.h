@@ -318,6 +318,13 @@ CI_CFG_OPT("EF_PIPE_SIZE", pipe_size, ci_int32,
 "fcntl F_SETPIPE_SZ where supported.",
            , , OO_PIPE_DEFAULT_SIZE, OO_PIPE_MIN_SIZE, CI_CFG_MAX_PIPE_SIZE,
            count)
+
+CI_CFG_OPT("EF_PIPE_SPLICE_ZC", pipe_splice_zc, ci_uint32,
+"When splice() moves data between an accelerated pipe and an accelerated TCP "
+"socket in the same stack, move the packet buffers between the pipe and the "
+"socket's receive or send queue instead of copying the data.  Data that "
+"can't be moved this way (for example a partial packet) is still copied.",
+           1, , 1, 0, 1, yesno)
 #endif
 
 CI_CFG_OPT("EF_SOCK_LOCK_BUZZ", sock_lock_buzz, ci_uint32,
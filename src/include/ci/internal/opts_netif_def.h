@@ -379,6 +379,16 @@ CI_CFG_OPT("EF_TX_TIMESTAMPING", tx_timestamping, ci_uint32,
 " does not succeed;\n",
            2, , 0, 0, 3, count)
 
+CI_CFG_OPT("EF_TX_TIMESTAMP_RING", tx_ts_ring, ci_uint32,
+"Number of entries in the stack's ring of TX timestamps, rounded up to a "
+"power of two.  Sockets that request ONLOAD_TIMESTAMPING_FLAG_TX_RING with "
+"onload_timestamping_request() have the hardware timestamps of the packets "
+"they send written to this ring, from which the application collects them "
+"in bulk with onload_tx_timestamps_read(), rather than to their error queue.  "
+"Timestamps that arrive when the ring is full are discarded.  0 disables "
+"the ring, and requests for it then fail with ENOENT.",
+           , , 0, 0, CI_CFG_TX_TS_RING_MAX, count)
+
 CI_CFG_OPT("EF_TCP_TSOPT_MODE", tcp_tsopt_mode, ci_uint32,
 "Enable or disable per-stack TCP header timestamps (as defined in RFC 1323).  "
 "Overrides system setting ipv4.tcp_timestamps and EF_TCP_SYN_OPTS.  "
@@ -432,6 +442,23 @@ CI_CFG_OPT("EF_TCP_SNDBUF_MODE", tcp_sndbuf_mode, ci_uint32,
            "EF_TCP_RCVBUF_MODE to give automatic adjustment of RCVBUF.",
            2, , 1, 0, 2, oneof:no;yes;auto)
 
+CI_CFG_OPT("EF_TCP_SEND_MAGAZINE", tcp_send_magazine, ci_uint32,
+           "Number of packet buffers each TCP socket may keep in reserve for "
+           "sending.  The reserve is refilled in a batch by send() calls "
+           "that hold the stack lock, and lets later send() calls get "
+           "buffers without taking the stack lock or using the shared "
+           "non-blocking buffer pool.  This is most useful when the stack "
+           "lock is often held by another thread (for example when one "
+           "thread receives and another sends).  The buffers are released "
+           "when the socket is freed, and are taken back and not refilled "
+           "while the stack is under memory pressure "
+           "(tcp_tx_mag_drained in onload_stackdump lots).  Hit and miss "
+           "counts are shown per socket and in "
+           "onload_stackdump more_stats.\n"
+           "  0  -  disabled (default);\n"
+           "  N  -  keep up to N buffers per socket.",
+           , , 0, 0, CI_CFG_TCP_SEND_MAGAZINE_MAX, count)
+
 CI_CFG_OPT("EF_TCP_SOCKBUF_MAX_FRACTION", tcp_sockbuf_max_fraction, ci_uint32,
            "This option controls the maximum fraction of the TX buffers "
            "that may be allocated to a single socket with EF_TCP_SNDBUF_MODE=2.  "
@@ -587,6 +614,21 @@ CI_CFG_OPT("EF_TCP_CLIENT_LOOPBACK", tcp_client_loopback, ci_uint32,
            3, , CITP_TCP_LOOPBACK_OFF, 0, CITP_TCP_LOOPBACK_TO_NEWSTACK,
            oneof:no;samestack;toconn;tolist;nonew)
 
+CI_CFG_OPT("EF_TCP_LOOPBACK_RING", tcp_loopback_ring, ci_uint32,
+"Size, in packet buffers, of the shared-memory byte ring used to carry "
+"data of established accelerated TCP loopback connections (see "
+"EF_TCP_CLIENT_LOOPBACK and EF_TCP_SERVER_LOOPBACK).  When non-zero, "
+"send() on such a connection copies data directly into a ring owned by "
+"the receiving socket instead of building, queueing and processing TCP "
+"packets.  Sequence numbers, receive windows (and so SO_RCVBUF), "
+"readiness notifications and shutdown behave as for the packet path, "
+"which is still used whenever the ring cannot take the data.  The ring "
+"is allocated from the stack's packet buffers when it is first used and "
+"is freed with the receiving socket.\n"
+"  0  -  disabled (default);\n"
+"  N  -  use a ring of N packet buffers per receiving socket.",
+           , , 0, 0, 256, count)
+
 #if CI_CFG_PKTS_AS_HUGE_PAGES
 CI_CFG_OPT("EF_USE_HUGE_PAGES", huge_pages, ci_uint32,
 "Control of whether huge pages are used for packet buffers:\n"
@@ -705,6 +747,34 @@ CI_CFG_OPT("EF_TCP_RX_LOG_FLAGS", tcp_rx_log_flags, ci_uint32,
 "Only active when EF_TCP_RX_CHECKS is set.",
            8, ,  0, MIN, MAX, bitmask)
 
+CI_CFG_OPT("EF_BINARY_LOG", blog_entries, ci_uint32,
+"Number of records in the stack's binary diagnostic log, rounded up to a "
+"power of two.  When non-zero, diagnostic messages that would otherwise be "
+"formatted and written to the log as they happen (currently those enabled "
+"by EF_TCP_RX_CHECKS and EF_TCP_RX_LOG_FLAGS) are instead recorded in "
+"binary form in a ring in the stack's shared state.  This costs tens of "
+"nanoseconds per message rather than the microseconds taken to format and "
+"write it.  Use \"onload_stackdump blog\" or \"onload_stackdump "
+"blog_follow\" to decode the log.  When the ring is full the oldest "
+"records are overwritten.",
+           , , 0, 0, CI_CFG_BLOG_ENTRIES_MAX, count)
+
+CI_CFG_OPT("EF_STATS_SNAPSHOT", ssnap_sock_log, ci_uint32,
+"When non-zero, the stack keeps a copy of its statistics in its shared "
+"state that monitoring tools can read without seeing counters that are "
+"part way through being updated, together with a log of the sockets "
+"allocated and freed.  The value is the number of records in the socket "
+"log, rounded up to a power of two.  A monitor that polls less often than "
+"this many sockets are created and destroyed has to rescan the stack's "
+"sockets.  See also EF_STATS_SNAPSHOT_USEC.",
+           , , 0, 0, CI_CFG_SSNAP_SOCK_LOG_MAX, count)
+
+CI_CFG_OPT("EF_STATS_SNAPSHOT_USEC", ssnap_usec, ci_uint32,
+"Minimum interval between updates of the statistics snapshot enabled by "
+"EF_STATS_SNAPSHOT.  The snapshot is updated at the end of a poll of the "
+"stack once this interval has passed.  Use 0 to update it on every poll.",
+           , , 100, 0, MAX, time:usec)
+
 #if CI_CFG_PORT_STRIPING
 CI_CFG_OPT("EF_STRIPE_DUPACK_THRESHOLD", stripe_dupack_threshold, ci_uint16,
 "For connections using port striping: Sets the number of duplicate ACKs that "
@@ -960,6 +1030,28 @@ CI_CFG_OPT("EF_RXQ_LIMIT", rxq_limit, ci_int32,
 "when it has a value larger than the ring size (EF_RXQ_SIZE).",
            , , 65535, CI_CFG_RX_DESC_BATCH, 65535, level)
 
+CI_CFG_OPT("EF_MEM_PRESSURE_SOCK_PKTS", mem_pressure_sock_pkts, ci_int32,
+"Limits how far one socket with a large receive backlog can hurt the rest "
+"of the stack when it runs short of packet buffers.  While the stack is in "
+"critical memory pressure, sockets holding fewer than this many received "
+"packet buffers continue to receive, and only sockets holding more have "
+"their received data dropped.  Between them, sockets may queue at most as "
+"many buffers as the stack keeps in reserve for critical memory pressure "
+"each time it enters it; after that, received data is dropped for all "
+"sockets.  When buffers are reclaimed, the sockets holding the most "
+"buffers over this limit are collapsed first.  The default of 0 drops "
+"received data for all sockets during critical memory pressure.",
+           , , 0, 0, 1000000000, count)
+
+CI_CFG_OPT("EF_RX_RECYCLE", rx_recycle, ci_int32,
+"Maximum number of received packet buffers per interface that are kept "
+"aside when the application has finished with them, to be posted straight "
+"back to the receive descriptor ring.  This saves returning buffers to the "
+"free pool only to take them out again on the next refill.  Buffers are "
+"returned to the free pool when the stack is short of packet buffers.  Set "
+"to 0 to disable.",
+           , , 64, 0, 65535, count)
+
 CI_CFG_OPT("EF_EVS_PER_POLL", evs_per_poll, ci_uint32,
 "Sets the number of hardware network events to handle before performing other "
 "work.  This is a hint for internal tuning, and the actual number handled "
@@ -991,6 +1083,18 @@ CI_CFG_OPT("EF_BUZZ_USEC", buzz_usec, ci_uint32,
 "by the EF_POLL_USEC option.",
            ,  poll_cycles, 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_FUTEX_SLEEP_USEC", futex_sleep_usec, ci_uint32,
+"When a thread blocks on a socket, it first waits on a futex for up to this "
+"many microseconds, and only then sleeps in the kernel.  A thread of the "
+"same process that handles network events for the socket wakes it directly "
+"through the futex, which avoids system calls into the Onload driver on "
+"both sides.  This suits applications in which other threads are busy in "
+"the stack (e.g. spinning) while one thread blocks.  Interrupts are not "
+"enabled while waiting on the futex, so a wakeup that would come from an "
+"interrupt is delayed by up to this timeout.  Futexes are not used once "
+"the stack has been shared with another process.  0 disables this.",
+           , , 0, 0, 1000000, time:usec)
+
 CI_CFG_OPT("EF_HELPER_USEC", timer_usec, ci_uint32,
 "Timeout in microseconds for the count-down interrupt timer.  This timer "
 "generates an interrupt if network events are not handled by the application "
@@ -1071,6 +1175,29 @@ CI_CFG_OPT("EF_PREALLOC_PACKETS", prealloc_packets, ci_int32,
 "EF_MIN_FREE_PACKETS option is not taken into account.",
            , , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_STACK_INIT_THREADS", stack_init_threads, ci_uint32,
+"Number of threads used to allocate, DMA-map and prefault packet buffers "
+"when an Onload stack is created.  Packet sets needed to satisfy "
+"EF_PREALLOC_PACKETS, EF_PREFAULT_PACKETS and the initial RX ring fill are "
+"allocated by this many kernel workers in parallel.  This reduces stack "
+"creation time with large values of EF_MAX_PACKETS.  See also "
+"EF_PREFAULT_THREADS."
+"\n"
+"The default of 1 does this work serially in the creating thread.",
+           , , 1, 1, 32, count)
+
+CI_CFG_OPT("EF_PREFAULT_THREADS", prefault_threads, ci_uint32,
+"Number of threads used to map the packet buffers prefaulted by "
+"EF_PREFAULT_PACKETS into the process when an Onload stack is created.  "
+"Values above 1 make Onload start short-lived threads of its own inside "
+"the application while the stack is created, so only set this for "
+"applications that allow that (for example, ones that do not restrict "
+"their thread count or the system calls they make).  This reduces stack "
+"creation time with large values of EF_MAX_PACKETS."
+"\n"
+"The default of 1 maps them in the creating thread.",
+           , , 1, 1, 32, count)
+
 /* Max is currently 2^21 EPs.
  * We allocate ep in pages, EP_BUF_PER_PAGE=4 ep per page, so min is 4.
  * 7 synrecv states consume one endpoint, but we also use aux buffers for
@@ -1216,7 +1343,8 @@ CI_CFG_OPT("EF_TCP_BACKLOG_MAX", tcp_backlog_max, ci_uint32,
 
 /* The number we really use is tcp_synrecv_max*2 - it is the maximum
  * number of aux buffers, assuming that synrrecv state can use one half of
- * them and listening bucktes use another half. */
+ * them and epoll and path MTU state use another half.  The synrecv lookup
+ * table also has (at least) tcp_synrecv_max*2 entries. */
 CI_CFG_OPT("EF_TCP_SYNRECV_MAX", tcp_synrecv_max, ci_uint32,
 "Places an upper limit on the number of embryonic (half-open) connections in "
 "an Onload stack; see also EF_TCP_BACKLOG_MAX.  By default, "
@@ -141,6 +141,14 @@ OO_STAT("Times Onload has woken threads waiting on a socket for receive.",
         ci_uint32, sock_wakes_rx, count)
 OO_STAT("Times Onload has woken threads waiting on a socket for transmit.",
         ci_uint32, sock_wakes_tx, count)
+OO_STAT("Times a thread has waited on a futex before blocking on a socket "
+        "(EF_FUTEX_SLEEP_USEC).",
+        ci_uint32, sock_futex_sleeps, count)
+OO_STAT("Times a thread waiting on a futex was not woken within "
+        "EF_FUTEX_SLEEP_USEC and went on to block in the kernel.",
+        ci_uint32, sock_futex_timeouts, count)
+OO_STAT("Times Onload has woken threads waiting on a socket's futex.",
+        ci_uint32, sock_futex_wakes, count)
 OO_STAT("Times OS has woken threads waiting on an Onload socket for receive.",
         ci_uint32, sock_wakes_rx_os, count)
 OO_STAT("Times OS has woken threads waiting on an Onload socket for transmit.",
@@ -235,8 +243,32 @@ OO_STAT("Multicast loop-back sends.",
         ci_uint32, udp_send_mcast_loop, count)
 OO_STAT("Multicast loop-back send was dropped due to RX packet buffer limit.",
         ci_uint32, udp_send_mcast_loop_drop, count)
+OO_STAT("Number of datagrams sent by splitting UDP_SEGMENT sends.",
+        ci_uint32, udp_send_gso_segs, count)
+OO_STAT("Number of datagrams coalesced into UDP_GRO receives.",
+        ci_uint32, udp_recv_gro_segs, count)
 OO_STAT("Number of active opens that reached established.",
         ci_uint32, active_opens, count)
+OO_STAT("Number of sends on accelerated loopback connections that placed "
+        "data in the receiver's loopback ring (EF_TCP_LOOPBACK_RING).",
+        ci_uint32, tcp_loop_ring_sends, count)
+OO_STAT("Number of loopback ring sends that found no space in the ring or "
+        "the receive window, so fell back to the packet path.",
+        ci_uint32, tcp_loop_ring_full, count)
+OO_STAT("Number of times a loopback ring could not be allocated for lack "
+        "of packet buffers.",
+        ci_uint32, tcp_loop_ring_nomem, count)
+OO_STAT("Number of packet buffers moved from a TCP receive queue to a pipe "
+        "by splice() without copying.",
+        ci_uint32, tcp_splice_to_pipe_bufs, count)
+OO_STAT("Number of packet buffers moved from a pipe to a TCP send queue by "
+        "splice(), rather than copied into new buffers.",
+        ci_uint32, tcp_splice_from_pipe_bufs, count)
+OO_STAT("Number of TX timestamps written to the stack's TX timestamp ring.",
+        ci_uint32, tx_ts_ring_posted, count)
+OO_STAT("Number of TX timestamps discarded because the stack's TX timestamp "
+        "ring was full.",
+        ci_uint32, tx_ts_ring_lost, count)
 OO_STAT(HANDOVER_DESCRIPTION(socket),
         ci_uint32, tcp_handover_socket, count)
 OO_STAT(HANDOVER_DESCRIPTION(bind) 
@@ -425,6 +457,12 @@ OO_STAT("Times a synrecv has been purged to make room for a new one - this "
         "may indicate a DOS attack; consider enabling SYN cookies to "
         "alleviate this.",
         ci_uint32, synrecv_purge, count)
+OO_STAT("Number of occupied synrecv table entries skipped by lookups because "
+        "they belonged to another connection.",
+        ci_uint32, synrecv_table_probes, count)
+OO_STAT("Number of SYN-ACKs sent in response to SYNs received in a poll, "
+        "and pushed to the NIC together at the end of that poll.",
+        ci_uint32, synack_batched, count)
 OO_STAT("We received a SYN packet, but the accept queue was full, so we drop "
         "it rather than sending a SYN-ACK.  If it's a legitimate connection "
         "attempt, the remote side should re-transmit the SYN later; when "
@@ -446,8 +484,6 @@ OO_STAT("Number of times accept() returned EAGAIN.",
         ci_uint32, accept_eagain, count)
 OO_STAT("Number of failed aux-buffer allocations.",
         ci_uint32, aux_alloc_fails, count)
-OO_STAT("Number of failed bucket-aux-buffer allocations.",
-        ci_uint32, aux_bucket_alloc_fails, count)
 OO_STAT("Times that accept() was called, but as a result of the "
         "TCP_DEFER_ACCEPT socket option (on the listening socket), we do not "
         "promote a half-opened connection from listen to accept queue until "
@@ -525,6 +561,21 @@ OO_STAT("Number of RX discards (other).",
 OO_STAT("Number of times we have refilled RX ring from recv() path.  This is "
         "a short-cut path used when in a low-memory situation.",
         ci_uint32, rx_refill_recv, count)
+OO_STAT("Number of received packet buffers kept aside for reposting to the "
+        "RX ring when freed (see EF_RX_RECYCLE).",
+        ci_uint32, rx_recycle_put, count)
+OO_STAT("Number of RX descriptors posted with recycled packet buffers.  "
+        "Compare with rx_recycle_miss to get the recycle rate.",
+        ci_uint32, rx_recycle_hit, count)
+OO_STAT("Number of RX descriptors posted with buffers from the free pool.",
+        ci_uint32, rx_recycle_miss, count)
+OO_STAT("Number of recycled packet buffers returned to the free pool because "
+        "the stack was short of packet buffers.",
+        ci_uint32, rx_recycle_drained, count)
+OO_STAT("Number of TCP send magazine buffers returned to the free pool "
+        "because the stack was short of packet buffers (see "
+        "EF_TCP_SEND_MAGAZINE).",
+        ci_uint32, tcp_tx_mag_drained, count)
 OO_STAT("Number of RX packets detected from the future.",
         ci_uint32, rx_future, count)
 OO_STAT("Number of RX packets detected from the future which did not complete.",
@@ -582,6 +633,14 @@ OO_STAT("Number of times stack has entered 'memory pressure' state.  "
         "memory_pressure_enter counts how many times we've gone into this "
         "critical state",
         ci_uint32, memory_pressure_enter, count)
+OO_STAT("Number of received packets queued during critical memory pressure "
+        "because the receiving socket held fewer than "
+        "EF_MEM_PRESSURE_SOCK_PKTS buffers and the stack's budget for them "
+        "was not used up.",
+        ci_uint32, memory_pressure_sock_accepts, count)
+OO_STAT("Number of packet buffers reclaimed from the sockets holding the "
+        "most received buffers, which are tried first when reaping.",
+        ci_uint32, pkts_reclaimed_heaviest, count)
 OO_STAT("Number of times stack has exited 'memory pressure' state via poll."
         MEMORY_PRESSURE_DESCRIPTION
         "If the total of the two exit counts is less than enter - we're "
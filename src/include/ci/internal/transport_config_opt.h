@@ -224,6 +224,19 @@
 /* How many packets to fill on TX path before pushing them out. */
 #define CI_CFG_TCP_TX_BATCH		8
 
+/* Maximum size of the per-socket TCP send magazine (EF_TCP_SEND_MAGAZINE). */
+#define CI_CFG_TCP_SEND_MAGAZINE_MAX	16
+
+/* Maximum number of records in a stack's binary log (EF_BINARY_LOG). */
+#define CI_CFG_BLOG_ENTRIES_MAX		(1 << 20)
+
+/* Maximum number of records in the socket log of a stack's stats snapshot
+ * (EF_STATS_SNAPSHOT). */
+#define CI_CFG_SSNAP_SOCK_LOG_MAX	(1 << 20)
+
+/* Limit on the size of the ring of TX timestamps (EF_TX_TIMESTAMP_RING). */
+#define CI_CFG_TX_TS_RING_MAX		(1 << 20)
+
 /* Maximum receive window size.  This used to be 0x7fff.  Here's why:
 **
 ** A weakness in ANVL (described in bug 828) means that if we set this
@@ -709,8 +722,12 @@
 
 /* Size of socket shared state buffer.  Must be 1024 or 2048.  Larger
  * value is needed if you enable too many CI_CFG_* options, such as
- * CI_CFG_TCP_SOCK_STATS. */
+ * CI_CFG_TCP_SOCK_STATS, or both CI_CFG_IPV6 and CI_CFG_SPIN_STATS. */
+#if CI_CFG_IPV6 && CI_CFG_SPIN_STATS
+#define CI_CFG_EP_BUF_SIZE              2048
+#else
 #define CI_CFG_EP_BUF_SIZE              1024
+#endif
 
 #if CI_CFG_IPV6 && !CI_CFG_FAKE_IPV6
 #error "CI_CFG_FAKE_IPV6 should be enabled to support IPv6"
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_HEADER >
+**  \brief  Load-aware steering of new connections across a cluster
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#ifndef __ONLOAD_CLUSTER_BALANCE_H__
+#define __ONLOAD_CLUSTER_BALANCE_H__
+
+/* Passive-open connections arriving at a cluster are spread over its
+ * stacks by the NIC's RSS indirection table, which maps each of
+ * OO_CLUSTER_BALANCE_BUCKETS hash buckets to one stack.  The policy here
+ * takes periodic load samples from each stack and reassigns buckets from
+ * overloaded stacks to lightly-loaded ones.
+ *
+ * Connections accepted by a clustered stack share the cluster's wildcard
+ * filter, so reassigning a bucket would send the packets of any connection
+ * already in that bucket to the wrong stack.  The policy therefore only
+ * moves buckets that have had no connections in the owning stack for
+ * [quiet_samples] consecutive samples.  This makes it effective for
+ * workloads of short-lived connections, where buckets drain quickly.
+ *
+ * A bucket is only as quiet as the sample says.  A SYN that the stack has
+ * not yet processed (still in its RX ring or event queue) has no synrecv
+ * entry, so the caller must bring each stack up to date before sampling
+ * it.  A stack that can't be brought up to date reports [buckets_unknown],
+ * and its buckets stay where they are until a later sample.
+ *
+ * The policy is pure computation with no locking and no allocation so that
+ * the driver can run it from a work item and test programs can drive it
+ * from synthetic load traces.
+ */
+
+#include <ci/tools.h>
+
+
+#define OO_CLUSTER_BALANCE_BUCKETS     128
+#define OO_CLUSTER_BALANCE_MAX_STACKS  64
+
+/* Load scores are fixed-point with this value representing 100%. */
+#define OO_CLUSTER_LOAD_ONE            1024
+
+/* Scores are smoothed as score += (sample - score) >> EWMA_SHIFT. */
+#define OO_CLUSTER_BALANCE_EWMA_SHIFT  2
+
+
+/* A load sample for one stack, filled in by the caller. */
+struct oo_cluster_load {
+  /* False if the stack does not exist or could not be sampled.  Such a
+   * stack neither gives nor receives buckets. */
+  ci_uint32 present;
+  /* Connections waiting to be accepted, and the limit, summed over the
+   * stack's listening sockets. */
+  ci_uint32 acceptq_n;
+  ci_uint32 acceptq_max;
+  /* Fraction of the sample period spent handling events, scaled to
+   * OO_CLUSTER_LOAD_ONE. */
+  ci_uint32 poll_busy;
+  /* Packet buffers in use, and the stack's limit. */
+  ci_uint32 pkts_in_use;
+  ci_uint32 pkts_max;
+  /* Bit [b] is set if the stack has a connection in bucket [b]. */
+  ci_uint32 bucket_busy[OO_CLUSTER_BALANCE_BUCKETS / 32];
+  /* True if [bucket_busy] could not be filled in for this sample.  The
+   * stack's buckets then keep their quiet counts but can't move. */
+  ci_uint32 buckets_unknown;
+};
+
+
+struct oo_cluster_balance {
+  /* Parameters. */
+  ci_uint32 n_stacks;
+  ci_uint32 high_wm;        /* don't shed load below this score */
+  ci_uint32 min_gap;        /* minimum score difference to move a bucket */
+  ci_uint32 quiet_samples;  /* samples a bucket must be empty to move */
+  ci_uint32 max_moves;      /* bucket moves per step */
+
+  /* State. */
+  ci_uint32 score[OO_CLUSTER_BALANCE_MAX_STACKS];
+  ci_uint8  indir[OO_CLUSTER_BALANCE_BUCKETS];
+  ci_uint8  quiet[OO_CLUSTER_BALANCE_BUCKETS];
+
+  /* Statistics. */
+  ci_uint32 n_steps;
+  ci_uint32 n_moves;
+};
+
+
+ci_inline void
+oo_cluster_load_mark_bucket(struct oo_cluster_load* load, unsigned bucket)
+{
+  bucket &= OO_CLUSTER_BALANCE_BUCKETS - 1;
+  load->bucket_busy[bucket >> 5] |= 1u << (bucket & 31);
+}
+
+
+ci_inline int
+oo_cluster_load_bucket_is_busy(const struct oo_cluster_load* load,
+                               unsigned bucket)
+{
+  return (load->bucket_busy[bucket >> 5] >> (bucket & 31)) & 1;
+}
+
+
+/* Initialises [b] with the indirection table [indir] that is programmed
+ * into the NIC, i.e. the VI set's rss_context->indirection_table.  That
+ * is not necessarily striped: it is rewritten when a stack leaves the
+ * cluster, and the caller must re-initialise [b] whenever it changes.
+ * Returns -EINVAL if an entry names a stack beyond [n_stacks].
+ */
+ci_inline int
+oo_cluster_balance_init(struct oo_cluster_balance* b, unsigned n_stacks,
+                        const ci_uint32* indir,
+                        unsigned high_wm, unsigned min_gap,
+                        unsigned quiet_samples, unsigned max_moves)
+{
+  unsigned i;
+
+  if( n_stacks > OO_CLUSTER_BALANCE_MAX_STACKS )
+    return -EINVAL;
+  for( i = 0; i < OO_CLUSTER_BALANCE_BUCKETS; ++i )
+    if( indir[i] >= n_stacks )
+      return -EINVAL;
+
+  memset(b, 0, sizeof(*b));
+  b->n_stacks = n_stacks;
+  b->high_wm = high_wm;
+  b->min_gap = min_gap;
+  b->quiet_samples = CI_MAX(quiet_samples, 1u);
+  b->max_moves = max_moves;
+  for( i = 0; i < OO_CLUSTER_BALANCE_BUCKETS; ++i )
+    b->indir[i] = indir[i];
+  return 0;
+}
+
+
+/* Converts a sample to a score in [0, OO_CLUSTER_LOAD_ONE].  A stack is as
+ * loaded as its most constrained resource. */
+ci_inline ci_uint32 oo_cluster_load_score(const struct oo_cluster_load* load)
+{
+  ci_uint32 score = CI_MIN(load->poll_busy, (ci_uint32) OO_CLUSTER_LOAD_ONE);
+
+  if( load->acceptq_max != 0 )
+    score = CI_MAX(score, (ci_uint32)
+                   ((ci_uint64) load->acceptq_n * OO_CLUSTER_LOAD_ONE /
+                    load->acceptq_max));
+  if( load->pkts_max != 0 )
+    score = CI_MAX(score, (ci_uint32)
+                   ((ci_uint64) load->pkts_in_use * OO_CLUSTER_LOAD_ONE /
+                    load->pkts_max));
+  return CI_MIN(score, (ci_uint32) OO_CLUSTER_LOAD_ONE);
+}
+
+
+/* Returns the eligible bucket of stack [stack] that has been quiet for
+ * longest, or -1 if there is none. */
+ci_inline int
+oo_cluster_balance_pick_bucket(const struct oo_cluster_balance* b,
+                               unsigned stack)
+{
+  int i, best = -1;
+
+  for( i = 0; i < OO_CLUSTER_BALANCE_BUCKETS; ++i )
+    if( b->indir[i] == stack && b->quiet[i] >= b->quiet_samples &&
+        (best < 0 || b->quiet[i] > b->quiet[best]) )
+      best = i;
+  return best;
+}
+
+
+/* Folds the samples in [loads] (indexed by stack) into the scores and
+ * moves up to [max_moves] quiet buckets from the most-loaded stack to the
+ * least-loaded one.  Returns the number of buckets moved; the caller should
+ * then program b->indir into the NIC. */
+ci_inline int oo_cluster_balance_step(struct oo_cluster_balance* b,
+                                      const struct oo_cluster_load* loads)
+{
+  unsigned n_buckets[OO_CLUSTER_BALANCE_MAX_STACKS];
+  unsigned s, i, hi, lo, share;
+  int n_moves = 0, bucket;
+
+  ++b->n_steps;
+
+  for( s = 0; s < b->n_stacks; ++s ) {
+    n_buckets[s] = 0;
+    if( loads[s].present ) {
+      ci_int32 delta = (ci_int32) oo_cluster_load_score(&loads[s]) -
+                       (ci_int32) b->score[s];
+      b->score[s] += delta / (1 << OO_CLUSTER_BALANCE_EWMA_SHIFT);
+    }
+    else {
+      b->score[s] = 0;
+    }
+  }
+
+  for( i = 0; i < OO_CLUSTER_BALANCE_BUCKETS; ++i ) {
+    s = b->indir[i];
+    ++n_buckets[s];
+    if( ! loads[s].present || oo_cluster_load_bucket_is_busy(&loads[s], i) )
+      b->quiet[i] = 0;
+    else if( ! loads[s].buckets_unknown && b->quiet[i] < 255 )
+      ++b->quiet[i];
+  }
+
+  while( n_moves < (int) b->max_moves ) {
+    hi = lo = b->n_stacks;
+    for( s = 0; s < b->n_stacks; ++s ) {
+      if( ! loads[s].present )
+        continue;
+      if( hi == b->n_stacks || b->score[s] > b->score[hi] )
+        hi = s;
+      if( lo == b->n_stacks || b->score[s] < b->score[lo] )
+        lo = s;
+    }
+    if( hi == lo || b->score[hi] < b->high_wm ||
+        b->score[hi] - b->score[lo] < b->min_gap || n_buckets[hi] <= 1 )
+      break;
+    if( loads[hi].buckets_unknown ||
+        (bucket = oo_cluster_balance_pick_bucket(b, hi)) < 0 )
+      break;
+
+    b->indir[bucket] = lo;
+    /* The bucket must prove itself quiet again before it can move back. */
+    b->quiet[bucket] = 0;
+    /* Assume that the load a stack sees is spread evenly over its buckets
+     * so that further moves this step see the effect of this one. */
+    share = b->score[hi] / n_buckets[hi];
+    b->score[hi] -= share;
+    b->score[lo] += share;
+    --n_buckets[hi];
+    ++n_buckets[lo];
+    ++n_moves;
+  }
+
+  b->n_moves += n_moves;
+  return n_moves;
+}
+
+
+#endif  /* __ONLOAD_CLUSTER_BALANCE_H__ */
@@ -704,6 +704,226 @@ onload_socket_nonaccel(int domain, int type, int protocol);
 extern int
 onload_socket_unicast_nonaccel(int domain, int type, int protocol);
 
+
+/**********************************************************************
+ * onload_ring: submit socket calls in batches
+ *
+ * A ring lets an application make many socket calls, on any number of
+ * sockets, with one call into Onload.  The application queues requests in
+ * the submission queue (SQ) of a ring, calls onload_ring_submit(), and
+ * then collects a completion for each request from the completion queue
+ * (CQ).  This avoids paying for the libc interception and file descriptor
+ * table lookup on every call, and a run of requests on the same socket
+ * looks the socket up only once.
+ *
+ * Both queues live in memory provided by the application, and must each
+ * have a power-of-2 number of entries.  A ring must not be used by more
+ * than one thread at a time.
+ *
+ *   struct onload_ring_sqe sqes[64];
+ *   struct onload_ring_cqe cqes[64];
+ *   struct onload_ring ring;
+ *   struct onload_ring_sqe* sqe;
+ *   struct onload_ring_cqe* cqe;
+ *
+ *   onload_ring_init(&ring, sqes, 64, cqes, 64);
+ *   for( i = 0; i < n_socks; ++i ) {
+ *     sqe = onload_ring_get_sqe(&ring);
+ *     sqe->op = ONLOAD_RING_OP_RECV;
+ *     sqe->fd = socks[i];
+ *     sqe->buf = bufs[i];
+ *     sqe->len = sizeof(bufs[i]);
+ *     sqe->op_flags = MSG_DONTWAIT;
+ *     sqe->user_data = i;
+ *   }
+ *   onload_ring_submit(&ring);
+ *   while( (cqe = onload_ring_peek_cqe(&ring)) != NULL ) {
+ *     if( cqe->res > 0 )
+ *       handle_data(cqe->user_data, cqe->res);
+ *     onload_ring_cqe_seen(&ring);
+ *   }
+ *
+ * Requests are carried out in order, and each behaves like the call it
+ * corresponds to, including blocking: a blocking request holds up the
+ * requests behind it, so pass MSG_DONTWAIT, or use non-blocking sockets,
+ * unless that is what is wanted.  Requests on file descriptors that are
+ * not accelerated by Onload are passed to the kernel.
+ */
+#include <errno.h>
+#include <string.h>
+
+enum onload_ring_op {
+  ONLOAD_RING_OP_NOP = 0,
+  /* send(fd, buf, len, op_flags) */
+  ONLOAD_RING_OP_SEND,
+  /* recv(fd, buf, len, op_flags) */
+  ONLOAD_RING_OP_RECV,
+  /* accept4(fd, NULL, NULL, op_flags) */
+  ONLOAD_RING_OP_ACCEPT,
+  /* close(fd) */
+  ONLOAD_RING_OP_CLOSE,
+};
+
+/* Flags for onload_ring_sqe.flags */
+/* RECV: where possible, complete with a zero-copy buffer holding the
+ * message rather than copying it to buf.  buf is still used for messages
+ * that cannot be delivered this way, for example TCP data. */
+#define ONLOAD_RING_SQE_F_ZC     0x1
+
+struct onload_ring_sqe {
+  uint64_t user_data;  /* Copied to the completion */
+  void*    buf;        /* SEND, RECV: data */
+  uint32_t len;        /* SEND, RECV: length of buf */
+  int32_t  fd;
+  int32_t  op_flags;   /* MSG_* flags, or SOCK_* flags for ACCEPT */
+  uint16_t op;         /* enum onload_ring_op */
+  uint16_t flags;      /* ONLOAD_RING_SQE_F_* */
+};
+
+/* Flags for onload_ring_cqe.flags */
+/* RECV: the message is in a zero-copy buffer at zc_buf, rather than in
+ * the request's buf.  Release it with onload_zc_release_buffers(), passing
+ * zc_handle as an onload_zc_handle. */
+#define ONLOAD_RING_CQE_F_ZC     0x1
+/* RECV: the datagram did not fit in buf, and the rest of it was
+ * discarded.  Never set for stream sockets. */
+#define ONLOAD_RING_CQE_F_TRUNC  0x2
+
+struct onload_ring_cqe {
+  uint64_t user_data;  /* From the request */
+  int32_t  res;        /* What the call would return, or -errno */
+  uint32_t flags;      /* ONLOAD_RING_CQE_F_* */
+  void*    zc_buf;     /* With ONLOAD_RING_CQE_F_ZC: message data */
+  void*    zc_handle;  /* With ONLOAD_RING_CQE_F_ZC: buffer handle */
+};
+
+struct onload_ring {
+  struct onload_ring_sqe* sqes;
+  struct onload_ring_cqe* cqes;
+  unsigned sq_mask;
+  unsigned cq_mask;
+  /* The application adds requests at sq_tail and Onload consumes them from
+   * sq_head.  Onload adds completions at cq_tail and the application
+   * consumes them from cq_head.  All four count up indefinitely. */
+  unsigned sq_head;
+  unsigned sq_tail;
+  unsigned cq_head;
+  unsigned cq_tail;
+};
+
+/* Initialise a ring.  Returns 0, or -EINVAL if either queue size is not a
+ * power of 2. */
+static inline int
+onload_ring_init(struct onload_ring* ring,
+                 struct onload_ring_sqe* sqes, unsigned sq_entries,
+                 struct onload_ring_cqe* cqes, unsigned cq_entries)
+{
+  if( sq_entries == 0 || (sq_entries & (sq_entries - 1)) ||
+      cq_entries == 0 || (cq_entries & (cq_entries - 1)) )
+    return -EINVAL;
+  ring->sqes = sqes;
+  ring->cqes = cqes;
+  ring->sq_mask = sq_entries - 1;
+  ring->cq_mask = cq_entries - 1;
+  ring->sq_head = ring->sq_tail = 0;
+  ring->cq_head = ring->cq_tail = 0;
+  return 0;
+}
+
+/* Return a cleared request to fill in at the tail of the SQ, or NULL if
+ * the SQ is full.  The request is queued by this call. */
+static inline struct onload_ring_sqe*
+onload_ring_get_sqe(struct onload_ring* ring)
+{
+  struct onload_ring_sqe* sqe;
+  if( ring->sq_tail - ring->sq_head > ring->sq_mask )
+    return NULL;
+  sqe = &ring->sqes[ring->sq_tail++ & ring->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/* Return the completion at the head of the CQ, or NULL if there is
+ * none. */
+static inline struct onload_ring_cqe*
+onload_ring_peek_cqe(struct onload_ring* ring)
+{
+  if( ring->cq_head == ring->cq_tail )
+    return NULL;
+  return &ring->cqes[ring->cq_head & ring->cq_mask];
+}
+
+/* Consume the completion returned by onload_ring_peek_cqe(). */
+static inline void
+onload_ring_cqe_seen(struct onload_ring* ring)
+{
+  ++ring->cq_head;
+}
+
+/* Carry out queued requests, in order, until the SQ is empty or the CQ is
+ * full.
+ *
+ * Returns the number of requests carried out, or -ENOSYS if the ring API
+ * is not supported.
+ */
+extern int onload_ring_submit(struct onload_ring* ring);
+
+
+/**********************************************************************
+ * onload_socket_handle: call a socket without looking it up each time
+ *
+ * onload_socket_handle_get() looks up an accelerated TCP or UDP socket
+ * once, and returns a handle through which the socket can be sent to,
+ * received from and polled without the libc interception, file descriptor
+ * table lookup and dispatch that every send() and recv() pays for.
+ *
+ *   struct onload_socket_handle* h;
+ *
+ *   if( onload_socket_handle_get(fd, &h) == 0 ) {
+ *     while( (rc = onload_socket_handle_recv(h, buf, len, 0)) > 0 )
+ *       onload_socket_handle_send(h, buf, rc, 0);
+ *     onload_socket_handle_put(h);
+ *   }
+ *
+ * A handle is valid only for as long as its file descriptor refers to the
+ * same socket.  Each call checks this, cheaply, and fails with -ESTALE
+ * once the descriptor has been closed or reused, or the socket moved by
+ * onload_move_fd() or handed over to the kernel.  A handle survives fork()
+ * and may be used by several threads at once.
+ *
+ * Release a handle with onload_socket_handle_put().  Until all of a
+ * socket's handles have been released, its state is not freed and its
+ * file descriptor number is not reused, even once it has been closed.
+ */
+struct onload_socket_handle;
+
+/* Returns 0 and a handle in [*handle_out], or:
+ *   -ESOCKTNOSUPPORT if [fd] is not accelerated by Onload
+ *   -ENOTSOCK if [fd] is accelerated but is not a TCP or UDP socket
+ *   -ENOMEM if out of memory
+ *   -ENOSYS if the handle API is not supported
+ */
+extern int
+onload_socket_handle_get(int fd, struct onload_socket_handle** handle_out);
+
+extern void onload_socket_handle_put(struct onload_socket_handle* handle);
+
+/* As send() and recv(), but return -errno on failure rather than setting
+ * errno. */
+extern ssize_t
+onload_socket_handle_send(struct onload_socket_handle* handle,
+                          const void* buf, size_t len, int flags);
+extern ssize_t
+onload_socket_handle_recv(struct onload_socket_handle* handle,
+                          void* buf, size_t len, int flags);
+
+/* Return which of [events] (POLLIN, POLLOUT etc.), together with POLLERR
+ * and POLLHUP, are ready on the socket now, polling the stack first if
+ * that is needed to find out.  Does not block.  Returns -errno on
+ * failure. */
+extern int
+onload_socket_handle_poll(struct onload_socket_handle* handle, short events);
+
 #endif /* ONLOAD_INCLUDE_DS_DATA_ONLY */
 
 #ifdef __cplusplus
@@ -53,10 +53,67 @@ enum onload_timestamping_flags {
   /* Request NIC and/or external timestamps for received packets */
   ONLOAD_TIMESTAMPING_FLAG_RX_NIC = 1 << 1,
   ONLOAD_TIMESTAMPING_FLAG_RX_CPACKET = 1 << 2,
+
+  /* Deliver NIC timestamps for sent packets through the stack's TX
+   * timestamp ring (see onload_tx_timestamps_read()) rather than the error
+   * queue.  Implies ONLOAD_TIMESTAMPING_FLAG_TX_NIC.  The request fails
+   * with -ENOENT if the stack has no ring (EF_TX_TIMESTAMP_RING=0). */
+  ONLOAD_TIMESTAMPING_FLAG_TX_RING = 1 << 3,
 };
 
 extern int onload_timestamping_request(int fd, unsigned flags);
 
+
+/**********************************************************************
+ * onload_tx_timestamps_read: collect TX timestamps in bulk
+ *
+ * Sockets for which ONLOAD_TIMESTAMPING_FLAG_TX_RING has been requested
+ * have their TX timestamps written to a ring in the shared state of their
+ * stack when the adapter reports that a packet has been sent.  The packet
+ * buffer is freed at once, and nothing is queued on the socket's error
+ * queue.
+ *
+ * This function copies up to [n] of the oldest entries from the ring of the
+ * stack that [fd] belongs to.  Any socket in the stack may be used.  It does
+ * not take the stack lock or make system calls, and may be called from
+ * several threads at once.  It does not poll the stack.
+ *
+ * endpoint_id matches that returned by onload_fd_stat() for the socket.
+ * key is as for SOF_TIMESTAMPING_OPT_ID, counted from when the ring was
+ * requested: for UDP the number of datagrams sent before this one, and for
+ * TCP (ONLOAD_TX_TIMESTAMP_F_TCP) the offset in the stream of the last byte
+ * of the segment.  If the timestamp is not available, stamp.sec is zero.
+ *
+ * The ring has EF_TX_TIMESTAMP_RING entries.  If it is full when a packet
+ * completes the timestamp is discarded, and the next entry written to the
+ * ring has ONLOAD_TX_TIMESTAMP_F_LOST set.
+ *
+ * Returns the number of entries copied, or a negative error code:
+ *   -ENOTTY     fd does not refer to an onload-accelerated socket
+ *   -ENOENT     the stack has no TX timestamp ring (EF_TX_TIMESTAMP_RING=0)
+ *   -EOPNOTSUPP this build of onload does not support timestamping
+ */
+
+struct onload_tx_timestamp {
+  struct onload_timestamp stamp;
+  uint32_t endpoint_id;
+  uint32_t key;
+  unsigned flags;
+};
+
+/* Flags for onload_tx_timestamp */
+enum onload_tx_timestamp_flags {
+  /* The adapter's clock was in sync when the packet was sent */
+  ONLOAD_TX_TIMESTAMP_F_IN_SYNC = 1 << 0,
+  /* The packet is a TCP segment */
+  ONLOAD_TX_TIMESTAMP_F_TCP = 1 << 1,
+  /* Timestamps were discarded before this one because the ring was full */
+  ONLOAD_TX_TIMESTAMP_F_LOST = 1 << 2,
+};
+
+extern int onload_tx_timestamps_read(int fd, struct onload_tx_timestamp* ts,
+                                     int n);
+
 #ifdef __cplusplus
 }
 #endif
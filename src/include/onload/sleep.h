@@ -22,6 +22,37 @@ extern void citp_waitable_wake_not_in_poll(ci_netif* ni, citp_waitable* sb,
                                            unsigned what);
 
 
+/* Mark [w] as possibly ready in the directions given by [what] (see
+ * ci_netif_state::sock_ready_words).  Must follow the bump of [sleep_seq]
+ * and a barrier, so that user-level poll() either sees the bit or sees the
+ * state that made [w] ready.
+ */
+ci_inline void ci_netif_sock_ready_set(ci_netif* ni, citp_waitable* w,
+                                       unsigned what)
+{
+  unsigned id = W_ID(w);
+  unsigned words = ci_netif_sock_ready_words(ni);
+  volatile ci_uint32* p = ni->sock_ready + (id >> 5);
+  ci_uint32 bit = 1u << (id & 31);
+
+  if(CI_UNLIKELY( (id >> 5) >= words ))
+    return;
+  /* Avoid dirtying the line when the bit is already set, as is usual for
+   * busy sockets. */
+  if( (what & CI_SB_FLAG_WAKE_RX) && ! (p[0] & bit) )
+    ci_atomic32_or(&p[0], bit);
+  if( (what & CI_SB_FLAG_WAKE_TX) && ! (p[words] & bit) )
+    ci_atomic32_or(&p[words], bit);
+}
+
+#ifndef __KERNEL__
+/* Wake threads of this process that are waiting on [sb] in a futex (see
+ * EF_FUTEX_SLEEP_USEC).  [sb->sleep_seq] must already have been bumped. */
+extern void citp_waitable_wake_futex(ci_netif* ni, citp_waitable* sb,
+                                     unsigned what) CI_HF;
+#endif
+
+
 ci_inline void citp_waitable_wake(ci_netif* ni, citp_waitable* sb,
 				  unsigned what)
 {
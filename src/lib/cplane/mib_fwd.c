@@ -15,15 +15,17 @@
 #include <cplane/mib.h>
 
 
-cicp_mac_rowid_t
-cp_fwd_find_row_iterate(struct cp_fwd_table* fwd_table,
-                        struct cp_fwd_key* key, struct cp_fwd_key* match,
-                        cp_fwd_find_hook_fn hook, void* hook_arg)
+/* Walk the probe sequence for [key] starting from its primary hash [hash1],
+ * which the caller has already calculated. */
+static cicp_mac_rowid_t
+cp_fwd_find_row_iterate_from(struct cp_fwd_table* fwd_table,
+                             struct cp_fwd_key* key, struct cp_fwd_key* match,
+                             cicp_mac_rowid_t hash1,
+                             cp_fwd_find_hook_fn hook, void* hook_arg)
 {
-  cicp_mac_rowid_t hash1, hash2, hash;
+  cicp_mac_rowid_t hash2, hash;
   int iter = 0;
 
-  cp_calc_fwd_hash(fwd_table, key, &hash1, NULL);
   hash = hash1;
   /* Note that hash2 is always odd, so using zero as value to indicate
    * invalidity is legitimate. */
@@ -45,6 +47,19 @@ cp_fwd_find_row_iterate(struct cp_fwd_table* fwd_table,
 }
 
 
+cicp_mac_rowid_t
+cp_fwd_find_row_iterate(struct cp_fwd_table* fwd_table,
+                        struct cp_fwd_key* key, struct cp_fwd_key* match,
+                        cp_fwd_find_hook_fn hook, void* hook_arg)
+{
+  cicp_mac_rowid_t hash1;
+
+  cp_calc_fwd_hash(fwd_table, key, &hash1, NULL);
+  return cp_fwd_find_row_iterate_from(fwd_table, key, match, hash1,
+                                      hook, hook_arg);
+}
+
+
 static int
 weight_check_match(struct cp_fwd_table* fwd_table,
                    cicp_mac_rowid_t fwd_id, void* arg)
@@ -72,6 +87,45 @@ ci_fwd_pfx_next(ci_ipx_pfx_t* mask, ci_uint8 pfx)
   bw_and_192((uint64_t*)mask->ip6, x);
 }
 
+/* Number of (dst, src) prefix pairs that __cp_fwd_find_match() hashes and
+ * prefetches before probing any of them.
+ *
+ * A lookup tries every pair of prefix lengths present in the table, longest
+ * destination first, and each try is a hash probe that usually ends at the
+ * first row it reads.  Probing the pairs one at a time serialises those
+ * cache misses, which makes misses and matches on short prefixes cost
+ * roughly one memory latency per prefix pair.  Issuing the first-row loads
+ * for a batch of pairs up front lets them overlap.  The first pair is
+ * probed on its own, as it is the one that matches most lookups. */
+#define CP_FWD_FIND_BATCH  8
+
+struct cp_fwd_find_cand {
+  cicp_prefixlen_t dst_pref;
+  cicp_prefixlen_t src_pref;
+  cicp_mac_rowid_t hash1;
+};
+
+static cicp_mac_rowid_t
+cp_fwd_find_cands(struct cp_fwd_table* fwd_table, struct cp_fwd_key* key,
+                  ci_uint32 weight, const struct cp_fwd_find_cand* cand, int n)
+{
+  struct cp_fwd_key k = *key;
+  cicp_mac_rowid_t id;
+  int i;
+
+  for( i = 0; i < n; ++i ) {
+    k.dst = key->dst;
+    cp_addr_apply_pfx(&k.dst, cand[i].dst_pref);
+    k.src = key->src;
+    cp_addr_apply_pfx(&k.src, cand[i].src_pref);
+    id = cp_fwd_find_row_iterate_from(fwd_table, &k, key, cand[i].hash1,
+                                      weight_check_match, &weight);
+    if( id != CICP_ROWID_BAD )
+      return id;
+  }
+  return CICP_ROWID_BAD;
+}
+
 cicp_mac_rowid_t
 __cp_fwd_find_match(struct cp_fwd_table* fwd_table, struct cp_fwd_key* key,
                     ci_uint32 weight,
@@ -80,6 +134,9 @@ __cp_fwd_find_match(struct cp_fwd_table* fwd_table, struct cp_fwd_key* key,
   ci_ipx_pfx_t src_prefs, zero_prefs = {};
   ci_uint8 src_pref, dst_pref;
   struct cp_fwd_key k = *key;
+  struct cp_fwd_find_cand cand[CP_FWD_FIND_BATCH];
+  cicp_mac_rowid_t id;
+  int n = 0, batch = 1;
 
   /* We must check entries with large destination prefixes (/32 for IPv4)
    * first to ensure we get correct PMTU information.  All other prefixes
@@ -92,19 +149,30 @@ __cp_fwd_find_match(struct cp_fwd_table* fwd_table, struct cp_fwd_key* key,
 
     src_prefs = src_prefs_in;
     while( cp_get_fwd_pfx_cmp(&src_prefs, &zero_prefs) ) {
-      cicp_mac_rowid_t id;
+      struct cp_fwd_row* fwd;
 
       src_pref = cp_get_largest_prefix(src_prefs);
       k.src = key->src;
       cp_addr_apply_pfx(&k.src, src_pref);
 
-      id = __cp_fwd_find_row(fwd_table, &k, key, weight);
-      if( id != CICP_ROWID_BAD )
-        return id;
+      cand[n].dst_pref = dst_pref;
+      cand[n].src_pref = src_pref;
+      cp_calc_fwd_hash(fwd_table, &k, &cand[n].hash1, NULL);
+      /* The probe reads [use] first and the key if the row is in use. */
+      fwd = cp_get_fwd_by_id(fwd_table, cand[n].hash1);
+      ci_prefetch(&fwd->key);
+      ci_prefetch(&fwd->use);
+      if( ++n == batch ) {
+        id = cp_fwd_find_cands(fwd_table, key, weight, cand, n);
+        if( id != CICP_ROWID_BAD )
+          return id;
+        n = 0;
+        batch = CP_FWD_FIND_BATCH;
+      }
       ci_fwd_pfx_next(&src_prefs, src_pref);
     }
     ci_fwd_pfx_next(&dst_prefs, dst_pref);
   }
 
-  return CICP_ROWID_BAD;
+  return cp_fwd_find_cands(fwd_table, key, weight, cand, n);
 }
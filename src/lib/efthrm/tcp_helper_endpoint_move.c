@@ -351,8 +351,11 @@ int efab_file_move_to_alien_stack(ci_private_t *priv, ci_netif *alien_ni,
     ci_ip_queue_init(&mid_ts->send);
     ci_ip_queue_init(&mid_ts->retrans);
     mid_ts->send_prequeue = OO_PP_ID_NULL;
-    new_ts->retrans_ptr = OO_PP_NULL;
+    mid_ts->retrans_ptr = OO_PP_NULL;
     mid_ts->tmpl_head = OO_PP_NULL;
+    /* The old socket's send magazine is released when it is freed. */
+    mid_ts->tx_mag.n = 0;
+    mid_ts->tx_mag.pkts = OO_PP_NULL;
     oo_atomic_set(&mid_ts->send_prequeue_in, 0);
 
     *new_ts = *mid_ts;
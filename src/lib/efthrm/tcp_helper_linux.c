@@ -16,6 +16,7 @@
 #include <onload/linux_onload_internal.h>
 #include <onload/tcp_helper_endpoint.h>
 #include <onload/tcp_poll.h>
+#include <onload/sleep.h>
 #include <linux/fs.h>
 #include <linux/spinlock.h>
 #include <driver/linux_affinity/autocompat.h>
@@ -1290,6 +1291,9 @@ static void efab_os_wakeup_event(tcp_helper_endpoint_t *ep,
     if( wq_active )
       CITP_STATS_NETIF_INC(&ep->thr->netif, sock_wakes_tx_os);
   }
+  ci_mb();
+  ci_netif_sock_ready_set(&ep->thr->netif, &s->b,
+                          CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX);
   ci_waitable_wakeup_all(&ep->waitq);
 
   /* Epoll3 support: */
@@ -174,6 +174,12 @@ efab_tcp_helper_drop_os_socket(tcp_helper_resource_t* trs,
 static void
 oo_inject_packets_kernel(tcp_helper_resource_t* trs, int sync);
 
+static int
+efab_tcp_helper_prealloc_bufs(tcp_helper_resource_t* trs, int n_sets);
+
+static int
+tcp_helper_init_pkt_sets(tcp_helper_resource_t* trs);
+
 
 /*----------------------------------------------------------------------------
  *
@@ -1959,6 +1965,11 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   int i, sz, rc, no_table_entries, no_active_wild_pools;
   int no_active_wild_table_entries;
   int no_seq_table_entries;
+  int no_synrecv_table_entries;
+  ci_uint32 no_blog_entries;
+  ci_uint32 no_ssnap_sock_entries;
+  ci_uint32 no_tx_ts_ring_entries;
+  ci_uint32 no_sock_ready_words;
   unsigned vi_state_bytes;
 #if CI_CFG_PIO
   unsigned pio_bufs_ofs = 0;
@@ -1995,6 +2006,28 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
     no_seq_table_entries = 0;
   }
 
+  /* Every syn-recv state in the stack has an entry in the synrecv table.
+   * Keep it at most half full so that probe sequences stay short. */
+  no_synrecv_table_entries = 1u << ci_log2_ge(NI_OPTS(ni).tcp_synrecv_max * 2,
+                                              4);
+
+  no_blog_entries = CI_MIN(NI_OPTS(ni).blog_entries,
+                           (ci_uint32) CI_CFG_BLOG_ENTRIES_MAX);
+  if( no_blog_entries != 0 )
+    no_blog_entries = 1u << ci_log2_ge(no_blog_entries, 0);
+
+  no_ssnap_sock_entries = CI_MIN(NI_OPTS(ni).ssnap_sock_log,
+                                 (ci_uint32) CI_CFG_SSNAP_SOCK_LOG_MAX);
+  if( no_ssnap_sock_entries != 0 )
+    no_ssnap_sock_entries = 1u << ci_log2_ge(no_ssnap_sock_entries, 0);
+
+  no_tx_ts_ring_entries = CI_MIN(NI_OPTS(ni).tx_ts_ring,
+                                 (ci_uint32) CI_CFG_TX_TS_RING_MAX);
+  if( no_tx_ts_ring_entries != 0 )
+    no_tx_ts_ring_entries = 1u << ci_log2_ge(no_tx_ts_ring_entries, 0);
+
+  no_sock_ready_words = CI_ROUND_UP(NI_OPTS(ni).max_ep_bufs, 32) / 32;
+
   /* pkt_sets_n should be zeroed before possible NIC reset */
   if( NI_OPTS(ni).max_packets > max_packets_per_stack ) {
     OO_DEBUG_ERR(ci_log("WARNING: EF_MAX_PACKETS reduced from %d to %d due to "
@@ -2062,6 +2095,18 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
         no_active_wild_pools;
   sz = CI_ROUND_UP(sz, __alignof__(ci_tcp_prev_seq_t));
   sz += sizeof(ci_tcp_prev_seq_t) * no_seq_table_entries;
+  sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+  sz += sizeof(ci_tcp_synrecv_table_entry) * no_synrecv_table_entries;
+  sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+  sz += sizeof(ci_netif_blog_rec) * no_blog_entries;
+  sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+  if( no_ssnap_sock_entries != 0 )
+    sz += sizeof(ci_netif_ssnap) +
+          sizeof(ci_netif_ssnap_sock) * no_ssnap_sock_entries;
+  sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+  sz += sizeof(oo_tx_timestamp) * no_tx_ts_ring_entries;
+  sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+  sz += sizeof(ci_uint32) * 2 * no_sock_ready_words;
   sz = CI_ROUND_UP(sz, __alignof__(struct oo_deferred_pkt));
   sz += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
   sz = CI_ROUND_UP(sz, __alignof__(ci_netif_filter_table));
@@ -2152,8 +2197,37 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
                                   __alignof__(ci_tcp_prev_seq_t));
   ns->seq_table_entries_n = no_seq_table_entries;
 
-  ns->deferred_pkts_ofs = ns->seq_table_ofs +
+  ns->synrecv_table_ofs = ns->seq_table_ofs +
                           sizeof(ci_tcp_prev_seq_t) * ns->seq_table_entries_n;
+  ns->synrecv_table_ofs = CI_ROUND_UP(ns->synrecv_table_ofs,
+                                      CI_CACHE_LINE_SIZE);
+  ns->synrecv_table_entries_n = no_synrecv_table_entries;
+
+  ns->blog_ofs = ns->synrecv_table_ofs +
+                 sizeof(ci_tcp_synrecv_table_entry) *
+                 ns->synrecv_table_entries_n;
+  ns->blog_ofs = CI_ROUND_UP(ns->blog_ofs, CI_CACHE_LINE_SIZE);
+  ns->blog_entries_n = no_blog_entries;
+
+  ns->ssnap_ofs = ns->blog_ofs +
+                  sizeof(ci_netif_blog_rec) * ns->blog_entries_n;
+  ns->ssnap_ofs = CI_ROUND_UP(ns->ssnap_ofs, CI_CACHE_LINE_SIZE);
+  ns->ssnap_sock_log_n = no_ssnap_sock_entries;
+
+  ns->tx_ts_ring_ofs = ns->ssnap_ofs;
+  if( ns->ssnap_sock_log_n != 0 )
+    ns->tx_ts_ring_ofs += sizeof(ci_netif_ssnap) +
+                          sizeof(ci_netif_ssnap_sock) * ns->ssnap_sock_log_n;
+  ns->tx_ts_ring_ofs = CI_ROUND_UP(ns->tx_ts_ring_ofs, CI_CACHE_LINE_SIZE);
+  ns->tx_ts_ring_n = ni->tx_ts_ring_n = no_tx_ts_ring_entries;
+
+  ns->sock_ready_ofs = ns->tx_ts_ring_ofs +
+                       sizeof(oo_tx_timestamp) * ns->tx_ts_ring_n;
+  ns->sock_ready_ofs = CI_ROUND_UP(ns->sock_ready_ofs, CI_CACHE_LINE_SIZE);
+  ns->sock_ready_words = ni->sock_ready_words = no_sock_ready_words;
+
+  ns->deferred_pkts_ofs = ns->sock_ready_ofs +
+                          sizeof(ci_uint32) * 2 * ns->sock_ready_words;
   ns->deferred_pkts_ofs = CI_ROUND_UP(ns->deferred_pkts_ofs,
                                       __alignof__(struct oo_deferred_pkt));
 
@@ -2177,6 +2251,11 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ni->packets = (void*) ((char*) ns + ns->buf_ofs);
   ni->active_wild_table = (void*) ((char*) ns + ns->active_wild_ofs);
   ni->seq_table = (void*) ((char*) ns + ns->seq_table_ofs);
+  ni->synrecv_table = (void*) ((char*) ns + ns->synrecv_table_ofs);
+  ni->blog = (void*) ((char*) ns + ns->blog_ofs);
+  ni->ssnap = (void*) ((char*) ns + ns->ssnap_ofs);
+  ni->tx_ts_ring = (void*) ((char*) ns + ns->tx_ts_ring_ofs);
+  ni->sock_ready = (void*) ((char*) ns + ns->sock_ready_ofs);
   ni->deferred_pkts = (void*) ((char*) ns + ns->deferred_pkts_ofs);
   ni->filter_table = (void*) ((char*) ns + ns->table_ofs);
   ni->filter_table_ext = (void*) ((char*) ns + ns->table_ext_ofs);
@@ -2188,16 +2267,20 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ni->packets->sets_max = ni->pkt_sets_max;
   ni->packets->sets_n = 0;
   ni->packets->n_pkts_allocated = 0;
+  for( i = 0; i < OO_PKTSET_BUCKETS; ++i )
+    ni->packets->bucket_head[i] = -1;
 
   /* Initialize the free list of synrecv/aux bufs */
   ni->state->free_aux_mem = OO_P_NULL;
   ni->state->n_free_aux_bufs = 0;
   memset(ni->state->n_aux_bufs, 0, sizeof(ni->state->n_aux_bufs));
   ns->max_aux_bufs[CI_TCP_AUX_TYPE_SYNRECV] = ni->opts.tcp_synrecv_max;
-  ns->max_aux_bufs[CI_TCP_AUX_TYPE_BUCKET] = ni->opts.max_ep_bufs;
   ns->max_aux_bufs[CI_TCP_AUX_TYPE_EPOLL] = ni->opts.max_ep_bufs;
   ns->max_aux_bufs[CI_TCP_AUX_TYPE_PMTUS] = ni->opts.max_ep_bufs;
 
+  for( i = 0; i < ns->synrecv_table_entries_n; ++i )
+    ni->synrecv_table[i].tsr = OO_P_NULL;
+
   /* The shared netif-state buffer and EP buffers are part of the mem mmap */
   trs->mem_mmap_bytes += ns->netif_mmap_bytes;
   OO_DEBUG_MEMSIZE(ci_log(
@@ -3571,6 +3654,14 @@ tcp_helper_alloc_ephem_table(ci_uint32 min_entries, ci_uint32* entries_out)
 }
 
 
+static ci_uint32 thr_frc_usec(ci_uint64 from, ci_uint64 to)
+{
+  if( oo_timesync_cpu_khz == 0 )
+    return 0;
+  return (ci_uint32) ((to - from) * 1000 / oo_timesync_cpu_khz);
+}
+
+
 int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
                         const ci_netif_config_opts* opts,
                         int ifindices_len, tcp_helper_cluster_t* thc,
@@ -3582,11 +3673,15 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   int rc, intf_i;
   ci_netif* ni;
   int hw_resources_allocated = 0;
+  ci_uint64 frc_start, frc_hw, frc_eps, frc_pkts, frc_fill, frc_end;
+  int n_prealloc_sets = 0;
 
   ci_assert(alloc);
   ci_assert(rs_out);
   ci_assert(ifindices_len <= 0);
 
+  ci_frc64(&frc_start);
+
   alloc->in_name[CI_CFG_STACK_NAME_LEN] = '\0';
 
   if( (opts->packet_buffer_mode & CITP_PKTBUF_MODE_PHYS) &&
@@ -3782,6 +3877,7 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   ci_assert( ! (alloc->in_flags & CI_NETIF_FLAG_IN_DL_CONTEXT) );
   rc = allocate_netif_hw_resources(alloc, thc, rs);
   if( rc < 0 ) goto fail6;
+  ci_frc64(&frc_hw);
 
   if( inject_kernel_gid != -2 && 
       ( inject_kernel_gid == -1 || inject_kernel_gid == ci_getgid() ) ) {
@@ -3818,6 +3914,7 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   tcp_helper_init_max_mss(rs);
 
   efab_tcp_helper_more_socks(rs);
+  ci_frc64(&frc_eps);
 
 #ifdef ONLOAD_OFE
   tcp_helper_rm_alloc_ofe(rs);
@@ -3825,9 +3922,17 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
 
   CI_MAGIC_SET(ni, NETIF_MAGIC);
 
+  /* Allocate the packet sets that the RX ring fill and prefault will need
+   * up front, in parallel.  Anything not allocated here is allocated one
+   * set at a time as usual. */
+  if( NI_OPTS(ni).stack_init_threads > 1 )
+    n_prealloc_sets = efab_tcp_helper_prealloc_bufs(rs,
+                                                tcp_helper_init_pkt_sets(rs));
+  ci_frc64(&frc_pkts);
 
   if( (rc = ci_netif_init_fill_rx_rings(ni)) != 0 )
     goto fail9;
+  ci_frc64(&frc_fill);
 
   rs->tproxy_ifindex = NULL;
   /* When requested set up tproxy mode on selected interface(s) */
@@ -3955,6 +4060,16 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   if( NI_OPTS(ni).int_driven )
     tcp_helper_request_wakeup(netif2tcp_helper_resource(ni));
 
+  ci_frc64(&frc_end);
+  ni->state->init_timing.hw_resources = thr_frc_usec(frc_start, frc_hw);
+  ni->state->init_timing.ep_table = thr_frc_usec(frc_hw, frc_eps);
+  ni->state->init_timing.pkt_alloc = thr_frc_usec(frc_eps, frc_pkts);
+  ni->state->init_timing.rx_fill = thr_frc_usec(frc_pkts, frc_fill);
+  ni->state->init_timing.kernel_total = thr_frc_usec(frc_start, frc_end);
+  ni->state->init_timing.prefault = 0;
+  ni->state->init_timing.pkt_sets = n_prealloc_sets;
+  ni->state->init_timing.threads = NI_OPTS(ni).stack_init_threads;
+
   efab_tcp_helper_netif_unlock(rs, 0);
 
   efab_notify_stacklist_change(rs);
@@ -5578,26 +5693,13 @@ efab_tcp_helper_no_more_bufs(tcp_helper_resource_t* trs)
 }
 
 
-static int 
-efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
-                               struct oo_iobufset** all_out,
-                               struct oo_buffer_pages** pages_out,
-                               uint64_t* hw_addrs)
+/* Returns the flags with which to allocate the pages of a packet set.
+ * Huge pages are only requested when called in the context of a process
+ * that may use them. */
+static int efab_tcp_helper_iobufset_flags(tcp_helper_resource_t* trs)
 {
   ci_netif* ni = &trs->netif;
-  int rc, intf_i;
-  struct oo_buffer_pages *pages;
   int flags;
-  struct efrm_pd *first_pd = NULL;
-  struct oo_iobufset *first_iobuf = NULL;
-
-  OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
-    all_out[intf_i] = NULL;
-  *pages_out = NULL;
-
-#ifdef OO_DO_HUGE_PAGES
-  BUILD_BUG_ON(HW_PAGES_PER_SET_S != HPAGE_SHIFT - PAGE_SHIFT);
-#endif
 
   flags = NI_OPTS(ni).compound_pages << OO_IOBUFSET_FLAG_COMPOUND_SHIFT;
 #if CI_CFG_PKTS_AS_HUGE_PAGES
@@ -5623,7 +5725,22 @@ efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
 #endif
   }
 #endif
-  rc = oo_iobufset_pages_alloc(HW_PAGES_PER_SET_S, &flags, &pages);
+  return flags;
+}
+
+
+static int
+efab_tcp_helper_iobufset_pages_alloc(tcp_helper_resource_t* trs, int flags,
+                                     struct oo_buffer_pages** pages_out)
+{
+  ci_netif* ni = &trs->netif;
+  int rc;
+
+#ifdef OO_DO_HUGE_PAGES
+  BUILD_BUG_ON(HW_PAGES_PER_SET_S != HPAGE_SHIFT - PAGE_SHIFT);
+#endif
+
+  rc = oo_iobufset_pages_alloc(HW_PAGES_PER_SET_S, &flags, pages_out);
   if( rc != 0 )
     return rc;
 #if CI_CFG_PKTS_AS_HUGE_PAGES
@@ -5634,7 +5751,28 @@ efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
              ni->state->pretty_name);
       ni->flags |= CI_NETIF_FLAG_HUGE_PAGES_FAILED;
     }
+#else
+  (void) ni;
 #endif
+  return 0;
+}
+
+
+/* DMA-maps [pages] for each of the stack's interfaces.  On failure the
+ * reference to [pages] is dropped. */
+static int
+efab_tcp_helper_iobufset_map(tcp_helper_resource_t* trs,
+                             struct oo_buffer_pages* pages,
+                             struct oo_iobufset** all_out,
+                             uint64_t* hw_addrs)
+{
+  ci_netif* ni = &trs->netif;
+  int rc, intf_i;
+  struct efrm_pd *first_pd = NULL;
+  struct oo_iobufset *first_iobuf = NULL;
+
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
+    all_out[intf_i] = NULL;
 
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
     struct efrm_pd *pd = efrm_vi_get_pd(trs->nic[intf_i].thn_vi_rs);
@@ -5666,79 +5804,51 @@ efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
     }
   }
 
-  *pages_out = pages;
   return 0;
 }
 
 
-int
-efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
+static int 
+efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
+                               struct oo_iobufset** all_out,
+                               struct oo_buffer_pages** pages_out,
+                               uint64_t* hw_addrs)
 {
-  struct oo_iobufset* iobrs[CI_CFG_MAX_INTERFACES];
-  struct oo_buffer_pages* pages;
-  uint64_t *hw_addrs;
-  ci_irqlock_state_t lock_flags;
-  ci_netif* ni = &trs->netif;
-  int i, rc, bufset_id, intf_i;
+  struct oo_buffer_pages *pages;
+  int rc;
 
-  ci_assert(ci_netif_is_locked(ni));
+  *pages_out = NULL;
 
-  /* efab_tcp_helper_iobufset_alloc() checks for pkt_sets_max, but we do
-   * not want to go in efab_tcp_helper_no_more_bufs() in this case, so
-   * let's exit early. */
-  if( ni->pkt_sets_n == ni->pkt_sets_max )
-    return -ENOSPC;
+  rc = efab_tcp_helper_iobufset_pages_alloc(trs,
+                                           efab_tcp_helper_iobufset_flags(trs),
+                                           &pages);
+  if( rc != 0 )
+    return rc;
 
-  if( (ni->flags & (CI_NETIF_FLAG_IN_DL_CONTEXT |
-                    CI_NETIF_FLAG_AVOID_ATOMIC_ALLOCATION) ) ==
-       (CI_NETIF_FLAG_IN_DL_CONTEXT |
-        CI_NETIF_FLAG_AVOID_ATOMIC_ALLOCATION) ) {
-    ef_eplock_holder_set_flag(&ni->state->lock,
-                              CI_EPLOCK_NETIF_NEED_PKT_SET);
-    return -EBUSY;
-  }
+  rc = efab_tcp_helper_iobufset_map(trs, pages, all_out, hw_addrs);
+  if( rc != 0 )
+    return rc;
 
-  hw_addrs = ci_alloc(sizeof(uint64_t) * (1 << HW_PAGES_PER_SET_S) *
-                      CI_CFG_MAX_INTERFACES);
-  if( hw_addrs == NULL ) {
-    ci_log("%s: [%d] out of memory", __func__, trs->id);
-    return -ENOMEM;
-  }
+  *pages_out = pages;
+  return 0;
+}
 
-  rc = efab_tcp_helper_iobufset_alloc(trs, iobrs, &pages, hw_addrs);
-  if(CI_UNLIKELY( rc < 0 )) {
-    /* With highly fragmented memory, iobufset_alloc may fail in
-     * atomic context but succeed later in non-atomic context.
-     * We should somehow differentiate temporary failures (atomic
-     * allocation failure) and permanent failure (out of buffer table
-     * entries).
-     */
-    if( rc == -ENOSPC )
-      efab_tcp_helper_no_more_bufs(trs);
-    else {
-      ++ni->state->stats.bufset_alloc_fails;
-      NI_LOG(ni, RESOURCE_WARNINGS,
-             FN_FMT "Failed to allocate packet buffers (%d)",
-             FN_PRI_ARGS(&trs->netif), rc);
 
-      /* We've got ENOMEM.  If we are in atomic context, it is possible
-       * that memory is available in non-atomic mode.
-       * efab_tcp_helper_netif_lock_callback() will kick off packet
-       * allocation via workqueue without
-       * CI_NETIF_FLAG_AVOID_ATOMIC_ALLOCATION flag check, so we'll
-       * retry from non-atomic context immediately.
-       *
-       * For all other errors (ENOMEM & non-atomic or other rc values),
-       * there is no obvious benefit in re-trying the same operation
-       * immediately. */
-      if( rc == -ENOMEM && ni->flags & CI_NETIF_FLAG_IN_DL_CONTEXT ) {
-        ef_eplock_holder_set_flag(&ni->state->lock,
-                                  CI_EPLOCK_NETIF_NEED_PKT_SET);
-      }
-    }
-    ci_free(hw_addrs);
-    return rc;
-  }
+/* Adds a packet set allocated by efab_tcp_helper_iobufset_alloc() to the
+ * stack.  On failure the set is released.  The caller retains ownership of
+ * [hw_addrs]. */
+static int
+efab_tcp_helper_install_bufs(tcp_helper_resource_t* trs,
+                             struct oo_iobufset** iobrs,
+                             struct oo_buffer_pages* pages,
+                             const uint64_t* hw_addrs)
+{
+  ci_irqlock_state_t lock_flags;
+  ci_netif* ni = &trs->netif;
+  int i, bufset_id, intf_i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
   /* check we get the size we are expecting */
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
     ci_assert(iobrs[intf_i] != NULL);
@@ -5753,7 +5863,6 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
     OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
       oo_iobufset_resource_release(iobrs[intf_i], 0);
     oo_iobufset_pages_release(pages);
-    ci_free(hw_addrs);
     return -ENOSPC;
   }
   bufset_id = ni->pkt_sets_n;
@@ -5782,6 +5891,7 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
 
   ni->packets->set[bufset_id].free = OO_PP_NULL;
   ni->packets->set[bufset_id].n_free = PKTS_PER_SET;
+  ni->packets->set[bufset_id].bucket = -1;
 #ifdef OO_DO_HUGE_PAGES
   ni->packets->set[bufset_id].shm_id = oo_iobufset_get_shmid(pages);
 #else
@@ -5814,7 +5924,7 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
     pkt->next = ni->packets->set[bufset_id].free;
     ni->packets->set[bufset_id].free = OO_PKT_P(pkt);
   }
-  ci_free(hw_addrs);
+  ci_netif_pktset_rebucket(ni, bufset_id);
 
   trs->netif.state->packet_alloc_numa_nodes |= 1 << numa_node_id();
   CHECK_FREEPKTS(ni);
@@ -5822,6 +5932,247 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
 }
 
 
+int
+efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
+{
+  struct oo_iobufset* iobrs[CI_CFG_MAX_INTERFACES];
+  struct oo_buffer_pages* pages;
+  uint64_t *hw_addrs;
+  ci_netif* ni = &trs->netif;
+  int rc;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  /* efab_tcp_helper_iobufset_alloc() checks for pkt_sets_max, but we do
+   * not want to go in efab_tcp_helper_no_more_bufs() in this case, so
+   * let's exit early. */
+  if( ni->pkt_sets_n == ni->pkt_sets_max )
+    return -ENOSPC;
+
+  if( (ni->flags & (CI_NETIF_FLAG_IN_DL_CONTEXT |
+                    CI_NETIF_FLAG_AVOID_ATOMIC_ALLOCATION) ) ==
+       (CI_NETIF_FLAG_IN_DL_CONTEXT |
+        CI_NETIF_FLAG_AVOID_ATOMIC_ALLOCATION) ) {
+    ef_eplock_holder_set_flag(&ni->state->lock,
+                              CI_EPLOCK_NETIF_NEED_PKT_SET);
+    return -EBUSY;
+  }
+
+  hw_addrs = ci_alloc(sizeof(uint64_t) * (1 << HW_PAGES_PER_SET_S) *
+                      CI_CFG_MAX_INTERFACES);
+  if( hw_addrs == NULL ) {
+    ci_log("%s: [%d] out of memory", __func__, trs->id);
+    return -ENOMEM;
+  }
+
+  rc = efab_tcp_helper_iobufset_alloc(trs, iobrs, &pages, hw_addrs);
+  if(CI_UNLIKELY( rc < 0 )) {
+    /* With highly fragmented memory, iobufset_alloc may fail in
+     * atomic context but succeed later in non-atomic context.
+     * We should somehow differentiate temporary failures (atomic
+     * allocation failure) and permanent failure (out of buffer table
+     * entries).
+     */
+    if( rc == -ENOSPC )
+      efab_tcp_helper_no_more_bufs(trs);
+    else {
+      ++ni->state->stats.bufset_alloc_fails;
+      NI_LOG(ni, RESOURCE_WARNINGS,
+             FN_FMT "Failed to allocate packet buffers (%d)",
+             FN_PRI_ARGS(&trs->netif), rc);
+
+      /* We've got ENOMEM.  If we are in atomic context, it is possible
+       * that memory is available in non-atomic mode.
+       * efab_tcp_helper_netif_lock_callback() will kick off packet
+       * allocation via workqueue without
+       * CI_NETIF_FLAG_AVOID_ATOMIC_ALLOCATION flag check, so we'll
+       * retry from non-atomic context immediately.
+       *
+       * For all other errors (ENOMEM & non-atomic or other rc values),
+       * there is no obvious benefit in re-trying the same operation
+       * immediately. */
+      if( rc == -ENOMEM && ni->flags & CI_NETIF_FLAG_IN_DL_CONTEXT ) {
+        ef_eplock_holder_set_flag(&ni->state->lock,
+                                  CI_EPLOCK_NETIF_NEED_PKT_SET);
+      }
+    }
+    ci_free(hw_addrs);
+    return rc;
+  }
+  rc = efab_tcp_helper_install_bufs(trs, iobrs, pages, hw_addrs);
+  ci_free(hw_addrs);
+  return rc;
+}
+
+/* Packet sets allocated and DMA-mapped by a worker of
+ * efab_tcp_helper_prealloc_bufs(). */
+struct thr_prealloc_set {
+  struct oo_iobufset* iobrs[CI_CFG_MAX_INTERFACES];
+  struct oo_buffer_pages* pages;
+  uint64_t* hw_addrs;
+  int rc;
+};
+
+struct thr_prealloc_worker {
+  struct work_struct work;
+  tcp_helper_resource_t* trs;
+  struct thr_prealloc_set* sets;
+  /* This worker handles sets [first], [first + stride], ... */
+  int first;
+  int stride;
+  int n_sets;
+  int flags;
+};
+
+/* Number of packet sets allocated per round of efab_tcp_helper_prealloc_bufs()
+ * which bounds the size of the DMA address arrays held at once. */
+#define THR_PREALLOC_SETS_PER_ROUND  64
+
+
+static void thr_prealloc_work(struct work_struct* data)
+{
+  struct thr_prealloc_worker* w = container_of(data,
+                                               struct thr_prealloc_worker,
+                                               work);
+  struct thr_prealloc_set* set;
+  int i, flags;
+
+  for( i = w->first; i < w->n_sets; i += w->stride ) {
+    set = &w->sets[i];
+    if( set->pages == NULL ) {
+      flags = w->flags;
+      set->rc = oo_iobufset_pages_alloc(HW_PAGES_PER_SET_S, &flags,
+                                        &set->pages);
+      if( set->rc != 0 ) {
+        set->pages = NULL;
+        break;
+      }
+    }
+    set->rc = efab_tcp_helper_iobufset_map(w->trs, set->pages, set->iobrs,
+                                           set->hw_addrs);
+    if( set->rc != 0 ) {
+      set->pages = NULL;
+      break;
+    }
+  }
+  /* Sets this worker did not get to are left with rc != 0. */
+}
+
+
+/* Adds up to [n_sets] packet sets to a stack that is being created.  The
+ * page allocation and DMA mapping of the sets, which dominate the cost of
+ * large stacks, are spread over EF_STACK_INIT_THREADS workers.  The sets
+ * are then installed serially.  Returns the number of sets added; failures
+ * are left for the serial allocation path to report. */
+static int
+efab_tcp_helper_prealloc_bufs(tcp_helper_resource_t* trs, int n_sets)
+{
+  struct thr_prealloc_worker* workers;
+  struct thr_prealloc_set* sets;
+  uint64_t* hw_addrs;
+  ci_netif* ni = &trs->netif;
+  size_t hw_addrs_per_set = (1 << HW_PAGES_PER_SET_S) * CI_CFG_MAX_INTERFACES;
+  int max_workers = NI_OPTS(ni).stack_init_threads;
+  int i, n, n_want, n_workers, n_installed, flags, n_added = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(!in_atomic());
+
+  n_sets = CI_MIN(n_sets, ni->pkt_sets_max - ni->pkt_sets_n);
+  if( n_sets <= 0 )
+    return 0;
+
+  sets = ci_alloc(sizeof(*sets) * THR_PREALLOC_SETS_PER_ROUND);
+  workers = ci_alloc(sizeof(*workers) * max_workers);
+  hw_addrs = ci_vmalloc(sizeof(uint64_t) * hw_addrs_per_set *
+                        THR_PREALLOC_SETS_PER_ROUND);
+  if( sets == NULL || workers == NULL || hw_addrs == NULL )
+    goto out;
+
+  while( n_added < n_sets ) {
+    flags = efab_tcp_helper_iobufset_flags(trs);
+    n_want = CI_MIN(n_sets - n_added, THR_PREALLOC_SETS_PER_ROUND);
+    memset(sets, 0, sizeof(*sets) * n_want);
+    for( n = 0; n < n_want; ++n ) {
+      sets[n].hw_addrs = hw_addrs + hw_addrs_per_set * n;
+      sets[n].rc = -EAGAIN;
+#if CI_CFG_PKTS_AS_HUGE_PAGES
+      /* Huge pages come from the IPC namespace of the creating process,
+       * which the workers do not run in, so they are allocated here. */
+      if( (flags & (OO_IOBUFSET_FLAG_HUGE_PAGE_TRY |
+                    OO_IOBUFSET_FLAG_HUGE_PAGE_FORCE)) &&
+          efab_tcp_helper_iobufset_pages_alloc(trs,
+                                          efab_tcp_helper_iobufset_flags(trs),
+                                          &sets[n].pages) != 0 )
+        break;
+#endif
+    }
+
+    n_workers = CI_MIN(max_workers, n);
+    for( i = 0; i < n_workers; ++i ) {
+      workers[i].trs = trs;
+      workers[i].sets = sets;
+      workers[i].first = i;
+      workers[i].stride = n_workers;
+      workers[i].n_sets = n;
+      workers[i].flags = flags;
+      INIT_WORK(&workers[i].work, thr_prealloc_work);
+      queue_work(trs->wq, &workers[i].work);
+    }
+    for( i = 0; i < n_workers; ++i )
+      flush_work(&workers[i].work);
+
+    n_installed = 0;
+    for( i = 0; i < n; ++i ) {
+      if( sets[i].rc == 0 ) {
+        if( efab_tcp_helper_install_bufs(trs, sets[i].iobrs, sets[i].pages,
+                                         sets[i].hw_addrs) == 0 )
+          ++n_installed;
+      }
+      else if( sets[i].pages != NULL ) {
+        /* Allocated here but not reached by a worker. */
+        oo_iobufset_pages_release(sets[i].pages);
+      }
+    }
+    n_added += n_installed;
+    if( n_installed < n_want )
+      break;
+  }
+
+ out:
+  if( hw_addrs != NULL )
+    ci_vfree(hw_addrs);
+  if( workers != NULL )
+    ci_free(workers);
+  if( sets != NULL )
+    ci_free(sets);
+  return n_added;
+}
+
+
+/* Returns the number of packet sets that creation of a stack will
+ * allocate: enough to fill the RX rings and the free pool, or all of
+ * EF_MAX_PACKETS with EF_PREALLOC_PACKETS, and enough for the process to
+ * prefault EF_PREFAULT_PACKETS. */
+static int tcp_helper_init_pkt_sets(tcp_helper_resource_t* trs)
+{
+  ci_netif* ni = &trs->netif;
+  int intf_i, n_pkts;
+
+  if( NI_OPTS(ni).prealloc_packets ) {
+    n_pkts = NI_OPTS(ni).max_packets;
+  }
+  else {
+    n_pkts = NI_OPTS(ni).min_free_packets;
+    OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
+      n_pkts += NI_OPTS(ni).rxq_limit;
+    n_pkts = CI_MAX(n_pkts, NI_OPTS(ni).prefault_packets);
+    n_pkts = CI_MIN(n_pkts, NI_OPTS(ni).max_packets);
+  }
+  return CI_MIN((n_pkts + PKTS_PER_SET - 1) / PKTS_PER_SET,
+                ni->pkt_sets_max);
+}
+
 static unsigned long
 tcp_helper_rm_nopage_iobuf(tcp_helper_resource_t* trs, void* opaque,
                            unsigned long offset)
@@ -6816,7 +7167,10 @@ void tcp_helper_endpoint_wakeup(tcp_helper_resource_t* thr,
 {
   citp_waitable* w = SP_TO_WAITABLE(&thr->netif, ep->id);
   int wq_active;
-  w->wake_request = 0;
+  /* Leave the CI_SB_FLAG_WAKE_FUTEX_MASK bits: threads waiting on the
+   * futex are woken from user level. */
+  ci_atomic32_and(&w->wake_request,
+                  ~(CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX));
   wq_active = ci_waitable_active(&ep->waitq);
   ci_waitable_wakeup_all(&ep->waitq);
   if( wq_active ) {
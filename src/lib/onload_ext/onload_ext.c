@@ -205,6 +205,12 @@ int onload_timestamping_request(int fd, unsigned flags)
   return -ENOSYS;
 }
 
+__attribute__((weak))
+int onload_tx_timestamps_read(int fd, struct onload_tx_timestamp* ts, int n)
+{
+  return -ENOSYS;
+}
+
 
 /**************************************************************************/
 
@@ -263,3 +269,40 @@ onload_socket_unicast_nonaccel(int domain, int type, int protocol)
   return socket(domain, type, protocol);
 }
 
+__attribute__((weak))
+int onload_ring_submit(struct onload_ring* ring)
+{
+  return -ENOSYS;
+}
+
+__attribute__((weak))
+int onload_socket_handle_get(int fd, struct onload_socket_handle** handle_out)
+{
+  return -ENOSYS;
+}
+
+__attribute__((weak))
+void onload_socket_handle_put(struct onload_socket_handle* handle)
+{
+}
+
+__attribute__((weak))
+ssize_t onload_socket_handle_send(struct onload_socket_handle* handle,
+                                  const void* buf, size_t len, int flags)
+{
+  return -ENOSYS;
+}
+
+__attribute__((weak))
+ssize_t onload_socket_handle_recv(struct onload_socket_handle* handle,
+                                  void* buf, size_t len, int flags)
+{
+  return -ENOSYS;
+}
+
+__attribute__((weak))
+int onload_socket_handle_poll(struct onload_socket_handle* handle,
+                              short events)
+{
+  return -ENOSYS;
+}
@@ -195,6 +195,9 @@ wrap( int, onload_ordered_epoll_wait, (int epfd, struct epoll_event *events,
 wrap(int, onload_timestamping_request, (int fd, unsigned flags),
      (fd, flags), -ENOSYS)
 
+wrap(int, onload_tx_timestamps_read,
+     (int fd, struct onload_tx_timestamp* ts, int n), (fd, ts, n), -ENOSYS)
+
 wrap(enum onload_delegated_send_rc,  onload_delegated_send_prepare,
      (int fd, int size, unsigned flags, struct onload_delegated_send* out),
      (fd, size, flags, out), ONLOAD_DELEGATED_SEND_RC_BAD_SOCKET)
@@ -221,3 +224,35 @@ wrap_with_fn(int, onload_socket_unicast_nonaccel,
              (int domain, int type, int protocol),
              (domain, type, protocol), socket)
 
+wrap(int, onload_ring_submit, (struct onload_ring* ring), (ring), -ENOSYS)
+
+wrap(int, onload_socket_handle_get,
+     (int fd, struct onload_socket_handle** handle_out),
+     (fd, handle_out), -ENOSYS)
+
+/* Returns void, so can't use wrap(). */
+void onload_socket_handle_put(struct onload_socket_handle* handle)
+{
+  static void (*p)(struct onload_socket_handle*);
+  if( p == NULL ) {
+    onload_ext_check_ver();
+    if( disabled || (p = dlsym(RTLD_NEXT, "onload_socket_handle_put")) == NULL )
+      p = (void*)(uintptr_t) 1;
+  }
+  if( (void*) p != (void*)(uintptr_t) 1 )
+    p(handle);
+}
+
+wrap(ssize_t, onload_socket_handle_send,
+     (struct onload_socket_handle* handle, const void* buf, size_t len,
+      int flags),
+     (handle, buf, len, flags), -ENOSYS)
+
+wrap(ssize_t, onload_socket_handle_recv,
+     (struct onload_socket_handle* handle, void* buf, size_t len, int flags),
+     (handle, buf, len, flags), -ENOSYS)
+
+wrap(int, onload_socket_handle_poll,
+     (struct onload_socket_handle* handle, short events),
+     (handle, events), -ENOSYS)
+
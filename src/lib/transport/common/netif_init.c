@@ -195,6 +195,7 @@ int citp_netif_by_id(ci_uint32 stack_id, ci_netif** out_ni, int locked)
   }
   __citp_add_netif(ni);
   ni->flags |= CI_NETIF_FLAGS_SHARED;
+  ci_atomic32_or(&ni->state->flags, CI_NETIF_FLAG_MULTI_PROCESS);
   citp_netif_init_ref(ni);
   citp_netif_ctor_hook(ni, 0);
 
@@ -430,6 +431,7 @@ int citp_netif_recreate_probed(ci_fd_t ul_sock_fd,
   ** process.  If they weren't shared they wouldn't exist to be restored.
   */
   ni->flags |= CI_NETIF_FLAGS_SHARED;
+  ci_atomic32_or(&ni->state->flags, CI_NETIF_FLAG_MULTI_PROCESS);
 
   /* We wouldn't be recreating this unless we had an endpoint to attach.
   ** We add the reference for the endpoint here to prevent a race
@@ -571,8 +573,10 @@ void __citp_netif_mark_all_shared(void)
   }
 
   /* Set shared flag on any netifs that haven't destructed above */
-  CI_DLLIST_FOR_EACH2(ci_netif, ni, link, &citp_active_netifs)
+  CI_DLLIST_FOR_EACH2(ci_netif, ni, link, &citp_active_netifs) {
     ni->flags |= CI_NETIF_FLAGS_SHARED;
+    ci_atomic32_or(&ni->state->flags, CI_NETIF_FLAG_MULTI_PROCESS);
+  }
 }
 
 
@@ -308,10 +308,12 @@ void ci_ip_cmsg_finish(struct cmsg_state* cmsg_state)
 
 /**
  * Fill in the msg ancillary data buffer with all control messages
- * according to cmsg_flags the user has set beforehand.
+ * according to cmsg_flags the user has set beforehand.  A non-zero
+ * [gso_size] adds the UDP_GRO control message for coalesced datagrams.
  */
 void ci_ip_cmsg_recv(ci_netif* ni, ci_udp_state* us, const ci_ip_pkt_fmt *pkt,
-                     struct msghdr *msg, int netif_locked, int *p_msg_flags)
+                     struct msghdr *msg, int netif_locked, int *p_msg_flags,
+                     int gso_size)
 {
   unsigned flags = us->s.cmsg_flags;
   struct cmsg_state cmsg_state;
@@ -357,6 +359,9 @@ void ci_ip_cmsg_recv(ci_netif* ni, ci_udp_state* us, const ci_ip_pkt_fmt *pkt,
     ip_cmsg_recv_timestamping(ni, pkt, us->s.timestamping_flags, &cmsg_state);
 #endif
 
+  if( gso_size != 0 )
+    ci_put_cmsg(&cmsg_state, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+
   ci_ip_cmsg_finish(&cmsg_state);
 }
 
@@ -368,8 +373,11 @@ void ci_ip_cmsg_recv(ci_netif* ni, ci_udp_state* us, const ci_ip_pkt_fmt *pkt,
  *
  * \param info_out    Must be a valid pointer. Contains a pointer to
  * struct in_pktinfo or struct in6_pktinfo.
+ * \param gso_size_out  Must be a valid pointer.  Set to the UDP_SEGMENT
+ * size if the user provided one, otherwise left unchanged.
  */
-int ci_ip_cmsg_send(const struct msghdr* msg, void** info_out)
+int ci_ip_cmsg_send(const struct msghdr* msg, void** info_out,
+                    int* gso_size_out)
 {
   struct cmsghdr *cmsg;
 
@@ -408,6 +416,15 @@ int ci_ip_cmsg_send(const struct msghdr* msg, void** info_out)
       else
         return -EINVAL;
     }
+    else if( cmsg->cmsg_level == SOL_UDP ) {
+      if( cmsg->cmsg_type == UDP_SEGMENT ) {
+        if( cmsg->cmsg_len != CMSG_LEN(sizeof(ci_uint16)) )
+          return -EINVAL;
+        *gso_size_out = *(ci_uint16*) CMSG_DATA(cmsg);
+      }
+      else
+        return -EINVAL;
+    }
   }
 
   return 0;
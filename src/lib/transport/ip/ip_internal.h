@@ -381,6 +381,18 @@ ci_tcp_ep_mcast_add_del(ci_netif*         ni,
 # define SO_REUSEPORT   15
 #endif
 
+#ifndef SOL_UDP
+# define SOL_UDP        17
+#endif
+
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT    103
+#endif
+
+#ifndef UDP_GRO
+# define UDP_GRO        104
+#endif
+
 #if CI_CFG_TIMESTAMPING
 /* The following value needs to match its counterpart
  * in kernel headers.
@@ -32,6 +32,7 @@ LIB_SRCS	:=		\
 		netif_stats.c	\
 		tcp_send.c	\
 		tcp_recv.c	\
+		tcp_loop_ring.c	\
 		ipid.c		\
 		netif_debug.c	\
 		tcp_debug.c	\
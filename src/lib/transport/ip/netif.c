@@ -379,6 +379,59 @@ static int ci_netif_try_to_reap_udp_recv_q(ci_netif* ni,
 }
 
 
+void ci_netif_rx_recycle_drain(ci_netif* ni)
+{
+  /* Return the buffers kept aside for reposting (EF_RX_RECYCLE) to the
+   * free pool.
+   */
+  ci_netif_state_nic_t* nsn;
+  ci_ip_pkt_fmt* pkt;
+  int intf_i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    nsn = &ni->state->nic[intf_i];
+    if( nsn->rx_recycle_n == 0 )
+      continue;
+    CITP_STATS_NETIF_ADD(ni, rx_recycle_drained, nsn->rx_recycle_n);
+    while( OO_PP_NOT_NULL(nsn->rx_recycle) ) {
+      pkt = PKT_CHK(ni, nsn->rx_recycle);
+      nsn->rx_recycle = pkt->next;
+      ci_assert_equal(pkt->refcount, 0);
+      ci_assert(pkt->flags & CI_PKT_FLAG_RX);
+      pkt->flags &= ~CI_PKT_FLAG_RX;
+      --ni->state->n_rx_pkts;
+      ci_netif_pkt_put(ni, pkt);
+    }
+    nsn->rx_recycle_n = 0;
+  }
+}
+
+
+void ci_netif_tx_mag_drain(ci_netif* ni)
+{
+  /* Return the buffers reserved for sendmsg() (EF_TCP_SEND_MAGAZINE) to
+   * the free pool.  They are not refilled while the stack is under memory
+   * pressure.
+   */
+  citp_waitable_obj* wo;
+  unsigned id;
+  int n = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( NI_OPTS(ni).tcp_send_magazine == 0 )
+    return;
+  for( id = 0; id < ni->state->n_ep_bufs; ++id ) {
+    wo = ID_TO_WAITABLE_OBJ(ni, id);
+    if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
+      n += ci_tcp_tx_mag_reclaim(ni, &wo->tcp);
+  }
+  CITP_STATS_NETIF_ADD(ni, tcp_tx_mag_drained, n);
+}
+
+
 void ci_netif_try_to_reap(ci_netif* ni, int stop_once_freed_n)
 {
   /* Look for packet buffers that can be reaped. */
@@ -391,6 +444,14 @@ void ci_netif_try_to_reap(ci_netif* ni, int stop_once_freed_n)
   int reap_harder = ni->packets->sets_n == ni->packets->sets_max
       || ni->state->mem_pressure;
 
+  /* Buffers kept aside for reposting are the cheapest to get back.  Those
+   * reserved for sendmsg() take a walk over the sockets, so are only taken
+   * back under memory pressure.
+   */
+  ci_netif_rx_recycle_drain(ni);
+  if( ni->state->mem_pressure )
+    ci_netif_tx_mag_drain(ni);
+
   if( ci_ni_dllist_is_empty(ni, &ni->state->reap_list) )
     return;
 
@@ -563,6 +624,13 @@ static void ci_netif_mem_pressure_enter_critical(ci_netif* ni, int intf_i)
   CITP_STATS_NETIF_INC(ni, memory_pressure_enter);
   ni->state->mem_pressure |= OO_MEM_PRESSURE_CRITICAL;
   ni->state->rxq_limit = 2*CI_CFG_RX_DESC_BATCH;
+  /* Sockets with a small backlog may go on queueing, but only as many
+   * buffers as the pressure pool hands back, so that they cannot between
+   * them use up the buffers needed to refill the RX rings.
+   */
+  ni->state->mem_pressure_sock_budget = ni->state->mem_pressure_pkt_pool_n;
+  ci_netif_rx_recycle_drain(ni);
+  ci_netif_tx_mag_drain(ni);
   ci_netif_mem_pressure_pkt_pool_use(ni);
   if( ci_netif_rx_vi_space(ni, ci_netif_rx_vi(ni, intf_i)) >=
       CI_CFG_RX_DESC_BATCH )
@@ -575,6 +643,7 @@ static void ci_netif_mem_pressure_exit_critical(ci_netif* ni)
   ci_assert(OO_PP_IS_NULL(ni->state->mem_pressure_pkt_pool));
   ci_netif_mem_pressure_pkt_pool_fill(ni);
   ni->state->rxq_limit = NI_OPTS(ni).rxq_limit;
+  ni->state->mem_pressure_sock_budget = 0;
   ni->state->mem_pressure &= ~OO_MEM_PRESSURE_CRITICAL;
 }
 
@@ -630,6 +699,47 @@ int ci_netif_mem_pressure_try_exit(ci_netif* ni)
  *
  *--------------------------------------------------------------------*/
 
+static int __ci_netif_rx_post_recycled(ci_netif* ni, ef_vi* vi, int intf_i)
+{
+  /* Post the buffers kept aside by ci_netif_pkt_free().  They are already
+   * counted in [n_rx_pkts] and marked for RX, and were last written by
+   * this interface, so there is no pool or packet-set work to do.  The
+   * list is walked with the next buffer prefetched while the descriptor
+   * for the current one is written.
+   */
+  ci_netif_state_nic_t* nsn = &ni->state->nic[intf_i];
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p pp = nsn->rx_recycle;
+  int i, n, posted = 0;
+
+  n = CI_MIN(nsn->rx_recycle_n, ci_netif_rx_vi_space(ni, vi));
+  n -= n % CI_CFG_RX_DESC_BATCH;
+
+  while( posted < n ) {
+    for( i = 0; i < CI_CFG_RX_DESC_BATCH; ++i ) {
+      pkt = PKT_CHK(ni, pp);
+      pp = pkt->next;
+      if( OO_PP_NOT_NULL(pp) )
+        ci_prefetch(PKT_CHK(ni, pp));
+      ci_assert(pkt->flags & CI_PKT_FLAG_RX);
+      ci_assert_equal(pkt->intf_i, intf_i);
+      ci_assert_equal(pkt->refcount, 0);
+      pkt->refcount = 1;
+      pkt->pkt_start_off = ef_vi_receive_prefix_len(vi);
+      ci_netif_poison_rx_pkt(pkt);
+      ef_vi_receive_init(vi, pkt->dma_addr[intf_i], OO_PKT_ID(pkt));
+    }
+    ef_vi_receive_push(vi);
+    posted += CI_CFG_RX_DESC_BATCH;
+  }
+
+  nsn->rx_recycle = pp;
+  nsn->rx_recycle_n -= posted;
+  CITP_STATS_NETIF_ADD(ni, rx_recycle_hit, posted);
+  return posted;
+}
+
+
 static int __ci_netif_rx_post(ci_netif* ni, ef_vi* vi, int intf_i,
                                int bufset_id, int max)
 {
@@ -685,6 +795,8 @@ static int __ci_netif_rx_post(ci_netif* ni, ef_vi* vi, int intf_i,
     ef_vi_receive_push(vi);
     posted += CI_CFG_RX_DESC_BATCH;
   } while( max - posted >= CI_CFG_RX_DESC_BATCH );
+  ci_netif_pktset_rebucket(ni, bufset_id);
+  CITP_STATS_NETIF_ADD(ni, rx_recycle_miss, posted);
 
   return posted;
 }
@@ -712,6 +824,12 @@ void ci_netif_rx_post(ci_netif* netif, int intf_i)
   ci_assert(ci_netif_is_locked(netif));
   ci_assert(ci_netif_rx_vi_space(netif, vi) >= CI_CFG_RX_DESC_BATCH);
 
+  if( netif->state->nic[intf_i].rx_recycle_n >= CI_CFG_RX_DESC_BATCH ) {
+    __ci_netif_rx_post_recycled(netif, vi, intf_i);
+    if( ci_netif_rx_vi_space(netif, vi) < CI_CFG_RX_DESC_BATCH )
+      return;
+  }
+
   max_n_to_post = ci_netif_rx_vi_space(netif, vi);
   rx_allowed = NI_OPTS(netif).max_rx_packets - netif->state->n_rx_pkts;
   if( max_n_to_post > rx_allowed )
@@ -177,12 +177,15 @@ void ci_netif_assert_valid(ci_netif* ni, const char* file, int line)
 void ci_netif_verify_freepkts(ci_netif *ni, const char *file, int line)
 {
   ci_ip_pkt_fmt *pkt;
-  int c1, c2, i;
+  int c1, c2, i, b, n_listed, n_nonempty;
 
-  for( c1 = 0, i = 0; i < ni->packets->sets_n; i++ ) {
+  for( c1 = 0, n_nonempty = 0, i = 0; i < ni->packets->sets_n; i++ ) {
     verify( OO_PP_NOT_NULL(ni->packets->set[i].free) ==
             (ni->packets->set[i].n_free > 0) );
     verify(ni->packets->set[i].n_free >= 0);
+    verify(ni->packets->set[i].bucket ==
+           OO_PKTSET_BUCKET(ni->packets->set[i].n_free));
+    n_nonempty += ni->packets->set[i].n_free > 0;
     c1 += ni->packets->set[i].n_free;
 
     if( ni->packets->set[i].n_free > 0 ) {
@@ -201,6 +204,14 @@ void ci_netif_verify_freepkts(ci_netif *ni, const char *file, int line)
       verify(c2 == ni->packets->set[i].n_free);
     }
   }
+
+  for( n_listed = 0, b = 0; b < OO_PKTSET_BUCKETS; b++ )
+    for( i = ni->packets->bucket_head[b]; i >= 0;
+         i = ni->packets->set[i].bucket_next ) {
+      verify(ni->packets->set[i].bucket == b);
+      ++n_listed;
+    }
+  verify(n_listed == n_nonempty);
 }
 
 #endif  /* NDEBUG */
@@ -298,6 +309,7 @@ static void ci_netif_dump_pkt_summary(ci_netif* ni, oo_dump_log_fn_t logger,
                                       void* log_arg)
 {
   int intf_i, rx_ring = 0, tx_ring = 0, tx_oflow = 0, used, rx_queued, i;
+  int rx_recycle;
   ci_netif_state* ns = ni->state;
 
   logger(log_arg, "  pkt_sets: pkt_size=%d set_size=%d max=%d alloc=%d",
@@ -310,27 +322,33 @@ static void ci_netif_dump_pkt_summary(ci_netif* ni, oo_dump_log_fn_t logger,
   }
 
   rx_ring = 0;
+  rx_recycle = 0;
   tx_ring = 0;
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
     rx_ring += ef_vi_receive_fill_level(ci_netif_rx_vi(ni, intf_i));
+    rx_recycle += ns->nic[intf_i].rx_recycle_n;
     tx_ring += ef_vi_transmit_fill_level(&ni->nic_hw[intf_i].vi);
     tx_oflow += ns->nic[intf_i].dmaq.num;
   }
   used = ni->packets->n_pkts_allocated - ni->packets->n_free - ns->n_async_pkts;
-  rx_queued = ns->n_rx_pkts - rx_ring - ns->mem_pressure_pkt_pool_n;
+  rx_queued = ns->n_rx_pkts - rx_ring - ns->mem_pressure_pkt_pool_n -
+              rx_recycle;
 
   logger(log_arg, "  pkt_bufs: max=%d alloc=%d free=%d async=%d%s",
          ni->packets->sets_max * PKTS_PER_SET,
          ni->packets->n_pkts_allocated, ni->packets->n_free, ns->n_async_pkts,
          (ns->mem_pressure & OO_MEM_PRESSURE_CRITICAL) ? " CRITICAL":
          (ns->mem_pressure ? " LOW":""));
-  logger(log_arg, "  pkt_bufs: rx=%d rx_ring=%d rx_queued=%d pressure_pool=%d",
-         ns->n_rx_pkts, rx_ring, rx_queued, ns->mem_pressure_pkt_pool_n);
+  logger(log_arg, "  pkt_bufs: rx=%d rx_ring=%d rx_queued=%d pressure_pool=%d "
+         "rx_recycle=%d", ns->n_rx_pkts, rx_ring, rx_queued,
+         ns->mem_pressure_pkt_pool_n, rx_recycle);
   logger(log_arg, "  pkt_bufs: tx=%d tx_ring=%d tx_oflow=%d",
          (used - ns->n_rx_pkts - ns->n_looppkts), tx_ring, tx_oflow);
   logger(log_arg, "  pkt_bufs: in_loopback=%d in_sock=%d", ns->n_looppkts,
          used - ns->n_rx_pkts - ns->n_looppkts - tx_ring - tx_oflow);
   logger(log_arg, "  pkt_bufs: rx_reserved=%d", ns->reserved_pktbufs);
+  if( ns->mem_pressure & OO_MEM_PRESSURE_CRITICAL )
+    logger(log_arg, "  pkt_bufs: sock_budget=%d", ns->mem_pressure_sock_budget);
 }
 
 
@@ -412,6 +430,7 @@ void ci_netif_pkt_dump_all(ci_netif* ni)
 }
 
 
+/* Returns true if anyone, in the kernel or on a futex, asked to be woken. */
 static int citp_waitable_force_wake(ci_netif* ni, citp_waitable* sb)
 {
   int rc = sb->wake_request != 0;
@@ -706,6 +725,197 @@ void ci_stack_time_dump(ci_netif* ni, oo_dump_log_fn_t logger, void* log_arg)
 }
 
 
+#ifndef __KERNEL__
+
+static const char* const ci_netif_blog_fmts[] = {
+#define OO_BLOG_FMT(id, fmt)  fmt,
+#include <ci/internal/blog_def.h>
+#undef OO_BLOG_FMT
+};
+
+
+/* Formats [fmt] with [args] as described in blog_def.h. */
+static void ci_netif_blog_format(char* buf, int len, const char* fmt,
+                                 const ci_uint64* args, unsigned n_args)
+{
+  char spec[16];
+  unsigned arg_i = 0;
+  int n = 0, spec_n;
+  ci_uint64 a;
+
+  while( *fmt != '\0' && n < len - 1 ) {
+    if( *fmt != '%' || fmt[1] == '%' ) {
+      buf[n++] = *fmt;
+      fmt += (*fmt == '%') ? 2 : 1;
+      continue;
+    }
+    spec[0] = *fmt++;
+    spec_n = 1;
+    while( *fmt != '\0' && strchr("-+ #0123456789.", *fmt) &&
+           spec_n < (int) sizeof(spec) - 4 )
+      spec[spec_n++] = *fmt++;
+    while( *fmt != '\0' && strchr("hlLqjzt", *fmt) )
+      ++fmt;
+    if( *fmt == '\0' )
+      break;
+    a = arg_i < n_args ? args[arg_i++] : 0;
+
+    switch( *fmt ) {
+    case 'd':
+    case 'i':
+      strcpy(spec + spec_n, "lld");
+      n += snprintf(buf + n, len - n, spec, (long long) a);
+      break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      spec[spec_n++] = 'l';
+      spec[spec_n++] = 'l';
+      spec[spec_n++] = *fmt;
+      spec[spec_n] = '\0';
+      n += snprintf(buf + n, len - n, spec, (unsigned long long) a);
+      break;
+    case 'c':
+      strcpy(spec + spec_n, "c");
+      n += snprintf(buf + n, len - n, spec, (int) a);
+      break;
+    case 'I': {
+      ci_uint32 addr_be32 = (ci_uint32) a;
+      n += snprintf(buf + n, len - n, CI_IP_PRINTF_FORMAT,
+                    CI_IP_PRINTF_ARGS(&addr_be32));
+      break;
+    }
+    case 'M': {
+      ci_uint8 mac[sizeof(a)];
+      memcpy(mac, &a, sizeof(a));
+      n += snprintf(buf + n, len - n, CI_MAC_PRINTF_FORMAT,
+                    CI_MAC_PRINTF_ARGS(mac));
+      break;
+    }
+    case 'F':
+      n += snprintf(buf + n, len - n, CI_TCP_FLAGS_FMT,
+                    CI_TCP_FLAGS_PRI_ARG((unsigned) a));
+      break;
+    case 'S':
+      n += snprintf(buf + n, len - n, "%s", ci_tcp_state_str((unsigned) a));
+      break;
+    default:
+      n += snprintf(buf + n, len - n, "<%%%c?>", *fmt);
+      break;
+    }
+    ++fmt;
+  }
+  buf[CI_MIN(n, len - 1)] = '\0';
+}
+
+
+/* Copies record [idx] of the binary log to [rec].  Returns false if it
+ * has not been written yet or was overwritten while being copied. */
+static int ci_netif_blog_read(ci_netif* ni, ci_uint32 idx,
+                              ci_netif_blog_rec* rec)
+{
+  ci_netif_blog_rec* src;
+
+  src = &ni->blog[idx & (ni->state->blog_entries_n - 1)];
+  if( src->seq != idx + 1 )
+    return 0;
+  ci_rmb();
+  memcpy(rec, src, sizeof(*rec));
+  ci_rmb();
+  return src->seq == idx + 1;
+}
+
+
+/* Decodes the records in the binary log from index [*pos] onwards, and
+ * advances [*pos] past them.  Records are timestamped relative to now.
+ * Returns the number of records that were lost because they were
+ * overwritten before they could be decoded.
+ */
+ci_uint32 ci_netif_blog_dump(ci_netif* ni, ci_uint32* pos,
+                             oo_dump_log_fn_t logger, void* log_arg)
+{
+  ci_netif_state* ns = ni->state;
+  ci_uint32 head = ns->blog_head;
+  ci_uint32 lost = 0;
+  unsigned khz = CI_MAX(IPTIMER_STATE(ni)->khz, 1u);
+  ci_netif_blog_rec rec;
+  ci_uint64 now, usec;
+  char text[256];
+
+  if( ns->blog_entries_n == 0 )
+    return 0;
+
+  ci_rmb();
+  if( head - *pos > ns->blog_entries_n ) {
+    lost += head - *pos - ns->blog_entries_n;
+    *pos = head - ns->blog_entries_n;
+  }
+
+  ci_frc64(&now);
+  for( ; *pos != head; ++*pos ) {
+    if( ! ci_netif_blog_read(ni, *pos, &rec) ) {
+      /* Either overwritten, or claimed but not yet written.  Don't wait for
+       * the writer: the record may belong to a process that has died. */
+      ++lost;
+      continue;
+    }
+    if( rec.fmt_id < OO_BLOG_ID_N )
+      ci_netif_blog_format(text, sizeof(text), ci_netif_blog_fmts[rec.fmt_id],
+                           rec.args, CI_MIN(rec.n_args, OO_BLOG_ARGS_MAX));
+    else
+      snprintf(text, sizeof(text), "unknown message %u", rec.fmt_id);
+    usec = now > rec.frc ? (now - rec.frc) * 1000 / khz : 0;
+    logger(log_arg, "%6u: -%"CI_PRIu64".%06u %s", *pos,
+           usec / 1000000, (unsigned) (usec % 1000000), text);
+  }
+  return lost;
+}
+
+
+/* Copies the stats snapshot to [snap].  Returns 0 on success, -ENOENT if
+ * the stack has no snapshot, or -EAGAIN if the stack was updating it.
+ * Callers that get -EAGAIN should just try again: an update takes well
+ * under a microsecond.
+ */
+int ci_netif_ssnap_read(ci_netif* ni, ci_netif_ssnap* snap)
+{
+  ci_uint32 gen;
+
+  if( ! ci_netif_ssnap_enabled(ni) )
+    return -ENOENT;
+  gen = OO_ACCESS_ONCE(ni->ssnap->generation);
+  if( gen & 1 )
+    return -EAGAIN;
+  ci_rmb();
+  memcpy(snap, ni->ssnap, sizeof(*snap));
+  ci_rmb();
+  if( OO_ACCESS_ONCE(ni->ssnap->generation) != gen )
+    return -EAGAIN;
+  snap->generation = gen;
+  return 0;
+}
+
+
+/* Copies record [idx] of the snapshot's socket log to [rec].  Returns false
+ * if it has not been written yet or was overwritten while being copied. */
+int ci_netif_ssnap_sock_read(ci_netif* ni, ci_uint32 idx,
+                             ci_netif_ssnap_sock* rec)
+{
+  ci_netif_ssnap_sock* src;
+
+  src = &ci_netif_ssnap_socks(ni)[idx & (ni->state->ssnap_sock_log_n - 1)];
+  if( src->seq != idx + 1 )
+    return 0;
+  ci_rmb();
+  memcpy(rec, src, sizeof(*rec));
+  ci_rmb();
+  return src->seq == idx + 1;
+}
+
+#endif /* __KERNEL__ */
+
+
 static void ci_netif_dump_vi(ci_netif* ni, int intf_i, oo_dump_log_fn_t logger,
                              void* log_arg)
 {
@@ -920,6 +1130,14 @@ void ci_netif_dump_to_logger(ci_netif* ni, oo_dump_log_fn_t logger,
   logger(log_arg, "  creation_time=%s (delta=%lusecs)", buff,
          nowt - ns->creation_time_sec);
 #endif
+  logger(log_arg, "  startup_usec: hw_resources=%u ep_table=%u pkt_alloc=%u "
+         "rx_fill=%u kernel_total=%u prefault=%u",
+         ns->init_timing.hw_resources, ns->init_timing.ep_table,
+         ns->init_timing.pkt_alloc, ns->init_timing.rx_fill,
+         ns->init_timing.kernel_total, ns->init_timing.prefault);
+  logger(log_arg, "  startup_pkt_sets: parallel=%u threads=%u",
+         (unsigned) ns->init_timing.pkt_sets,
+         (unsigned) ns->init_timing.threads);
 
   tmp = ni->state->lock.lock;
   logger(log_arg, "  lock=%"CI_PRIx64" "CI_NETIF_LOCK_FMT"  nics=%"CI_PRIx64
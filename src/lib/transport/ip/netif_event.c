@@ -180,20 +180,28 @@ static void measure_processing_delay(ci_netif* ni, struct timespec pkt_ts,
   if(CI_UNLIKELY( (sync_flags & in_sync) != in_sync ))
     return;
 
-  frc_diff = its->frc - ni->state->sync_frc;
-  if( frc_diff > ni->state->max_frc_diff ) {
-    /* Ensure we keep a reasonable correspondence between frc and real
-     * time.  We only do this in user-space because that is convenient.
-     */
+#ifndef __KERNEL__
+  /* Prefer the driver's continuously calibrated mapping, and only fall
+   * back to keeping our own correspondence until that is available.
+   */
+  if( ci_netif_frc_to_wall_ns(ni, its->frc, &stack_ns) != 0 )
+#endif
+  {
+    frc_diff = its->frc - ni->state->sync_frc;
+    if( frc_diff > ni->state->max_frc_diff ) {
+      /* Ensure we keep a reasonable correspondence between frc and real
+       * time.  We only do this in user-space because that is convenient.
+       */
 #ifdef __KERNEL__
-    return;
+      return;
 #else
-    frc_resync(ni);
-    frc_diff = its->frc - ni->state->sync_frc;
+      frc_resync(ni);
+      frc_diff = its->frc - ni->state->sync_frc;
 #endif
+    }
+    stack_ns = ni->state->sync_ns + frc_diff * 1000000 / its->khz;
   }
 
-  stack_ns = ni->state->sync_ns + frc_diff * 1000000 / its->khz;
   pkt_ns = (ci_uint64) pkt_ts.tv_sec * 1000000000 + pkt_ts.tv_nsec;
 
   if( stack_ns >= pkt_ns ) {
@@ -1095,6 +1103,11 @@ static void process_post_poll_list(ci_netif* ni)
       if( sb->sb_flags & CI_SB_FLAG_WAKE_TX )
         ++sb->sleep_seq.rw.tx;
       ci_mb();
+      ci_netif_sock_ready_set(ni, sb, sb->sb_flags);
+#ifndef __KERNEL__
+      citp_waitable_wake_futex(ni, sb, sb->sb_flags &
+                               (CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX));
+#endif
 
       lists_need_wake |= sb->ready_lists_in_use;
 
@@ -1226,6 +1239,69 @@ static void ci_netif_tx_pkt_complete_udp(ci_netif* netif,
 #endif
 
 
+#if CI_CFG_TIMESTAMPING
+/* Write the TX timestamp of [pkt] to the stack's TX timestamp ring if its
+ * socket asked for that.  Returns true if the packet's timestamp has been
+ * dealt with, so that it need not be queued on the socket. */
+static int ci_netif_tx_ts_ring_post(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  ci_netif_state* ns = ni->state;
+  ci_uint32 ring_n = ci_netif_tx_ts_ring_n(ni);
+  citp_waitable_obj* wo;
+  oo_tx_timestamp* e;
+  oo_sp sock_id;
+  ci_uint32 key, flags = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( pkt->flags & CI_PKT_FLAG_UDP )
+    sock_id = pkt->pf.udp.tx_sock_id;
+  else
+    sock_id = pkt->pf.tcp_tx.sock_id;
+  if( OO_SP_IS_NULL(sock_id) )
+    return 0;
+  wo = SP_TO_WAITABLE_OBJ(ni, sock_id);
+  if( ! (wo->waitable.state & CI_TCP_STATE_TCP_CONN) &&
+      wo->waitable.state != CI_TCP_STATE_UDP )
+    return 0;
+  if( ! onload_timestamping_want_tx_ring(wo->sock.timestamping_flags) )
+    return 0;
+
+  if( pkt->flags & CI_PKT_FLAG_UDP ) {
+    key = pkt->ts_key;
+  }
+  else {
+    key = pkt->pf.tcp_tx.end_seq - 1 - wo->sock.ts_key;
+    flags |= OO_TX_TS_F_TCP;
+  }
+
+  if( ns->tx_ts_ring_added - ns->tx_ts_ring_removed >= ring_n ) {
+    /* Full, or there is no ring.  The packet is freed all the same. */
+    ns->tx_ts_ring_lost = 1;
+    CITP_STATS_NETIF_INC(ni, tx_ts_ring_lost);
+    return 1;
+  }
+  if( ns->tx_ts_ring_lost ) {
+    flags |= OO_TX_TS_F_LOST;
+    ns->tx_ts_ring_lost = 0;
+  }
+  if( pkt->hw_stamp.tv_nsec & CI_IP_PKT_HW_STAMP_FLAG_IN_SYNC )
+    flags |= OO_TX_TS_F_IN_SYNC;
+
+  e = &ni->tx_ts_ring[ns->tx_ts_ring_added & (ring_n - 1)];
+  e->sock_id = OO_SP_TO_INT(sock_id);
+  e->key = key;
+  e->sec = pkt->hw_stamp.tv_sec;
+  e->nsec = pkt->hw_stamp.tv_nsec & ~CI_IP_PKT_HW_STAMP_FLAG_IN_SYNC;
+  e->flags = flags;
+  ci_wmb();
+  ++ns->tx_ts_ring_added;
+  CITP_STATS_NETIF_INC(ni, tx_ts_ring_posted);
+  return 1;
+}
+#endif
+
+
 ci_inline void __ci_netif_tx_pkt_complete(ci_netif* ni,
                                           struct ci_netif_poll_state* ps,
                                           ci_ip_pkt_fmt* pkt, ef_event* ev)
@@ -1274,6 +1350,11 @@ ci_inline void __ci_netif_tx_pkt_complete(ci_netif* ni,
       pkt->flags &= ~CI_PKT_FLAG_TX_TIMESTAMPED;
     }
 
+    /* Timestamps that go to the ring don't hold on to the packet. */
+    if( (pkt->flags & CI_PKT_FLAG_TX_TIMESTAMPED) &&
+        ci_netif_tx_ts_ring_post(ni, pkt) )
+      pkt->flags &= ~CI_PKT_FLAG_TX_TIMESTAMPED;
+
     /* Ensure that timestamp is written down before
      * CI_PKT_FLAG_TX_PENDING removal. */
     ci_wmb();
@@ -1643,6 +1724,19 @@ static void ci_netif_tx_progress(ci_netif* ni, int intf_i)
 }
 
 
+/* Ring the doorbells deferred by ci_netif_send_batch() calls made during
+ * the poll, such as for SYN-ACKs.  Most of them will have been pushed
+ * already at the end of ci_netif_poll_intf().
+ */
+ci_inline void ci_netif_poll_tx_push(ci_netif* ni)
+{
+  if( ni->poll_tx_intf_mask != 0 ) {
+    ci_netif_send_batch_push(ni, ni->poll_tx_intf_mask);
+    ni->poll_tx_intf_mask = 0;
+  }
+}
+
+
 static int ci_netif_poll_intf(ci_netif* ni, int intf_i, int max_evs)
 {
   struct ci_netif_poll_state ps;
@@ -1776,6 +1870,7 @@ handled:
     process_post_poll_list(ni);
     ni->state->poll_work_outstanding = 1;
   }
+  ci_netif_poll_tx_push(ni);
   --ni->state->in_poll;
   if( ps.tx_pkt_free_list_n )
     ci_netif_poll_free_pkts(ni, &ps);
@@ -1849,6 +1944,36 @@ static void ci_netif_loopback_pkts_send(ci_netif* ni)
 }
 
 
+/* Copies the stack's counters to the stats snapshot (EF_STATS_SNAPSHOT).
+ * We hold the stack lock, so are the only writer.
+ */
+static void ci_netif_ssnap_publish(ci_netif* ni)
+{
+  ci_netif_state* ns = ni->state;
+  ci_netif_ssnap* snap = ni->ssnap;
+  ci_uint32 gen = snap->generation;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert_equal(gen & 1, 0);
+
+  ns->ssnap_last_frc = IPTIMER_STATE(ni)->frc;
+  snap->generation = gen + 1;
+  ci_wmb();
+  snap->frc = ns->ssnap_last_frc;
+  snap->sock_head = ns->ssnap_sock_head;
+  snap->n_ep_bufs = ns->n_ep_bufs;
+  snap->n_rx_pkts = ns->n_rx_pkts;
+  snap->n_async_pkts = ns->n_async_pkts;
+  snap->n_free_pkts = ni->packets->n_free;
+  snap->pkt_sets_n = ni->packets->sets_n;
+#if CI_CFG_STATS_NETIF
+  memcpy(&snap->stats, &ns->stats, sizeof(snap->stats));
+#endif
+  ci_wmb();
+  snap->generation = gen + 2;
+}
+
+
 int ci_netif_poll_n(ci_netif* netif, int max_evs)
 {
   int intf_i, n_evs_handled = 0;
@@ -1892,6 +2017,7 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
     process_post_poll_list(netif);
   }
   ci_assert_equal(netif->state->n_looppkts, 0);
+  ci_netif_poll_tx_push(netif);
   --netif->state->in_poll;
 
   /* If we've got packets that need to be forwarded to the kernel, and they are
@@ -1930,6 +2056,11 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
 
   netif->state->poll_work_outstanding = 0;
 
+  if(CI_UNLIKELY( ci_netif_ssnap_enabled(netif) ) &&
+     IPTIMER_STATE(netif)->frc - netif->state->ssnap_last_frc >=
+     netif->state->ssnap_cycles )
+    ci_netif_ssnap_publish(netif);
+
   /* returns the number of events handled */
   return n_evs_handled;
 }
@@ -22,6 +22,9 @@
 #ifndef __KERNEL__
 #include <cplane/cplane.h>
 #include <net/if.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include <ci/internal/efabcfg.h>
 #if CI_CFG_PKTS_AS_HUGE_PAGES
 #include <sys/shm.h>
@@ -73,6 +76,8 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
     ci_ni_dllist_init(ni, &nn->tx_ready_list, 
                       oo_ptr_to_statep(ni, &nn->tx_ready_list), "txrd");
     nn->rx_frags = OO_PP_NULL;
+    nn->rx_recycle = OO_PP_NULL;
+    assert_zero(nn->rx_recycle_n);
   }
 
   /* List of free packet buffers. */
@@ -82,6 +87,7 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
   assert_zero(nis->mem_pressure);
   nis->mem_pressure_pkt_pool = OO_PP_NULL;
   assert_zero(nis->mem_pressure_pkt_pool_n);
+  assert_zero(nis->mem_pressure_sock_budget);
   nis->looppkts = OO_PP_NULL;
   nis->n_looppkts = 0;
 
@@ -166,6 +172,12 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
   nis->kernel_packets_cycles =
             __oo_usec_to_cycles64(cpu_khz,
                                   NI_OPTS(ni).kernel_packets_timer_usec);
+  nis->ssnap_cycles = __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).ssnap_usec);
+  if( nis->ssnap_sock_log_n != 0 ) {
+    ni->ssnap->version = OO_SSNAP_VERSION;
+    ni->ssnap->size = sizeof(ci_netif_ssnap);
+    ni->ssnap->sock_log_n = nis->ssnap_sock_log_n;
+  }
 
   ci_ip_timer_state_init(ni, cpu_khz);
   nis->last_spin_poll_frc = IPTIMER_STATE(ni)->frc;
@@ -852,6 +864,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if( (s = getenv("EF_BUZZ_USEC")) ) {
     opts->buzz_usec = atoi(s);
   }
+  if( (s = getenv("EF_FUTEX_SLEEP_USEC")) )
+    opts->futex_sleep_usec = atoi(s);
 
   /* The options that follow are (at time of writing) not sensitive to the
    * order in which they are read.
@@ -930,6 +944,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   }
   if ( (s = getenv("EF_PREALLOC_PACKETS")) )
     opts->prealloc_packets = atoi(s);
+  if ( (s = getenv("EF_STACK_INIT_THREADS")) )
+    opts->stack_init_threads = atoi(s);
+  if ( (s = getenv("EF_PREFAULT_THREADS")) )
+    opts->prefault_threads = atoi(s);
   if ( (s = getenv("EF_RXQ_MIN")) )
     opts->rxq_min = atoi(s);
   if ( (s = getenv("EF_MIN_FREE_PACKETS")) )
@@ -964,6 +982,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->rxq_size = atoi(s);
   if ( (s = getenv("EF_RXQ_LIMIT")) )
     opts->rxq_limit = atoi(s);
+  if ( (s = getenv("EF_RX_RECYCLE")) )
+    opts->rx_recycle = atoi(s);
+  if ( (s = getenv("EF_MEM_PRESSURE_SOCK_PKTS")) )
+    opts->mem_pressure_sock_pkts = atoi(s);
   if ( (s = getenv("EF_TXQ_SIZE")) )
     opts->txq_size = atoi(s);
   if ( (s = getenv("EF_TXQ_LIMIT")) )
@@ -1042,6 +1064,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->rst_delayed_conn = atoi(s);
   if( (s = getenv("EF_TCP_SNDBUF_MODE")) )
     opts->tcp_sndbuf_mode = atoi(s);
+  if( (s = getenv("EF_TCP_SEND_MAGAZINE")) )
+    opts->tcp_send_magazine = atoi(s);
   if( (s = getenv("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
     opts->tcp_nonblock_no_pkts_mode = atoi(s);
   if( (s = getenv("EF_TCP_RCVBUF_STRICT")) )
@@ -1097,6 +1121,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if( opts->tcp_server_loopback == CITP_TCP_LOOPBACK_OFF &&
       opts->tcp_client_loopback == CITP_TCP_LOOPBACK_SAMESTACK )
     opts->tcp_client_loopback = CITP_TCP_LOOPBACK_OFF;
+  if( (s = getenv("EF_TCP_LOOPBACK_RING")) )
+    opts->tcp_loopback_ring = atoi(s);
 
   if( (s = getenv("EF_TCP_RX_CHECKS")) ) {
     unsigned v;
@@ -1107,6 +1133,12 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
       opts->tcp_rx_log_flags = v;
     }
   }
+  if( (s = getenv("EF_BINARY_LOG")) )
+    opts->blog_entries = atoi(s);
+  if( (s = getenv("EF_STATS_SNAPSHOT")) )
+    opts->ssnap_sock_log = atoi(s);
+  if( (s = getenv("EF_STATS_SNAPSHOT_USEC")) )
+    opts->ssnap_usec = atoi(s);
 
   if( (s = getenv("EF_ACCEPTQ_MIN_BACKLOG")) )
     opts->acceptq_min_backlog = atoi(s);
@@ -1270,6 +1302,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
 
   if( (s = getenv("EF_TX_TIMESTAMPING")) )
     opts->tx_timestamping = atoi(s);
+  if( (s = getenv("EF_TX_TIMESTAMP_RING")) )
+    opts->tx_ts_ring = atoi(s);
 
   if( (s = getenv("EF_TIMESTAMPING_REPORTING")) )
     opts->timestamping_reporting = atoi(s);
@@ -1731,6 +1765,17 @@ static void netif_tcp_helper_build2(ci_netif* ni)
     (ci_ni_dllist_t*) ((char*) ni->state + ni->state->active_wild_ofs);
   ni->seq_table =
     (ci_tcp_prev_seq_t*) ((char*) ni->state + ni->state->seq_table_ofs);
+  ni->synrecv_table =
+    (ci_tcp_synrecv_table_entry*) ((char*) ni->state +
+                                   ni->state->synrecv_table_ofs);
+  ni->blog =
+    (ci_netif_blog_rec*) ((char*) ni->state + ni->state->blog_ofs);
+  ni->ssnap =
+    (ci_netif_ssnap*) ((char*) ni->state + ni->state->ssnap_ofs);
+  ni->tx_ts_ring =
+    (oo_tx_timestamp*) ((char*) ni->state + ni->state->tx_ts_ring_ofs);
+  ni->sock_ready =
+    (volatile ci_uint32*) ((char*) ni->state + ni->state->sock_ready_ofs);
   ni->deferred_pkts =
     (struct oo_deferred_pkt*) ((char*) ni->state +
                                ni->state->deferred_pkts_ofs);
@@ -2032,6 +2077,36 @@ unsigned ci_netif_build_future_intf_mask(ci_netif* ni)
 }
 
 
+static size_t ci_netif_extra_eps_bytes(ci_netif* ni)
+{
+  return CI_ROUND_UP(sizeof(struct ci_extra_ep) * ni->state->max_ep_bufs,
+                     (size_t) CI_PAGE_SIZE);
+}
+
+
+/* Serialises initialisation of the entries of ci_netif::eps.  Growth
+ * happens a page of entries at a time, so this is rarely taken. */
+static pthread_mutex_t ci_netif_extra_eps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void ci_netif_extra_eps_grow(ci_netif* ni, unsigned id)
+{
+  unsigned i, n;
+  const unsigned per_page = CI_PAGE_SIZE / sizeof(struct ci_extra_ep);
+
+  ci_assert_lt(id, ni->state->max_ep_bufs);
+
+  pthread_mutex_lock(&ci_netif_extra_eps_lock);
+  if( id >= ni->eps_n ) {
+    n = CI_MIN(CI_ROUND_UP(id + 1, per_page), ni->state->max_ep_bufs);
+    for( i = ni->eps_n; i < n; ++i )
+      ni->eps[i].fd = CI_FD_BAD;
+    ci_wmb();
+    ni->eps_n = n;
+  }
+  pthread_mutex_unlock(&ci_netif_extra_eps_lock);
+}
+
+
 static int netif_tcp_helper_build(ci_netif* ni)
 {
   /* On entry we require the following to be initialised:
@@ -2204,17 +2279,16 @@ static int netif_tcp_helper_build(ci_netif* ni)
     goto fail2;
   }
 
-  ni->eps = CI_ALLOC_ARRAY(typeof(*ni->eps), ni->state->max_ep_bufs);
-  if( ni->eps == NULL ) {
+  /* Reserve address space only: entries are initialised by
+   * ci_netif_extra_eps_grow() as endpoints are used. */
+  ni->eps_n = 0;
+  ni->eps = mmap(NULL, ci_netif_extra_eps_bytes(ni), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if( ni->eps == MAP_FAILED ) {
+    ni->eps = NULL;
     rc = -ENOMEM;
     goto fail2;
   }
-  {
-    int i;
-    struct ci_extra_ep ref = { CI_FD_BAD };
-    for( i = 0; i < ni->state->max_ep_bufs; ++ i )
-      ni->eps[i] = ref;
-  }
 
   /* For diagnostic purposes, mark the stack as lacking a mapping of init_net's
    * cplane if such is the case.  We couldn't set this flag in ci_netif_init()
@@ -2276,10 +2350,10 @@ ci_inline void netif_tcp_helper_free(ci_netif* ni)
 #ifdef __KERNEL__
   efab_thr_release(netif2tcp_helper_resource(ni));
 #else
+  if( ni->eps != NULL )
+    munmap(ni->eps, ci_netif_extra_eps_bytes(ni));
   if( ni->state != NULL )
     netif_tcp_helper_munmap(ni);
-  if( ni->eps != NULL )
-    CI_FREE_OBJ(ni->eps);
   if( ni->pkt_bufs != NULL )
     CI_FREE_OBJ(ni->pkt_bufs);
   ci_netif_deinit(ni);
@@ -2559,6 +2633,45 @@ static void ci_netif_sanity_checks(void)
                       sizeof(((citp_waitable*)0)->sb_aflags)
                    <= CI_AUX_HEADER_SIZE );
 
+  /* Keep the hot fields of the socket states on the cache lines they were
+   * laid out for.  Socket states sit at the start of an endpoint buffer,
+   * which is cache-line aligned, so lines are counted from there.  The
+   * IPv6 addresses in ci_sock_cmn push everything after them down a line.
+   * If one of these fails, find a cold field to move out rather than
+   * changing the expected line.
+   */
+  CI_BUILD_ASSERT( EP_BUF_SIZE % CI_CACHE_LINE_SIZE == 0 );
+  CI_BUILD_ASSERT( CI_MEMBER_OFFSET(citp_waitable_obj, sock) == 0 );
+  CI_BUILD_ASSERT( CI_MEMBER_OFFSET(citp_waitable_obj, tcp) == 0 );
+  CI_BUILD_ASSERT( CI_MEMBER_OFFSET(citp_waitable_obj, udp) == 0 );
+#if CI_CACHE_LINE_SIZE == 64
+# define SOCK_FIELD_LINES(type, f, first, last)                         \
+  CI_BUILD_ASSERT( OO_SOCK_FIELD_LINE(type, f) == (first) &&            \
+                   OO_SOCK_FIELD_END_LINE(type, f) == (last) )
+# define IP6_LINE  (CI_CFG_IPV6 ? 1 : 0)
+  SOCK_FIELD_LINES(ci_sock_cmn, s_flags,         1,            1);
+  SOCK_FIELD_LINES(ci_sock_cmn, rx_errno,        1,            1);
+  SOCK_FIELD_LINES(ci_sock_cmn, pkt,             1,            2 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_sock_cmn, space_for_hdrs,  2 + IP6_LINE, 3);
+  /* Sequence, window and congestion state used for each incoming ACK. */
+  SOCK_FIELD_LINES(ci_tcp_state, tcpflags,       5 + IP6_LINE, 5 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, snd_nxt,        5 + IP6_LINE, 5 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, rcv_added,      5 + IP6_LINE, 5 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, tsrecent,       5 + IP6_LINE, 5 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, cwnd,           6 + IP6_LINE, 6 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, t_last_sent,    6 + IP6_LINE, 6 + IP6_LINE);
+  /* Queues and buffers used for each packet sent or received. */
+  SOCK_FIELD_LINES(ci_tcp_state, send,           7 + IP6_LINE, 7 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, recv1,          7 + IP6_LINE, 7 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, rob,            7 + IP6_LINE, 7 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_tcp_state, tx_mag,         8 + IP6_LINE, 8 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_udp_state, udpflags,       4 + IP6_LINE, 4 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_udp_state, recv_q,         5 + IP6_LINE, 5 + IP6_LINE);
+  SOCK_FIELD_LINES(ci_udp_state, tx_count,       5 + IP6_LINE, 5 + IP6_LINE);
+# undef IP6_LINE
+# undef SOCK_FIELD_LINES
+#endif
+
 #ifndef NDEBUG
   {
     int i = CI_MEMBER_OFFSET(ci_ip_cached_hdrs, ipx.ip4);
@@ -2609,6 +2722,35 @@ static void ci_netif_pkt_reserve_free(ci_netif* ni, oo_pkt_p pkt_list, int n)
 
 #ifndef __KERNEL__
 
+/* Upper limit of EF_PREFAULT_THREADS. */
+#define CI_NETIF_PREFAULT_THREADS_MAX  32
+
+/* Share of the packet sets prefaulted by one thread. */
+struct ci_netif_prefault_share {
+  ci_netif* ni;
+  int       first_set;
+  int       stride;
+  int       rc;
+};
+
+
+static void* ci_netif_pkt_prefault_share(void* arg)
+{
+  struct ci_netif_prefault_share* share = arg;
+  ci_netif* ni = share->ni;
+  ci_ip_pkt_fmt* pkt;
+  int set, i;
+
+  for( set = share->first_set; set < ni->packets->sets_n;
+       set += share->stride )
+    for( i = set * PKTS_PER_SET; i < (set + 1) * PKTS_PER_SET; ++i ) {
+      pkt = PKT(ni, i);
+      share->rc += *(volatile ci_int32*)(&pkt->refcount);
+    }
+  return NULL;
+}
+
+
 static int ci_netif_pkt_prefault(ci_netif* ni)
 {
   /* Touch all allocated packet buffers so we don't incur the cost of
@@ -2620,18 +2762,54 @@ static int ci_netif_pkt_prefault(ci_netif* ni)
    *
    * Similarly, the cast into volatile is designed to prevent compiler
    * optimisations.
+   *
+   * Most of the cost is in mapping each packet set, which happens on
+   * first touch.  With EF_PREFAULT_THREADS the sets are shared between
+   * that many threads, which map them concurrently.  This is opt-in, as
+   * not every application tolerates threads it did not create.
    */
-  ci_ip_pkt_fmt* pkt;
-  int i, n;
+  struct ci_netif_prefault_share shares[CI_NETIF_PREFAULT_THREADS_MAX];
+  pthread_t threads[CI_NETIF_PREFAULT_THREADS_MAX];
+  char started[CI_NETIF_PREFAULT_THREADS_MAX];
+  sigset_t all_sigs, old_sigs;
+  int i, n_threads;
   int rc = 0;
 
-  if( NI_OPTS(ni).prefault_packets ) {
-    n = ni->packets->n_pkts_allocated;
-    for( i = 0; i < n; ++i ) {
-      pkt = PKT(ni, i);
-      rc += *(volatile ci_int32*)(&pkt->refcount);
-    }
+  if( ! NI_OPTS(ni).prefault_packets )
+    return 0;
+
+  n_threads = CI_MIN((int) NI_OPTS(ni).prefault_threads,
+                     CI_NETIF_PREFAULT_THREADS_MAX);
+  n_threads = CI_MAX(CI_MIN(n_threads, ni->packets->sets_n), 1);
+  for( i = 0; i < n_threads; ++i ) {
+    shares[i].ni = ni;
+    shares[i].first_set = i;
+    shares[i].stride = n_threads;
+    shares[i].rc = 0;
+    started[i] = 0;
+  }
+
+  /* The helper threads must not take any of the application's signals. */
+  if( n_threads > 1 ) {
+    sigfillset(&all_sigs);
+    pthread_sigmask(SIG_SETMASK, &all_sigs, &old_sigs);
+    for( i = 1; i < n_threads; ++i )
+      started[i] = pthread_create(&threads[i], NULL,
+                                  ci_netif_pkt_prefault_share,
+                                  &shares[i]) == 0;
+    pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+  }
+
+  ci_netif_pkt_prefault_share(&shares[0]);
+  for( i = 1; i < n_threads; ++i ) {
+    if( started[i] )
+      pthread_join(threads[i], NULL);
+    else
+      ci_netif_pkt_prefault_share(&shares[i]);
   }
+
+  for( i = 0; i < n_threads; ++i )
+    rc += shares[i].rc;
   return rc;
 }
 
@@ -2685,12 +2863,27 @@ static int check_pio(ci_netif_config_opts* opts)
 #endif
 
 
+/* Reserves and maps EF_PREFAULT_PACKETS packet buffers, recording the time
+ * taken in the stack's startup timings. */
+static void ci_netif_prefault(ci_netif* ni)
+{
+  ci_uint64 start, end;
+  ci_uint32 khz = IPTIMER_STATE(ni)->khz;
+
+  ci_frc64(&start);
+  ci_netif_pkt_prefault_reserve(ni);
+  ci_netif_pkt_prefault(ni);
+  ci_frc64(&end);
+  if( khz != 0 )
+    ni->state->init_timing.prefault = (ci_uint32) ((end - start) * 1000 / khz);
+}
+
+
 void ci_netif_cluster_prefault(ci_netif* ni)
 {
   if( ni->flags & CI_NETIF_FLAGS_PREFAULTED )
     return;
-  ci_netif_pkt_prefault_reserve(ni);
-  ci_netif_pkt_prefault(ni);
+  ci_netif_prefault(ni);
 
   /* Fixme: in theory, we should protect the flag change with the stack
    * lock. */
@@ -2802,8 +2995,7 @@ int ci_netif_ctor(ci_netif* ni, ef_driver_handle fd, const char* stack_name,
     return rc;
   }
 
-  ci_netif_pkt_prefault_reserve(ni);
-  ci_netif_pkt_prefault(ni);
+  ci_netif_prefault(ni);
 
   ci_netif_log_startup_banner(ni, "Using");
 
@@ -16,23 +16,22 @@
 #include <onload/mmap.h>
 #include <sys/shm.h>
 
-pthread_mutex_t citp_pkt_map_lock = PTHREAD_MUTEX_INITIALIZER;
-
+/* Maps packet set [setid] on first touch.
+ *
+ * No lock is taken: each thread that finds the set unmapped maps it, and
+ * the mapping is published in [pkt_bufs] with compare-and-swap.  A thread
+ * that loses the race unmaps its own copy and uses the winner's.  So
+ * threads touching different sets never wait for each other, and a race on
+ * the same set costs no more than a redundant mmap().
+ */
 ci_ip_pkt_fmt* __ci_netif_pkt(ci_netif* ni, unsigned id)
 {
   int rc;
-  ci_ip_pkt_fmt* pkt = 0;
   unsigned setid = id >> CI_CFG_PKTS_PER_SET_S;
   void *p;
 
   ci_assert(id != (unsigned)(-1));
 
-  pthread_mutex_lock(&citp_pkt_map_lock);
-  /* Recheck the condition now we have the lock */
-  if( PKT_BUFSET_U_MMAPPED(ni, setid) )
-    /* The mapping appeared while we were waiting for the lock */
-    goto got_pkt_out;
-
 #if CI_CFG_PKTS_AS_HUGE_PAGES
   if( ni->packets->set[setid].shm_id >= 0 ) {
     p = shmat(ni->packets->set[setid].shm_id, NULL, 0);
@@ -49,7 +48,7 @@ ci_ip_pkt_fmt* __ci_netif_pkt(ci_netif* ni, unsigned id)
         ci_log("%s: shmat(0x%x) failed for pkt set %d (%d)", __FUNCTION__,
                ni->packets->set[setid].shm_id, setid, -errno);
       }
-      goto out;
+      goto fail;
     }
   }
   else
@@ -64,45 +63,84 @@ ci_ip_pkt_fmt* __ci_netif_pkt(ci_netif* ni, unsigned id)
     if( rc < 0 ) {
       ci_log("%s: oo_resource_mmap for pkt set %d failed (%d)",
              __FUNCTION__, setid, rc);
-      goto out;
+      goto fail;
     }
   }
   ci_assert(p);
-  ni->pkt_bufs[setid] = p;
 
- got_pkt_out:
-  pkt = (ci_ip_pkt_fmt*) __PKT_BUF(ni, id);
-
- out:
-  pthread_mutex_unlock(&citp_pkt_map_lock);
-  if( CI_UNLIKELY(pkt == NULL) ) {
-    ci_log("Failed to map packets!");
-    ci_netif_unlock(ni);
-    ci_fail(("Crashing..."));
+  if( ! ci_cas_uintptr_succeed(&ni->pkt_bufs[setid], 0, (ci_uintptr_t) p) ) {
+    /* Another thread mapped this set while we were doing so. */
+    ci_assert(PKT_BUFSET_U_MMAPPED(ni, setid));
+#if CI_CFG_PKTS_AS_HUGE_PAGES
+    if( ni->packets->set[setid].shm_id >= 0 )
+      rc = shmdt(p);
+    else
+#endif
+      rc = oo_resource_munmap(ci_netif_get_driver_handle(ni), p,
+                              CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET);
+    if( rc < 0 )
+      LOG_NV(ci_log("%s: munmap pkt set %d failed (%d)",
+                    __FUNCTION__, setid, rc));
   }
-  return pkt;
+
+  return (ci_ip_pkt_fmt*) __PKT_BUF(ni, id);
+
+ fail:
+  ci_log("Failed to map packets!");
+  ci_netif_unlock(ni);
+  ci_fail(("Crashing..."));
+  return NULL;
 }
 
 #endif
 
 
+/* Returns a packet set from the fullest non-empty free-count bucket, which
+ * has within (PKTS_PER_SET / OO_PKTSET_BUCKETS) of the most free buffers of
+ * any set, or -1 if no set has free buffers.  Preferring (nearly) free sets
+ * avoids pulling in any new sets and keeps the used packets in a small group
+ * of working sets.
+ */
 int ci_netif_pktset_best(ci_netif* ni)
 {
-  int i, ret = -1, n_free = 0;
-  
-  for( i = 0; i < ni->packets->sets_n; i ++ ) {
-    if( ni->packets->set[i].n_free > n_free ) {
-      n_free = ni->packets->set[i].n_free;
-      ret = i;
-    }
-    if( n_free >= CI_CFG_PKT_SET_HIGH_WATER ) {
-      /* We've found a set which is almost-free.  Let's reuse it
-       * to avoid pulling in any new sets, and keep all the used packets
-       * in a small group of working sets. */
-      return ret;
-    }
+  int b;
+
+  for( b = OO_PKTSET_BUCKETS - 1; b >= 0; --b )
+    if( ni->packets->bucket_head[b] >= 0 )
+      return ni->packets->bucket_head[b];
+  return -1;
+}
+
+
+/* Moves a packet set to the free-count bucket that matches its [n_free].
+ * Called whenever [n_free] may have crossed a bucket boundary.
+ */
+void ci_netif_pktset_rebucket(ci_netif* ni, int bufset_id)
+{
+  oo_pktbuf_manager* pm = ni->packets;
+  oo_pktbuf_set* set = &pm->set[bufset_id];
+  int bucket = OO_PKTSET_BUCKET(set->n_free);
+
+  if( bucket == set->bucket )
+    return;
+
+  if( set->bucket >= 0 ) {
+    if( set->bucket_prev >= 0 )
+      pm->set[set->bucket_prev].bucket_next = set->bucket_next;
+    else
+      pm->bucket_head[set->bucket] = set->bucket_next;
+    if( set->bucket_next >= 0 )
+      pm->set[set->bucket_next].bucket_prev = set->bucket_prev;
+  }
+
+  set->bucket = bucket;
+  if( bucket >= 0 ) {
+    set->bucket_prev = -1;
+    set->bucket_next = pm->bucket_head[bucket];
+    if( set->bucket_next >= 0 )
+      pm->set[set->bucket_next].bucket_prev = bufset_id;
+    pm->bucket_head[bucket] = bufset_id;
   }
-  return ret;
 }
 
 
@@ -206,6 +244,33 @@ void ci_netif_set_merge_atomic_flag(ci_netif* ni)
 }
 #endif
 
+/* Keep a released RX buffer aside for ci_netif_rx_post() to post straight
+ * back to the ring it came from, rather than returning it to the free
+ * pool.  It stays counted in [n_rx_pkts].  Returns true if it did so.
+ */
+ci_inline int ci_netif_pkt_rx_recycle(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  ci_netif_state_nic_t* nsn;
+
+  /* NONB_POOL is also set if we could not get the lock. */
+  if( (pkt->flags & CI_PKT_FLAG_NONB_POOL) || ni->state->mem_pressure ||
+      (unsigned) pkt->intf_i >= (unsigned) oo_stack_intf_max(ni) )
+    return 0;
+  nsn = &ni->state->nic[pkt->intf_i];
+  if( nsn->rx_recycle_n >= NI_OPTS(ni).rx_recycle )
+    return 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+  __ci_netif_pkt_clean(pkt);
+  pkt->flags |= CI_PKT_FLAG_RX;
+  pkt->next = nsn->rx_recycle;
+  nsn->rx_recycle = OO_PKT_P(pkt);
+  ++nsn->rx_recycle_n;
+  CITP_STATS_NETIF_INC(ni, rx_recycle_put);
+  return 1;
+}
+
+
 void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
                        CI_KERNEL_ARG(int* p_netif_is_locked))
 {
@@ -244,8 +309,11 @@ void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
   }
 #endif
 
-  if( pkt->flags & CI_PKT_FLAG_RX )
+  if( pkt->flags & CI_PKT_FLAG_RX ) {
+    if( NI_OPTS(ni).rx_recycle && ci_netif_pkt_rx_recycle(ni, pkt) )
+      return;
     CI_NETIF_STATE_MOD(ni, *p_netif_is_locked, n_rx_pkts, -);
+  }
   __ci_netif_pkt_clean(pkt);
 #if CI_CFG_POISON_BUFS
   if( NI_OPTS(ni).poison_rx_buf )
@@ -269,6 +337,61 @@ void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
 }
 
 
+static int ci_netif_sock_try_to_free(ci_netif* ni, citp_waitable_obj* wo,
+                                     int desperation)
+{
+  if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
+    return ci_tcp_try_to_free_pkts(ni, &wo->tcp, desperation);
+#if CI_CFG_UDP
+  else if( wo->waitable.state == CI_TCP_STATE_UDP )
+    return ci_udp_try_to_free_pkts(ni, &wo->udp, desperation);
+#endif
+  return 0;
+}
+
+
+/* How many of the sockets holding the most received buffers are tried
+ * before the others. */
+#define CI_NETIF_PKT_FREE_HEAVIEST  8
+
+static int ci_netif_pkt_try_to_free_heaviest(ci_netif* ni, int desperation,
+                                             int stop_once_freed_n)
+{
+  /* Free buffers from the sockets with the largest receive backlogs
+   * first.  Sockets holding no more than EF_MEM_PRESSURE_SOCK_PKTS are
+   * left alone here.
+   */
+  int heavy_id[CI_NETIF_PKT_FREE_HEAVIEST];
+  int heavy_n[CI_NETIF_PKT_FREE_HEAVIEST];
+  int i, n, n_heavy = 0, freed = 0;
+  unsigned id;
+
+  for( id = 0; id < ni->state->n_ep_bufs; ++id ) {
+    citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, id);
+    n = ci_netif_sock_rx_pkts(ni, &wo->waitable);
+    if( n <= NI_OPTS(ni).mem_pressure_sock_pkts ||
+        (n_heavy == CI_NETIF_PKT_FREE_HEAVIEST &&
+         n <= heavy_n[n_heavy - 1]) )
+      continue;
+    /* Insert into the list, which is sorted largest first. */
+    if( n_heavy < CI_NETIF_PKT_FREE_HEAVIEST )
+      ++n_heavy;
+    for( i = n_heavy - 1; i > 0 && heavy_n[i - 1] < n; --i ) {
+      heavy_n[i] = heavy_n[i - 1];
+      heavy_id[i] = heavy_id[i - 1];
+    }
+    heavy_n[i] = n;
+    heavy_id[i] = id;
+  }
+
+  for( i = 0; i < n_heavy && freed < stop_once_freed_n; ++i )
+    freed += ci_netif_sock_try_to_free(ni, ID_TO_WAITABLE_OBJ(ni, heavy_id[i]),
+                                       desperation);
+  CITP_STATS_NETIF_ADD(ni, pkts_reclaimed_heaviest, freed);
+  return freed;
+}
+
+
 int ci_netif_pkt_try_to_free(ci_netif* ni, int desperation, int stop_once_freed_n)
 {
   unsigned id;
@@ -286,14 +409,16 @@ int ci_netif_pkt_try_to_free(ci_netif* ni, int desperation, int stop_once_freed_
             == CI_NETIF_PKT_TRY_TO_FREE_MAX_DESP);
   CITP_STATS_NETIF(++(&ni->state->stats.pkt_scramble0)[desperation]);
 
+  if( NI_OPTS(ni).mem_pressure_sock_pkts ) {
+    freed = ci_netif_pkt_try_to_free_heaviest(ni, desperation,
+                                              stop_once_freed_n);
+    if( freed >= stop_once_freed_n )
+      return freed;
+  }
+
   for( id = 0; id < ni->state->n_ep_bufs; ++id ) {
-    citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, id);
-    if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
-      freed += ci_tcp_try_to_free_pkts(ni, &wo->tcp, desperation);
-#if CI_CFG_UDP
-    else if( wo->waitable.state == CI_TCP_STATE_UDP )
-      freed += ci_udp_try_to_free_pkts(ni, &wo->udp, desperation);
-#endif
+    freed += ci_netif_sock_try_to_free(ni, ID_TO_WAITABLE_OBJ(ni, id),
+                                       desperation);
     if( freed >= stop_once_freed_n )
       return freed;
   }
@@ -127,6 +127,30 @@ void ci_netif_dmaq_shove2(ci_netif* ni, int intf_i, int is_fresh)
 }
 
 
+void ci_netif_send_batch(ci_netif* ni, ci_ip_pkt_fmt* pkt,
+                         unsigned* intf_mask)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(pkt->intf_i >= 0);
+  ci_assert(pkt->intf_i < CI_CFG_MAX_INTERFACES);
+  ci_check( ! ci_eth_addr_is_zero((ci_uint8 *)oo_ether_dhost(pkt)));
+
+  __ci_netif_dmaq_insert_prep_pkt(ni, pkt);
+  __ci_netif_dmaq_put(ni, ci_netif_dmaq(ni, pkt->intf_i), pkt);
+  *intf_mask |= 1u << pkt->intf_i;
+}
+
+
+void ci_netif_send_batch_push(ci_netif* ni, unsigned intf_mask)
+{
+  int intf_i;
+
+  for( intf_i = 0; intf_mask != 0; ++intf_i, intf_mask >>= 1 )
+    if( (intf_mask & 1) && ci_netif_dmaq_not_empty(ni, intf_i) )
+      ci_netif_dmaq_shove2(ni, intf_i, 0 /*is_fresh*/);
+}
+
+
 void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
 {
   int intf_i, rc;
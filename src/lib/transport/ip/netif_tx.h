@@ -134,6 +134,16 @@ extern void ci_netif_dmaq_shove1(ci_netif*, int intf_i);
  */
 extern void ci_netif_dmaq_shove2(ci_netif*, int intf_i, int is_fresh);
 
+/* Puts [pkt] on the overflow queue of its interface without ringing the
+ * doorbell, and adds the interface to [*intf_mask].  Once a whole train
+ * of packets has been queued this way, ci_netif_send_batch_push() moves
+ * them to the hardware ring with one doorbell per interface.  Interfaces
+ * whose queue has been pushed by other means in the meantime are skipped.
+ */
+extern void ci_netif_send_batch(ci_netif*, ci_ip_pkt_fmt* pkt,
+                                unsigned* intf_mask);
+extern void ci_netif_send_batch_push(ci_netif*, unsigned intf_mask);
+
 
 #define ci_netif_dmaq(ni, nic_i)  (&(ni)->state->nic[nic_i].dmaq)
 
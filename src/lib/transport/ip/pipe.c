@@ -1739,6 +1739,180 @@ int ci_pipe_zc_move(ci_netif* ni, struct oo_pipe* pipe_src,
                               oo_pipe_zc_move_cb, &ctx);
 }
 
+
+/* Move complete buffers from the pipe to the send queue of a TCP socket in
+ * the same stack.  Each buffer becomes one segment, so we only take buffers
+ * whose payload fits in an MSS and which have room for the socket's headers
+ * in front of it.  Buffers that were spliced in from a TCP receive queue
+ * (see ci_pipe_zc_move_from_tcp()) usually already have their payload in the
+ * right place; otherwise the payload is moved within the buffer.
+ *
+ * We stop at the first buffer that can't be moved, or when the send queue
+ * is full, and leave it to the caller to copy what is left.  A partially
+ * read first buffer can be moved, but a partially requested last buffer
+ * can't.
+ */
+static int
+oo_pipe_zc_to_tcp_cb(void* c, ci_netif* ni, struct oo_pipe* p, int flags,
+                     ci_ip_pkt_fmt* head, int bytes_available, int read_len,
+                     ci_ip_pkt_fmt** next_pkt_out, int* next_pkt_payload_out,
+                     int* n_pkts_out)
+{
+  ci_tcp_state* ts = c;
+  ci_ip_pkt_fmt* pkt = head;
+  ci_ip_pkt_fmt* fill_list = NULL;
+  int bytes_can_move = CI_MIN(bytes_available, read_len);
+  int hdr_end = ETH_HLEN + ts->outgoing_hdrs_len;
+  ci_uint32 offset = p->read_ptr.offset;
+  int credit, n_pkts = 0, bytes = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert_equal(OO_PKT_P(head), p->read_ptr.pp);
+
+  *next_pkt_out = head;
+  *next_pkt_payload_out = 0;
+  *n_pkts_out = 0;
+
+  if( ! (ts->s.b.state & CI_TCP_STATE_SYNCHRONISED) || ts->s.tx_errno )
+    return 0;
+  credit = ci_tcp_tx_send_space(ni, ts);
+
+  while( n_pkts < credit && bytes < bytes_can_move ) {
+    int n = pkt->pf.pipe.pay_len - offset;
+    oo_pkt_p next;
+
+    if( n <= 0 || n > bytes_can_move - bytes || n > tcp_eff_mss(ts) ||
+        hdr_end + n > OO_PIPE_BUF_MAX_SIZE || pkt->refcount != 1 )
+      break;
+    next = oo_pipe_next_buf(p, pkt);
+    ci_tcp_tx_pkt_fill_in_place(ni, ts, pkt, pipe_get_point(ni, p, pkt, offset),
+                                n, &fill_list);
+    bytes += n;
+    ++n_pkts;
+    offset = 0;
+    pkt = PKT_CHK(ni, next);
+  }
+
+  if( n_pkts == 0 )
+    return 0;
+
+  /* If we stopped short the caller will copy the rest straight away, so
+   * don't push a partial segment now. */
+  ci_tcp_sendmsg_enqueue_filled(ni, ts, fill_list, bytes,
+                                bytes < bytes_can_move ? MSG_MORE :
+                                                         flags & MSG_MORE);
+  CITP_STATS_NETIF_ADD(ni, tcp_splice_from_pipe_bufs, n_pkts);
+
+  *next_pkt_out = pkt;
+  *n_pkts_out = n_pkts;
+  return bytes;
+}
+
+
+/* Zero-copy splice() from a pipe to a TCP socket in the same stack.
+ *
+ * Blocks (unless MSG_DONTWAIT) while the pipe is empty, but not for space
+ * in the send queue.  Returns the number of bytes moved, which may be 0 if
+ * nothing could be moved without copying: the caller should then fall back
+ * to a copying splice.  Supported flags: MSG_DONTWAIT, MSG_MORE.
+ */
+int ci_pipe_zc_move_to_tcp(ci_netif* ni, struct oo_pipe* p, ci_tcp_state* ts,
+                           int len, int flags)
+{
+  return oo_pipe_zc_read_bare(ni, p, len, flags,
+                              OO_PIPE_ZC_READ_BARE_FLAG_LOCK_STACK |
+                              OO_PIPE_ZC_READ_BARE_FLAG_REMOVE_BUFFERS,
+                              oo_pipe_zc_to_tcp_cb, ts);
+}
+
+
+/* Zero-copy splice() from a TCP socket to a pipe in the same stack.
+ *
+ * Whole packets are taken from the head of the socket's receive queue and
+ * inserted into the pipe, with [pf.pipe.base] pointing at the TCP payload.
+ * We stop at the first packet that can't be moved as a whole (it is chained,
+ * shared, or longer than the remaining [len]), or when the pipe is full.
+ *
+ * Never blocks.  Returns the number of bytes moved, which may be 0 if there
+ * was nothing that could be moved: the caller should then fall back to a
+ * copying splice, which also takes care of blocking, EOF and errors.
+ */
+int ci_pipe_zc_move_from_tcp(ci_netif* ni, struct oo_pipe* p,
+                             ci_tcp_state* ts, int len, int flags)
+{
+  struct ci_pipe_pkt_list pkts = {};
+  ci_ip_pkt_fmt* pkt;
+  int room, n, bytes = 0;
+
+  if( ! (ts->s.b.state & CI_TCP_STATE_SYNCHRONISED) ||
+      tcp_rcv_usr(ts) == 0 || len <= 0 )
+    return 0;
+
+  if( ci_sock_lock(ni, &ts->s.b) != 0 )
+    return 0;
+  ci_netif_lock(ni);
+
+  if( (p->aflags & (CI_PFD_AFLAG_CLOSED << CI_PFD_AFLAG_READER_SHIFT)) ||
+      TS_QUEUE_RX(ts) != &ts->recv1 ||
+      (tcp_urg_data(ts) & CI_TCP_URG_IS_HERE) ||
+      ci_tcp_loop_ring_used(ts) != 0 )
+    goto out;
+
+  if( p->bufs_num >= p->bufs_max )
+    oo_pipe_reap_empty_buffers(ni, p, 0, NULL);
+  room = (int) p->bufs_max - (int) p->bufs_num;
+
+  /* Free what has already been read, so that the packet at the extract
+   * pointer is at the head of the queue and is not empty.
+   */
+  ci_tcp_rx_reap_rxq_bufs_socklocked(ni, ts);
+
+  while( room > 0 && OO_PP_NOT_NULL(ts->recv1.head) ) {
+    pkt = PKT_CHK(ni, ts->recv1.head);
+    ci_assert(OO_PP_EQ(ts->recv1.head, ts->recv1_extract));
+    n = oo_offbuf_left(&pkt->buf);
+    if( n <= 0 || n > len - bytes || n > tcp_rcv_usr(ts) ||
+        pkt->refcount != 1 || pkt->n_buffers != 1 ||
+        OO_PP_NOT_NULL(pkt->frag_next) )
+      break;
+
+    ts->recv1_extract = ts->recv1.head = pkt->next;
+    ci_tcp_rx_buf_adjust(ni, ts, &ts->recv1, -1);
+    --ts->recv1.num;
+    ts->rcv_delivered += n;
+
+    if( pkt->flags & CI_PKT_FLAG_RX )
+      --ni->state->n_rx_pkts;
+    pkt->pf.pipe.base = (ci_uint8*) oo_offbuf_ptr(&pkt->buf) - pkt->dma_start;
+    pkt->pf.pipe.pay_len = n;
+    __ci_netif_pkt_clean(pkt);
+    ci_assert_le(pkt->pf.pipe.base + n, OO_PIPE_BUF_MAX_SIZE);
+    oo_pipe_pkt_list_push(&pkts, pkt);
+
+    bytes += n;
+    --room;
+  }
+
+  if( bytes == 0 )
+    goto out;
+
+  oo_pipe_insert_buffers(ni, p, &pkts);
+  ci_wmb();
+  p->bytes_added += bytes;
+  __oo_pipe_wake_peer(ni, p, CI_SB_FLAG_WAKE_RX);
+  CITP_STATS_NETIF_ADD(ni, tcp_splice_to_pipe_bufs, pkts.count);
+
+  if( NI_OPTS(ni).tcp_rcvbuf_mode == 1 )
+    ci_tcp_rcvbuf_drs(ni, ts);
+  if( SEQ_LE(ts->ack_trigger, ts->rcv_delivered) )
+    ci_tcp_recv_wnd_update_locked(ni, ts);
+
+ out:
+  ci_netif_unlock(ni);
+  ci_sock_unlock(ni, &ts->s.b);
+  return bytes;
+}
+
 #endif
 
 
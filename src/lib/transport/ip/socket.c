@@ -119,6 +119,19 @@ void ci_sock_cmn_init(ci_netif* ni, ci_sock_cmn* s, int can_poison)
 
 
 
+void ci_sock_rx_pkts_dump(ci_netif* ni, ci_sock_cmn* s, const char* pf,
+                          oo_dump_log_fn_t logger, void* log_arg)
+{
+  int rx_pkts = ci_netif_sock_rx_pkts(ni, &s->b);
+  if( NI_OPTS(ni).mem_pressure_sock_pkts == 0 )
+    logger(log_arg, "%s  rx_pkt_bufs: held=%d", pf, rx_pkts);
+  else
+    logger(log_arg, "%s  rx_pkt_bufs: held=%d limit=%d%s", pf, rx_pkts,
+           NI_OPTS(ni).mem_pressure_sock_pkts,
+           ci_netif_mem_pressure_sock_may_queue(ni, rx_pkts) ? "" : " OVER");
+}
+
+
 void ci_sock_cmn_dump(ci_netif* ni, ci_sock_cmn* s, const char* pf,
                       oo_dump_log_fn_t logger, void* log_arg)
 {
@@ -127,6 +140,7 @@ void ci_sock_cmn_dump(ci_netif* ni, ci_sock_cmn* s, const char* pf,
          (int) s->uuid CI_DEBUG_ARG((int)s->pid),
          CI_SOCK_FLAGS_PRI_ARG(s));
   logger(log_arg, "%s  rcvbuf=%d sndbuf=%d", pf, s->so.rcvbuf, s->so.sndbuf);
+  ci_sock_rx_pkts_dump(ni, s, pf, logger, log_arg);
   logger(log_arg, "%s  rcvtimeo_ms=%d sndtimeo_ms=%d sigown=%d "
          "cmsg="OO_CMSG_FLAGS_FMT,
          pf, s->so.rcvtimeo_msec, s->so.sndtimeo_msec, s->b.sigown,
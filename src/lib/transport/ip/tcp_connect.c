@@ -1622,12 +1622,6 @@ int ci_tcp_listen_init(ci_netif *ni, ci_tcp_socket_listen *tls)
   tls->n_listenq = 0;
   tls->n_listenq_new = 0;
 
-  /* Allocate and initialise the listen bucket */
-  tls->bucket = ci_ni_aux_alloc_bucket(ni);
-  if( OO_P_IS_NULL(tls->bucket) )
-    return -ENOBUFS;
-  tls->n_buckets = 1;
-
   /* Initialise the listenQ. */
   for( i = 0; i <= CI_CFG_TCP_SYNACK_RETRANS_MAX; ++i ) {
     sp = TS_OFF(ni, tls);
@@ -247,7 +247,9 @@ static void ci_tcp_state_recv_assert_valid(ci_netif* ni, ci_tcp_state* ts,
   if( ts->s.b.state & CI_TCP_STATE_ACCEPT_DATA )
     verify(SEQ_EQ(tcp_rcv_nxt(ts), ts->rcv_added));
 
-  seq = ts->rcv_delivered;
+  /* Data in the loopback ring precedes anything unread in recv1. */
+  bytes = ci_tcp_loop_ring_used(ts);
+  seq = ts->rcv_delivered + bytes;
 
   /* Iterate over both recv1 and recv2. */
   q = &ts->recv1;
@@ -578,6 +580,7 @@ void ci_tcp_state_dump_qs(ci_netif* ni, int ep_id, int dump)
   }
 
   log("%s: "NTS_FMT, __FUNCTION__, NTS_PRI_ARGS(ni, ts));
+  ci_sock_rx_pkts_dump(ni, &ts->s, "", ci_log_dump_fn, NULL);
   log("recv1: extract=%d", OO_PP_FMT(ts->recv1_extract));
   ci_netif_pkt_queue_dump(ni, &ts->recv1, 1, dump);
   log("recv2:");
@@ -674,9 +677,8 @@ void ci_tcp_socket_listen_dump(ci_netif* ni, ci_tcp_socket_listen* tls,
 {
   ci_tcp_socket_cmn_dump(ni, &tls->c, pf, logger, log_arg);
 
-  logger(log_arg, "%s  listenq: max=%d n=%d new=%d buckets=%d", pf, 
-         ci_tcp_listenq_max(ni), tls->n_listenq, tls->n_listenq_new,
-         tls->n_buckets);
+  logger(log_arg, "%s  listenq: max=%d n=%d new=%d", pf,
+         ci_tcp_listenq_max(ni), tls->n_listenq, tls->n_listenq_new);
   logger(log_arg, "%s  acceptq: max=%d n=%d accepted=%d", pf,
          tls->acceptq_max, ci_tcp_acceptq_n(tls), tls->acceptq_n_out);
   logger(log_arg, "%s  defer_accept=%d", pf, tls->c.tcp_defer_accept);
@@ -803,6 +805,11 @@ void ci_tcp_state_dump(ci_netif* ni, ci_tcp_state* ts,
                   " rob_pkts=%d q_pkts=%d+%d usr=%d",
          pf, ts->rcv_added - stats.rx_isn, stats.rx_pkts, ts->rob.num,
          ts->recv1.num, ts->recv2.num, tcp_rcv_usr(ts));
+  if( ts->loop_ring.n_bufs != 0 || ts->loop_ring.flags != 0 )
+    logger(log_arg, "%s  rcv: loop_ring bufs=%d used=%u%s", pf,
+           ts->loop_ring.n_bufs, ci_tcp_loop_ring_used(ts),
+           (ts->loop_ring.flags & OO_TCP_LOOP_RING_FLAG_NOMEM) ?
+             " NOMEM" : "");
 
   logger(log_arg,
          "%s  eff_mss=%d smss=%d amss=%d  used_bufs=%d wscl s=%d r=%d",
@@ -824,6 +831,9 @@ void ci_tcp_state_dump(ci_netif* ni, ci_tcp_state* ts,
   logger(log_arg, "%s  tx: defer=%d nomac=%u warm=%u warm_aborted=%u", pf,
          stats.tx_defer, stats.tx_nomac_defer, stats.tx_msg_warm,
          stats.tx_msg_warm_abort);
+  if( NI_OPTS(ni).tcp_send_magazine )
+    logger(log_arg, "%s  tx: mag_pkts=%d mag_hits=%u mag_misses=%u", pf,
+           OO_TCP_TX_MAG_N(&ts->tx_mag), stats.tx_mag_hits, stats.tx_mag_misses);
   logger(log_arg, "%s  tmpl: send_fast=%u send_slow=%u active=%u", pf,
          stats.tx_tmpl_send_fast, stats.tx_tmpl_send_slow,
          stats.tx_tmpl_active);
@@ -907,7 +917,10 @@ static void tcp_rx_checks_cmn(ci_netif* ni, ci_sock_cmn* s,
   if( chk & CI_TCP_RX_CHK_SRC_IS_EFAB ) {
     ci_uint8 mac_prefix[] = { 0x00, 0x0F, 0x53, 0x00 };
     if( memcmp(oo_ether_shost(pkt), mac_prefix, sizeof(mac_prefix)) ) {
-      ci_log(LPF "SHOST_NOT_EFAB:");
+      if( ci_netif_blog_enabled(ni) )
+        OO_BLOG(ni, TCP_RX_SHOST_NOT_EFAB);
+      else
+        ci_log(LPF "SHOST_NOT_EFAB:");
       *dump |= DUMP_PKT_ADDR | DUMP_SOCK_ADDR;
     }
   }
@@ -926,11 +939,33 @@ static void tcp_rx_checks_cmn(ci_netif* ni, ci_sock_cmn* s,
 }
 
 
+static void tcp_rx_checks_blog_cmn(ci_netif* ni, ci_ip_pkt_fmt* pkt,
+                                   unsigned dump)
+{
+  ci_tcp_hdr* tcp = PKT_TCP_HDR(pkt);
+
+  if( (dump & DUMP_PKT) == DUMP_PKT )
+    OO_BLOG(ni, TCP_RX_PKT, oo_ip_hdr(pkt)->ip_saddr_be32,
+            CI_BSWAP_BE16(tcp->tcp_source_be16),
+            oo_ip_hdr(pkt)->ip_daddr_be32,
+            CI_BSWAP_BE16(tcp->tcp_dest_be16), tcp->tcp_flags);
+
+  if( (dump & DUMP_PKT_ADDR) == DUMP_PKT_ADDR )
+    OO_BLOG(ni, TCP_RX_PKT_MAC, oo_blog_mac(oo_ether_shost(pkt)),
+            oo_blog_mac(oo_ether_dhost(pkt)));
+}
+
+
 static void tcp_rx_checks_dump_cmn(ci_netif* ni, ci_ip_pkt_fmt* pkt,
 				   unsigned dump)
 {
   ci_tcp_hdr* tcp = PKT_TCP_HDR(pkt);
 
+  if( ci_netif_blog_enabled(ni) ) {
+    tcp_rx_checks_blog_cmn(ni, pkt, dump);
+    return;
+  }
+
   if( (dump & DUMP_PKT) == DUMP_PKT )
     ci_log(LPF "pkt "CI_IP_PRINTF_FORMAT":%u=>"CI_IP_PRINTF_FORMAT":%u ["
 	   CI_TCP_FLAGS_FMT"]",
@@ -966,8 +1001,11 @@ void ci_tcp_rx_checks(ci_netif* ni, ci_tcp_state* ts, ci_ip_pkt_fmt* pkt)
     memcpy(mac, ci_ip_cache_ether_dhost(&ts->s.pkt), ETH_ALEN);
     mac[5] ^= twiddle;
     if( memcmp(oo_ether_shost(pkt), mac, ETH_ALEN) ) {
-      ci_log(LPF "SHOST_BAD: expected="CI_MAC_PRINTF_FORMAT,
-	     CI_MAC_PRINTF_ARGS(mac));
+      if( ci_netif_blog_enabled(ni) )
+        OO_BLOG(ni, TCP_RX_SHOST_BAD, oo_blog_mac(mac));
+      else
+        ci_log(LPF "SHOST_BAD: expected="CI_MAC_PRINTF_FORMAT,
+               CI_MAC_PRINTF_ARGS(mac));
       dump |= DUMP_PKT_ADDR | DUMP_SOCK_ADDR;
     }
   }
@@ -977,6 +1015,28 @@ void ci_tcp_rx_checks(ci_netif* ni, ci_tcp_state* ts, ci_ip_pkt_fmt* pkt)
    */
   tcp_rx_checks_dump_cmn(ni, pkt, dump);
 
+  if( ci_netif_blog_enabled(ni) ) {
+    if( (dump & DUMP_SOCK) == DUMP_SOCK ) {
+      OO_BLOG(ni, TCP_RX_SOCK, S_FMT(ts),
+              SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_nxt(ts)),
+              ci_tcp_inflight(ts), tcp_rcv_usr(ts), ts->s.b.state);
+      OO_BLOG(ni, TCP_RX_SOCK_ADDR, S_FMT(ts),
+              tcp_laddr_be32(ts), CI_BSWAP_BE16(tcp_lport_be16(ts)),
+              tcp_raddr_be32(ts), CI_BSWAP_BE16(tcp_rport_be16(ts)));
+    }
+    if( (dump & DUMP_SOCK_ADDR) == DUMP_SOCK_ADDR ) {
+      int stripe = 0;
+#if CI_CFG_PORT_STRIPING
+      stripe = !!(ts->tcpflags & CI_TCPT_FLAG_STRIPE);
+#endif
+      OO_BLOG(ni, TCP_RX_SOCK_MAC, S_FMT(ts),
+              oo_blog_mac(ci_ip_cache_ether_shost(&ts->s.pkt)),
+              oo_blog_mac(ci_ip_cache_ether_dhost(&ts->s.pkt)),
+              ts->s.pkt.hwport, stripe);
+    }
+    return;
+  }
+
   if( (dump & DUMP_SOCK) == DUMP_SOCK ) {
     ci_log(LNT_FMT "snd=%d inf=%d rcv=%d %s", LNT_PRI_ARGS(ni, ts),
 	   SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_nxt(ts)),
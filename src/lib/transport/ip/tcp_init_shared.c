@@ -57,12 +57,19 @@ static void ci_tcp_state_connected_opts_init(ci_netif* netif, ci_tcp_state* ts)
   oo_atomic_set(&ts->send_prequeue_in, 0);
   ts->send_in = 0;
   ts->send_out = 0;
+  ts->tx_mag.n = 0;
+  ts->tx_mag.pkts = OO_PP_NULL;
 
   /* Queues. */
   ci_ip_queue_init(&ts->recv1);
   ci_ip_queue_init(&ts->recv2);
   TS_QUEUE_RX_SET(ts, recv1);
   ts->recv1_extract = OO_PP_NULL;
+  ts->loop_ring.wr_pp = ts->loop_ring.rd_pp = OO_PP_NULL;
+  ts->loop_ring.wr_off = ts->loop_ring.rd_off = 0;
+  ts->loop_ring.n_bufs = 0;
+  ts->loop_ring.flags = 0;
+  ts->loop_ring.bytes_added = ts->loop_ring.bytes_removed = 0;
 
   /* Re-order buffer length is limited by our window. */
   ci_ip_queue_init(&ts->rob);
@@ -0,0 +1,277 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Shared-memory byte ring for accelerated TCP loopback.
+**   \date  2020/06/15
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* With EF_TCP_LOOPBACK_RING, data sent on an established accelerated
+ * loopback connection is copied straight into a ring of packet buffers
+ * owned by the receiving socket, instead of being turned into TCP segments
+ * and pushed through ci_ip_send_tcp_list_loopback() and the RX path.
+ *
+ * Both ends of an accelerated loopback connection always live in the same
+ * stack (EF_TCP_CLIENT_LOOPBACK modes 2-4 move one or both sockets), so the
+ * ring is in stack shared memory and is visible to both processes.
+ *
+ * The connection's sequence space is kept consistent: the sender advances
+ * snd_nxt/snd_una and the receiver advances rcv_nxt/rcv_added as if the
+ * bytes had been sent, received and acknowledged.  The receive window is
+ * therefore still honoured (and so SO_RCVBUF), window updates still flow
+ * back through the normal loopback ACK path, tcp_rcv_usr() still drives
+ * poll/epoll readiness, and a FIN sent by shutdown() still arrives after
+ * the data.
+ *
+ * Ordering invariant: the ring is only written when every unread byte of
+ * the receiver is already in the ring, so data in the ring always precedes
+ * any unread data in recv1.  Whenever the ring can't take the data, the
+ * sender falls back to the packet path and further ring writes are blocked
+ * until the receiver has consumed those packets.
+ */
+
+#define LPF "TCP LOOP RING "
+
+#include "ip_internal.h"
+#include <onload/sleep.h>
+
+
+ci_inline int ci_tcp_loop_ring_space(struct oo_tcp_loop_ring* r)
+{
+  return r->n_bufs * OO_TCP_LOOP_RING_BUF_SIZE -
+         (r->bytes_added - r->bytes_removed);
+}
+
+
+#ifndef __KERNEL__
+
+static int ci_tcp_loop_ring_can_send(ci_netif* ni, ci_tcp_state* ts,
+                                     ci_tcp_state* peer)
+{
+  return ts->s.tx_errno == 0 &&
+         peer->local_peer == S_SP(ts) &&
+         (peer->s.b.state & CI_TCP_STATE_ACCEPT_DATA) &&
+         ! (peer->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN) &&
+         peer->s.rx_errno == 0 &&
+         TS_QUEUE_RX(peer) == &peer->recv1 &&
+         ci_ip_queue_is_empty(&peer->recv2) &&
+         ci_ip_queue_is_empty(&peer->rob) &&
+         ci_tcp_sendq_is_empty(ts) &&
+         ts->send_prequeue == OO_PP_ID_NULL &&
+         ci_ip_queue_is_empty(&ts->retrans) &&
+         SEQ_EQ(tcp_enq_nxt(ts), tcp_snd_nxt(ts)) &&
+         SEQ_EQ(tcp_snd_una(ts), tcp_snd_nxt(ts)) &&
+         SEQ_EQ(tcp_snd_nxt(ts), tcp_rcv_nxt(peer)) &&
+         tcp_rcv_usr(peer) == ci_tcp_loop_ring_used(peer);
+}
+
+
+static int ci_tcp_loop_ring_alloc(ci_netif* ni, ci_tcp_state* ts)
+{
+  struct oo_tcp_loop_ring* r = &ts->loop_ring;
+  ci_ip_pkt_fmt* first = NULL;
+  ci_ip_pkt_fmt* last = NULL;
+  ci_ip_pkt_fmt* pkt;
+  int i;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert_equal(r->n_bufs, 0);
+  ci_assert_equal(ci_tcp_loop_ring_used(ts), 0);
+
+  if( (r->flags & OO_TCP_LOOP_RING_FLAG_NOMEM) || ni->state->mem_pressure )
+    return -ENOMEM;
+
+  for( i = 0; i < NI_OPTS(ni).tcp_loopback_ring; ++i ) {
+    pkt = ci_netif_pkt_alloc(ni, 0);
+    if( pkt == NULL ) {
+      LOG_TV(log(LNTS_FMT "failed to allocate loopback ring (%d/%d)",
+                 LNTS_PRI_ARGS(ni, ts), i, NI_OPTS(ni).tcp_loopback_ring));
+      CITP_STATS_NETIF_INC(ni, tcp_loop_ring_nomem);
+      for( pkt = first; i > 0; --i ) {
+        oo_pkt_p next = pkt->next;
+        pkt->next = OO_PP_NULL;
+        ci_netif_pkt_release(ni, pkt);
+        if( i > 1 )
+          pkt = PKT_CHK(ni, next);
+      }
+      r->flags |= OO_TCP_LOOP_RING_FLAG_NOMEM;
+      return -ENOMEM;
+    }
+    if( last != NULL )
+      last->next = OO_PKT_P(pkt);
+    else
+      first = pkt;
+    last = pkt;
+  }
+  last->next = OO_PKT_P(first);
+
+  r->wr_pp = r->rd_pp = OO_PKT_P(first);
+  r->wr_off = r->rd_off = 0;
+  /* The reader does not look at the pointers while the ring is empty, but
+   * make sure they're valid before anyone can see a non-zero [n_bufs].
+   */
+  ci_wmb();
+  r->n_bufs = i;
+  return 0;
+}
+
+
+int ci_tcp_loop_ring_send(ci_netif* ni, ci_tcp_state* ts, ci_iovec_ptr* piov)
+{
+  ci_tcp_state* peer;
+  struct oo_tcp_loop_ring* r;
+  ci_ip_pkt_fmt* pkt;
+  int space, n, total = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(NI_OPTS(ni).tcp_loopback_ring);
+  ci_assert(OO_SP_NOT_NULL(ts->local_peer));
+
+  peer = ID_TO_TCP(ni, ts->local_peer);
+  if( ! ci_tcp_loop_ring_can_send(ni, ts, peer) )
+    return 0;
+  r = &peer->loop_ring;
+  if( r->n_bufs == 0 && ci_tcp_loop_ring_alloc(ni, peer) != 0 )
+    return 0;
+
+  space = CI_MIN(ci_tcp_loop_ring_space(r),
+                 SEQ_SUB(ts->snd_max, tcp_snd_nxt(ts)));
+  if( space <= 0 ) {
+    CITP_STATS_NETIF_INC(ni, tcp_loop_ring_full);
+    return 0;
+  }
+
+  pkt = PKT_CHK(ni, r->wr_pp);
+  while( space > 0 && ! ci_iovec_ptr_is_empty_proper(piov) ) {
+    if( r->wr_off == OO_TCP_LOOP_RING_BUF_SIZE ) {
+      r->wr_pp = pkt->next;
+      r->wr_off = 0;
+      pkt = PKT_CHK(ni, r->wr_pp);
+    }
+    n = CI_MIN(space, (int) CI_IOVEC_LEN(&piov->io));
+    n = CI_MIN(n, OO_TCP_LOOP_RING_BUF_SIZE - r->wr_off);
+    memcpy(pkt->dma_start + r->wr_off, CI_IOVEC_BASE(&piov->io), n);
+    ci_iovec_ptr_advance(piov, n);
+    r->wr_off += n;
+    space -= n;
+    total += n;
+  }
+  if( total == 0 )
+    return 0;
+
+  /* Payload must be visible before the reader can see it in the ring, and
+   * the ring must be updated before tcp_rcv_usr() says there is data.
+   */
+  ci_wmb();
+  r->bytes_added += total;
+
+  tcp_enq_nxt(ts) += total;
+  tcp_snd_nxt(ts) = tcp_snd_una(ts) = tcp_enq_nxt(ts);
+  ts->t_last_sent = ci_tcp_time_now(ni);
+
+  tcp_rcv_nxt(peer) += total;
+  ci_wmb();
+  peer->rcv_added += total;
+  peer->ack_trigger = peer->rcv_delivered + ci_tcp_ack_trigger_delta(peer);
+  peer->t_last_recv_payload = ts->t_last_sent;
+
+  LOG_TV(log(LNTS_FMT "%d bytes via loopback ring to %d (ring used=%u)",
+             LNTS_PRI_ARGS(ni, ts), total, OO_SP_FMT(ts->local_peer),
+             ci_tcp_loop_ring_used(peer)));
+  CITP_STATS_NETIF_INC(ni, tcp_loop_ring_sends);
+
+  ci_tcp_wake_possibly_not_in_poll(ni, peer, CI_SB_FLAG_WAKE_RX);
+  return total;
+}
+
+#endif /* __KERNEL__ */
+
+
+int ci_tcp_loop_ring_recv(ci_netif* ni, ci_tcp_state* ts, ci_iovec_ptr* piov,
+                          int flags)
+{
+  struct oo_tcp_loop_ring* r = &ts->loop_ring;
+  ci_uint32 avail = ci_tcp_loop_ring_used(ts);
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p pp;
+  int off, n, total = 0;
+
+  ci_assert(ci_sock_is_locked(ni, &ts->s.b));
+
+  if( avail == 0 )
+    return 0;
+  /* Read the ring pointers and payload only after [bytes_added]. */
+  ci_rmb();
+
+  pp = r->rd_pp;
+  off = r->rd_off;
+  pkt = PKT_CHK(ni, pp);
+  while( avail > 0 && ! ci_iovec_ptr_is_empty_proper(piov) ) {
+    if( off == OO_TCP_LOOP_RING_BUF_SIZE ) {
+      pp = pkt->next;
+      off = 0;
+      pkt = PKT_CHK(ni, pp);
+    }
+    n = CI_MIN(avail, CI_IOVEC_LEN(&piov->io));
+    n = CI_MIN(n, OO_TCP_LOOP_RING_BUF_SIZE - off);
+    /* As with the packet path, MSG_TRUNC consumes data without writing to
+     * the user's buffer. */
+    if(CI_LIKELY( ! (flags & MSG_TRUNC) )) {
+#ifdef __KERNEL__
+      if( copy_to_user(CI_IOVEC_BASE(&piov->io), pkt->dma_start + off, n) ) {
+        ci_log("%s: faulted", __FUNCTION__);
+        break;
+      }
+#else
+      memcpy(CI_IOVEC_BASE(&piov->io), pkt->dma_start + off, n);
+#endif
+    }
+    ci_iovec_ptr_advance(piov, n);
+    off += n;
+    avail -= n;
+    total += n;
+  }
+
+  if( ! (flags & MSG_PEEK) && total > 0 ) {
+    r->rd_pp = pp;
+    r->rd_off = off;
+    /* Finish with the payload before the writer may reuse the space, and
+     * remove it from the ring before removing it from tcp_rcv_usr() so the
+     * writer never sees unread bytes outside the ring.
+     */
+    ci_wmb();
+    r->bytes_removed += total;
+    ci_wmb();
+    ts->rcv_delivered += total;
+  }
+  return total;
+}
+
+
+void ci_tcp_loop_ring_free(ci_netif* ni, ci_tcp_state* ts)
+{
+  struct oo_tcp_loop_ring* r = &ts->loop_ring;
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p pp = r->rd_pp;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  for( ; r->n_bufs > 0; --r->n_bufs ) {
+    pkt = PKT_CHK(ni, pp);
+    pp = pkt->next;
+    pkt->next = OO_PP_NULL;
+    ci_netif_pkt_release(ni, pkt);
+  }
+  r->wr_pp = r->rd_pp = OO_PP_NULL;
+  r->wr_off = r->rd_off = 0;
+  r->flags = 0;
+  r->bytes_removed = r->bytes_added;
+}
+
+/*! \cidoxg_end */
@@ -232,6 +232,10 @@ static void __ci_tcp_state_free(ci_netif *ni, ci_tcp_state *ts)
 
   ci_tcp_rx_queue_drop(ni, ts, &ts->recv1);
   ci_tcp_rx_queue_drop(ni, ts, &ts->recv2);
+  if( ts->loop_ring.n_bufs != 0 )
+    ci_tcp_loop_ring_free(ni, ts);
+  if( OO_PP_NOT_NULL(ts->tx_mag.pkts) )
+    ci_tcp_tx_mag_drain(ni, ts);
 
 #if CI_CFG_TIMESTAMPING
   ci_udp_recv_q_drop(ni, &ts->timestamp_q);
@@ -1138,9 +1142,14 @@ ci_tcp_rcvbuf_unabuse_socklocked(ci_netif* ni, ci_tcp_state* ts)
 int ci_tcp_try_to_free_pkts(ci_netif* ni, ci_tcp_state* ts,
                              int desperation)
 {
-  int freed;
+  int freed, mag_freed;
   ci_assert(ts->s.b.state & CI_TCP_STATE_TCP_CONN);
 
+  /* Buffers reserved for sendmsg() hold no data, so give them back
+   * first. */
+  mag_freed = ci_tcp_tx_mag_reclaim(ni, ts);
+  CITP_STATS_NETIF_ADD(ni, tcp_tx_mag_drained, mag_freed);
+
   switch( desperation ) {
   case 0:
     if( ! ci_sock_trylock(ni, &ts->s.b) )  break;
@@ -1150,20 +1159,20 @@ int ci_tcp_try_to_free_pkts(ci_netif* ni, ci_tcp_state* ts,
       freed -= __ci_tcp_rx_buf_count(ni, ts);
       ci_assert_ge(freed, 0);
       ci_sock_unlock(ni, &ts->s.b);
-      return freed;
+      return freed + mag_freed;
     }
   case 1:
     {
       freed = ts->rob.num;
       ci_tcp_drop_rob(ni, ts);
-      return freed;
+      return freed + mag_freed;
     }
   default:
     break;
   }
 
   /* ?? TODO: could also coalesce the retrans queue. */
-  return 0;
+  return mag_freed;
 }
 
 void
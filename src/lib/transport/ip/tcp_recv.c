@@ -101,18 +101,12 @@ int ci_tcp_send_wnd_update(ci_netif* ni, ci_tcp_state* ts, int sock_locked)
 }
 
 
-/* This is called after we've pulled a certain amount of data from the
-** receive queue, and sends a window update if appropriate.
+/* As ci_tcp_recvmsg_send_wnd_update(), for callers that already hold the
+** stack lock.
 */
-static void ci_tcp_recvmsg_send_wnd_update(ci_netif* ni, ci_tcp_state* ts)
+void ci_tcp_recv_wnd_update_locked(ci_netif* ni, ci_tcp_state* ts)
 {
-  if( ! ci_netif_trylock(ni) ) {
-    ci_bit_set(&ts->s.s_aflags, CI_SOCK_AFLAG_NEED_ACK_BIT);
-    if( ! ci_netif_lock_or_defer_work(ni, &ts->s.b) )
-      return;
-    ci_bit_clear(&ts->s.s_aflags, CI_SOCK_AFLAG_NEED_ACK_BIT);
-  }
-
+  ci_assert(ci_netif_is_locked(ni));
   CHECK_TS(ni, ts);
 
   LOG_TR(log(LNTS_FMT "ack_trigger=%x c/w rcv_delivered=%x "
@@ -148,7 +142,22 @@ static void ci_tcp_recvmsg_send_wnd_update(ci_netif* ni, ci_tcp_state* ts)
 
  out:
   CHECK_TS(ni, ts);
+}
+
+
+/* This is called after we've pulled a certain amount of data from the
+** receive queue, and sends a window update if appropriate.
+*/
+static void ci_tcp_recvmsg_send_wnd_update(ci_netif* ni, ci_tcp_state* ts)
+{
+  if( ! ci_netif_trylock(ni) ) {
+    ci_bit_set(&ts->s.s_aflags, CI_SOCK_AFLAG_NEED_ACK_BIT);
+    if( ! ci_netif_lock_or_defer_work(ni, &ts->s.b) )
+      return;
+    ci_bit_clear(&ts->s.s_aflags, CI_SOCK_AFLAG_NEED_ACK_BIT);
+  }
 
+  ci_tcp_recv_wnd_update_locked(ni, ts);
   ci_netif_unlock(ni);
 }
 
@@ -424,6 +433,36 @@ ci_tcp_recvmsg_get(struct tcp_recv_info *rinf)
 }
 
 
+/* Copy data from the loopback byte ring (EF_TCP_LOOPBACK_RING) to the
+** app's buffer(s).  Data in the ring precedes any unread data in recv1, so
+** this must be called before ci_tcp_recvmsg_get().
+*/
+static int ci_tcp_recvmsg_loop_ring(struct tcp_recv_info *rinf)
+{
+  ci_netif* ni = rinf->a->ni;
+  ci_tcp_state* ts = rinf->a->ts;
+  int n;
+
+  n = ci_tcp_loop_ring_recv(ni, ts, &rinf->piov, rinf->a->flags);
+  if( n <= 0 )
+    return 0;
+
+#ifndef __KERNEL__
+  /* No timestamps for ring data. */
+  if( rinf->rc == 0 )
+    rinf->a->msg->msg_controllen = 0;
+#endif
+
+  if( ! (rinf->a->flags & MSG_PEEK) ) {
+    if( NI_OPTS(ni).tcp_rcvbuf_mode == 1 )
+      ci_tcp_rcvbuf_drs(ni, ts);
+    if( SEQ_LE(ts->ack_trigger, ts->rcv_delivered) )
+      ci_tcp_recvmsg_send_wnd_update(ni, ts);
+  }
+  return n;
+}
+
+
 #ifndef __KERNEL__
 /* Returns >0 if socket is readable.  Returns 0 if spin times-out.  Returns
  * -ve error code otherwise.
@@ -577,7 +616,13 @@ int ci_tcp_recvmsg(const ci_tcp_recvmsg_args* a)
   ci_frc64(&start_frc);
 
  poll_recv_queue:
-  rinf.rc += ci_tcp_recvmsg_get(&rinf);
+  if(CI_UNLIKELY( ci_tcp_loop_ring_used(ts) != 0 )) {
+    rinf.rc += ci_tcp_recvmsg_loop_ring(&rinf);
+    if( ! ((flags & ONLOAD_MSG_ONEPKT) && rinf.rc > 0) )
+      rinf.rc += ci_tcp_recvmsg_get(&rinf);
+  }
+  else
+    rinf.rc += ci_tcp_recvmsg_get(&rinf);
 
   /* Return immediately if we've filled the app's buffer(s).
    * In case of empty buffer, we should wait for socket to be readable.
@@ -2594,6 +2594,10 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
   if (!already_parsed)
     ci_tcp_parse_options(netif, rxp, NULL);
 
+  rxp->hash = ci_tcp_synrecv_hash(netif, RX_PKT_DADDR(pkt),
+                                  tcp->tcp_dest_be16, RX_PKT_SADDR(pkt),
+                                  tcp->tcp_source_be16);
+
   if( CI_UNLIKELY(tcp->tcp_flags & CI_TCP_FLAG_RST) ) {
     handle_rx_listen_rst(netif, tls, rxp);
     return;
@@ -2877,8 +2881,8 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
     tsr = ci_ni_aux_p2synrecv(netif,
                               ci_ni_aux_alloc(netif,
                                               CI_TCP_AUX_TYPE_SYNRECV));
-    tsr->bucket_link = OO_P_NULL;
     tsr->hash = rxp->hash;
+    tsr->tls_id = S_SP(tls);
   }
 
   /* parse the SYN options */
@@ -4193,6 +4197,11 @@ static void handle_rx_slow(ci_tcp_state* ts, ci_netif* netif,
   if( pkt->pf.tcp_rx.pay_len <= 0 )
     /* Process segments without payload, as they'll be freed immediately. */
     goto continue_mem_pressure;
+  if( ci_netif_mem_pressure_sock_accept(
+                              netif, ci_netif_sock_rx_pkts(netif, &ts->s.b)) )
+    /* This socket is not the cause of the memory pressure, so don't make
+     * it suffer.  See EF_MEM_PRESSURE_SOCK_PKTS. */
+    goto continue_mem_pressure;
   CITP_STATS_NETIF_INC(netif, memory_pressure_drops);
   ts->tcpflags |= CI_TCPT_FLAG_MEM_DROP;
   ci_tcp_drop_rob(netif, ts);
@@ -4583,10 +4592,6 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
                   (SOCK_TO_TCP(sender)->tcpflags &
                    CI_TCPT_FLAG_LOOP_DEFERRED)) );
       /* SYN to listening socket or data with TCP_DEFER_ACCEPT */
-      rxp.hash = ci_netif_filter_hash(netif,
-                                      daddr, tcp->tcp_dest_be16,
-                                      saddr, tcp->tcp_source_be16,
-                                      IPPROTO_TCP);
       ci_tcp_rx_deliver_to_listen(s, &rxp);
     }
     else if( !bad_recipient && s->b.state & CI_TCP_STATE_TCP_CONN &&
@@ -4623,7 +4628,7 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
                                        &saddr, tcp->tcp_source_be16,
                                        IPPROTO_TCP, pkt->intf_i, pkt->vlan,
                                        ci_tcp_rx_deliver_to_conn, &rxp,
-                                       &rxp.hash);
+                                       NULL);
     if(CI_LIKELY( rxp.pkt == NULL ))
       return;
 
@@ -4650,8 +4655,7 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
                                    ip4->ip_daddr_be32, tcp->tcp_dest_be16,
                                    ip4->ip_saddr_be32, tcp->tcp_source_be16,
                                    IPPROTO_TCP, pkt->intf_i, pkt->vlan,
-                                   ci_tcp_rx_deliver_to_conn, &rxp,
-                                   &rxp.hash);
+                                   ci_tcp_rx_deliver_to_conn, &rxp, NULL);
     if(CI_LIKELY( rxp.pkt == NULL ))
       return;
 
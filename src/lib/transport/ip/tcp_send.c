@@ -734,8 +734,10 @@ int ci_tcp_tmpl_alloc(ci_netif* ni, ci_tcp_state* ts,
 #if CI_CFG_TIMESTAMPING
   /* This flag should not be set on a segment of length 0,
    * we assume this is never the case with templated sends */
-  if( onload_timestamping_want_tx_nic(ts->s.timestamping_flags) )
+  if( onload_timestamping_want_tx_nic(ts->s.timestamping_flags) ) {
     pkt->flags |= CI_PKT_FLAG_TX_TIMESTAMPED;
+    pkt->pf.tcp_tx.sock_id = S_SP(ts);
+  }
 #endif
 
   /* XXX: Do I have to worry about MSG_CORK? */
@@ -1797,6 +1799,119 @@ unroll_msg_warm(ci_netif* ni, ci_tcp_state* ts, struct tcp_send_info* sinf,
 }
 
 
+/* Returns the number of buffers in the magazine, or -1 if another thread
+ * has claimed it.
+ */
+ci_inline int ci_tcp_tx_mag_claim(struct oo_tcp_tx_mag* mag)
+{
+  ci_uint32 n = mag->n;
+  if( (n & OO_TCP_TX_MAG_CLAIMED) ||
+      ! ci_cas32u_succeed(&mag->n, n, n | OO_TCP_TX_MAG_CLAIMED) )
+    return -1;
+  return n;
+}
+
+
+ci_inline void ci_tcp_tx_mag_unclaim(struct oo_tcp_tx_mag* mag, int n)
+{
+  ci_wmb();
+  mag->n = n;
+}
+
+
+/* Release all the buffers in the send magazine.  The caller must have
+ * claimed the magazine, or the socket must be out of use.
+ */
+void ci_tcp_tx_mag_drain(ci_netif* ni, ci_tcp_state* ts)
+{
+  struct oo_tcp_tx_mag* mag = &ts->tx_mag;
+  ci_ip_pkt_fmt* pkt;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  while( OO_PP_NOT_NULL(mag->pkts) ) {
+    pkt = PKT_CHK(ni, mag->pkts);
+    mag->pkts = pkt->next;
+    ci_netif_pkt_release_1ref(ni, pkt);
+    --ni->state->n_async_pkts;
+  }
+  mag->n &= OO_TCP_TX_MAG_CLAIMED;
+}
+
+
+/* Release the buffers in the send magazine unless a sender has it claimed.
+ * Returns the number of buffers released.
+ */
+int ci_tcp_tx_mag_reclaim(ci_netif* ni, ci_tcp_state* ts)
+{
+  struct oo_tcp_tx_mag* mag = &ts->tx_mag;
+  int n;
+
+  if( OO_TCP_TX_MAG_N(mag) == 0 || (n = ci_tcp_tx_mag_claim(mag)) < 0 )
+    return 0;
+  ci_tcp_tx_mag_drain(ni, ts);
+  ci_tcp_tx_mag_unclaim(mag, 0);
+  return n;
+}
+
+
+/* Top up the send magazine once it is at most half full, so that it is
+ * refilled in batches.  Gives up the buffers instead if the stack is short
+ * of them.
+ */
+static void ci_tcp_tx_mag_refill(ci_netif* ni, ci_tcp_state* ts)
+{
+  struct oo_tcp_tx_mag* mag = &ts->tx_mag;
+  int max = NI_OPTS(ni).tcp_send_magazine;
+  ci_ip_pkt_fmt* pkt;
+  int n;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( OO_TCP_TX_MAG_N(mag) * 2 > max || (n = ci_tcp_tx_mag_claim(mag)) < 0 )
+    return;
+  if(CI_UNLIKELY( ni->state->mem_pressure )) {
+    ci_tcp_tx_mag_drain(ni, ts);
+    n = 0;
+  }
+  else
+    while( n < max && ci_netif_pkt_tx_may_alloc(ni) &&
+           (pkt = ci_netif_pkt_alloc(ni, CI_PKT_ALLOC_FOR_TCP_TX |
+                                         CI_PKT_ALLOC_NO_REAP)) != NULL ) {
+      ++ni->state->n_async_pkts;
+      pkt->next = mag->pkts;
+      mag->pkts = OO_PKT_P(pkt);
+      ++n;
+    }
+  ci_tcp_tx_mag_unclaim(mag, n);
+}
+
+
+/* Take buffers from the send magazine.  Needs neither the stack lock nor
+ * (unless another thread is sending on this socket) any atomic operation
+ * per buffer.
+ */
+static void ci_tcp_tx_mag_get(ci_netif* ni, ci_tcp_state* ts,
+                              struct tcp_send_info* sinf)
+{
+  struct oo_tcp_tx_mag* mag = &ts->tx_mag;
+  ci_ip_pkt_fmt* pkt;
+  int n = 0, avail;
+
+  if( mag->n != 0 && (avail = ci_tcp_tx_mag_claim(mag)) >= 0 ) {
+    for( ; sinf->n_needed > 0 && avail > 0; --sinf->n_needed, ++n ) {
+      pkt = PKT_CHK_NNL(ni, mag->pkts);
+      mag->pkts = pkt->next;
+      oo_pkt_filler_add_pkt(&sinf->pf, pkt);
+      --avail;
+    }
+    ci_tcp_tx_mag_unclaim(mag, avail);
+  }
+  ts->stats.tx_mag_hits += n;
+  ts->stats.tx_mag_misses += sinf->n_needed;
+}
+
+
 /* Grab packet buffers. */
 static int
 ci_tcp_send_alloc_pkts(ci_netif* ni, ci_tcp_state* ts,
@@ -1818,6 +1933,9 @@ ci_tcp_send_alloc_pkts(ci_netif* ni, ci_tcp_state* ts,
 
   sinf->n_needed -= got;
 
+  if( NI_OPTS(ni).tcp_send_magazine && sinf->n_needed > 0 )
+    ci_tcp_tx_mag_get(ni, ts, sinf);
+
   while( sinf->n_needed > 0 ) {
     if( si_trylock(ni, sinf) ) {
       if( (pkt = ci_netif_pkt_tx_tcp_alloc(ni, ts)) ) {
@@ -1960,6 +2078,22 @@ int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
   ci_assert_le(tcp_eff_mss(ts),
                CI_MAX_ETH_DATA_LEN - sizeof(ci_tcp_hdr) - sizeof(ci_ip4_hdr));
 
+#ifndef __KERNEL__
+  /* Established loopback connection: copy into the receiver's byte ring
+   * if we can.  Anything the ring can't take goes by the packet path.
+   */
+  if( NI_OPTS(ni).tcp_loopback_ring && OO_SP_NOT_NULL(ts->local_peer) &&
+      ! (flags & ONLOAD_MSG_WARM) && si_trylock(ni, &sinf) ) {
+    int n = ci_tcp_loop_ring_send(ni, ts, &piov);
+    sinf.total_sent += n;
+    sinf.total_unsent -= n;
+    if( sinf.total_unsent == 0 ) {
+      ci_netif_unlock(ni);
+      return sinf.total_sent;
+    }
+  }
+#endif
+
   if( si_trylock(ni, &sinf) && ci_ip_queue_not_empty(sendq) ) {
     ci_assert(! (flags & ONLOAD_MSG_WARM));
     /* Usually, non-empty sendq means we do not have any window to
@@ -2079,6 +2213,8 @@ int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
         }
         /* Assert that there's no need to free unused packets */
         ci_assert_equal(sinf.pf.alloc_pkt, NULL);
+        if( NI_OPTS(ni).tcp_send_magazine )
+          ci_tcp_tx_mag_refill(ni, ts);
         if( sinf.stack_locked ) ci_netif_unlock(ni);
         return sinf.total_sent;
       }
@@ -2534,6 +2670,72 @@ int ci_tcp_zc_send(ci_netif* ni, ci_tcp_state* ts, struct onload_zc_mmsg* msg,
 }
 
 
+/* Turn a packet buffer that already holds [len] bytes of payload at [data]
+ * (somewhere within the same buffer) into a TCP segment for [ts], and add
+ * it to [*fill_list] for ci_tcp_sendmsg_enqueue_filled().  Used by splice()
+ * to send buffers taken from a pipe without copying them.
+ *
+ * If the payload does not start exactly where this socket's headers end it
+ * is moved within the buffer; the caller must have checked that it fits.
+ */
+void ci_tcp_tx_pkt_fill_in_place(ci_netif* ni, ci_tcp_state* ts,
+                                 ci_ip_pkt_fmt* pkt, const void* data,
+                                 int len, ci_ip_pkt_fmt** fill_list)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert_equal(pkt->refcount, 1);
+  ci_assert_gt(len, 0);
+  ci_assert_le(len, tcp_eff_mss(ts));
+  ci_assert_nflags(pkt->flags, CI_PKT_FLAG_RX);
+
+  __ci_netif_pkt_clean(pkt);
+  ci_tcp_tx_pkt_init(pkt, ts->outgoing_hdrs_len, tcp_eff_mss(ts));
+  ci_assert_le(oo_offbuf_ptr(&pkt->buf) + len,
+               (char*) pkt + CI_CFG_PKT_BUF_SIZE);
+  if( oo_offbuf_ptr(&pkt->buf) != data )
+    memmove(oo_offbuf_ptr(&pkt->buf), data, len);
+  pkt->buf_len += len;
+  pkt->pay_len += len;
+  oo_offbuf_advance(&pkt->buf, len);
+  pkt->pf.tcp_tx.end_seq = len;
+
+  CI_USER_PTR_SET(pkt->pf.tcp_tx.next, *fill_list);
+  *fill_list = pkt;
+  /* ci_tcp_sendmsg_enqueue() expects packets it's given to be counted as
+   * async. */
+  ++ni->state->n_async_pkts;
+}
+
+
+/* Enqueue packets prepared by ci_tcp_tx_pkt_fill_in_place() and push them
+ * out.  [fill_list] is in reverse order, as built.  The caller holds the
+ * stack lock and has checked that the connection is synchronised, that
+ * [tx_errno] is clear and that there is room in the send queue.
+ */
+void ci_tcp_sendmsg_enqueue_filled(ci_netif* ni, ci_tcp_state* ts,
+                                   ci_ip_pkt_fmt* fill_list, int bytes,
+                                   int flags)
+{
+  int af = ipcache_af(&ts->s.pkt);
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(fill_list);
+  ci_assert(ts->s.b.state & CI_TCP_STATE_SYNCHRONISED);
+  ci_assert_equal(ts->s.tx_errno, 0);
+
+  if( (flags & MSG_MORE) || (ts->s.s_aflags & CI_SOCK_AFLAG_CORK) ) {
+    fill_list->flags |= CI_PKT_FLAG_TX_MORE;
+    fill_list->flags &=~ CI_PKT_FLAG_TX_PSH_ON_ACK;
+  }
+  ts->send_in += ci_tcp_sendmsg_enqueue(ni, ts, fill_list, bytes, &ts->send);
+  if( fill_list->flags & CI_PKT_FLAG_TX_MORE )
+    TX_PKT_IPX_TCP(af, fill_list)->tcp_flags = CI_TCP_FLAG_ACK;
+  else
+    TX_PKT_IPX_TCP(af, fill_list)->tcp_flags = CI_TCP_FLAG_PSH|CI_TCP_FLAG_ACK;
+  ci_tcp_tx_advance_nagle(ni, ts);
+}
+
+
 static int ci_tcp_ds_get_arp(ci_netif* ni, ci_tcp_state* ts)
 {
   int i;
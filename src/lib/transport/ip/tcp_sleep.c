@@ -22,6 +22,13 @@
 # define HANDLE_SIGNALS 0
 #endif
 
+#ifndef __KERNEL__
+# include <errno.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+# include <linux/futex.h>
+#endif
+
 
 /**********************************************************************
  *
@@ -31,6 +38,77 @@
 
 #ifndef __KERNEL__
 
+/* Wait for up to EF_FUTEX_SLEEP_USEC for [w->sleep_seq] to change, to be
+ * woken by citp_waitable_wake_futex() in another thread of this process.
+ * Like the kernel, drops the locks given in [*lock_flags] first.
+ *
+ * Returns 0 if woken (or maybe woken), -EAGAIN if the caller's timeout has
+ * expired, or 1 if the caller should go on to sleep in the kernel.
+ */
+static int ci_sock_sleep_futex(ci_netif* ni, citp_waitable* w, ci_bits why,
+                               unsigned* lock_flags, ci_uint64 sleep_seq,
+                               ci_uint32* timeout_ms_p)
+{
+  ci_uint64 usec = NI_OPTS(ni).futex_sleep_usec;
+  ci_uint64 start_frc, now_frc;
+  volatile ci_uint32* word;
+  ci_sleep_seq_t seq;
+  struct timespec ts;
+  ci_uint32 elapsed_ms;
+  int rc, saved_errno;
+
+  if( *lock_flags & CI_SLEEP_NETIF_LOCKED ) {
+    ci_netif_unlock(ni);
+    *lock_flags &=~ CI_SLEEP_NETIF_LOCKED;
+  }
+  if( *lock_flags & CI_SLEEP_SOCK_LOCKED ) {
+    ci_sock_unlock(ni, w);
+    *lock_flags &=~ CI_SLEEP_SOCK_LOCKED;
+  }
+
+  seq.all = sleep_seq;
+  word = why == CI_SB_FLAG_WAKE_RX ? &w->sleep_seq.rw.rx : &w->sleep_seq.rw.tx;
+  if( timeout_ms_p != NULL && *timeout_ms_p != 0 )
+    usec = CI_MIN(usec, (ci_uint64) *timeout_ms_p * 1000);
+
+  /* Ask to be woken before checking whether we need to be.  Wakers bump
+   * [sleep_seq] before looking at [wake_request]. */
+  ci_atomic32_or(&w->wake_request, why << CI_SB_FLAG_WAKE_FUTEX_SHIFT);
+  ci_mb();
+  if( w->sleep_seq.all != sleep_seq )
+    return 0;
+
+  CITP_STATS_NETIF_INC(ni, sock_futex_sleeps);
+  ts.tv_sec = usec / 1000000;
+  ts.tv_nsec = (usec % 1000000) * 1000;
+  saved_errno = errno;
+  ci_frc64(&start_frc);
+  rc = syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE,
+               why == CI_SB_FLAG_WAKE_RX ? seq.rw.rx : seq.rw.tx,
+               &ts, NULL, 0);
+  if( rc < 0 )
+    rc = -errno;
+  errno = saved_errno;
+
+  if( rc == 0 || rc == -EAGAIN )
+    /* Woken, or [sleep_seq] had already changed. */
+    return 0;
+  if( rc == -EINTR )
+    /* Let the kernel sleep deal with any deferred signal handlers. */
+    return 1;
+
+  CITP_STATS_NETIF_INC(ni, sock_futex_timeouts);
+  if( timeout_ms_p != NULL && *timeout_ms_p != 0 ) {
+    ci_frc64(&now_frc);
+    elapsed_ms = (now_frc - start_frc) / IPTIMER_STATE(ni)->khz;
+    if( elapsed_ms >= *timeout_ms_p )
+      return -EAGAIN;
+    *timeout_ms_p -= elapsed_ms;
+  }
+  return 1;
+}
+
+
 int ci_sock_sleep(ci_netif* ni, citp_waitable* w, ci_bits why,
                   unsigned lock_flags, ci_uint64 sleep_seq,
                   ci_uint32 *timeout_ms_p)
@@ -56,6 +134,17 @@ int ci_sock_sleep(ci_netif* ni, citp_waitable* w, ci_bits why,
   ci_assert(!(lock_flags & CI_SLEEP_NETIF_LOCKED) || ci_netif_is_locked(ni));
   ci_assert(!(lock_flags & CI_SLEEP_SOCK_LOCKED) || ci_sock_is_locked(ni, w));
 
+  /* Pipes are woken only from the kernel. */
+  if( NI_OPTS(ni).futex_sleep_usec != 0 &&
+      (why == CI_SB_FLAG_WAKE_RX || why == CI_SB_FLAG_WAKE_TX) &&
+      w->state != CI_TCP_STATE_PIPE &&
+      ! (ni->state->flags & CI_NETIF_FLAG_MULTI_PROCESS) ) {
+    rc = ci_sock_sleep_futex(ni, w, why, &lock_flags, sleep_seq,
+                             timeout_ms_p);
+    if( rc <= 0 )
+      return rc;
+  }
+
   op.sock_id = W_SP(w);
   op.why = why;
   op.sleep_seq = sleep_seq;
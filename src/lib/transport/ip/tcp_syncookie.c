@@ -17,129 +17,115 @@ static int syncookie_mss[8] =
 
 
 
-/* Siphash-2-4 implementation */
-
-struct siphash {
-  ci_uint64 v0, v1, v2, v3;
-
-  union {
-    ci_uint64 a;
-    unsigned char b[8];
-  } buf;
-  unsigned char* p;
-  ci_uint64 c;
-};
+/* Siphash-2-4 implementation
+ *
+ * The inputs here are short and of fixed length: 13 bytes (ports, IPv4
+ * addresses, and the time and MSS index) for a syncookie, and a 4-tuple
+ * for the synrecv table.  Rather than feeding them byte by byte through a
+ * generic implementation, the callers build the little-endian message
+ * words directly and the rounds run in registers.  The syncookie is the
+ * same as SipHash-2-4 of the byte string used before.
+ */
 
 #define SIP_ROTL(x, b) (ci_uint64)(((x) << (b)) | ( (x) >> (64 - (b))))
 
-static void
-sip_round(struct siphash* h, int rounds)
+#define SIP_ROUND(v0, v1, v2, v3)                \
+  do {                                          \
+    v0 += v1;                                   \
+    v1 = SIP_ROTL(v1, 13);                      \
+    v1 ^= v0;                                   \
+    v0 = SIP_ROTL(v0, 32);                      \
+    v2 += v3;                                   \
+    v3 = SIP_ROTL(v3, 16);                      \
+    v3 ^= v2;                                   \
+    v0 += v3;                                   \
+    v3 = SIP_ROTL(v3, 21);                      \
+    v3 ^= v0;                                   \
+    v2 += v1;                                   \
+    v1 = SIP_ROTL(v1, 17);                      \
+    v1 ^= v2;                                   \
+    v2 = SIP_ROTL(v2, 32);                      \
+  } while( 0 )
+
+#define SIP_SYNCOOKIE_LEN 13
+
+/* Hashes a message of [len] bytes: [n] full words [m] followed by the final
+ * word [b], which holds the remaining len % 8 bytes. */
+static ci_uint64
+sip_hash_w(const ci_uint64* key, const ci_uint64* m, int n, ci_uint64 b,
+           unsigned len)
 {
+  ci_uint64 v0 = 0x736f6d6570736575ULL ^ key[0];
+  ci_uint64 v1 = 0x646f72616e646f6dULL ^ key[1];
+  ci_uint64 v2 = 0x6c7967656e657261ULL ^ key[0];
+  ci_uint64 v3 = 0x7465646279746573ULL ^ key[1];
   int i;
 
-  for( i = 0; i < rounds; i++ ) {
-    h->v0 += h->v1;
-    h->v1 = SIP_ROTL(h->v1, 13);
-    h->v1 ^= h->v0;
-    h->v0 = SIP_ROTL(h->v0, 32);
-
-    h->v2 += h->v3;
-    h->v3 = SIP_ROTL(h->v3, 16);
-    h->v3 ^= h->v2;
-
-    h->v0 += h->v3;
-    h->v3 = SIP_ROTL(h->v3, 21);
-    h->v3 ^= h->v0;
-
-    h->v2 += h->v1;
-    h->v1 = SIP_ROTL(h->v1, 17);
-    h->v1 ^= h->v2;
-    h->v2 = SIP_ROTL(h->v2, 32);
+  /* The full words... */
+  for( i = 0; i < n; ++i ) {
+    v3 ^= m[i];
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= m[i];
   }
-}
 
-static ci_uint64
-sip_hash(ci_uint64* key, const void* data, int len)
-{
-  struct siphash h;
-  const unsigned char *p = data, *pe = p + len;
-  ci_uint64 m;
-  char left;
-  ci_uint64 b;
-
-  /* init */
-  memset(&h, 0, sizeof(h));
-  h.v0 = 0x736f6d6570736575ULL ^ key[0];
-  h.v1 = 0x646f72616e646f6dULL ^ key[1];
-  h.v2 = 0x6c7967656e657261ULL ^ key[0];
-  h.v3 = 0x7465646279746573ULL ^ key[1];
-  h.p = h.buf.b;
-
-  /* update */
-  do {
-    while( p < pe && h.p - h.buf.b < sizeof(h.buf.b) )
-      *h.p++ = *p++;
-
-    if( h.p - h.buf.b < sizeof(h.buf.b) )
-      break;
-
-    m = CI_BSWAP_LE64(h.buf.a);
-    h.v3 ^= m;
-    sip_round(&h, 2);
-    h.v0 ^= m;
-
-    h.p = h.buf.b;
-    h.c += 8;
-  } while( pe - p > 0 );
-
-  /* finish */
-  left = h.p - h.buf.b;
-  b = (h.c + left) << 56;
-
-  switch (left) {
-    case 7: b |= (uint64_t)h.buf.b[6] << 48; /* fall through */
-    case 6: b |= (uint64_t)h.buf.b[5] << 40; /* fall through */
-    case 5: b |= (uint64_t)h.buf.b[4] << 32; /* fall through */
-    case 4: b |= (uint64_t)h.buf.b[3] << 24; /* fall through */
-    case 3: b |= (uint64_t)h.buf.b[2] << 16; /* fall through */
-    case 2: b |= (uint64_t)h.buf.b[1] << 8;  /* fall through */
-    case 1: b |= (uint64_t)h.buf.b[0] << 0;  /* fall through */
-    case 0: break;
-  }
+  /* ...and the final word carrying the tail and the length. */
+  b |= (ci_uint64) len << 56;
+  v3 ^= b;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  v0 ^= b;
 
-  h.v3 ^= b;
-  sip_round(&h, 2);
-  h.v0 ^= b;
-  h.v2 ^= 0xff;
-  sip_round(&h, 4);
+  v2 ^= 0xff;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
 
-  return h.v0 ^ h.v1 ^ h.v2  ^ h.v3;
+  return v0 ^ v1 ^ v2 ^ v3;
 }
 
 static ci_uint32
 ci_tcp_syncookie_hash(ci_netif* netif, ci_tcp_socket_listen* tls,
                       ci_tcp_state_synrecv* tsr, int t, int m)
 {
-  ci_uint8 hash_data[13];
-
-  hash_data[0] = tsr->l_port & 0xff;
-  hash_data[1] = tsr->l_port >> 8;
-  hash_data[2] = tsr->r_port & 0xff;
-  hash_data[3] = tsr->r_port >> 8;
-  hash_data[4] = tsr->l_addr.ip4 & 0xff;
-  hash_data[5] = (tsr->l_addr.ip4 & 0xff00) >> 8;
-  hash_data[6] = (tsr->l_addr.ip4 & 0xff0000) >> 16;
-  hash_data[7] = (tsr->l_addr.ip4 & 0xff000000) >> 24;
-  hash_data[8] = tsr->r_addr.ip4 & 0xff;
-  hash_data[9] = (tsr->r_addr.ip4 & 0xff00) >> 8;
-  hash_data[10] = (tsr->r_addr.ip4 & 0xff0000) >> 16;
-  hash_data[11] = (tsr->r_addr.ip4 & 0xff000000) >> 24;
-  hash_data[12] = t << 3 | m;
+  /* Bytes 0-7: local port, remote port, local address.
+   * Bytes 8-12: remote address, t << 3 | m. */
+  ci_uint64 w0 = (ci_uint64) tsr->l_port |
+                 ((ci_uint64) tsr->r_port << 16) |
+                 ((ci_uint64) (ci_uint32) tsr->l_addr.ip4 << 32);
+  ci_uint64 w1 = (ci_uint64) (ci_uint32) tsr->r_addr.ip4 |
+                 ((ci_uint64) (ci_uint8) (t << 3 | m) << 32);
 
   ci_assert_equal(sizeof(netif->state->hash_salt),
                   2 * sizeof(ci_uint64));
-  return (ci_uint32)sip_hash((void *)netif->state->hash_salt,
-                             hash_data, sizeof(hash_data));
+  return (ci_uint32)sip_hash_w((const void*) netif->state->hash_salt,
+                               &w0, 1, w1, SIP_SYNCOOKIE_LEN);
+}
+
+/* Index of a 4-tuple in the synrecv table.  This must be keyed: the
+ * filter table hash is trivially invertible, so with it a SYN flood from
+ * chosen addresses and ports could put every syn-recv state in one probe
+ * sequence. */
+ci_uint32
+ci_tcp_synrecv_hash(ci_netif* netif, ci_addr_t laddr, ci_uint16 lport_be16,
+                    ci_addr_t raddr, ci_uint16 rport_be16)
+{
+  const ci_uint64* key = (const void*) netif->state->hash_salt;
+  ci_uint64 ports = (ci_uint64) lport_be16 | ((ci_uint64) rport_be16 << 16);
+  ci_uint64 m[4];
+
+#if CI_CFG_IPV6
+  if( CI_IS_ADDR_IP6(laddr) ) {
+    m[0] = laddr.u64[0];
+    m[1] = laddr.u64[1];
+    m[2] = raddr.u64[0];
+    m[3] = raddr.u64[1];
+    return (ci_uint32) sip_hash_w(key, m, 4, ports, 36);
+  }
+#endif
+  m[0] = ports | ((ci_uint64) (ci_uint32) laddr.ip4 << 32);
+  return (ci_uint32) sip_hash_w(key, m, 1, (ci_uint32) raddr.ip4, 12);
 }
 
 /* End of siphash implementation */
@@ -19,334 +19,166 @@
 
 #define LPF "TCP SYNRECV "
 
-#define TSR_FMT "ptr:%x next:%x hash:%x l:"IPX_FMT":%d r:"IPX_FMT":%d"
+#define TSR_FMT "ptr:%x listen:%d hash:%x l:"IPX_FMT":%d r:"IPX_FMT":%d"
 #define TSR_ARGS(tsr)                                               \
-  ci_tcp_synrecv2p(ni, tsr), tsr->bucket_link, tsr->hash,           \
+  ci_tcp_synrecv2p(ni, tsr), OO_SP_FMT(tsr->tls_id), tsr->hash,     \
   IPX_ARG(AF_IP(tsr->l_addr)), CI_BSWAP_BE16(tsr->l_port),          \
   IPX_ARG(AF_IP(tsr->r_addr)), CI_BSWAP_BE16(tsr->r_port)
 
-#ifdef __KERNEL__
-/* We do not expect per-bucket list to be longer than a few members.
- * However, we must not break things if attacker managed to make a lot of
- * connection with the same hash (and the hash used here is not
- * cryptographically strong).
- * Finally, we must impose some limit to avoid malicious userland from
- * making kernel spin in the loop undefinetly long. */
-#define CI_LISTENQ_BUCKET_LIST_LIMIT(ni) NI_OPTS(ni).tcp_backlog_max
-#endif
 
-/* tcp_backlog_max <= 2^4:
- *      max level is 0 (2^4 different lists)
- * tcp_backlog_max <= 2^8:
- *      max level is 1 (2^8 different lists if no hash collisions happen)
- * tcp_backlog_max <= 2^12 = 4096:
- *      max level is 2.
+/* The syn-recv states of all the listening sockets in the stack are
+ * indexed by one flat open-addressed hash table, ni->synrecv_table.  It
+ * has at least twice as many entries as there may be syn-recv states, so
+ * probe sequences are short, and each entry carries the hash so that
+ * probing an occupied slot does not need to touch the syn-recv state
+ * unless the hash matches.  Collisions are resolved by linear probing,
+ * and removal shifts the following entries back so that no tombstones
+ * are needed.  Linear probing relies on the hash spreading the entries,
+ * which an attacker choosing addresses and ports must not be able to
+ * defeat, so the hash is ci_tcp_synrecv_hash(), keyed per stack.
+ *
+ * The table lives in the shared state, so all loops are bounded by the
+ * table size rather than by finding an empty slot.
  */
-#define CI_LISTENQ_BUCKET_MAX_DEPTH(ni) \
-    ((ci_log2_le(NI_OPTS(ni).tcp_backlog_max) - 1) / 4)
 
-ci_inline int ci_tcp_listenq_hash2idx(ci_uint32 hash, int level)
+ci_inline unsigned ci_tcp_synrecv_table_mask(ci_netif* ni)
 {
-  return (hash >> (CI_TCP_LISTEN_BUCKET_S * level)) &
-      ((1 << CI_TCP_LISTEN_BUCKET_S) - 1);
+  return ni->state->synrecv_table_entries_n - 1;
 }
 
 
-/* Iterate through all the syn-recv states in this bucket.
- *
- * fn_tsr() callback function is called for each syn-recv state.
- *
- * If fn_bucket() callback function is not NULL, then it is called for each
- * (sub-)bucket, including the top one.  fn_bucket() is called after all
- * the syn-recv states have been handled via fn_tsr() callback.
- */
-static int
-ci_tcp_listenq_bucket_iter(ci_netif* ni, ci_tcp_listen_bucket* bucket,
-                           void (fn_tsr)(ci_netif* ni,
-                                         ci_tcp_state_synrecv* tsr,
-                                         void* arg),
-                           void (fn_bucket)(ci_netif* ni,
-                                            ci_tcp_listen_bucket* bucket,
-                                            void* arg),
-                           void* arg)
+static void
+ci_tcp_synrecv_table_insert(ci_netif* ni, ci_tcp_state_synrecv* tsr)
 {
-  ci_ni_aux_mem* aux;
-  int idx;
-  int ret = 0;
+  ci_tcp_synrecv_table_entry* table = ni->synrecv_table;
+  unsigned mask = ci_tcp_synrecv_table_mask(ni);
+  unsigned i = tsr->hash & mask;
+  unsigned n;
 
-  for( idx = 0; idx < CI_TCP_LISTEN_BUCKET_SIZE; idx++ ) {
-    if( OO_P_IS_NULL(bucket->bucket[idx]) )
-      continue;
-    aux = ci_ni_aux_p2aux(ni, bucket->bucket[idx]);
-    if( aux->type == CI_TCP_AUX_TYPE_BUCKET ) {
-      ci_tcp_listenq_bucket_iter(ni, &aux->u.bucket,
-                                 fn_tsr, fn_bucket, arg);
-    }
-    else {
-      oo_p tsr_p = tsr_p = bucket->bucket[idx];
-      do {
-        ci_tcp_state_synrecv* tsr = &ci_ni_aux_p2aux(ni, tsr_p)->u.synrecv;
-        tsr_p = tsr->bucket_link;
-        fn_tsr(ni, tsr, arg);
-      } while( OO_P_NOT_NULL(tsr_p) );
+  LOG_TV(ci_log("%s([%d] "TSR_FMT")", __func__, NI_ID(ni), TSR_ARGS(tsr)));
+
+  for( n = 0; n <= mask; ++n, i = (i + 1) & mask )
+    if( OO_P_IS_NULL(table[i].tsr) ) {
+      table[i].hash = tsr->hash;
+      table[i].tsr = ci_tcp_synrecv2p(ni, tsr);
+      return;
     }
-  }
-  if( fn_bucket != NULL )
-    fn_bucket(ni, bucket, arg);
 
-  return ret;
+  /* There are fewer syn-recv states than table entries, so we only get
+   * here if the table has been corrupted. */
+  ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE, __FUNCTION__);
 }
 
 
+/* Empty the entry at [i], and move back any following entries in the
+ * same probe sequence whose home slot is not between [i] and where they
+ * are now. */
 static void
-ci_tcp_listenq_synrecv_drop(ci_netif* ni, ci_tcp_state_synrecv* tsr,
-                            void* arg)
+ci_tcp_synrecv_table_remove_slot(ci_netif* ni, unsigned i)
 {
-  int* ret = arg;
-
-  if( OO_SP_IS_NULL(tsr->local_peer) )
-    ci_ni_dllist_remove(ni, ci_tcp_synrecv2link(tsr));
-  /* RFC 793 tells us to send FIN and move to FIN-WAIT1 state.
-   * However, Linux (and probably everybody else) does not do it. */
-  ci_tcp_synrecv_free(ni, tsr);
-  (*ret)++;
-}
-
-static void
-ci_tcp_listenq_bucket_drop(ci_netif* ni, ci_tcp_listen_bucket* bucket,
-                              void* arg)
-{
-  ci_ni_aux_free(ni, CI_CONTAINER(ci_ni_aux_mem, u.bucket, bucket));
+  ci_tcp_synrecv_table_entry* table = ni->synrecv_table;
+  unsigned mask = ci_tcp_synrecv_table_mask(ni);
+  unsigned j = i;
+  unsigned n;
+
+  for( n = 0; n < mask; ++n ) {
+    j = (j + 1) & mask;
+    if( OO_P_IS_NULL(table[j].tsr) )
+      break;
+    if( ((j - table[j].hash) & mask) >= ((j - i) & mask) ) {
+      table[i] = table[j];
+      i = j;
+    }
+  }
+  table[i].tsr = OO_P_NULL;
 }
 
 
 static void
-ci_tcp_listenq_bucket_insert(ci_netif* ni, ci_tcp_socket_listen* tls,
-                             ci_tcp_listen_bucket* bucket,
-                             ci_tcp_state_synrecv* tsr, int level)
+ci_tcp_synrecv_table_remove(ci_netif* ni, ci_tcp_state_synrecv* tsr)
 {
-  ci_ni_aux_mem* aux;
-  int idx = ci_tcp_listenq_hash2idx(tsr->hash, level);
+  ci_tcp_synrecv_table_entry* table = ni->synrecv_table;
+  unsigned mask = ci_tcp_synrecv_table_mask(ni);
+  unsigned i = tsr->hash & mask;
   oo_p tsr_p = ci_tcp_synrecv2p(ni, tsr);
-#ifdef __KERNEL__
-  int i = 0;
-#endif
-  oo_p nbucket;
+  unsigned n;
 
-  LOG_TV(ci_log("%s([%d] level=%d "TSR_FMT")", __func__,
-                NI_ID(ni), level, TSR_ARGS(tsr)));
-
-  if( OO_P_IS_NULL(bucket->bucket[idx]) ) {
-    bucket->bucket[idx] = tsr_p;
-    return;
-  }
+  LOG_TV(ci_log("%s([%d] "TSR_FMT")", __func__, NI_ID(ni), TSR_ARGS(tsr)));
 
-  level++;
-  aux = ci_ni_aux_p2aux(ni, bucket->bucket[idx]);
-  if( aux->type == CI_TCP_AUX_TYPE_BUCKET ) {
-    ci_tcp_listenq_bucket_insert(ni, tls, &aux->u.bucket, tsr, level);
-    return;
-  }
-
-  /* So, this bucket contains of a list of other synrecv states.  We add
-   * our trs to this list and try to improve things by allocating
-   * next-level bucket. */
-  tsr->bucket_link = bucket->bucket[idx];
-  bucket->bucket[idx] = tsr_p;
-
-  if( level > CI_LISTENQ_BUCKET_MAX_DEPTH(ni) )
-    return;
-
-  nbucket = ci_ni_aux_alloc_bucket(ni);
-  if( OO_P_IS_NULL(nbucket) )
-    return;
-  bucket->bucket[idx] = nbucket;
-  bucket = ci_ni_aux_p2bucket(ni, nbucket);
-  tls->n_buckets++;
-
-  while( OO_P_NOT_NULL(tsr_p) ) {
-    tsr = &ci_ni_aux_p2aux(ni, tsr_p)->u.synrecv;
-#ifdef __KERNEL__
-    if( i++ > CI_LISTENQ_BUCKET_LIST_LIMIT(ni) ) {
-      ci_tcp_listenq_bucket_insert(ni, tls, bucket, tsr, level);
-      ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE,
-                              __FUNCTION__);
+  for( n = 0; n <= mask; ++n, i = (i + 1) & mask ) {
+    if( OO_P_IS_NULL(table[i].tsr) )
+      break;
+    if( table[i].tsr == tsr_p ) {
+      ci_tcp_synrecv_table_remove_slot(ni, i);
       return;
     }
-#endif
-    tsr_p = tsr->bucket_link;
-    tsr->bucket_link = OO_P_NULL;
-    ci_tcp_listenq_bucket_insert(ni, tls, bucket, tsr, level);
-  }
-}
-
-/* Return 1 if the bucket is empty now */
-static int
-ci_tcp_listenq_bucket_remove(ci_netif* ni, ci_tcp_socket_listen* tls,
-                             ci_tcp_listen_bucket* bucket,
-                             ci_tcp_state_synrecv* tsr, int level)
-{
-  ci_ni_aux_mem* aux;
-  int idx = ci_tcp_listenq_hash2idx(tsr->hash, level);
-  oo_p tsr_p = ci_tcp_synrecv2p(ni, tsr);
-
-  /* Fixme: we remove empty buckets only.  In theory, it may be useful to
-   * remove a bucket with one non-empty list, but it maked code more
-   * complicated. */
-  int empty = 0;
-#ifdef __KERNEL__
-  int i = 0;
-
-  if( level > CI_LISTENQ_BUCKET_MAX_DEPTH(ni) ) {
-    ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE, __FUNCTION__);
-    return 0;
-  }
-#endif
-
-  LOG_TV(ci_log("%s([%d] level=%d "TSR_FMT")", __func__,
-                NI_ID(ni), level, TSR_ARGS(tsr)));
-  ci_assert( OO_P_NOT_NULL(bucket->bucket[idx]) );
-#ifdef __KERNEL__
-  if( OO_P_IS_NULL(bucket->bucket[idx]) ) {
-    ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE,
-                            __FUNCTION__);
-    return 0;
-  }
-#endif
-
-  level++;
-  aux = ci_ni_aux_p2aux(ni, bucket->bucket[idx]);
-  if( aux->type == CI_TCP_AUX_TYPE_BUCKET ) {
-    empty = ci_tcp_listenq_bucket_remove(ni, tls, &aux->u.bucket, tsr, level);
-    if( empty ) {
-      bucket->bucket[idx] = OO_P_NULL;
-      ci_ni_aux_free(ni, aux);
-      tls->n_buckets--;
-    }
-  }
-  else {
-    if( bucket->bucket[idx] == tsr_p ) {
-      bucket->bucket[idx] = tsr->bucket_link;
-      empty = OO_P_IS_NULL(bucket->bucket[idx]);
-    }
-    else {
-      ci_tcp_state_synrecv* prev = &aux->u.synrecv;
-      while( prev->bucket_link != tsr_p ) {
-        aux = ci_ni_aux_p2aux(ni, prev->bucket_link);
-        prev = &aux->u.synrecv;
-#ifdef __KERNEL__
-        if( i++ > CI_LISTENQ_BUCKET_LIST_LIMIT(ni) ) {
-          ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE,
-                                  __FUNCTION__);
-          return 0;
-        }
-#endif
-      }
-      prev->bucket_link = tsr->bucket_link;
-    }
   }
 
-  if( empty ) {
-    int i;
-    for( i = 0; i < CI_TCP_LISTEN_BUCKET_SIZE; i++ )
-      if( OO_P_NOT_NULL(bucket->bucket[i]) )
-        return 0;
-    return 1;
-  }
-  return 0;
+  ci_assert(0);
+  ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE, __FUNCTION__);
 }
 
+
 static ci_tcp_state_synrecv*
-ci_tcp_listenq_bucket_lookup(ci_netif* ni, ci_tcp_listen_bucket* bucket,
-                             ciip_tcp_rx_pkt* rxp,
-                             int level)
+ci_tcp_synrecv_table_lookup(ci_netif* ni, ci_tcp_socket_listen* tls,
+                            ciip_tcp_rx_pkt* rxp)
 {
-  ci_ni_aux_mem* aux;
-  int idx = ci_tcp_listenq_hash2idx(rxp->hash, level);
+  ci_tcp_synrecv_table_entry* table = ni->synrecv_table;
+  unsigned mask = ci_tcp_synrecv_table_mask(ni);
+  unsigned i = rxp->hash & mask;
   ci_tcp_state_synrecv* tsr;
   ci_addr_t saddr, daddr;
   ci_uint16 sport, dport;
-#ifdef __KERNEL__
-  int i = 0;
-
-  if( level > CI_LISTENQ_BUCKET_MAX_DEPTH(ni) ) {
-    ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE,
-                            __FUNCTION__);
-    return 0;
-  }
-#endif
+  unsigned n;
 
   saddr = RX_PKT_SADDR(rxp->pkt);
   daddr = RX_PKT_DADDR(rxp->pkt);
   sport = rxp->tcp->tcp_source_be16;
   dport = rxp->tcp->tcp_dest_be16;
 
-  LOG_TV(ci_log("%s([%d] level=%d hash:%x l:"IPX_FMT":%d r:"IPX_FMT":%d)",
-                __func__,
-                NI_ID(ni), level, rxp->hash,
+  LOG_TV(ci_log("%s([%d] hash:%x l:"IPX_FMT":%d r:"IPX_FMT":%d)",
+                __func__, NI_ID(ni), rxp->hash,
                 IPX_ARG(AF_IP(daddr)), CI_BSWAP_BE16(dport),
                 IPX_ARG(AF_IP(saddr)), CI_BSWAP_BE16(sport)));
-  if( OO_P_IS_NULL(bucket->bucket[idx]) )
-    return NULL;
-
-  level++;
-  aux = ci_ni_aux_p2aux(ni, bucket->bucket[idx]);
-  if( aux->type == CI_TCP_AUX_TYPE_BUCKET )
-    return ci_tcp_listenq_bucket_lookup(ni, &aux->u.bucket, rxp, level);
-
-
-  tsr = &aux->u.synrecv;
-  do {
-    if( sport == tsr->r_port &&
-        dport == tsr->l_port &&
-        CI_IPX_ADDR_EQ(saddr, tsr->r_addr) &&
-        CI_IPX_ADDR_EQ(daddr, tsr->l_addr) )
-      return tsr;
-    if( OO_P_IS_NULL(tsr->bucket_link) )
-      return NULL;
-    aux = ci_ni_aux_p2aux(ni, tsr->bucket_link);
-    tsr = &aux->u.synrecv;
-#ifdef __KERNEL__
-    if( i++ > CI_LISTENQ_BUCKET_LIST_LIMIT(ni) ) {
-      ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE,
-                              __FUNCTION__);
+
+  for( n = 0; n <= mask; ++n, i = (i + 1) & mask ) {
+    if( OO_P_IS_NULL(table[i].tsr) )
       return NULL;
+    if( table[i].hash == rxp->hash ) {
+      tsr = ci_ni_aux_p2synrecv(ni, table[i].tsr);
+      if( sport == tsr->r_port &&
+          dport == tsr->l_port &&
+          tsr->tls_id == S_SP(tls) &&
+          CI_IPX_ADDR_EQ(saddr, tsr->r_addr) &&
+          CI_IPX_ADDR_EQ(daddr, tsr->l_addr) )
+        return tsr;
     }
-#endif
-  } while(1);
+    CITP_STATS_NETIF_INC(ni, synrecv_table_probes);
+  }
 
-  /* unreachable */
+  ci_netif_error_detected(ni, CI_NETIF_ERROR_SYNRECV_TABLE, __FUNCTION__);
   return NULL;
 }
 
 
-struct oo_dump_synrecv {
-  oo_dump_log_fn_t logger;
-  void *arg;
-  ci_tcp_socket_listen* tls;
-};
-
-static void
-ci_tcp_listenq_synrecv_print(ci_netif* ni, ci_tcp_state_synrecv* tsr,
-                             void* arg)
-{
-  struct oo_dump_synrecv* l = arg;
-  l->logger(l->arg, "TCP 0 0 "OOF_IPXPORT" "OOF_IPXPORT" SYN_RECV",
-            OOFA_IPXPORT(tsr->l_addr, tsr->l_port),
-            OOFA_IPXPORT(tsr->r_addr, tsr->r_port));
-}
-
 void
 ci_tcp_listenq_print_to_logger(ci_netif* ni, ci_tcp_socket_listen* tls,
                                oo_dump_log_fn_t logger, void* log_arg)
 {
-  struct oo_dump_synrecv l = {
-    .logger = logger,
-    .arg = log_arg,
-    .tls = tls,
-  };
-  ci_tcp_listenq_bucket_iter(ni, ci_ni_aux_p2bucket(ni, tls->bucket),
-                             ci_tcp_listenq_synrecv_print, NULL, &l);
+  ci_tcp_synrecv_table_entry* table = ni->synrecv_table;
+  ci_tcp_state_synrecv* tsr;
+  unsigned i;
+
+  for( i = 0; i < ni->state->synrecv_table_entries_n; ++i ) {
+    if( OO_P_IS_NULL(table[i].tsr) )
+      continue;
+    tsr = ci_ni_aux_p2synrecv(ni, table[i].tsr);
+    if( tsr->tls_id != S_SP(tls) )
+      continue;
+    logger(log_arg, "TCP 0 0 "OOF_IPXPORT" "OOF_IPXPORT" SYN_RECV",
+           OOFA_IPXPORT(tsr->l_addr, tsr->l_port),
+           OOFA_IPXPORT(tsr->r_addr, tsr->r_port));
+  }
 }
 
 
@@ -373,11 +205,30 @@ ci_tcp_listen_timer_set(ci_netif* ni, ci_tcp_socket_listen* tls,
 
 int ci_tcp_listenq_drop_all(ci_netif* ni, ci_tcp_socket_listen* tls)
 {
+  ci_tcp_synrecv_table_entry* table = ni->synrecv_table;
+  ci_tcp_state_synrecv* tsr;
+  unsigned i = 0;
   int ret = 0;
 
-  ci_tcp_listenq_bucket_iter(ni, ci_ni_aux_p2bucket(ni, tls->bucket),
-                             ci_tcp_listenq_synrecv_drop,
-                             ci_tcp_listenq_bucket_drop, &ret);
+  while( i < ni->state->synrecv_table_entries_n ) {
+    if( OO_P_IS_NULL(table[i].tsr) ) {
+      ++i;
+      continue;
+    }
+    tsr = ci_ni_aux_p2synrecv(ni, table[i].tsr);
+    if( tsr->tls_id != S_SP(tls) ) {
+      ++i;
+      continue;
+    }
+    /* Removal may move a later entry into this slot, so do not advance. */
+    ci_tcp_synrecv_table_remove_slot(ni, i);
+    if( OO_SP_IS_NULL(tsr->local_peer) )
+      ci_ni_dllist_remove(ni, ci_tcp_synrecv2link(tsr));
+    /* RFC 793 tells us to send FIN and move to FIN-WAIT1 state.
+     * However, Linux (and probably everybody else) does not do it. */
+    ci_tcp_synrecv_free(ni, tsr);
+    ret++;
+  }
   return ret;
 }
 
@@ -388,9 +239,8 @@ void ci_tcp_listenq_insert(ci_netif* ni, ci_tcp_socket_listen* tls,
 
   tls->n_listenq++;
 
-  ci_tcp_listenq_bucket_insert(ni, tls,
-                               ci_ni_aux_p2bucket(ni, tls->bucket),
-                               tsr, 0);
+  ci_assert_equal(tsr->tls_id, S_SP(tls));
+  ci_tcp_synrecv_table_insert(ni, tsr);
 
   if( OO_SP_NOT_NULL(tsr->local_peer) )
     return;
@@ -413,9 +263,7 @@ void ci_tcp_listenq_remove(ci_netif* ni, ci_tcp_socket_listen* tls,
   ci_assert(tsr);
   ci_assert(tls);
 
-  ci_tcp_listenq_bucket_remove(ni, tls,
-                               ci_ni_aux_p2bucket(ni, tls->bucket),
-                               tsr, 0);
+  ci_tcp_synrecv_table_remove(ni, tsr);
   if( OO_SP_IS_NULL(tsr->local_peer) ) {
     ci_ni_dllist_remove(ni, ci_tcp_synrecv2link(tsr));
 
@@ -452,9 +300,7 @@ ci_tcp_listenq_lookup(ci_netif* netif, ci_tcp_socket_listen* tls,
 {
   ci_tcp_state_synrecv* tsr;
 
-  tsr = ci_tcp_listenq_bucket_lookup(
-                        netif, ci_ni_aux_p2bucket(netif, tls->bucket),
-                        rxp, 0);
+  tsr = ci_tcp_synrecv_table_lookup(netif, tls, rxp);
   if( tsr == NULL ) {
     LOG_TV(log(LPF "no match for %s:%d->%s:%d",
                ip_addr_str(oo_ip_hdr(rxp->pkt)->ip_saddr_be32),
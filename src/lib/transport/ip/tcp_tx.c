@@ -46,8 +46,10 @@ ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
     pp = pkt->next;
 #if CI_CFG_TIMESTAMPING
     if( onload_timestamping_want_tx_nic(ts->s.timestamping_flags) &&
-        CI_TCP_PAYLEN(oo_tx_ip_hdr(pkt), TX_PKT_TCP(pkt)) != 0 )
+        CI_TCP_PAYLEN(oo_tx_ip_hdr(pkt), TX_PKT_TCP(pkt)) != 0 ) {
       pkt->flags |= CI_PKT_FLAG_TX_TIMESTAMPED;
+      pkt->pf.tcp_tx.sock_id = S_SP(ts);
+    }
 #endif
     ci_ip_set_mac_and_port(ni, &ts->s.pkt, pkt);
     ci_netif_pkt_hold(ni, pkt);
@@ -132,8 +134,10 @@ static void ci_ip_tcp_list_to_dmaq_striping(ci_netif* ni, ci_tcp_state* ts,
     pkt = PKT_CHK(ni, pp);
 #if CI_CFG_TIMESTAMPING
     if( onload_timestamping_want_tx_nic(ts->s.timestamping_flags) &&
-        CI_TCP_PAYLEN(oo_tx_ip_hdr(pkt), TX_PKT_IPX_TCP(af, pkt)) != 0 )
+        CI_TCP_PAYLEN(oo_tx_ip_hdr(pkt), TX_PKT_IPX_TCP(af, pkt)) != 0 ) {
       pkt->flags |= CI_PKT_FLAG_TX_TIMESTAMPED;
+      pkt->pf.tcp_tx.sock_id = S_SP(ts);
+    }
 #endif
     ci_ip_set_mac_and_port(ni, &ts->s.pkt, pkt);
     pp = pkt->next;
@@ -267,8 +271,10 @@ fast:
 
 #if CI_CFG_TIMESTAMPING
       if( onload_timestamping_want_tx_nic(ts->s.timestamping_flags) &&
-          CI_TCP_PAYLEN(oo_tx_ip_hdr(pkt), TX_PKT_IPX_TCP(af, pkt)) != 0 )
+          CI_TCP_PAYLEN(oo_tx_ip_hdr(pkt), TX_PKT_IPX_TCP(af, pkt)) != 0 ) {
         pkt->flags |= CI_PKT_FLAG_TX_TIMESTAMPED;
+        pkt->pf.tcp_tx.sock_id = S_SP(ts);
+      }
 #else
       (void)af;
 #endif
@@ -877,6 +883,16 @@ int ci_tcp_synrecv_send(ci_netif* netif, ci_tcp_socket_listen* tls,
     ci_ip_local_send(netif, pkt, S_SP(tls), tsr->local_peer);
     rc = 0;
   }
+  else if( (tcp_flags & CI_TCP_FLAG_SYN) && netif->state->in_poll &&
+           ipcache->status == retrrc_success ) {
+    /* SYN-ACK in response to a SYN found by this poll.  During a SYN
+     * flood a poll finds many of them, so leave the doorbell to the end of
+     * the poll rather than ringing it for each one. */
+    ci_ip_set_mac_and_port(netif, ipcache, pkt);
+    ci_netif_send_batch(netif, pkt, &netif->poll_tx_intf_mask);
+    CITP_STATS_NETIF_INC(netif, synack_batched);
+    rc = 0;
+  }
   else {
     rc = ci_ip_send_pkt_send(netif, &tls->s.cp, pkt, ipcache);
     ci_netif_pkt_release(netif, pkt);
@@ -86,6 +86,7 @@ static void ci_udp_state_init(ci_netif* netif, ci_udp_state* us)
   oo_atomic_set(&us->tx_async_q_level, 0);
   us->tx_count = 0;
   us->udpflags = CI_UDPF_MCAST_LOOP;
+  us->gso_size = 0;
   us->ip_pktinfo_cache.intf_i = -1;
   us->stamp = 0;
   memset(&us->stats, 0, sizeof(us->stats));
@@ -312,6 +313,9 @@ void ci_udp_state_dump(ci_netif* ni, ci_udp_state* us, const char* pf,
          uss.n_tx_eagain, uss.n_tx_spin, uss.n_tx_block);
   logger(log_arg, "%s  snd: poll_avoids_full=%d fragments=%d confirm=%d", pf,
          uss.n_tx_poll_avoids_full, uss.n_tx_fragments, uss.n_tx_msg_confirm);
+  if( us->gso_size != 0 || uss.n_tx_gso != 0 || uss.n_rx_gro != 0 )
+    logger(log_arg, "%s  gso: segment=%u tx_gso=%u rx_gro=%u", pf,
+           us->gso_size, uss.n_tx_gso, uss.n_rx_gro);
   logger(log_arg,
          "%s  snd: os_slow=%d os_late=%d unconnect_late=%d nomac=%u(%u%%)", pf,
          uss.n_tx_os_slow, uss.n_tx_os_late, uss.n_tx_unconnect_late,
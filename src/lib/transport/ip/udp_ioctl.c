@@ -53,6 +53,13 @@ void ci_udp_compute_stamp(ci_netif *ni, ci_uint64 stamp, struct timespec *ts)
   struct oo_timesync* oo_ts_local;
   double ns_rate;
 
+  /* Use the driver's precomputed mapping when it is available. */
+  if(CI_LIKELY( ci_netif_frc_to_wall_ns(ni, stamp, &delta) == 0 )) {
+    ts->tv_sec = delta / 1000000000llu;
+    ts->tv_nsec = delta % 1000000000llu;
+    return;
+  }
+
   oo_ts_local = &(__oo_per_thread_get()->timesync);
   ci_synchronise_clock(ni, oo_ts_local);
 
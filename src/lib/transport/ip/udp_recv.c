@@ -329,6 +329,119 @@ static void ci_udp_filter_kernel_pkt(ci_netif* ni, ci_udp_state* us,
 #endif /* __KERNEL__ */
 
 
+#if defined(__linux__) && !defined(__KERNEL__)
+
+/* Can [pkt] be appended to a UDP_GRO receive that started with [first]?
+ * It must belong to the same flow and be no longer than [first].
+ */
+static int ci_udp_gro_match(ci_ip_pkt_fmt* first, ci_ip_pkt_fmt* pkt)
+{
+  int af = oo_pkt_af(first);
+  const ci_udp_hdr* udp_first;
+  const ci_udp_hdr* udp;
+
+  if( (pkt->flags & CI_PKT_FLAG_RX_INDIRECT) || oo_pkt_af(pkt) != af ||
+      pkt->pf.udp.pay_len == 0 ||
+      pkt->pf.udp.pay_len > first->pf.udp.pay_len )
+    return 0;
+  udp_first = oo_ipx_data(af, first);
+  udp = oo_ipx_data(af, pkt);
+  return udp->udp_source_be16 == udp_first->udp_source_be16 &&
+         udp->udp_dest_be16 == udp_first->udp_dest_be16 &&
+         CI_IPX_ADDR_EQ(RX_PKT_SADDR(pkt), RX_PKT_SADDR(first)) &&
+         CI_IPX_ADDR_EQ(RX_PKT_DADDR(pkt), RX_PKT_DADDR(first));
+}
+
+
+/* UDP_GRO: copy [first] and as many following datagrams of the same flow
+ * as will fit into [piov], and deliver them as one.  A datagram shorter
+ * than [first] ends the run, as does running out of room: we never
+ * truncate a datagram other than the first.  The number of bytes per
+ * datagram is reported in a UDP_GRO control message.
+ */
+static int ci_udp_recvmsg_get_gro(ci_udp_recv_info* rinf,
+                                  ci_ip_pkt_fmt* first, ci_iovec_ptr* piov)
+{
+  ci_netif* ni = rinf->a->ni;
+  ci_udp_state* us = rinf->a->us;
+  ci_msghdr* msg = rinf->msg;
+  int gso_size = first->pf.udp.pay_len;
+  /* Only coalesce packets that ci_udp_recv_q_put() has finished adding. */
+  int avail = ci_udp_recv_q_pkts(&us->recv_q);
+  int space = ci_iovec_ptr_bytes_count(piov);
+  int rc, i, total = 0, n_segs = 0, n_bufs = 0;
+  ci_ip_pkt_fmt* pkt = first;
+  ci_ip_pkt_fmt* next;
+  ci_iovec_ptr iov_start;
+
+  while( 1 ) {
+    iov_start = *piov;
+    rc = oo_copy_pkt_to_iovec_no_adv(ni, pkt, piov, pkt->pf.udp.pay_len);
+    if(CI_UNLIKELY( rc < 0 )) {
+      if( n_segs == 0 )
+        return rc;
+      break;
+    }
+    if(CI_UNLIKELY( rc < pkt->pf.udp.pay_len ))
+      rinf->msg_flags |= LOCAL_MSG_TRUNC;
+    total += rc;
+    space -= rc;
+    n_bufs += pkt->n_buffers;
+    ++n_segs;
+    if( rc < gso_size || n_segs == CI_UDP_GSO_SEGS_MAX )
+      break;
+    next = ci_udp_recv_q_next(ni, pkt);
+    if( next == NULL || n_bufs + next->n_buffers > avail ||
+        ! ci_udp_gro_match(first, next) ||
+        next->pf.udp.pay_len > space ||
+        total + next->pf.udp.pay_len > 0xffff )
+      break;
+    /* oo_copy_pkt_to_iovec_no_adv() leaves [piov] in an unspecified
+     * position, so move past the datagram we've just copied ourselves.
+     */
+    *piov = iov_start;
+    while( rc > 0 ) {
+      int n;
+      while( CI_IOVEC_LEN(&piov->io) == 0 ) {
+        piov->io = *piov->iov++;
+        --piov->iovlen;
+      }
+      n = CI_MIN(rc, CI_IOVEC_LEN(&piov->io));
+      ci_iovec_ptr_advance(piov, n);
+      rc -= n;
+    }
+    pkt = next;
+  }
+
+  /* Fill in the control messages and address before any of the packets
+   * are delivered, as that makes them reapable.
+   */
+  if( us->s.cmsg_flags != 0 || n_segs > 1 )
+    ci_ip_cmsg_recv(ni, us, first, msg, 0, &rinf->msg_flags,
+                    n_segs > 1 ? gso_size : 0);
+  else
+    msg->msg_controllen = 0;
+  ci_udp_recvmsg_fill_msghdr(ni, msg, first, &us->s);
+  us->stamp = first->tstamp_frc;
+  us->future_intf_i = first->intf_i;
+
+  for( i = 0, pkt = first; ; pkt = next ) {
+    next = ci_udp_recv_q_next(ni, pkt);
+    ci_udp_recv_q_deliver(ni, &us->recv_q, pkt);
+    if( ++i == n_segs )
+      break;
+  }
+  if( n_segs > 1 ) {
+    ++us->stats.n_rx_gro;
+    CITP_STATS_NETIF_ADD(ni, udp_recv_gro_segs, n_segs);
+  }
+  us->udpflags |= CI_UDPF_LAST_RECV_ON;
+  return total;
+}
+
+#endif
+
+
 static int ci_udp_recvmsg_get(ci_udp_recv_info* rinf, ci_iovec_ptr* piov)
 {
   ci_netif* ni = rinf->a->ni;
@@ -343,9 +456,18 @@ static int ci_udp_recvmsg_get(ci_udp_recv_info* rinf, ci_iovec_ptr* piov)
     goto recv_q_is_empty;
 
 #if defined(__linux__) && !defined(__KERNEL__)
+  if( (us->udpflags & CI_UDPF_GRO) && msg != NULL &&
+      ! (rinf->flags & MSG_PEEK) &&
+      ! (pkt->flags & CI_PKT_FLAG_RX_INDIRECT)
+# if CI_CFG_ZC_RECV_FILTER
+      && ! us->recv_q_filter
+# endif
+      )
+    return ci_udp_recvmsg_get_gro(rinf, pkt, piov);
+
   if( msg != NULL ) {
     if( CI_UNLIKELY(us->s.cmsg_flags != 0 ) )
-      ci_ip_cmsg_recv(ni, us, pkt, msg, 0, &rinf->msg_flags);
+      ci_ip_cmsg_recv(ni, us, pkt, msg, 0, &rinf->msg_flags, 0);
     else
       msg->msg_controllen = 0;
   }
@@ -1318,7 +1440,7 @@ int ci_udp_zc_recv(ci_udp_iomsg_args* a, struct onload_zc_recv_args* args)
         args->msg.msghdr.msg_controllen = supplied_controllen;
         args->msg.msghdr.msg_control = supplied_control;
         ci_ip_cmsg_recv(ni, us, pkt, &args->msg.msghdr, 0,
-                        &args->msg.msghdr.msg_flags);
+                        &args->msg.msghdr.msg_flags, 0);
       }
       else
         args->msg.msghdr.msg_controllen = 0;
@@ -118,6 +118,19 @@ int ci_udp_csum_correct(ci_ip_pkt_fmt* pkt, ci_udp_hdr* udp)
 
 
 
+/* Received data is dropped during critical memory pressure, except for
+ * sockets with only a small backlog.  That way a socket that is not being
+ * read does not cause drops for every other socket in the stack.
+ */
+ci_inline int ci_udp_rx_mem_ok(ci_netif* ni, ci_udp_state* us)
+{
+  if(CI_LIKELY( ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) ))
+    return 1;
+  return ci_netif_mem_pressure_sock_accept(ni,
+                                      ci_netif_sock_rx_pkts(ni, &us->s.b));
+}
+
+
 int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
 {
   /* Deliver a received packet to a socket. */
@@ -148,7 +161,7 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
 #endif
 
   if( (recvq_depth <= us->stats.max_recvq_pkts) &&
-      ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) ) {
+      ci_udp_rx_mem_ok(ni, us) ) {
     int multi_destination_pkt;
 
   fast_receive:
@@ -213,7 +226,7 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
   /* First check if we've come here just to update max_recvq_depth */
   if( recvq_depth > us->stats.max_recvq_pkts ) {
     if( recvq_depth <= ci_udp_recv_q_bytes2packets(us->s.so.rcvbuf)  &&
-        ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) ) {
+        ci_udp_rx_mem_ok(ni, us) ) {
       us->stats.max_recvq_pkts = recvq_depth;
       goto fast_receive;
     }
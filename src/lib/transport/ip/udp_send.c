@@ -75,6 +75,7 @@ struct udp_send_info {
   int                   stack_locked;
   ci_uint32             timeout;
   int                   old_ipcache_updated;
+  int                   gso_size;
 };
 
 
@@ -641,9 +642,14 @@ static void fixup_pkt_not_transmitted(ci_netif *ni, ci_ip_pkt_fmt* pkt)
 }
 
 
+/* If [tx_batch] is not NULL the datagram is queued without ringing the
+ * doorbell, and the caller must pass [*tx_batch] to
+ * ci_netif_send_batch_push() once it has queued all of its datagrams.
+ */
 static void ci_udp_sendmsg_send(ci_netif* ni, ci_udp_state* us,
                                 ci_ip_pkt_fmt* pkt, int flags,
-                                struct udp_send_info* sinf)
+                                struct udp_send_info* sinf,
+                                unsigned* tx_batch)
 {
   ci_ip_pkt_fmt* first_pkt = pkt;
   ci_ip_cached_hdrs* ipcache;
@@ -765,12 +771,14 @@ static void ci_udp_sendmsg_send(ci_netif* ni, ci_udp_state* us,
 
   if( ipcache_ttl(ipcache) ) {
     if(CI_LIKELY( ipcache_onloadable )) {
-      /* TODO: Hit the doorbell just once. */
       while( 1 ) {
         oo_pkt_p next = pkt->next;
         prep_send_pkt(ni, us, pkt, ipcache);
         /* We've called ci_netif_pkt_hold() in ci_udp_sendmsg_fill(). */
-        ci_netif_send(ni, pkt);
+        if( tx_batch != NULL )
+          ci_netif_send_batch(ni, pkt, tx_batch);
+        else
+          ci_netif_send(ni, pkt);
         if( OO_PP_IS_NULL(next) )
           break;
         pkt = PKT_CHK(ni, next);
@@ -885,6 +893,8 @@ void ci_udp_sendmsg_send_async_q(ci_netif* ni, ci_udp_state* us)
   oo_pkt_p pp, send_list;
   ci_ip_pkt_fmt* pkt;
   int flags, level = 0;
+  unsigned tx_batch = 0;
+  unsigned* p_tx_batch;
 
   /* Grab the contents of [tx_async_q]. */
   do {
@@ -905,6 +915,9 @@ void ci_udp_sendmsg_send_async_q(ci_netif* ni, ci_udp_state* us)
 
   oo_atomic_add(&us->tx_async_q_level, -level);
 
+  /* If there is more than one datagram, ring the doorbell just once. */
+  p_tx_batch = OO_PP_NOT_NULL(pkt->netif.tx.dmaq_next) ? &tx_batch : NULL;
+
   /* Send each datagram. */
   while( 1 ) {
     pp = pkt->netif.tx.dmaq_next;
@@ -913,15 +926,17 @@ void ci_udp_sendmsg_send_async_q(ci_netif* ni, ci_udp_state* us)
     else
       flags = 0;
     ++us->stats.n_tx_lock_defer;
-    ci_udp_sendmsg_send(ni, us, pkt, flags, NULL);
+    ci_udp_sendmsg_send(ni, us, pkt, flags, NULL, p_tx_batch);
     ci_netif_pkt_release(ni, pkt);
     if( OO_PP_IS_NULL(pp) )  break;
     pkt = PKT_CHK(ni, pp);
   }
+  if( p_tx_batch != NULL )
+    ci_netif_send_batch_push(ni, tx_batch);
 }
 
-static void ci_udp_sendmsg_async_q_enqueue(ci_netif* ni, ci_udp_state* us,
-                                           ci_ip_pkt_fmt* pkt, int flags)
+static void ci_udp_sendmsg_async_q_put(ci_netif* ni, ci_udp_state* us,
+                                       ci_ip_pkt_fmt* pkt, int flags)
 {
   if( flags & MSG_CONFIRM )
     /* Only setting this for first IP fragment -- that should be fine. */
@@ -933,7 +948,12 @@ static void ci_udp_sendmsg_async_q_enqueue(ci_netif* ni, ci_udp_state* us,
     OO_PP_INIT(ni, pkt->netif.tx.dmaq_next, us->tx_async_q);
   while( ci_cas32_fail(&us->tx_async_q,
                        OO_PP_ID(pkt->netif.tx.dmaq_next), OO_PKT_ID(pkt)) );
+}
 
+static void ci_udp_sendmsg_async_q_enqueue(ci_netif* ni, ci_udp_state* us,
+                                           ci_ip_pkt_fmt* pkt, int flags)
+{
+  ci_udp_sendmsg_async_q_put(ni, us, pkt, flags);
   if( ci_netif_lock_or_defer_work(ni, &us->s.b) )
     ci_netif_unlock(ni);
 }
@@ -1340,6 +1360,109 @@ int ci_udp_sendmsg_fill(ci_netif* ni, ci_udp_state* us,
 }
 
 
+/* UDP_SEGMENT: send [bytes_to_send] as a train of datagrams carrying
+ * [sinf->gso_size] bytes of payload each (the last may be shorter).  The
+ * caller has checked that each datagram fits the path MTU, so none are
+ * fragmented.  The whole train is built before it is sent so that it goes
+ * to the NIC with a single doorbell, or is handed to the lock holder in
+ * one go when the stack lock is contended.
+ */
+static void ci_udp_sendmsg_gso(ci_netif* ni, ci_udp_state* us,
+                               ci_iovec_ptr* piov, int bytes_to_send,
+                               int flags, struct udp_send_info* sinf)
+{
+  struct oo_pkt_filler pf;
+  ci_ip_pkt_fmt* head = NULL;
+  ci_ip_pkt_fmt* tail = NULL;
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p pp;
+  unsigned tx_batch = 0;
+  int was_locked = sinf->stack_locked;
+  int af = ipcache_af(&us->s.pkt);
+  int rc, seg_bytes, bytes_left, n_segs = 0;
+
+  ci_assert_gt(sinf->gso_size, 0);
+  ci_assert_gt(bytes_to_send, sinf->gso_size);
+
+  pf.alloc_pkt = NULL;
+
+  for( bytes_left = bytes_to_send; bytes_left > 0; bytes_left -= seg_bytes ) {
+    seg_bytes = CI_MIN(bytes_left, sinf->gso_size);
+    rc = ci_udp_sendmsg_fill(ni, us, piov, seg_bytes, flags, &pf, sinf);
+    if(CI_UNLIKELY( rc < 0 ))
+      goto fill_failed;
+#if CI_CFG_TIMESTAMPING
+    if( us->s.timestamping_flags & ONLOAD_SOF_TIMESTAMPING_OPT_ID ) {
+      pf.pkt->ts_key = us->s.ts_key;
+      ci_atomic32_inc(&us->s.ts_key);
+    }
+#endif
+    TX_PKT_SET_DADDR(af, pf.pkt, ipcache_raddr(&sinf->ipcache));
+    TX_PKT_IPX_UDP(af, pf.pkt)->udp_dest_be16 = sinf->ipcache.dport_be16;
+    pf.pkt->netif.tx.dmaq_next = OO_PP_NULL;
+    if( tail != NULL )
+      tail->netif.tx.dmaq_next = OO_PKT_P(pf.pkt);
+    else
+      head = pf.pkt;
+    tail = pf.pkt;
+    ++n_segs;
+  }
+  if( sinf->stack_locked && ! was_locked )
+    ++us->stats.n_tx_lock_pkt;
+  sinf->rc = bytes_to_send;
+
+ send:
+  ++us->stats.n_tx_gso;
+  CITP_STATS_NETIF_ADD(ni, udp_send_gso_segs, n_segs);
+  if( si_trylock_and_inc(ni, sinf, us->stats.n_tx_lock_snd) ) {
+    for( pkt = head; ; pkt = PKT_CHK(ni, pp) ) {
+      pp = pkt->netif.tx.dmaq_next;
+      ci_udp_sendmsg_send(ni, us, pkt, flags, sinf, &tx_batch);
+      ci_netif_pkt_release(ni, pkt);
+      if( OO_PP_IS_NULL(pp) )
+        break;
+    }
+    ci_netif_send_batch_push(ni, tx_batch);
+    ci_netif_unlock(ni);
+    sinf->stack_locked = 0;
+  }
+  else {
+    for( pkt = head; ; pkt = PKT_CHK_NNL(ni, pp) ) {
+      pp = pkt->netif.tx.dmaq_next;
+      ci_udp_sendmsg_async_q_put(ni, us, pkt, flags);
+      if( OO_PP_IS_NULL(pp) )
+        break;
+    }
+    if( ci_netif_lock_or_defer_work(ni, &us->s.b) )
+      ci_netif_unlock(ni);
+  }
+  return;
+
+ fill_failed:
+  sinf->rc = rc;
+  if( head == NULL )
+    return;
+  if( ! sinf->stack_locked ) {
+    /* ci_udp_sendmsg_fill() could not get the lock back after failing (only
+     * possible in the kernel), so we can't free what we've built.  Send it,
+     * and report a short send.
+     */
+    sinf->rc = bytes_to_send - bytes_left;
+    goto send;
+  }
+  /* Drop the datagrams built so far: as on Linux, the send is all or
+   * nothing.
+   */
+  for( pkt = head; ; pkt = PKT_CHK(ni, pp) ) {
+    pp = pkt->netif.tx.dmaq_next;
+    fixup_pkt_not_transmitted(ni, pkt);
+    ci_netif_pkt_release(ni, pkt);
+    if( OO_PP_IS_NULL(pp) )
+      break;
+  }
+}
+
+
 static
 void ci_udp_sendmsg_onload(ci_netif* ni, ci_udp_state* us,
                            const ci_msghdr* msg, int flags,
@@ -1373,9 +1496,19 @@ void ci_udp_sendmsg_onload(ci_netif* ni, ci_udp_state* us,
     ci_iovec_ptr_init(&piov, NULL, 0);
   }
 
+  if(CI_UNLIKELY( sinf->gso_size != 0 )) {
+    /* UDP_SEGMENT: as on Linux, each datagram must fit the path MTU. */
+    if( sinf->gso_size > sinf->ipcache.mtu - CI_IPX_HDR_SIZE(af) -
+                         sizeof(ci_udp_hdr) ||
+        bytes_to_send > (unsigned long) sinf->gso_size * CI_UDP_GSO_SEGS_MAX ) {
+      sinf->rc = -EINVAL;
+      return;
+    }
+  }
+
 #if CI_CFG_IPV6
   /* FIXIT: Onload doesn't support IPv6 fragmentation */
-  if( IS_AF_INET6(af) && bytes_to_send >
+  if( IS_AF_INET6(af) && sinf->gso_size == 0 && bytes_to_send >
       sinf->ipcache.mtu - CI_IPX_HDR_SIZE(af) - sizeof(ci_udp_hdr) ) {
     goto send_via_os;
   }
@@ -1389,6 +1522,10 @@ void ci_udp_sendmsg_onload(ci_netif* ni, ci_udp_state* us,
     goto no_space_or_too_big;
 
  back_to_fast_path:
+  if( sinf->gso_size != 0 && bytes_to_send > sinf->gso_size ) {
+    ci_udp_sendmsg_gso(ni, us, &piov, bytes_to_send, flags, sinf);
+    return;
+  }
   was_locked = sinf->stack_locked;
   if( bytes_to_send > sinf->ipcache.mtu - CI_IPX_HDR_SIZE(af) -
       sizeof(ci_udp_hdr) &&
@@ -1442,7 +1579,7 @@ void ci_udp_sendmsg_onload(ci_netif* ni, ci_udp_state* us,
     TX_PKT_IPX_UDP(af, pf.pkt)->udp_dest_be16 = sinf->ipcache.dport_be16;
 
     if( si_trylock_and_inc(ni, sinf, us->stats.n_tx_lock_snd) ) {
-      ci_udp_sendmsg_send(ni, us, pf.pkt, flags, sinf);
+      ci_udp_sendmsg_send(ni, us, pf.pkt, flags, sinf, NULL);
       ci_netif_pkt_release(ni, pf.pkt);
       ci_netif_unlock(ni);
       sinf->stack_locked = 0;
@@ -1509,12 +1646,13 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
   sinf.used_ipcache = 0;
   sinf.old_ipcache_updated = 0;
   sinf.timeout = us->s.so.sndtimeo_msec;
+  sinf.gso_size = us->gso_size;
 
 #if defined(__linux__) && !defined(__KERNEL__)
   /* TODO: should be done for sun too? */
   if(CI_UNLIKELY( CMSG_FIRSTHDR(msg) != NULL )) {
     void* info = NULL;
-    if( ci_ip_cmsg_send(msg, &info) != 0 || info != NULL )
+    if( ci_ip_cmsg_send(msg, &info, &sinf.gso_size) != 0 || info != NULL )
       goto send_via_os;
   }
 #endif
@@ -294,8 +294,19 @@ int ci_udp_getsockopt(citp_socket* ep, ci_fd_t fd, int level,
 #endif
 
   } else if (level == IPPROTO_UDP) {
-    /* We definitely don't support this */
-    RET_WITH_ERRNO(ENOPROTOOPT);
+    switch (optname) {
+    case UDP_SEGMENT:
+      u = us->gso_size;
+      goto u_out_udp;
+
+    case UDP_GRO:
+      u = (us->udpflags & CI_UDPF_GRO) != 0;
+      goto u_out_udp;
+
+    default:
+      /* We definitely don't support this */
+      RET_WITH_ERRNO(ENOPROTOOPT);
+    }
   } else {
     SOCKOPT_RET_INVALID_LEVEL(&us->s);
   }
@@ -303,6 +314,9 @@ int ci_udp_getsockopt(citp_socket* ep, ci_fd_t fd, int level,
  u_out_char:
  u_out:
   return ci_getsockopt_final(optval, optlen, SOL_IP, &u, sizeof(u));
+
+ u_out_udp:
+  return ci_getsockopt_final(optval, optlen, SOL_UDP, &u, sizeof(u));
 }
 
 
@@ -626,7 +640,30 @@ static int ci_udp_setsockopt_lk(citp_socket* ep, ci_fd_t fd, ci_fd_t os_sock,
 #endif
 
   } else if (level == IPPROTO_UDP) {
-    RET_WITH_ERRNO(ENOPROTOOPT);
+    switch( optname ) {
+    case UDP_SEGMENT:
+      if( (rc = opt_not_ok(optval, optlen, int)) )
+        goto fail_inval;
+      v = *(int*) optval;
+      if( v < 0 || v > 0xffff ) {
+        rc = -EINVAL;
+        goto fail_inval;
+      }
+      us->gso_size = v;
+      break;
+
+    case UDP_GRO:
+      if( (rc = opt_not_ok(optval, optlen, int)) )
+        goto fail_inval;
+      if( *(int*) optval )
+        us->udpflags |= CI_UDPF_GRO;
+      else
+        us->udpflags &=~ CI_UDPF_GRO;
+      break;
+
+    default:
+      RET_WITH_ERRNO(ENOPROTOOPT);
+    }
   }
   else {
     LOG_U(log(FNS_FMT "unknown level=%d optname=%d accepted by O/S",
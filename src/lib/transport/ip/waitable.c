@@ -15,6 +15,13 @@
 
 #include "ip_internal.h"
 #include <onload/sleep.h>
+#ifndef __KERNEL__
+# include <errno.h>
+# include <limits.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+# include <linux/futex.h>
+#endif
 
 
 void citp_waitable_reinit(ci_netif* ni, citp_waitable* w)
@@ -23,6 +30,9 @@ void citp_waitable_reinit(ci_netif* ni, citp_waitable* w)
   w->sleep_seq.all = 0;
   w->sigown = 0;
   w->spin_cycles = ni->state->sock_spin_cycles;
+  /* Make poll() look at the new endpoint at least once. */
+  ci_mb();
+  ci_netif_sock_ready_set(ni, w, CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX);
 }
 
 
@@ -99,6 +109,7 @@ citp_waitable_obj* citp_waitable_obj_alloc(ci_netif* netif)
   netif->state->free_eps_head = wo->waitable.wt_next;
   CI_DEBUG(wo->waitable.wt_next = OO_SP_NULL);
   ci_assert_equal(wo->waitable.state, CI_TCP_STATE_FREE);
+  OO_SSNAP_SOCK(netif, W_SP(&wo->waitable), ALLOC, CI_TCP_STATE_FREE);
 
   return wo;
 }
@@ -161,6 +172,10 @@ void citp_waitable_obj_free_to_cache(ci_netif* ni, citp_waitable* w)
    * accepted from the cache then these will be cleared when
    * __citp_waitable_obj_free is called, otherwise they'll be checked for
    * correctness, and updated if necessary when the socket is accepted.
+   *
+   * Clearing all of [wake_request] includes the futex bits: no thread can
+   * be waiting as the socket no longer has a file descriptor, and waiters
+   * that timed out leave their bits behind.
    */
   w->wake_request = 0;
   w->sb_flags = 0;
@@ -179,6 +194,8 @@ static void __citp_waitable_obj_free(ci_netif* ni, citp_waitable* w)
   ci_assert(ci_ni_dllist_is_self_linked(ni, &w->post_poll_link));
   ci_assert(OO_SP_IS_NULL(w->wt_next));
 
+  OO_SSNAP_SOCK(ni, W_SP(w), FREE, w->state);
+  /* Including any futex bits left by waiters that timed out. */
   w->wake_request = 0;
   w->sb_flags = 0;
   w->sb_aflags = CI_SB_AFLAG_ORPHAN | CI_SB_AFLAG_NOT_READY;
@@ -491,6 +508,29 @@ citp_waitable_wake_epoll3_not_in_poll(ci_netif* ni, citp_waitable* sb)
 }
 
 
+#ifndef __KERNEL__
+void citp_waitable_wake_futex(ci_netif* ni, citp_waitable* sb, unsigned what)
+{
+  ci_uint32 req = (what << CI_SB_FLAG_WAKE_FUTEX_SHIFT) & sb->wake_request;
+  int saved_errno;
+
+  if(CI_LIKELY( req == 0 ))
+    return;
+  ci_atomic32_and(&sb->wake_request, ~req);
+
+  saved_errno = errno;
+  if( req & (CI_SB_FLAG_WAKE_RX << CI_SB_FLAG_WAKE_FUTEX_SHIFT) )
+    syscall(SYS_futex, &sb->sleep_seq.rw.rx, FUTEX_WAKE_PRIVATE, INT_MAX,
+            NULL, NULL, 0);
+  if( req & (CI_SB_FLAG_WAKE_TX << CI_SB_FLAG_WAKE_FUTEX_SHIFT) )
+    syscall(SYS_futex, &sb->sleep_seq.rw.tx, FUTEX_WAKE_PRIVATE, INT_MAX,
+            NULL, NULL, 0);
+  errno = saved_errno;
+  CITP_STATS_NETIF_INC(ni, sock_futex_wakes);
+}
+#endif
+
+
 void citp_waitable_wake_not_in_poll(ci_netif* ni, citp_waitable* sb,
                                     unsigned what)
 {
@@ -503,6 +543,7 @@ void citp_waitable_wake_not_in_poll(ci_netif* ni, citp_waitable* sb,
   if( what & CI_SB_FLAG_WAKE_TX )
     ++sb->sleep_seq.rw.tx;
   ci_mb();
+  ci_netif_sock_ready_set(ni, sb, what);
 
 #ifdef __KERNEL__
   if( what & sb->wake_request ) {
@@ -512,6 +553,7 @@ void citp_waitable_wake_not_in_poll(ci_netif* ni, citp_waitable* sb,
   citp_waitable_wake_epoll3_not_in_poll(ni, sb);
 
 #else
+  citp_waitable_wake_futex(ni, sb, what);
   if( what & sb->wake_request ) {
     sb->sb_flags |= what;
     ci_netif_put_on_post_poll(ni, sb);
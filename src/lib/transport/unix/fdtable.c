@@ -952,7 +952,9 @@ citp_uncache_fds_ul(ci_netif* netif)
 {
   {
     int i;
-    for( i = 0; i < netif->state->n_ep_bufs; ++i) {
+    /* Entries beyond [eps_n] have never been used. */
+    int n = CI_MIN(netif->state->n_ep_bufs, netif->eps_n);
+    for( i = 0; i < n; ++i) {
       int fd = netif->eps[i].fd;
       if( fd != CI_FD_BAD )
         ci_tcp_helper_close_no_trampoline(fd);
@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Socket calls through handles that bypass the fd table
+**   \date  2026/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#include "internal.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <onload/extensions.h>
+#include <onload/tcp_poll.h>
+
+
+/* A handle holds a reference to the fdinfo, so the socket stays mapped
+ * until the handle is released, whatever happens to [fd]. */
+struct onload_socket_handle {
+  citp_fdinfo*    fdi;
+  citp_socket*    ep;
+  int             fd;
+  int             is_tcp;
+};
+
+
+/* Is [h->fd] still the socket that [h] was made from?  The fast test is
+ * that the fd table still holds the same fdinfo.  When another thread has
+ * the entry marked busy we have to do a proper lookup to find out. */
+static int oo_handle_is_valid(struct onload_socket_handle* h)
+{
+  citp_fdinfo_p fdip = citp_fdtable.table[h->fd].fdip;
+  citp_fdinfo* fdi;
+  int valid;
+
+  if( h->ep->s->b.sb_aflags & CI_SB_AFLAG_MOVED_AWAY )
+    return 0;
+  if(CI_LIKELY( fdip == fdi_to_fdip(h->fdi) ))
+    return 1;
+  if( ! fdip_is_busy(fdip) )
+    return 0;
+  fdi = citp_fdtable_lookup(h->fd);
+  valid = fdi == h->fdi;
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  return valid;
+}
+
+
+int onload_socket_handle_get(int fd, struct onload_socket_handle** handle_out)
+{
+  struct onload_socket_handle* h;
+  citp_lib_context_t lib_context;
+  citp_fdinfo* fdi;
+  int rc;
+
+  Log_CALL(ci_log("%s(%d, %p)", __FUNCTION__, fd, handle_out));
+
+  citp_enter_lib(&lib_context);
+  if( (fdi = citp_fdtable_lookup(fd)) == NULL ) {
+    rc = -ESOCKTNOSUPPORT;
+    goto out;
+  }
+  switch( citp_fdinfo_get_type(fdi) ) {
+  case CITP_TCP_SOCKET:
+  case CITP_UDP_SOCKET:
+    break;
+  case CITP_PASSTHROUGH_FD:
+    rc = -ESOCKTNOSUPPORT;
+    goto out_release;
+  default:
+    rc = -ENOTSOCK;
+    goto out_release;
+  }
+  if( (h = malloc(sizeof(*h))) == NULL ) {
+    rc = -ENOMEM;
+    goto out_release;
+  }
+  /* Keep the reference from the lookup. */
+  h->fdi = fdi;
+  h->ep = &fdi_to_sock_fdi(fdi)->sock;
+  h->fd = fd;
+  h->is_tcp = citp_fdinfo_get_type(fdi) == CITP_TCP_SOCKET;
+  *handle_out = h;
+  rc = 0;
+  goto out;
+
+ out_release:
+  citp_fdinfo_release_ref(fdi, 0);
+ out:
+  citp_exit_lib(&lib_context, TRUE);
+  Log_CALL_RESULT(rc);
+  return rc;
+}
+
+
+void onload_socket_handle_put(struct onload_socket_handle* h)
+{
+  citp_lib_context_t lib_context;
+
+  Log_CALL(ci_log("%s(%p)", __FUNCTION__, h));
+
+  citp_enter_lib(&lib_context);
+  citp_fdinfo_release_ref(h->fdi, 0);
+  citp_exit_lib(&lib_context, TRUE);
+  free(h);
+}
+
+
+ssize_t onload_socket_handle_send(struct onload_socket_handle* h,
+                                  const void* buf, size_t len, int flags)
+{
+  citp_lib_context_t lib_context;
+  citp_socket* ep = h->ep;
+  struct iovec iov;
+  struct msghdr m;
+  ci_udp_iomsg_args a;
+  int rc;
+
+  citp_enter_lib(&lib_context);
+  if(CI_UNLIKELY( ! oo_handle_is_valid(h) )) {
+    citp_exit_lib(&lib_context, TRUE);
+    return -ESTALE;
+  }
+
+  iov.iov_base = (void*) buf;
+  iov.iov_len = len;
+  if( h->is_tcp ) {
+    /* As citp_tcp_send(). */
+    if( ep->s->b.sb_aflags & (CI_SB_AFLAG_O_NONBLOCK | CI_SB_AFLAG_O_NDELAY) )
+      flags |= MSG_DONTWAIT;
+    if( ep->s->b.state != CI_TCP_LISTEN ) {
+      rc = ci_tcp_sendmsg(ep->netif, SOCK_TO_TCP(ep->s), &iov, 1, flags);
+    }
+    else {
+      errno = ep->s->tx_errno;
+      rc = -1;
+    }
+    if( rc == -1 && errno == EPIPE && ! (flags & MSG_NOSIGNAL) )
+      oo_resource_op(ci_netif_get_driver_handle(ep->netif),
+                     OO_IOC_KILL_SELF_SIGPIPE, NULL);
+  }
+  else {
+    memset(&m, 0, sizeof(m));
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    a.ep = ep;
+    a.fd = h->fd;
+    a.ni = ep->netif;
+    a.us = SOCK_TO_UDP(ep->s);
+    rc = ci_udp_sendmsg(&a, &m, flags);
+  }
+
+  if( rc < 0 )
+    rc = -errno;
+  citp_exit_lib(&lib_context, TRUE);
+  return rc;
+}
+
+
+ssize_t onload_socket_handle_recv(struct onload_socket_handle* h,
+                                  void* buf, size_t len, int flags)
+{
+  citp_lib_context_t lib_context;
+  citp_socket* ep = h->ep;
+  ci_tcp_recvmsg_args ta;
+  ci_udp_iomsg_args ua;
+  struct iovec iov;
+  struct msghdr m;
+  int rc;
+
+  citp_enter_lib(&lib_context);
+  if(CI_UNLIKELY( ! oo_handle_is_valid(h) )) {
+    citp_exit_lib(&lib_context, TRUE);
+    return -ESTALE;
+  }
+
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  memset(&m, 0, sizeof(m));
+  m.msg_iov = &iov;
+  m.msg_iovlen = 1;
+  if( h->is_tcp ) {
+    /* As citp_tcp_recv(). */
+    if( ep->s->b.sb_aflags & (CI_SB_AFLAG_O_NONBLOCK | CI_SB_AFLAG_O_NDELAY) )
+      flags |= MSG_DONTWAIT;
+    if( (flags & (MSG_WAITALL | ONLOAD_MSG_ONEPKT)) ==
+        (MSG_WAITALL | ONLOAD_MSG_ONEPKT) ) {
+      errno = EINVAL;
+      rc = -1;
+    }
+    else if( ep->s->b.state != CI_TCP_LISTEN ) {
+      ci_tcp_recvmsg_args_init(&ta, ep->netif, SOCK_TO_TCP(ep->s), &m, flags);
+      rc = ci_tcp_recvmsg(&ta);
+    }
+    else {
+      CI_SET_ERROR(rc, SOCK_RX_ERRNO(ep->s));
+    }
+  }
+  else {
+    ua.fd = h->fd;
+    ua.ep = ep;
+    ua.ni = ep->netif;
+    ua.us = SOCK_TO_UDP(ep->s);
+    rc = ci_udp_recvmsg(&ua, &m, flags);
+  }
+
+  if( rc < 0 )
+    rc = -errno;
+  citp_exit_lib(&lib_context, TRUE);
+  return rc;
+}
+
+
+static unsigned oo_handle_poll_events(struct onload_socket_handle* h)
+{
+  if( h->is_tcp )
+    return ci_tcp_poll_events(h->ep->netif, h->ep->s);
+  else
+    return ci_udp_poll_events(h->ep->netif, SOCK_TO_UDP(h->ep->s));
+}
+
+
+int onload_socket_handle_poll(struct onload_socket_handle* h, short events)
+{
+  citp_lib_context_t lib_context;
+  ci_netif* ni = h->ep->netif;
+  unsigned want = events | POLLERR | POLLHUP;
+  unsigned mask;
+  ci_uint64 frc;
+
+  citp_enter_lib(&lib_context);
+  if(CI_UNLIKELY( ! oo_handle_is_valid(h) )) {
+    citp_exit_lib(&lib_context, TRUE);
+    return -ESTALE;
+  }
+
+  /* As citp_tcp_poll() and citp_udp_poll(). */
+  mask = oo_handle_poll_events(h);
+  if( (mask & want) == 0 ) {
+    ci_frc64(&frc);
+    if( citp_poll_if_needed(ni, frc, 0) )
+      mask = oo_handle_poll_events(h);
+  }
+
+  citp_exit_lib(&lib_context, TRUE);
+  return mask & want;
+}
@@ -474,6 +474,10 @@ extern int citp_ep_dup_fcntl_dup_cloexec(int oldfd, long arg) CI_HF;
 extern int citp_ep_dup3(unsigned oldfd, unsigned newfd, int flags) CI_HF;
 extern int citp_ep_close(unsigned fd) CI_HF;
 
+/* Emulate Onload's accept() inheritance options for a socket accepted by
+ * the kernel from listening socket [lfd]. */
+extern void oo_accept_os_hack_inheritance(int lfd, int afd) CI_HF;
+
 extern void citp_fdtable_dump(void)  CI_HF;
 extern void citp_fdtable_dump_fd(int fd)  CI_HF;
 
@@ -576,14 +580,12 @@ extern int citp_init_trampoline(ci_fd_t fd) CI_HF;
 extern citp_fdinfo* citp_tcp_dup(citp_fdinfo* orig_fdi);
 
 /* Locking order:
- * - citp_pkt_map_lock is the innermost lock;
  * - citp_dup_lock should be taken before citp_ul_lock.
  * citp_dup_lock protects dups and forks, which are not async-safe and can
  * not be called from signal handler.  So, citp_dup_lock may be taken
  * without enter_lib.
  */
 extern pthread_mutex_t citp_dup_lock;
-extern pthread_mutex_t citp_pkt_map_lock;
 
 extern int citp_timespec_compare(const struct timespec* a,
                                  const struct timespec* b) CI_HF;
@@ -99,7 +99,6 @@ static void citp_netif_pre_fork_hook(void)
 #endif
 
   oo_rwlock_lock_write(&citp_dup2_lock);
-  pthread_mutex_lock(&citp_pkt_map_lock);
 
   if( citp.init_level < CITP_INIT_NETIF )
     return;
@@ -129,7 +128,6 @@ static void citp_netif_parent_fork_hook(void)
   }
 
   Log_CALL(ci_log("%s()", __FUNCTION__));
-  pthread_mutex_unlock(&citp_pkt_map_lock);
   oo_rwlock_unlock_write(&citp_dup2_lock);
 
   if( citp.init_level < CITP_INIT_FDTABLE)
@@ -179,7 +177,6 @@ static void citp_netif_child_fork_hook(void)
   pthread_mutex_init(&citp_dup_lock, NULL);
   oo_rwlock_ctor(&citp_ul_lock);
   oo_rwlock_ctor(&citp_dup2_lock);
-  pthread_mutex_init(&citp_pkt_map_lock, NULL);
 
   if( citp.init_level < CITP_INIT_FDTABLE)
     return;
@@ -289,25 +289,135 @@ int onload_timestamping_request(int fd, unsigned flags)
 
   citp_enter_lib(&lib_context);
 
-  if( (fdi = citp_fdtable_lookup(fd)) != NULL && citp_fdinfo_is_socket(fdi) ) {
+  fdi = citp_fdtable_lookup(fd);
+  if( fdi == NULL ) {
+    rc = -ENOTTY;
+  }
+  else if( ! citp_fdinfo_is_socket(fdi) ) {
+    rc = -ENOTTY;
+    citp_fdinfo_release_ref(fdi, 0);
+  }
+  else if( (flags & ONLOAD_TIMESTAMPING_FLAG_TX_RING) &&
+           ci_netif_tx_ts_ring_n(fdi_to_socket(fdi)->netif) == 0 ) {
+    /* Without a ring (EF_TX_TIMESTAMP_RING) every timestamp would be
+     * dropped as lost. */
+    rc = -ENOENT;
+    citp_fdinfo_release_ref(fdi, 0);
+  }
+  else {
+    ci_netif* ni = fdi_to_socket(fdi)->netif;
     ci_sock_cmn* sock = fdi_to_socket(fdi)->s;
+
+    /* As for SO_TIMESTAMPING, which this overrides. */
+    ci_netif_lock(ni);
     if( flags & ONLOAD_TIMESTAMPING_FLAG_RX_MASK )
       sock->cmsg_flags |= CI_IP_CMSG_TIMESTAMPING;
     else
       sock->cmsg_flags &= ~CI_IP_CMSG_TIMESTAMPING;
 
+    if( flags & ONLOAD_TIMESTAMPING_FLAG_TX_RING ) {
+      flags |= ONLOAD_TIMESTAMPING_FLAG_TX_NIC;
+      /* The ring reports keys as SOF_TIMESTAMPING_OPT_ID would, counting
+       * from now unless that option was already set. */
+      if( ~sock->timestamping_flags & ONLOAD_SOF_TIMESTAMPING_OPT_ID ) {
+        sock->ts_key = 0;
+        if( sock->b.state & CI_TCP_STATE_TCP_CONN )
+          sock->ts_key = SOCK_TO_TCP(sock)->snd_una;
+      }
+      flags |= ONLOAD_SOF_TIMESTAMPING_OPT_ID;
+    }
     sock->timestamping_flags = ONLOAD_SOF_TIMESTAMPING_ONLOAD | flags;
-    if( flags & ONLOAD_TIMESTAMPING_FLAG_TX_MASK )
+    /* Timestamps that go to the ring are never queued on the socket. */
+    if( (flags & ONLOAD_TIMESTAMPING_FLAG_TX_MASK) &&
+        ! (flags & ONLOAD_TIMESTAMPING_FLAG_TX_RING) )
       /* HACK: this tricks the TCP receive path into providing timestamps */
       sock->timestamping_flags |= ONLOAD_SOF_TIMESTAMPING_STREAM;
+    ci_netif_unlock(ni);
 
     rc = 0;
+    citp_fdinfo_release_ref(fdi, 0);
+  }
+
+  citp_exit_lib(&lib_context, 0);
+  return rc;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+
+#if CI_CFG_TIMESTAMPING
+/* Copy up to [n] entries from the TX timestamp ring.  Other readers may be
+ * doing the same, so the entries are claimed only after they have been
+ * copied, and if that fails they are copied again. */
+static int oo_tx_ts_ring_read(ci_netif* ni, struct onload_tx_timestamp* out,
+                              int n)
+{
+  ci_netif_state* ns = ni->state;
+  ci_uint32 ring_n = ns->tx_ts_ring_n;
+  ci_uint32 removed, avail, i;
+  const oo_tx_timestamp* e;
+
+  CI_BUILD_ASSERT(OO_TX_TS_F_IN_SYNC == ONLOAD_TX_TIMESTAMP_F_IN_SYNC);
+  CI_BUILD_ASSERT(OO_TX_TS_F_TCP == ONLOAD_TX_TIMESTAMP_F_TCP);
+  CI_BUILD_ASSERT(OO_TX_TS_F_LOST == ONLOAD_TX_TIMESTAMP_F_LOST);
+
+  if( ring_n == 0 )
+    return -ENOENT;
+  if( n <= 0 )
+    return 0;
+
+  do {
+    removed = ns->tx_ts_ring_removed;
+    avail = ns->tx_ts_ring_added - removed;
+    if( avail == 0 )
+      return 0;
+    /* Read the entries only after seeing that they have been written. */
+    ci_rmb();
+    avail = CI_MIN(avail, ring_n);
+    avail = CI_MIN(avail, (ci_uint32) n);
+    for( i = 0; i < avail; ++i ) {
+      e = &ni->tx_ts_ring[(removed + i) & (ring_n - 1)];
+      out[i].stamp.sec = e->sec;
+      out[i].stamp.nsec = e->nsec;
+      out[i].stamp.nsec_frac = 0;
+      out[i].stamp.reserved = 0;
+      out[i].endpoint_id = e->sock_id;
+      out[i].key = e->key;
+      out[i].flags = e->flags;
+    }
+  } while( ! ci_cas32u_succeed(&ns->tx_ts_ring_removed, removed,
+                               removed + avail) );
+
+  return avail;
+}
+#endif
+
+
+int onload_tx_timestamps_read(int fd, struct onload_tx_timestamp* ts, int n)
+{
+#if CI_CFG_TIMESTAMPING
+  citp_fdinfo* fdi;
+  int rc;
+  citp_lib_context_t lib_context;
+
+  Log_CALL(ci_log("%s(%d, %p, %d)", __FUNCTION__, fd, ts, n));
+
+  citp_enter_lib(&lib_context);
+
+  if( (fdi = citp_fdtable_lookup(fd)) != NULL ) {
+    if( citp_fdinfo_is_socket(fdi) )
+      rc = oo_tx_ts_ring_read(fdi_to_socket(fdi)->netif, ts, n);
+    else
+      rc = -ENOTTY;
+    citp_fdinfo_release_ref(fdi, 0);
   }
   else {
     rc = -ENOTTY;
   }
 
-  citp_exit_lib(&lib_context, 0);
+  citp_exit_lib(&lib_context, TRUE);
+  Log_CALL_RESULT(rc);
   return rc;
 #else
   return -EOPNOTSUPP;
@@ -99,6 +99,25 @@ int citp_splice_pipe_pipe(citp_pipe_fdi* in_pipe_fdi,
 }
 
 
+/* Returns the TCP socket behind [alien_fdi] if splice() between it and the
+ * pipe can move packet buffers rather than copy, else NULL.
+ */
+static ci_tcp_state* citp_pipe_splice_tcp_peer(citp_pipe_fdi* epi,
+                                               citp_fdinfo* alien_fdi)
+{
+  citp_sock_fdi* sock_epi;
+
+  if( ! CITP_OPTS.pipe_splice_zc || alien_fdi == NULL ||
+      citp_fdinfo_get_type(alien_fdi) != CITP_TCP_SOCKET )
+    return NULL;
+  sock_epi = fdi_to_sock_fdi(alien_fdi);
+  if( sock_epi->sock.netif != epi->ni ||
+      ! (sock_epi->sock.s->b.state & CI_TCP_STATE_TCP_CONN) )
+    return NULL;
+  return SOCK_TO_TCP(sock_epi->sock.s);
+}
+
+
 /* Copies data from an alien descriptor to pipe
  *
  * Some observations on kernel implementation behaviour:
@@ -118,11 +137,13 @@ int citp_splice_pipe_pipe(citp_pipe_fdi* in_pipe_fdi,
  * recvmsg and non-blocking flags.
  */
 #define CITP_PIPE_SPLICE_WRITE_STACK_IOV_LEN 64
-int citp_pipe_splice_write(citp_fdinfo* fdi, int alien_fd, loff_t* alien_off,
+int citp_pipe_splice_write(citp_fdinfo* fdi, int alien_fd,
+                           citp_fdinfo* alien_fdi, loff_t* alien_off,
                            size_t olen, int flags,
                            citp_lib_context_t* lib_context)
 {
   citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdi);
+  ci_tcp_state* ts;
   struct iovec iov_on_stack[CITP_PIPE_SPLICE_WRITE_STACK_IOV_LEN];
   struct iovec* iov = iov_on_stack;
   int iov_num_allocated = CITP_PIPE_SPLICE_WRITE_STACK_IOV_LEN;
@@ -168,6 +189,15 @@ int citp_pipe_splice_write(citp_fdinfo* fdi, int alien_fd, loff_t* alien_off,
     }
   }
 
+  /* If alien_fd is an Onload TCP socket in the same stack, try to move its
+   * received packets into the pipe.  Whatever can't be moved is copied
+   * below. */
+  if( (ts = citp_pipe_splice_tcp_peer(epi, alien_fdi)) != NULL ) {
+    rc = ci_pipe_zc_move_from_tcp(epi->ni, epi->pipe, ts, len, 0);
+    if( rc > 0 )
+      return rc;
+  }
+
   do {
     int count;
     int iov_num;
@@ -296,11 +326,13 @@ static int oo_splice_read_cb(void* context, struct iovec* iov,
 }
 
 
-int citp_pipe_splice_read(citp_fdinfo* fdi, int alien_fd, loff_t* alien_off,
+int citp_pipe_splice_read(citp_fdinfo* fdi, int alien_fd,
+                          citp_fdinfo* alien_fdi, loff_t* alien_off,
                           size_t len, int flags,
                           citp_lib_context_t* lib_context)
 {
   citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdi);
+  ci_tcp_state* ts = citp_pipe_splice_tcp_peer(epi, alien_fdi);
   int rc;
   int read_len = 0;
   int non_block = flags & SPLICE_F_NONBLOCK;
@@ -321,6 +353,18 @@ int citp_pipe_splice_read(citp_fdinfo* fdi, int alien_fd, loff_t* alien_off,
       .len = len,
       .lib_context = lib_context
     };
+    if( ts != NULL ) {
+      /* Move whole buffers to the socket's send queue if we can; fall back
+       * to copying if none could be moved. */
+      rc = ci_pipe_zc_move_to_tcp(epi->ni, epi->pipe, ts, len,
+                                  (non_block ? MSG_DONTWAIT : 0) |
+                                  ((flags & SPLICE_F_MORE) ? MSG_MORE : 0));
+      if( rc != 0 ) {
+        if( rc > 0 )
+          read_len += rc;
+        break;
+      }
+    }
     rc = ci_pipe_zc_read(epi->ni, epi->pipe, len,
                          non_block ? MSG_DONTWAIT : 0,
                          oo_splice_read_cb, &ctx);
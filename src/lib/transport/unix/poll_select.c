@@ -4,9 +4,120 @@
 #include "internal.h"
 #include "ul_poll.h"
 #include "ul_select.h"
+#include <onload/tcp_poll.h>
+#include <onload/sleep.h>
 
 #if CI_CFG_USERSPACE_SELECT
 
+/****************************************************************************
+ ***************************** READINESS BITMAPS ****************************
+ ****************************************************************************/
+
+/* Each stack keeps a bit per socket for each of OO_SOCK_READY_RX_EVENTS
+ * and OO_SOCK_READY_TX_EVENTS, which is set whenever the socket is woken.
+ * A socket whose bits are clear has none of those events, so with large
+ * descriptor sets poll() and select() need not look at the socket state of
+ * the many sockets that are idle.
+ */
+
+/* Returns the socket if [fdi] is one whose readiness is tracked in the
+ * sock_ready bitmaps, else NULL. */
+ci_inline citp_socket* oo_sock_ready_ep(citp_fdinfo* fdi)
+{
+  citp_socket* ep;
+
+  switch( citp_fdinfo_get_type(fdi) ) {
+  case CITP_TCP_SOCKET:
+  case CITP_UDP_SOCKET:
+    ep = &fdi_to_sock_fdi(fdi)->sock;
+    if(CI_UNLIKELY( ep->s->b.sb_aflags & CI_SB_AFLAG_MOVED_AWAY ))
+      return NULL;
+    return ep;
+  default:
+    return NULL;
+  }
+}
+
+
+static unsigned oo_sock_ready_events(citp_socket* ep)
+{
+  if( ep->s->b.state & CI_TCP_STATE_TCP )
+    return ci_tcp_poll_events(ep->netif, ep->s);
+  else
+    return ci_udp_poll_events(ep->netif, SOCK_TO_UDP(ep->s));
+}
+
+
+/* Returns true if [ep] has none of [events], judging by its readiness bits
+ * alone.  The stack is polled (if needed) the first time we see it in each
+ * pass, so that the bits are up to date.  A pending [so_error] is not
+ * always accompanied by a wake, so a socket with one is never skipped.
+ */
+static int oo_sock_ready_idle(citp_socket* ep, unsigned events,
+                              ci_uint64 frc, unsigned spin,
+                              ci_netif** last_ni)
+{
+  ci_netif* ni = ep->netif;
+  unsigned id = W_ID(&ep->s->b);
+  unsigned words = ci_netif_sock_ready_words(ni);
+  ci_uint32 bit = 1u << (id & 31);
+
+  if( ni != *last_ni ) {
+    citp_poll_if_needed(ni, frc, spin);
+    *last_ni = ni;
+  }
+  if(CI_UNLIKELY( (id >> 5) >= words ))
+    return 0;
+  if( ni->sock_ready[id >> 5] & bit )
+    return 0;
+  if(CI_UNLIKELY( ep->s->so_error ))
+    return 0;
+  return ! (events & OO_SOCK_READY_TX_EVENTS) ||
+         ! (ni->sock_ready[words + (id >> 5)] & bit);
+}
+
+
+/* Called when [ep] was found to have none of the requested events.  Clear
+ * its bits for the classes of events that it has none of at all, so that
+ * later passes can skip it.  A wake may race with us, so look at the
+ * socket again after clearing: the waker sets the bit after updating the
+ * socket state, so one of us sees the other's change.
+ */
+static void oo_sock_ready_clear(citp_socket* ep)
+{
+  ci_netif* ni = ep->netif;
+  unsigned id = W_ID(&ep->s->b);
+  unsigned words = ci_netif_sock_ready_words(ni);
+  volatile ci_uint32* p = ni->sock_ready + (id >> 5);
+  ci_uint32 bit = 1u << (id & 31);
+  unsigned mask, cleared = 0;
+
+  if(CI_UNLIKELY( (id >> 5) >= words ))
+    return;
+
+  mask = oo_sock_ready_events(ep);
+  if( ! (mask & OO_SOCK_READY_RX_EVENTS) && (p[0] & bit) ) {
+    ci_atomic32_and(&p[0], ~bit);
+    cleared |= CI_SB_FLAG_WAKE_RX;
+  }
+  if( ! (mask & OO_SOCK_READY_TX_EVENTS) && (p[words] & bit) ) {
+    ci_atomic32_and(&p[words], ~bit);
+    cleared |= CI_SB_FLAG_WAKE_TX;
+  }
+  if( cleared == 0 )
+    return;
+
+  ci_mb();
+  mask = oo_sock_ready_events(ep);
+  if( ! (mask & OO_SOCK_READY_RX_EVENTS) )
+    cleared &=~ CI_SB_FLAG_WAKE_RX;
+  if( ! (mask & OO_SOCK_READY_TX_EVENTS) )
+    cleared &=~ CI_SB_FLAG_WAKE_TX;
+  if( cleared )
+    ci_netif_sock_ready_set(ni, &ep->s->b, cleared);
+}
+
+
 /****************************************************************************
  ************************************ SELECT ********************************
  ****************************************************************************/
@@ -158,7 +269,11 @@ static inline int do_sys_select(const char* why, int nfds,
 */
 ci_inline int citp_ul_select(struct oo_ul_select_state*__restrict__ s)
 {
-  int r, w, e, fd, n = 0;
+  int r, w, e, fd, wi, n = 0, n_before;
+  unsigned long bits, m;
+  ci_netif* last_ni = NULL;
+  citp_fdinfo_p fdip;
+  citp_socket* ep;
 
 #if CI_CFG_SPIN_STATS
   s->stat_incremented = 0;
@@ -171,13 +286,19 @@ ci_inline int citp_ul_select(struct oo_ul_select_state*__restrict__ s)
 
   s->is_kernel_fd = 0;
 
-  for( fd = 0; fd < s->nfds_inited; ++fd ) {
-    r = FD_ISSET(fd, s->rdi);
-    w = FD_ISSET(fd, s->wri);
-    e = FD_ISSET(fd, s->exi);
-
-    if( r | w | e ) {
-      citp_fdinfo_p fdip = citp_fdtable.table[fd].fdip;
+  /* Walk the sets a word at a time, visiting only the fds that are set. */
+  for( wi = 0; wi * CI_NFDBITS < s->nfds_inited; ++wi ) {
+    bits = CI_FDS_BITS(s->rdi)[wi] | CI_FDS_BITS(s->wri)[wi] |
+           CI_FDS_BITS(s->exi)[wi];
+    for( ; bits != 0; bits &= bits - 1 ) {
+      fd = wi * CI_NFDBITS + __builtin_ctzl(bits);
+      if( fd >= s->nfds_inited )
+        break;
+      r = FD_ISSET(fd, s->rdi);
+      w = FD_ISSET(fd, s->wri);
+      e = FD_ISSET(fd, s->exi);
+
+      fdip = citp_fdtable.table[fd].fdip;
       if( fdip_is_normal(fdip) ) {
 	citp_fdinfo* fdi = fdip_to_fdi(fdip);
 
@@ -190,8 +311,20 @@ ci_inline int citp_ul_select(struct oo_ul_select_state*__restrict__ s)
           s->ul_select_spin &= ~(1 << ONLOAD_SPIN_SO_BUSY_POLL);
         }
 
+        ep = oo_sock_ready_ep(fdi);
+        if( ep != NULL &&
+            oo_sock_ready_idle(ep, (r ? POLLIN : 0) | (w ? POLLOUT : 0) |
+                                   (e ? POLLPRI : 0),
+                               s->now_frc, s->ul_select_spin, &last_ni) ) {
+          s->is_ul_fd = 1;
+          continue;
+        }
+
+        n_before = n;
 	if( citp_fdinfo_get_ops(fdi)->select(fdi, &n, r, w, e, s) ) {
 	  s->is_ul_fd = 1;
+          if( n == n_before && ep != NULL )
+            oo_sock_ready_clear(ep);
 	  continue;
 	}
       }
@@ -206,14 +339,24 @@ ci_inline int citp_ul_select(struct oo_ul_select_state*__restrict__ s)
   if( citp_fdtable_not_mt_safe() )
     CITP_FDTABLE_UNLOCK_RD();
 
-  for( ; fd < s->nfds_split; ++fd ) {
-    r = FD_ISSET(fd, s->rdi);
-    w = FD_ISSET(fd, s->wri);
-    e = FD_ISSET(fd, s->exi);
-    if( r | w | e ) {
-      if( r )  FD_SET(fd, s->rdk);
-      if( w )  FD_SET(fd, s->wrk);
-      if( e )  FD_SET(fd, s->exk);
+  /* Everything from [nfds_inited] up to the split is a kernel fd. */
+  for( wi = s->nfds_inited / CI_NFDBITS; wi * CI_NFDBITS < s->nfds_split;
+       ++wi ) {
+    m = ~0ul;
+    if( wi * CI_NFDBITS < s->nfds_inited )
+      m &= ~0ul << (s->nfds_inited % CI_NFDBITS);
+    if( (wi + 1) * CI_NFDBITS > s->nfds_split )
+      m &= (1ul << (s->nfds_split % CI_NFDBITS)) - 1;
+    if( (bits = CI_FDS_BITS(s->rdi)[wi] & m) ) {
+      CI_FDS_BITS(s->rdk)[wi] |= bits;
+      s->is_kernel_fd = 1;
+    }
+    if( (bits = CI_FDS_BITS(s->wri)[wi] & m) ) {
+      CI_FDS_BITS(s->wrk)[wi] |= bits;
+      s->is_kernel_fd = 1;
+    }
+    if( (bits = CI_FDS_BITS(s->exi)[wi] & m) ) {
+      CI_FDS_BITS(s->exk)[wi] |= bits;
       s->is_kernel_fd = 1;
     }
   }
@@ -553,6 +696,7 @@ int citp_ul_do_select(int nfds, fd_set* rds, fd_set* wrs, fd_set* exs,
 */
 static int citp_ul_poll(int nfds, struct oo_ul_poll_state*__restrict__ ps)
 {
+  ci_netif* last_ni = NULL;
   int i;
 
   ps->n_ul_ready = 0;
@@ -568,6 +712,9 @@ static int citp_ul_poll(int nfds, struct oo_ul_poll_state*__restrict__ ps)
     if( fd < citp_fdtable.inited_count ) {
       citp_fdinfo_p fdip = citp_fdtable.table[fd].fdip;
       if( fdip_is_normal(fdip) ) {
+        citp_fdinfo* fdi = fdip_to_fdi(fdip);
+        citp_socket* ep;
+
         ++ps->n_ul_fds;
 
         /* If SO_BUSY_POLL behaviour requested need to check if there is
@@ -579,10 +726,19 @@ static int citp_ul_poll(int nfds, struct oo_ul_poll_state*__restrict__ ps)
           ps->ul_poll_spin &= ~(1 << ONLOAD_SPIN_SO_BUSY_POLL);
         }
 
-        if( citp_fdinfo_get_ops(fdip_to_fdi(fdip))->poll(fdip_to_fdi(fdip),
-                                                         &ps->pfds[i], ps) ) {
+        ep = oo_sock_ready_ep(fdi);
+        if( ep != NULL &&
+            oo_sock_ready_idle(ep, ps->pfds[i].events, ps->this_poll_frc,
+                               ps->ul_poll_spin, &last_ni) ) {
+          ps->pfds[i].revents = 0;
+          continue;
+        }
+
+        if( citp_fdinfo_get_ops(fdi)->poll(fdi, &ps->pfds[i], ps) ) {
           if( ps->pfds[i].revents != 0 )
             ++ps->n_ul_ready;
+          else if( ep != NULL )
+            oo_sock_ready_clear(ep);
           continue;
         }
       }
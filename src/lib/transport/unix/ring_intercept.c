@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Batched socket calls submitted through an onload_ring
+**   \date  2026/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#include "internal.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <onload/extensions.h>
+#include <onload/extensions_zc.h>
+
+
+/* See note about convertions in sockcall_intercept.c */
+#define CI_NOT_NULL     ((void *)-1)
+
+
+struct oo_ring_zc_recv {
+  const struct onload_ring_sqe* sqe;
+  struct onload_ring_cqe* cqe;
+};
+
+
+static enum onload_zc_callback_rc
+oo_ring_zc_recv_cb(struct onload_zc_recv_args* args, int flags)
+{
+  struct oo_ring_zc_recv* zr = args->user_ptr;
+  struct onload_ring_cqe* cqe = zr->cqe;
+  struct onload_zc_msg* msg = &args->msg;
+  size_t copied = 0, n;
+  int i;
+
+  if( msg->msghdr.msg_iovlen == 1 &&
+      msg->iov[0].buf != ONLOAD_ZC_HANDLE_NONZC ) {
+    cqe->res = msg->iov[0].iov_len;
+    cqe->flags |= ONLOAD_RING_CQE_F_ZC;
+    cqe->zc_buf = msg->iov[0].iov_base;
+    cqe->zc_handle = msg->iov[0].buf;
+    return ONLOAD_ZC_KEEP | ONLOAD_ZC_TERMINATE;
+  }
+
+  /* A datagram that spans several buffers can't be handed over as one
+   * buffer, so copy it out as recv() would, truncating it to fit.  Only
+   * datagram sockets get here: see oo_ring_zc_recv(). */
+  for( i = 0; i < msg->msghdr.msg_iovlen; ++i ) {
+    n = CI_MIN(msg->iov[i].iov_len, zr->sqe->len - copied);
+    memcpy((char*) zr->sqe->buf + copied, msg->iov[i].iov_base, n);
+    copied += n;
+    if( n < msg->iov[i].iov_len ) {
+      cqe->flags |= ONLOAD_RING_CQE_F_TRUNC;
+      break;
+    }
+  }
+  cqe->res = copied;
+  return ONLOAD_ZC_TERMINATE;
+}
+
+
+/* Returns >= 0 if the request was completed with zero-copy receive
+ * (successfully or not), or < 0 if it should be done as a copying recv. */
+static int oo_ring_zc_recv(citp_fdinfo* fdi, const struct onload_ring_sqe* sqe,
+                           struct onload_ring_cqe* cqe)
+{
+  struct oo_ring_zc_recv zr = { sqe, cqe };
+  struct onload_zc_recv_args args;
+  int rc;
+
+  if( sqe->op_flags & ~MSG_DONTWAIT )
+    return -1;
+  /* The callback may discard the tail of a message that does not fit in
+   * buf, which is only right for datagrams.  A copying recv() leaves
+   * unread stream data queued. */
+  if( citp_fdinfo_get_type(fdi) != CITP_UDP_SOCKET )
+    return -1;
+
+  memset(&args, 0, sizeof(args));
+  args.cb = oo_ring_zc_recv_cb;
+  args.user_ptr = &zr;
+  args.flags = sqe->op_flags & ONLOAD_MSG_DONTWAIT;
+  cqe->res = -EAGAIN;
+  rc = citp_fdinfo_get_ops(fdi)->zc_recv(fdi, &args);
+  /* Not supported on this socket, or there is data in the kernel
+   * socket. */
+  if( rc == -EOPNOTSUPP || rc == -ENOTEMPTY )
+    return -1;
+  if( rc < 0 )
+    cqe->res = rc;
+  return 0;
+}
+
+
+static void oo_ring_msghdr(struct msghdr* m, struct iovec* iov,
+                           const struct onload_ring_sqe* sqe)
+{
+  iov->iov_base = sqe->buf;
+  iov->iov_len = sqe->len;
+  CI_DEBUG(m->msg_name = CI_NOT_NULL);
+  m->msg_namelen = 0;
+  m->msg_iov = iov;
+  m->msg_iovlen = 1;
+  CI_DEBUG(m->msg_control = CI_NOT_NULL);
+  m->msg_controllen = 0;
+}
+
+
+/* Carry out [sqe] on an Onload socket. */
+static int oo_ring_do_fdi(citp_fdinfo* fdi, const struct onload_ring_sqe* sqe,
+                          struct onload_ring_cqe* cqe,
+                          citp_lib_context_t* lib_context)
+{
+  struct msghdr m;
+  struct iovec iov;
+
+  switch( sqe->op ) {
+  case ONLOAD_RING_OP_SEND:
+    oo_ring_msghdr(&m, &iov, sqe);
+    return citp_fdinfo_get_ops(fdi)->send(fdi, &m, sqe->op_flags);
+  case ONLOAD_RING_OP_RECV:
+    if( (sqe->flags & ONLOAD_RING_SQE_F_ZC) &&
+        oo_ring_zc_recv(fdi, sqe, cqe) >= 0 ) {
+      if( cqe->res >= 0 )
+        return cqe->res;
+      errno = -cqe->res;
+      return -1;
+    }
+    oo_ring_msghdr(&m, &iov, sqe);
+    m.msg_flags = 0;
+    return citp_fdinfo_get_ops(fdi)->recv(fdi, &m, sqe->op_flags);
+  case ONLOAD_RING_OP_ACCEPT:
+    return citp_fdinfo_get_ops(fdi)->accept(fdi, NULL, NULL, sqe->op_flags,
+                                            lib_context);
+  default:
+    ci_assert(0);
+    return -1;
+  }
+}
+
+
+/* Carry out [sqe] on a file descriptor that Onload does not handle. */
+static int oo_ring_do_sys(const struct onload_ring_sqe* sqe,
+                          citp_lib_context_t* lib_context)
+{
+  int rc;
+
+  /* May block for a long time - stop deferring signals during syscall */
+  citp_exit_lib(lib_context, FALSE);
+  switch( sqe->op ) {
+  case ONLOAD_RING_OP_SEND:
+    rc = ci_sys_send(sqe->fd, sqe->buf, sqe->len, sqe->op_flags);
+    break;
+  case ONLOAD_RING_OP_RECV:
+    rc = ci_sys_recv(sqe->fd, sqe->buf, sqe->len, sqe->op_flags);
+    break;
+  case ONLOAD_RING_OP_ACCEPT:
+#if CI_LIBC_HAS_accept4
+    rc = ci_sys_accept4(sqe->fd, NULL, NULL, sqe->op_flags);
+#else
+    if( sqe->op_flags == 0 ) {
+      rc = ci_sys_accept(sqe->fd, NULL, NULL);
+    }
+    else {
+      errno = EINVAL;
+      rc = -1;
+    }
+#endif
+    break;
+  default:
+    ci_assert(0);
+    rc = -1;
+  }
+  citp_reenter_lib(lib_context);
+
+  if( sqe->op == ONLOAD_RING_OP_ACCEPT && rc >= 0 ) {
+    citp_fdtable_passthru(rc, 0);
+    oo_accept_os_hack_inheritance(sqe->fd, rc);
+  }
+  return rc;
+}
+
+
+int onload_ring_submit(struct onload_ring* ring)
+{
+  const struct onload_ring_sqe* sqe;
+  struct onload_ring_cqe* cqe;
+  citp_lib_context_t lib_context;
+  citp_fdinfo* fdi = NULL;
+  int last_fd = -1, done = 0, rc;
+
+  Log_CALL(ci_log("%s(%p) sq=%u-%u cq=%u-%u", __FUNCTION__, ring,
+                  ring->sq_head, ring->sq_tail, ring->cq_head, ring->cq_tail));
+
+  citp_enter_lib(&lib_context);
+
+  while( ring->sq_head != ring->sq_tail &&
+         ring->cq_tail - ring->cq_head <= ring->cq_mask ) {
+    sqe = &ring->sqes[ring->sq_head & ring->sq_mask];
+    cqe = &ring->cqes[ring->cq_tail & ring->cq_mask];
+    cqe->user_data = sqe->user_data;
+    cqe->flags = 0;
+    cqe->zc_buf = NULL;
+    cqe->zc_handle = NULL;
+
+    switch( sqe->op ) {
+    case ONLOAD_RING_OP_NOP:
+      rc = 0;
+      break;
+    case ONLOAD_RING_OP_CLOSE:
+      /* Drop our reference before the socket goes away. */
+      if( fdi != NULL && sqe->fd == last_fd ) {
+        citp_fdinfo_release_ref(fdi, 0);
+        fdi = NULL;
+        last_fd = -1;
+      }
+      rc = citp_ep_close(sqe->fd);
+      break;
+    case ONLOAD_RING_OP_SEND:
+    case ONLOAD_RING_OP_RECV:
+    case ONLOAD_RING_OP_ACCEPT:
+      /* Runs of requests on one socket are common, so only look the socket
+       * up when it changes. */
+      if( sqe->fd != last_fd ) {
+        if( fdi != NULL )
+          citp_fdinfo_release_ref(fdi, 0);
+        fdi = citp_fdtable_lookup(sqe->fd);
+        last_fd = sqe->fd;
+      }
+      if( fdi != NULL )
+        rc = oo_ring_do_fdi(fdi, sqe, cqe, &lib_context);
+      else
+        rc = oo_ring_do_sys(sqe, &lib_context);
+      break;
+    default:
+      rc = -1;
+      errno = EINVAL;
+      break;
+    }
+
+    cqe->res = rc >= 0 ? rc : -errno;
+    ++ring->sq_head;
+    ++ring->cq_tail;
+    ++done;
+  }
+
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+
+  FDTABLE_ASSERT_VALID();
+  citp_exit_lib(&lib_context, TRUE);
+
+  Log_CALL_RESULT(done);
+  return done;
+}
@@ -174,6 +174,7 @@ static void citp_dump_opts(citp_opts_t *o)
   DUMP_OPT_INT("EF_PIPE_RECV_SPIN",     pipe_recv_spin);
   DUMP_OPT_INT("EF_PIPE_SEND_SPIN",     pipe_send_spin);
   DUMP_OPT_INT("EF_PIPE_SIZE",          pipe_size);
+  DUMP_OPT_INT("EF_PIPE_SPLICE_ZC",     pipe_splice_zc);
 #endif
   DUMP_OPT_INT("EF_SOCK_LOCK_BUZZ",     sock_lock_buzz);
   DUMP_OPT_INT("EF_STACK_LOCK_BUZZ",    stack_lock_buzz);
@@ -452,6 +453,7 @@ static void citp_opts_getenv(citp_opts_t* opts)
   GET_ENV_OPT_INT("EF_PIPE_RECV_SPIN",  pipe_recv_spin);
   GET_ENV_OPT_INT("EF_PIPE_SEND_SPIN",  pipe_send_spin);
   GET_ENV_OPT_INT("EF_PIPE_SIZE",       pipe_size);
+  GET_ENV_OPT_INT("EF_PIPE_SPLICE_ZC",  pipe_splice_zc);
 #endif
   GET_ENV_OPT_INT("EF_SOCK_LOCK_BUZZ",  sock_lock_buzz);
   GET_ENV_OPT_INT("EF_STACK_LOCK_BUZZ", stack_lock_buzz);
@@ -23,11 +23,11 @@ extern int citp_splice_pipe_pipe(citp_pipe_fdi* in_pipe_fdi,
                                  citp_pipe_fdi* out_pipe_fdi, size_t rlen,
                                  int flags);
 extern int citp_pipe_splice_write(citp_fdinfo* fdi, int alien_fd,
-                                  loff_t* alien_off,
+                                  citp_fdinfo* alien_fdi, loff_t* alien_off,
                                   size_t len, int flags,
                                   citp_lib_context_t* lib_context);
 extern int citp_pipe_splice_read(citp_fdinfo* fdi, int alien_fd,
-                                 loff_t* alien_off,
+                                 citp_fdinfo* alien_fdi, loff_t* alien_off,
                                  size_t len, int flags,
                                  citp_lib_context_t* lib_context);
 
@@ -21,6 +21,13 @@
 
 #define OO_POLL_MAX_OSP    16
 
+/* The events that each of a stack's sock_ready bitmaps stands for.  A
+ * socket's bit may be clear only if it has none of these events. */
+#define OO_SOCK_READY_RX_EVENTS  (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI | \
+                                  POLLRDHUP | POLLERR | POLLHUP)
+#define OO_SOCK_READY_TX_EVENTS  (POLLOUT | POLLWRNORM | POLLWRBAND | \
+                                  POLLERR | POLLHUP)
+
 #define KEEP_POLLING(what, now, start)                                  \
   (what && (((now) = ci_frc64_get()) - (start) < citp.spin_cycles))
 
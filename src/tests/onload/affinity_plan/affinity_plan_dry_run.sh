@@ -0,0 +1,41 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
+
+# Checks the plan onload_affinity_plan makes in dry-run (--topology) mode
+# for the sample host description in src/tools/ip, against the expected
+# output alongside this script.  Needs no NIC, driver or stacks:
+#
+#   ./affinity_plan_dry_run.sh [path/to/onload_affinity_plan]
+#
+# If the planner changes on purpose, regenerate sample.plan and sample.env
+# by running the same commands, and check the new plan by hand.
+
+plan=${1:-onload_affinity_plan}
+here=$(cd "$(dirname "$0")" && pwd)
+topo="$here/../../../tools/ip/affinity_plan_sample.topo"
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+rc=0
+
+fail() {
+  echo "FAIL: $*"
+  rc=1
+}
+
+"$plan" --topology "$topo" > "$tmp/plan" || fail "--topology exited $?"
+diff -u "$here/sample.plan" "$tmp/plan" || fail "unexpected plan"
+
+"$plan" --topology "$topo" --env > "$tmp/env" || fail "--env exited $?"
+diff -u "$here/sample.env" "$tmp/env" || fail "unexpected --env output"
+
+# A dry run must not touch the host.
+"$plan" --topology "$topo" --apply > /dev/null 2>&1 &&
+  fail "--topology accepted with --apply"
+
+echo "bogus line" > "$tmp/bad.topo"
+"$plan" --topology "$tmp/bad.topo" > /dev/null 2>&1 &&
+  fail "bad description accepted"
+
+[ $rc -eq 0 ] && echo "PASS"
+exit $rc
@@ -0,0 +1,387 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Trace-driven simulation of load-aware cluster steering.
+ *
+ * Models a cluster of [-n] stacks behind a 128-entry RSS indirection
+ * table and drives the policy in onload/cluster_balance.h with the inputs
+ * that a driver would sample from each stack.  No hardware is needed:
+ *
+ *   ./cluster_balance_sim                  (built-in trace, balanced)
+ *   ./cluster_balance_sim -o               (same, RSS only)
+ *   ./cluster_balance_sim -t trace.txt -v
+ *
+ * Each tick, [-r] connections arrive in uniformly random buckets at the
+ * stack that owns the bucket.  The stack handles each SYN [-s] ticks later
+ * (its event latency) and queues the connection on its accept queue ([-q]
+ * deep), or drops it if that is full.  Each stack accepts up to its
+ * capacity per tick, and accepted connections stay open for [-l] ticks.
+ * Every [-p] ticks the stacks are sampled and the policy may move buckets.
+ *
+ * Each stack is polled before it is sampled, so that
+ * SYNs it has not handled yet show their buckets as busy.  The poll needs
+ * the stack lock, which is busy [-L] percent of the time; the sample then
+ * has [buckets_unknown] set.  [-u] samples without polling, which shows
+ * the connections that the race would break.
+ *
+ * A trace file has lines of the form "<tick> <stack> <capacity>", which
+ * set the number of connections that a stack can accept per tick from
+ * that tick on; '#' starts a comment.  Without one, every stack has
+ * capacity [-c] and stack 0 drops to a quarter of that between ticks 500
+ * and 2000, as if it shared its core with something else.
+ *
+ * The run fails if the policy ever moves a bucket that still has
+ * connections or unhandled SYNs in its old stack, as those would be broken
+ * on real hardware.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <onload/cluster_balance.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+#define N_BUCKETS     OO_CLUSTER_BALANCE_BUCKETS
+#define MAX_EVENTS    1024
+
+
+struct trace_event {
+  unsigned tick;
+  unsigned stack;
+  unsigned capacity;
+};
+
+struct conn {
+  unsigned bucket;
+  unsigned arrived;
+};
+
+struct stack {
+  unsigned      capacity;
+  struct conn*  q;                     /* accept queue, a ring */
+  unsigned      q_head, q_n;
+  unsigned      pending[N_BUCKETS];      /* SYNs not yet handled */
+  unsigned      queued[N_BUCKETS];
+  unsigned      open[N_BUCKETS];
+  unsigned      served;                /* this period */
+  unsigned      busy_ticks;            /* this period */
+};
+
+
+static int cfg_n_stacks = 4;
+static int cfg_rate = 40;
+static int cfg_capacity = 12;
+static int cfg_lifetime = 5;
+static int cfg_acceptq = 64;
+static int cfg_period = 10;
+static int cfg_ticks = 3000;
+static int cfg_high = 70;
+static int cfg_pkts = 512;
+static int cfg_syn_latency = 3;
+static int cfg_lock_busy = 10;
+static int cfg_off;
+static int cfg_no_poll;
+static int cfg_verbose;
+static const char* cfg_trace;
+
+static struct trace_event events[MAX_EVENTS];
+static int n_events;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  cluster_balance_sim [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <stacks>   cluster size (default 4)\n");
+  fprintf(stderr, "  -r <conns>    arrivals per tick (default 40)\n");
+  fprintf(stderr, "  -c <conns>    accepts per tick per stack (default 12)\n");
+  fprintf(stderr, "  -l <ticks>    connection lifetime (default 5)\n");
+  fprintf(stderr, "  -q <conns>    accept queue limit (default 64)\n");
+  fprintf(stderr, "  -P <pkts>     packet buffers per stack (default 512)\n");
+  fprintf(stderr, "  -s <ticks>    SYN event latency (default 3)\n");
+  fprintf(stderr, "  -L <percent>  chance stack lock is busy (default 10)\n");
+  fprintf(stderr, "  -p <ticks>    sample period (default 10)\n");
+  fprintf(stderr, "  -T <ticks>    length of run (default 3000)\n");
+  fprintf(stderr, "  -H <percent>  shed load above this (default 70)\n");
+  fprintf(stderr, "  -t <file>     capacity trace\n");
+  fprintf(stderr, "  -o            balancing off\n");
+  fprintf(stderr, "  -u            sample without polling first\n");
+  fprintf(stderr, "  -v            print each sample\n");
+  exit(1);
+}
+
+
+static void trace_add(unsigned tick, unsigned stack, unsigned capacity)
+{
+  TEST(n_events < MAX_EVENTS);
+  TEST(stack < (unsigned) cfg_n_stacks);
+  TEST(n_events == 0 || events[n_events - 1].tick <= tick);
+  events[n_events].tick = tick;
+  events[n_events].stack = stack;
+  events[n_events].capacity = capacity;
+  ++n_events;
+}
+
+
+static void trace_load(void)
+{
+  char line[256];
+  unsigned tick, stack, capacity;
+  FILE* f;
+  int s;
+
+  if( cfg_trace == NULL ) {
+    for( s = 0; s < cfg_n_stacks; ++s )
+      trace_add(0, s, cfg_capacity);
+    trace_add(500, 0, cfg_capacity / 4);
+    trace_add(2000, 0, cfg_capacity);
+    return;
+  }
+
+  TEST((f = fopen(cfg_trace, "r")) != NULL);
+  while( fgets(line, sizeof(line), f) != NULL ) {
+    char* p = strchr(line, '#');
+    if( p != NULL )
+      *p = '\0';
+    if( sscanf(line, "%u %u %u", &tick, &stack, &capacity) == 3 )
+      trace_add(tick, stack, capacity);
+  }
+  fclose(f);
+}
+
+
+static unsigned rand_n(unsigned n)
+{
+  static uint64_t x = 88172645463325252ull;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x % n;
+}
+
+
+static void enqueue(struct stack* st, unsigned bucket, unsigned arrived,
+                    unsigned long long* dropped)
+{
+  if( st->q_n == (unsigned) cfg_acceptq ) {
+    ++*dropped;
+    return;
+  }
+  st->q[(st->q_head + st->q_n) % cfg_acceptq].bucket = bucket;
+  st->q[(st->q_head + st->q_n) % cfg_acceptq].arrived = arrived;
+  ++st->q_n;
+  ++st->queued[bucket];
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct oo_cluster_balance policy;
+  struct oo_cluster_load loads[OO_CLUSTER_BALANCE_MAX_STACKS];
+  struct stack* stacks;
+  unsigned* closing;                 /* [lifetime + 1][stacks][buckets] */
+  unsigned* syns;                    /* [syn_latency + 1][stacks][buckets] */
+  uint8_t indir[N_BUCKETS];
+  ci_uint32 seed[N_BUCKETS];
+  unsigned long long arrived = 0, dropped = 0, accepted = 0, broken = 0;
+  unsigned long long wait_sum = 0;
+  unsigned wait_max = 0;
+  int c, s, b, i, j, tick, ev = 0, slots, syn_slots;
+
+  while( (c = getopt(argc, argv, "n:r:c:l:q:P:s:L:p:T:H:t:ouv")) != -1 )
+    switch( c ) {
+    case 'n':  cfg_n_stacks = atoi(optarg);  break;
+    case 'r':  cfg_rate = atoi(optarg);      break;
+    case 'c':  cfg_capacity = atoi(optarg);  break;
+    case 'l':  cfg_lifetime = atoi(optarg);  break;
+    case 'q':  cfg_acceptq = atoi(optarg);   break;
+    case 'P':  cfg_pkts = atoi(optarg);      break;
+    case 's':  cfg_syn_latency = atoi(optarg);  break;
+    case 'L':  cfg_lock_busy = atoi(optarg);    break;
+    case 'p':  cfg_period = atoi(optarg);    break;
+    case 'T':  cfg_ticks = atoi(optarg);     break;
+    case 'H':  cfg_high = atoi(optarg);      break;
+    case 't':  cfg_trace = optarg;           break;
+    case 'o':  cfg_off = 1;                  break;
+    case 'u':  cfg_no_poll = 1;              break;
+    case 'v':  cfg_verbose = 1;              break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_n_stacks < 2 ||
+      cfg_n_stacks > OO_CLUSTER_BALANCE_MAX_STACKS || cfg_rate < 0 ||
+      cfg_capacity < 0 || cfg_lifetime < 1 || cfg_acceptq < 1 ||
+      cfg_pkts < 1 || cfg_syn_latency < 0 || cfg_lock_busy < 0 ||
+      cfg_lock_busy > 100 || cfg_period < 1 || cfg_ticks < 1 ||
+      cfg_high < 1 || cfg_high > 100 )
+    usage();
+
+  trace_load();
+
+  /* Start from the table a new VI set gets, with the buckets striped
+   * across the stacks.  Move at most 4 buckets per step, only between
+   * stacks whose scores differ by an eighth, and only once a bucket has
+   * been quiet for 2 samples. */
+  for( b = 0; b < N_BUCKETS; ++b )
+    seed[b] = b % cfg_n_stacks;
+  TEST(oo_cluster_balance_init(&policy, cfg_n_stacks, seed,
+                               cfg_high * OO_CLUSTER_LOAD_ONE / 100,
+                               OO_CLUSTER_LOAD_ONE / 8, 2, 4) == 0);
+
+  slots = cfg_lifetime + 1;
+  syn_slots = cfg_syn_latency + 1;
+  TEST((stacks = calloc(cfg_n_stacks, sizeof(*stacks))) != NULL);
+  TEST((closing = calloc((size_t) slots * cfg_n_stacks * N_BUCKETS,
+                         sizeof(*closing))) != NULL);
+  TEST((syns = calloc((size_t) syn_slots * cfg_n_stacks * N_BUCKETS,
+                      sizeof(*syns))) != NULL);
+  for( s = 0; s < cfg_n_stacks; ++s )
+    TEST((stacks[s].q = calloc(cfg_acceptq, sizeof(struct conn))) != NULL);
+
+#define CLOSING(t, s, b)                                                \
+  closing[(((t) % slots) * cfg_n_stacks + (s)) * N_BUCKETS + (b)]
+#define SYNS(t, s, b)                                                   \
+  syns[(((t) % syn_slots) * cfg_n_stacks + (s)) * N_BUCKETS + (b)]
+
+  for( tick = 0; tick < cfg_ticks; ++tick ) {
+    while( ev < n_events && events[ev].tick <= (unsigned) tick ) {
+      stacks[events[ev].stack].capacity = events[ev].capacity;
+      ++ev;
+    }
+
+    /* Connections reaching the end of their lifetime close. */
+    for( s = 0; s < cfg_n_stacks; ++s )
+      for( b = 0; b < N_BUCKETS; ++b ) {
+        stacks[s].open[b] -= CLOSING(tick, s, b);
+        CLOSING(tick, s, b) = 0;
+      }
+
+    /* New connections land on the stack that owns their bucket. */
+    for( i = 0; i < cfg_rate; ++i ) {
+      s = policy.indir[b = rand_n(N_BUCKETS)];
+      ++SYNS(tick + cfg_syn_latency, s, b);
+      ++stacks[s].pending[b];
+      ++arrived;
+    }
+
+    /* Stacks handle the SYNs that have reached the end of their event
+     * latency. */
+    for( s = 0; s < cfg_n_stacks; ++s )
+      for( b = 0; b < N_BUCKETS; ++b ) {
+        for( ; SYNS(tick, s, b) != 0; --SYNS(tick, s, b) ) {
+          --stacks[s].pending[b];
+          enqueue(&stacks[s], b, tick - cfg_syn_latency, &dropped);
+        }
+      }
+
+    /* Each stack accepts what it can. */
+    for( s = 0; s < cfg_n_stacks; ++s ) {
+      struct stack* st = &stacks[s];
+      unsigned n = 0, wait;
+      while( n < st->capacity && st->q_n > 0 ) {
+        struct conn* conn = &st->q[st->q_head];
+        wait = tick - conn->arrived;
+        wait_sum += wait;
+        if( wait > wait_max )
+          wait_max = wait;
+        --st->queued[conn->bucket];
+        ++st->open[conn->bucket];
+        ++CLOSING(tick + cfg_lifetime, s, conn->bucket);
+        st->q_head = (st->q_head + 1) % cfg_acceptq;
+        --st->q_n;
+        ++n;
+        ++accepted;
+      }
+      st->served += n;
+      if( st->q_n > 0 || (st->capacity != 0 && n == st->capacity) )
+        ++st->busy_ticks;
+    }
+
+    if( (tick + 1) % cfg_period != 0 )
+      continue;
+
+    /* Sample the stacks. */
+    memset(loads, 0, sizeof(loads));
+    for( s = 0; s < cfg_n_stacks; ++s ) {
+      struct stack* st = &stacks[s];
+      unsigned in_use = 0;
+      int locked = rand_n(100) >= (unsigned) cfg_lock_busy;
+      loads[s].present = 1;
+      loads[s].buckets_unknown = ! locked;
+      if( locked && ! cfg_no_poll )
+        for( j = 1; j <= cfg_syn_latency; ++j )
+          for( b = 0; b < N_BUCKETS; ++b )
+            for( ; SYNS(tick + j, s, b) != 0; --SYNS(tick + j, s, b) ) {
+              --st->pending[b];
+              enqueue(st, b, tick + j - cfg_syn_latency, &dropped);
+            }
+      loads[s].acceptq_n = st->q_n;
+      loads[s].acceptq_max = cfg_acceptq;
+      loads[s].poll_busy = st->busy_ticks * OO_CLUSTER_LOAD_ONE / cfg_period;
+      for( b = 0; b < N_BUCKETS; ++b ) {
+        in_use += st->open[b] + st->queued[b];
+        if( locked && st->open[b] + st->queued[b] != 0 )
+          oo_cluster_load_mark_bucket(&loads[s], b);
+      }
+      loads[s].pkts_in_use = in_use;
+      loads[s].pkts_max = cfg_pkts;
+      st->served = st->busy_ticks = 0;
+    }
+
+    if( cfg_off )
+      continue;
+
+    memcpy(indir, policy.indir, sizeof(indir));
+    oo_cluster_balance_step(&policy, loads);
+    for( b = 0; b < N_BUCKETS; ++b )
+      if( policy.indir[b] != indir[b] ) {
+        struct stack* st = &stacks[indir[b]];
+        broken += st->open[b] + st->queued[b] + st->pending[b];
+      }
+
+    if( cfg_verbose ) {
+      printf("%6d:", tick + 1);
+      for( s = 0; s < cfg_n_stacks; ++s ) {
+        int n_buckets = 0;
+        for( b = 0; b < N_BUCKETS; ++b )
+          n_buckets += policy.indir[b] == s;
+        printf("  [%d] cap=%-3u q=%-3u load=%3u%% buckets=%-3d", s,
+               stacks[s].capacity, stacks[s].q_n,
+               policy.score[s] * 100 / OO_CLUSTER_LOAD_ONE, n_buckets);
+      }
+      printf("\n");
+    }
+  }
+#undef SYNS
+#undef CLOSING
+
+  printf("%s: %llu arrived, %llu accepted, %llu dropped (%.2f%%)\n",
+         cfg_off ? "rss only" : "balanced", arrived, accepted, dropped,
+         arrived ? 100.0 * dropped / arrived : 0.0);
+  printf("accept wait: mean %.2f ticks, max %u ticks\n",
+         accepted ? (double) wait_sum / accepted : 0.0, wait_max);
+  printf("bucket moves: %u in %u samples, connections broken: %llu\n",
+         policy.n_moves, policy.n_steps, broken);
+
+  for( s = 0; s < cfg_n_stacks; ++s )
+    free(stacks[s].q);
+  free(stacks);
+  free(closing);
+  free(syns);
+  return broken ? 1 : 0;
+}
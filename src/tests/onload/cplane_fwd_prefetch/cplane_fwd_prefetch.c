@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Batched prefetch of prefix probes in route cache lookups.
+ *
+ * Builds a synthetic fwd table in private memory, filled the way the
+ * control plane server fills it, and times cp_fwd_find_match() for three
+ * kinds of destination:
+ *
+ *   host   - has its own /32 row, found by the first probe;
+ *   subnet - covered only by a /8 row, so every longer prefix length in the
+ *            table is tried first;
+ *   miss   - not covered by any row, so every prefix pair is tried.
+ *
+ * Each is timed for the library lookup, which hashes the prefix pairs in
+ * batches and prefetches their first rows, and for a reference that probes
+ * the pairs one at a time, e.g.:
+ *
+ *   ./cplane_fwd_prefetch -l 18 -n 100000 -p 6
+ *
+ * No Onload stack or control plane server is needed.
+ */
+
+#include <ci/tools.h>
+
+#define CI_CFG_IPV6 1
+#include <onload/hash.h>
+#include <cplane/hash.h>
+#include <cplane/mib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+static unsigned cfg_table_ln2 = 16;
+static unsigned cfg_hosts = 8192;
+static unsigned cfg_prefixes = 4;
+static unsigned cfg_iters = 1000000;
+
+/* IPv4 prefix lengths as stored in the table. */
+#define PFX4(len)  (96 + (len))
+
+#define N_KEYS  4096
+
+/* The i'th host row's address: distinct and scattered over 10.0.0.0/8 for
+ * i < 2^23, with an even host part. */
+#define HOST(i)  (0x0a000000 | (((i) * 2654435761u) << 1 & 0xffffff))
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  cplane_fwd_prefetch [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -l <ln2>      log2 of fwd table rows (default 16)\n");
+  fprintf(stderr, "  -n <n>        /32 host rows (default 8192)\n");
+  fprintf(stderr, "  -p <n>        distinct dst prefix lengths between /8 "
+          "and /32 (default 4)\n");
+  fprintf(stderr, "  -i <n>        lookups per measurement (default "
+          "1000000)\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void pfx_set(ci_ipx_pfx_t* pfx, cicp_prefixlen_t len)
+{
+  uint64_t x[3];
+  bw_shift_bit_192(x, len);
+  bw_or_192(pfx->ip6, x);
+}
+
+
+/* Add a row as the server does: take the first unoccupied row on the probe
+ * sequence and count the sequence in [use] of each row it passes. */
+static void fwd_add(struct cp_fwd_table* t, ci_uint32 src, cicp_prefixlen_t spfx,
+                    ci_uint32 dst, cicp_prefixlen_t dpfx)
+{
+  struct cp_fwd_key k;
+  struct cp_fwd_row* fwd;
+  cicp_mac_rowid_t hash1, hash2, hash;
+  int iter = 0;
+
+  memset(&k, 0, sizeof(k));
+  k.src = CI_ADDR_FROM_IP4(src);
+  cp_addr_apply_pfx(&k.src, spfx);
+  k.dst = CI_ADDR_FROM_IP4(dst);
+  cp_addr_apply_pfx(&k.dst, dpfx);
+  cp_calc_fwd_hash(t, &k, &hash1, &hash2);
+
+  for( hash = hash1; ; hash = (hash + hash2) & t->mask ) {
+    TEST(++iter < CP_REHASH_LIMIT(t->mask));
+    fwd = &t->rows[hash];
+    ++fwd->use;
+    if( ~fwd->flags & CICP_FWD_FLAG_OCCUPIED )
+      break;
+  }
+  fwd->key = k;
+  fwd->key_ext.src_prefix = spfx;
+  fwd->key_ext.dst_prefix = dpfx;
+  fwd->flags = CICP_FWD_FLAG_OCCUPIED | CICP_FWD_FLAG_DATA_VALID;
+  pfx_set(&t->prefix[CP_FWD_PREFIX_SRC], spfx);
+  pfx_set(&t->prefix[CP_FWD_PREFIX_DST], dpfx);
+}
+
+
+static void pfx_clear(ci_ipx_pfx_t* mask, cicp_prefixlen_t len)
+{
+  uint64_t x[3];
+  bw_shift_bit_192(x, len);
+  bw_not_192(x);
+  bw_and_192(mask->ip6, x);
+}
+
+
+/* The lookup as it was before prefix pairs were batched: one probe
+ * sequence at a time, in the same order. */
+static cicp_mac_rowid_t
+find_match_serial(struct cp_fwd_table* t, struct cp_fwd_key* key)
+{
+  ci_ipx_pfx_t dst_prefs = t->prefix[CP_FWD_PREFIX_DST];
+  ci_ipx_pfx_t src_prefs, zero_prefs = {};
+  struct cp_fwd_key k = *key;
+  cicp_prefixlen_t src_pref, dst_pref;
+  cicp_mac_rowid_t id;
+
+  while( cp_get_fwd_pfx_cmp(&dst_prefs, &zero_prefs) ) {
+    dst_pref = cp_get_largest_prefix(dst_prefs);
+    k.dst = key->dst;
+    cp_addr_apply_pfx(&k.dst, dst_pref);
+    src_prefs = t->prefix[CP_FWD_PREFIX_SRC];
+    while( cp_get_fwd_pfx_cmp(&src_prefs, &zero_prefs) ) {
+      src_pref = cp_get_largest_prefix(src_prefs);
+      k.src = key->src;
+      cp_addr_apply_pfx(&k.src, src_pref);
+      id = __cp_fwd_find_row(t, &k, key, CP_FWD_MULTIPATH_WEIGHT_NONE);
+      if( id != CICP_ROWID_BAD )
+        return id;
+      pfx_clear(&src_prefs, src_pref);
+    }
+    pfx_clear(&dst_prefs, dst_pref);
+  }
+  return CICP_ROWID_BAD;
+}
+
+
+static double run(struct cp_fwd_table* t, struct cp_fwd_key* keys,
+                  int serial, int expect_hit)
+{
+  cicp_mac_rowid_t id;
+  uint64_t t0;
+  unsigned i;
+
+  t0 = now_ns();
+  for( i = 0; i < cfg_iters; ++i ) {
+    struct cp_fwd_key* key = &keys[i % N_KEYS];
+    if( serial )
+      id = find_match_serial(t, key);
+    else
+      id = cp_fwd_find_match(t, key, CP_FWD_MULTIPATH_WEIGHT_NONE);
+    if( (id != CICP_ROWID_BAD) != expect_hit ) {
+      fprintf(stderr, "ERROR: unexpected %s for key %u\n",
+              expect_hit ? "miss" : "hit", i % N_KEYS);
+      exit(1);
+    }
+  }
+  return (double) (now_ns() - t0) / cfg_iters;
+}
+
+
+static void make_keys(struct cp_fwd_key* keys, ci_uint32 src,
+                      const ci_uint32* dsts)
+{
+  int i;
+  memset(keys, 0, sizeof(*keys) * N_KEYS);
+  for( i = 0; i < N_KEYS; ++i ) {
+    keys[i].src = CI_ADDR_FROM_IP4(src);
+    keys[i].dst = CI_ADDR_FROM_IP4(dsts[i]);
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct cp_fwd_table t;
+  static struct cp_fwd_key keys[3][N_KEYS];
+  static ci_uint32 dsts[N_KEYS];
+  static const char* names[3] = { "host", "subnet", "miss" };
+  ci_uint32 src = htonl(0xc0a80001);  /* 192.168.0.1 */
+  unsigned i, j;
+  int c;
+
+  while( (c = getopt(argc, argv, "l:n:p:i:")) != -1 )
+    switch( c ) {
+    case 'l':
+      cfg_table_ln2 = atoi(optarg);
+      break;
+    case 'n':
+      cfg_hosts = atoi(optarg);
+      break;
+    case 'p':
+      cfg_prefixes = atoi(optarg);
+      break;
+    case 'i':
+      cfg_iters = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_table_ln2 < 4 || cfg_table_ln2 > 24 ||
+      cfg_prefixes > 23 || cfg_hosts >= 1u << 23 || cfg_hosts == 0 || cfg_iters == 0 )
+    usage();
+
+  memset(&t, 0, sizeof(t));
+  t.mask = (1u << cfg_table_ln2) - 1;
+  TEST(t.rows = calloc(t.mask + 1, sizeof(*t.rows)));
+  TEST(t.rw_rows = calloc(t.mask + 1, sizeof(*t.rw_rows)));
+  TEST(t.prefix = calloc(CP_FWD_PREFIX_NUM, sizeof(*t.prefix)));
+  TEST(cfg_hosts < (t.mask + 1) / 2);
+  srandom(1);
+
+  /* Hosts in 10.0.0.0/8, all from our address.  One row per other prefix
+   * length, in 172.16.0.0/12, just so that those lengths are present, and
+   * one source-independent route for 10.0.0.0/8 itself. */
+  for( i = 0; i < cfg_hosts; ++i )
+    fwd_add(&t, src, PFX4(32), htonl(HOST(i)), PFX4(32));
+  for( i = 0; i < cfg_prefixes; ++i )
+    fwd_add(&t, src, PFX4(32), htonl(0xac100000), PFX4(31 - i));
+  fwd_add(&t, 0, PFX4(0), htonl(0x0a000000), PFX4(8));
+
+  for( i = 0; i < N_KEYS; ++i )
+    dsts[i] = htonl(HOST(random() % cfg_hosts));
+  make_keys(keys[0], src, dsts);
+  /* Host rows only have even host parts, so these match the /8 row. */
+  for( i = 0; i < N_KEYS; ++i )
+    dsts[i] = htonl(0x0a000000 | ((random() * 2 + 1) & 0xffffff));
+  make_keys(keys[1], src, dsts);
+  for( i = 0; i < N_KEYS; ++i )
+    dsts[i] = htonl(0x0b000000 | (random() & 0xffffff));
+  make_keys(keys[2], src, dsts);
+
+  printf("# rows=%u hosts=%u dst_prefixes=%u lookups=%u\n",
+         t.mask + 1, cfg_hosts, cfg_prefixes + 2, cfg_iters);
+  printf("# %-8s %12s %12s\n", "dest", "prefetch_ns", "serial_ns");
+  for( j = 0; j < 3; ++j ) {
+    /* Warm up both, then measure. */
+    run(&t, keys[j], 0, j != 2);
+    run(&t, keys[j], 1, j != 2);
+    printf("  %-8s %12.1f %12.1f\n", names[j],
+           run(&t, keys[j], 0, j != 2), run(&t, keys[j], 1, j != 2));
+  }
+  return 0;
+}
@@ -0,0 +1,14 @@
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
+TARGETS	:= cplane_fwd_prefetch
+
+MMAKE_LIBS	:= $(LINK_CPLANE_LIB) $(LINK_CITOOLS_LIB)
+MMAKE_LIB_DEPS	:= $(CPLANE_LIB_DEPEND) $(CITOOLS_LIB_DEPEND)
+
+all: $(TARGETS)
+
+targets:
+	@echo $(TARGETS)
+
+clean:
+	@$(MakeClean)
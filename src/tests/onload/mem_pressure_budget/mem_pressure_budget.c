@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Checks the admission of received buffers during critical memory pressure
+ * (EF_MEM_PRESSURE_SOCK_PKTS).
+ *
+ * Builds a stack state in private memory with [-s] UDP sockets and
+ * [-t] TCP sockets, one of which has a large receive backlog, enters
+ * critical memory pressure with a pressure pool of [-p] buffers, and then
+ * offers received buffers to the sockets in turn using the same function
+ * as the receive paths, e.g.:
+ *
+ *   ./mem_pressure_budget -l 32 -s 768 -t 16 -p 64
+ *
+ * The run fails if:
+ *  - a socket is let past EF_MEM_PRESSURE_SOCK_PKTS;
+ *  - the sockets between them queue more than the pressure pool;
+ *  - the socket with the backlog queues anything;
+ *  - anything is queued with EF_MEM_PRESSURE_SOCK_PKTS=0.
+ *
+ * No Onload stack is needed.
+ */
+
+#define _GNU_SOURCE
+#include <ci/internal/ip.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+static int cfg_limit = 32;
+static int cfg_udp = 768;
+static int cfg_tcp = 16;
+static int cfg_pool = 64;
+static int cfg_rounds = 100;
+static int cfg_verbose;
+
+
+static int sock_rx_pkts(ci_netif* ni, citp_waitable_obj* wo)
+{
+  return ci_netif_sock_rx_pkts(ni, &wo->waitable);
+}
+
+
+/* Queue one more received buffer on [wo], as the receive path would. */
+static void sock_queue(citp_waitable_obj* wo)
+{
+  if( wo->waitable.state == CI_TCP_STATE_UDP )
+    ++wo->udp.recv_q.pkts_added;
+  else
+    ++wo->tcp.recv1.num;
+}
+
+
+/* Runs one spell of critical memory pressure and returns the number of
+ * buffers queued. */
+static int run(ci_netif* ni, citp_waitable_obj* socks, int n_socks,
+               int limit)
+{
+  int i, round, held, accepted = 0;
+  ci_uint32 accepts0;
+
+  NI_OPTS(ni).mem_pressure_sock_pkts = limit;
+  for( i = 0; i < n_socks; ++i ) {
+    socks[i].udp.recv_q.pkts_added = 0;
+    socks[i].udp.recv_q.pkts_reaped = 0;
+    socks[i].tcp.recv1.num = 0;
+    socks[i].tcp.recv2.num = 0;
+    socks[i].tcp.rob.num = 0;
+  }
+  /* Socket 0 has not been read for a while. */
+  if( socks[0].waitable.state == CI_TCP_STATE_UDP )
+    socks[0].udp.recv_q.pkts_added = 10 * limit + 1000;
+  else
+    socks[0].tcp.recv1.num = 10 * limit + 1000;
+
+  ni->state->mem_pressure = OO_MEM_PRESSURE_CRITICAL;
+  ni->state->mem_pressure_pkt_pool_n = cfg_pool;
+  ni->state->mem_pressure_sock_budget = cfg_pool;
+  accepts0 = ni->state->stats.memory_pressure_sock_accepts;
+
+  for( round = 0; round < cfg_rounds; ++round )
+    for( i = 0; i < n_socks; ++i ) {
+      held = sock_rx_pkts(ni, &socks[i]);
+      if( ci_netif_mem_pressure_sock_accept(ni, held) ) {
+        TEST(held < limit);
+        TEST(i != 0);
+        sock_queue(&socks[i]);
+        ++accepted;
+      }
+    }
+
+  for( i = 1; i < n_socks; ++i )
+    TEST(sock_rx_pkts(ni, &socks[i]) <= limit);
+  TEST(accepted <= cfg_pool);
+  TEST(ni->state->mem_pressure_sock_budget == cfg_pool - accepted);
+#if CI_CFG_STATS_NETIF
+  TEST(ni->state->stats.memory_pressure_sock_accepts - accepts0 ==
+       (ci_uint32) accepted);
+#else
+  (void) accepts0;
+#endif
+  if( cfg_verbose )
+    printf("limit=%d sockets=%d pool=%d accepted=%d\n",
+           limit, n_socks, cfg_pool, accepted);
+  return accepted;
+}
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: mem_pressure_budget [-l limit] [-s udp_socks] "
+          "[-t tcp_socks] [-p pool] [-r rounds] [-v]\n");
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  ci_netif ni;
+  citp_waitable_obj* socks;
+  int c, i, n_socks, expect;
+
+  while( (c = getopt(argc, argv, "l:s:t:p:r:v")) != -1 )
+    switch( c ) {
+    case 'l':  cfg_limit = atoi(optarg);   break;
+    case 's':  cfg_udp = atoi(optarg);     break;
+    case 't':  cfg_tcp = atoi(optarg);     break;
+    case 'p':  cfg_pool = atoi(optarg);    break;
+    case 'r':  cfg_rounds = atoi(optarg);  break;
+    case 'v':  cfg_verbose = 1;            break;
+    default:   usage();
+    }
+  n_socks = cfg_udp + cfg_tcp;
+  if( optind != argc || cfg_limit <= 0 || n_socks < 2 || cfg_pool < 0 )
+    usage();
+
+  memset(&ni, 0, sizeof(ni));
+  TEST((ni.state = calloc(1, sizeof(*ni.state))) != NULL);
+  TEST((socks = calloc(n_socks, sizeof(*socks))) != NULL);
+  for( i = 0; i < n_socks; ++i )
+    socks[i].waitable.state = i < cfg_udp ? CI_TCP_STATE_UDP :
+                                            CI_TCP_ESTABLISHED;
+
+  /* Disabled: everything is dropped. */
+  TEST(run(&ni, socks, n_socks, 0) == 0);
+
+  /* The light sockets between them could take more than the pool, so they
+   * must be held to it.  With a large pool, each is held to the limit. */
+  expect = (n_socks - 1) * CI_MIN(cfg_limit, cfg_rounds);
+  TEST(run(&ni, socks, n_socks, cfg_limit) == CI_MIN(expect, cfg_pool));
+  cfg_pool = expect + 100;
+  TEST(run(&ni, socks, n_socks, cfg_limit) == expect);
+
+  /* The same with the backlog on a TCP socket. */
+  socks[0].waitable.state = CI_TCP_ESTABLISHED;
+  TEST(run(&ni, socks, n_socks, cfg_limit) == expect);
+
+  /* Nothing is queued once the budget is used up. */
+  ni.state->mem_pressure_sock_budget = 0;
+  TEST(! ci_netif_mem_pressure_sock_accept(&ni, 0));
+
+  free(socks);
+  free(ni.state);
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,14 @@
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
+TARGETS	:= mem_pressure_budget
+
+MMAKE_LIBS	:= $(LINK_CITOOLS_LIB)
+MMAKE_LIB_DEPS	:= $(CITOOLS_LIB_DEPEND)
+
+all: $(TARGETS)
+
+targets:
+	@echo $(TARGETS)
+
+clean:
+	@$(MakeClean)
@@ -1,7 +1,11 @@
 # SPDX-License-Identifier: BSD-2-Clause
 # X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
 SUBDIRS	:= wire_order tproxy_preload woda_preload hwtimestamping \
-           sync_preload l3xudp_preload
+           sync_preload l3xudp_preload tcp_loopback \
+           udp_gso syn_storm cluster_balance stack_startup \
+           cplane_fwd_prefetch sock_ring thread_pingpong \
+           sock_handle poll_many \
+           mem_pressure_budget
 
 ifneq ($(ONLOAD_ONLY),1)
 # These tests have dependency on kernel_compat lib,
@@ -0,0 +1,11 @@
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
+TARGETS	:= poll_many
+
+all: $(TARGETS)
+
+targets:
+	@echo $(TARGETS)
+
+clean:
+	@$(MakeClean)
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Cost of poll() and select() over large numbers of mostly idle sockets.
+ *
+ * Opens <n> UDP sockets bound to the loopback address, plus <k> pipes
+ * whose read ends are polled too, and times poll() and select() with a
+ * zero timeout.  With -r one datagram is sent to one of the sockets first,
+ * so that the calls have one ready descriptor to find.  For example:
+ *
+ *   EF_MAX_ENDPOINTS=131072 onload ./poll_many -n 100000 -i 1000
+ *
+ * select() is given fd sets sized to suit rather than FD_SETSIZE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define BITS_PER_LONG  (8 * sizeof(unsigned long))
+
+static unsigned cfg_socks = 1000;
+static unsigned cfg_pipes = 0;
+static unsigned cfg_iters = 10000;
+static int cfg_ready = 0;
+
+static struct pollfd* pfds;
+static unsigned n_pfds;
+static int max_fd = -1;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  poll_many [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <n>        number of UDP sockets (default 1000)\n");
+  fprintf(stderr, "  -k <n>        number of pipes (default 0)\n");
+  fprintf(stderr, "  -i <n>        calls per test (default 10000)\n");
+  fprintf(stderr, "  -r            make one socket readable\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void report(const char* test, uint64_t ns)
+{
+  printf("%-8s %8u fds: %10.1f usec/call %8.2f nsec/fd\n", test, n_pfds,
+         ns / 1000.0 / cfg_iters, (double) ns / cfg_iters / n_pfds);
+}
+
+
+static void add_fd(int fd)
+{
+  pfds[n_pfds].fd = fd;
+  pfds[n_pfds].events = POLLIN;
+  ++n_pfds;
+  if( fd > max_fd )
+    max_fd = fd;
+}
+
+
+static void setup(void)
+{
+  struct rlimit rl;
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  unsigned i;
+  int fd, pfd[2];
+  char c = 0;
+
+  rl.rlim_cur = rl.rlim_max = cfg_socks + 2 * cfg_pipes + 64;
+  if( setrlimit(RLIMIT_NOFILE, &rl) < 0 )
+    fprintf(stderr, "setrlimit(%u): %s\n", (unsigned) rl.rlim_cur,
+            strerror(errno));
+
+  TEST(pfds = calloc(cfg_socks + cfg_pipes, sizeof(pfds[0])));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for( i = 0; i < cfg_socks; ++i ) {
+    TRY(fd = socket(AF_INET, SOCK_DGRAM, 0));
+    TRY(bind(fd, (struct sockaddr*) &sa, sizeof(sa)));
+    add_fd(fd);
+  }
+  for( i = 0; i < cfg_pipes; ++i ) {
+    TRY(pipe(pfd));
+    add_fd(pfd[0]);
+  }
+
+  if( cfg_ready && cfg_socks > 0 ) {
+    fd = pfds[cfg_socks / 2].fd;
+    TRY(getsockname(fd, (struct sockaddr*) &sa, &sa_len));
+    TRY(sendto(pfds[0].fd, &c, 1, 0, (struct sockaddr*) &sa, sizeof(sa)));
+    /* Wait for it to arrive. */
+    for( i = 0; i < 1000; ++i ) {
+      struct pollfd p = { .fd = fd, .events = POLLIN };
+      if( poll(&p, 1, 1) == 1 )
+        break;
+    }
+  }
+}
+
+
+static void run_poll(void)
+{
+  int expect = cfg_ready && cfg_socks > 0;
+  uint64_t t;
+  unsigned i;
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i )
+    TEST(poll(pfds, n_pfds, 0) == expect);
+  report("poll", now_ns() - t);
+}
+
+
+static void run_select(void)
+{
+  int expect = cfg_ready && cfg_socks > 0;
+  unsigned n_longs = (max_fd + BITS_PER_LONG) / BITS_PER_LONG;
+  unsigned long* in;
+  unsigned long* rd;
+  uint64_t t;
+  unsigned i;
+
+  /* Build the set by hand, as FD_SET() may refuse fds >= FD_SETSIZE. */
+  TEST(in = calloc(n_longs, sizeof(in[0])));
+  TEST(rd = calloc(n_longs, sizeof(rd[0])));
+  for( i = 0; i < n_pfds; ++i )
+    in[pfds[i].fd / BITS_PER_LONG] |= 1ul << (pfds[i].fd % BITS_PER_LONG);
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i ) {
+    memcpy(rd, in, n_longs * sizeof(in[0]));
+    TEST(select(max_fd + 1, (fd_set*) rd, NULL, NULL,
+                &(struct timeval){ 0, 0 }) == expect);
+  }
+  report("select", now_ns() - t);
+  free(in);
+  free(rd);
+}
+
+
+int main(int argc, char* argv[])
+{
+  int c;
+
+  while( (c = getopt(argc, argv, "n:k:i:r")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_socks = atoi(optarg);
+      break;
+    case 'k':
+      cfg_pipes = atoi(optarg);
+      break;
+    case 'i':
+      cfg_iters = atoi(optarg);
+      break;
+    case 'r':
+      cfg_ready = 1;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_iters == 0 || cfg_socks + cfg_pipes == 0 )
+    usage();
+
+  setup();
+  run_poll();
+  run_select();
+  return 0;
+}
@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Per-call overhead of socket calls made on a file descriptor and through
+ * an onload_socket_handle.
+ *
+ * Opens one TCP loopback connection within one process, and times:
+ *
+ *   recv    recv(MSG_DONTWAIT) on a socket with no data, which does
+ *           nothing but the call overhead
+ *   poll    poll() with a zero timeout on a socket with no data
+ *   xfer    a send() of one message followed by the recv() of it at the
+ *           other end of the connection
+ *
+ * first with the ordinary calls and then with the handle calls.  For
+ * example:
+ *
+ *   EF_TCP_SERVER_LOOPBACK=2 EF_TCP_CLIENT_LOOPBACK=4 \
+ *     onload ./sock_handle_bench -i 1000000
+ *
+ * Without Onload only the ordinary calls are timed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <onload/extensions.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+static unsigned cfg_iters = 1000000;
+static unsigned cfg_size = 64;
+
+static int cli, srv;
+static char buf[2048];
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  sock_handle_bench [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -i <n>        calls per test (default 1000000)\n");
+  fprintf(stderr, "  -s <bytes>    message size for xfer (default 64, max %d)\n",
+          (int) sizeof(buf));
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void connect_pair(void)
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  int lsock, one = 1;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(bind(lsock, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(getsockname(lsock, (struct sockaddr*) &sa, &sa_len));
+  TRY(listen(lsock, 1));
+  TRY(cli = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(cli, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+  TRY(connect(cli, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(srv = accept(lsock, NULL, NULL));
+  close(lsock);
+}
+
+
+static void report(const char* test, const char* api, uint64_t t)
+{
+  printf("%-5s %-7s %8.1f ns/call\n", test, api, (double) t / cfg_iters);
+}
+
+
+static void run_sys(void)
+{
+  struct pollfd pfd = { .fd = srv, .events = POLLIN };
+  uint64_t t;
+  unsigned i;
+  ssize_t rc;
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i )
+    TEST(recv(srv, buf, sizeof(buf), MSG_DONTWAIT) < 0 && errno == EAGAIN);
+  report("recv", "fd", now_ns() - t);
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i )
+    TEST(poll(&pfd, 1, 0) == 0);
+  report("poll", "fd", now_ns() - t);
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i ) {
+    TEST(send(cli, buf, cfg_size, 0) == cfg_size);
+    TRY(rc = recv(srv, buf, cfg_size, MSG_WAITALL));
+    TEST(rc == cfg_size);
+  }
+  report("xfer", "fd", now_ns() - t);
+}
+
+
+static void run_handle(struct onload_socket_handle* hcli,
+                       struct onload_socket_handle* hsrv)
+{
+  uint64_t t;
+  unsigned i;
+  ssize_t rc;
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i )
+    TEST(onload_socket_handle_recv(hsrv, buf, sizeof(buf), MSG_DONTWAIT) ==
+         -EAGAIN);
+  report("recv", "handle", now_ns() - t);
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i )
+    TEST(onload_socket_handle_poll(hsrv, POLLIN) == 0);
+  report("poll", "handle", now_ns() - t);
+
+  t = now_ns();
+  for( i = 0; i < cfg_iters; ++i ) {
+    TEST(onload_socket_handle_send(hcli, buf, cfg_size, 0) == cfg_size);
+    TRY(rc = onload_socket_handle_recv(hsrv, buf, cfg_size, MSG_WAITALL));
+    TEST(rc == cfg_size);
+  }
+  report("xfer", "handle", now_ns() - t);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct onload_socket_handle* hcli;
+  struct onload_socket_handle* hsrv;
+  int c, rc;
+
+  while( (c = getopt(argc, argv, "i:s:")) != -1 )
+    switch( c ) {
+    case 'i':
+      cfg_iters = atoi(optarg);
+      break;
+    case 's':
+      cfg_size = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_iters == 0 || cfg_size == 0 ||
+      cfg_size > sizeof(buf) )
+    usage();
+
+  connect_pair();
+  run_sys();
+
+  rc = onload_socket_handle_get(cli, &hcli);
+  if( rc < 0 ) {
+    printf("onload_socket_handle_get: %s\n", strerror(-rc));
+  }
+  else {
+    TRY(onload_socket_handle_get(srv, &hsrv));
+    run_handle(hcli, hsrv);
+
+    /* Once the fd is closed the handle must notice. */
+    close(cli);
+    TEST(onload_socket_handle_send(hcli, buf, 1, 0) == -ESTALE);
+    onload_socket_handle_put(hcli);
+    onload_socket_handle_put(hsrv);
+  }
+
+  close(srv);
+  return 0;
+}
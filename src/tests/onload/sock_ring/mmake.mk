@@ -0,0 +1,14 @@
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
+TARGETS	:= sock_ring_bench
+
+MMAKE_LIBS	+= $(LINK_ONLOAD_EXT_LIB)
+MMAKE_LIB_DEPS	+= $(ONLOAD_EXT_LIB_DEPEND)
+
+all: $(TARGETS)
+
+targets:
+	@echo $(TARGETS)
+
+clean:
+	@$(MakeClean)
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Cost of many small socket calls, made one at a time or through an
+ * onload_ring.
+ *
+ * Opens a number of TCP loopback connections within one process.  Each
+ * round sends a message on the client end of every connection and then
+ * receives it on the server end, first with send() and recv() and then by
+ * submitting the same requests to a ring in one onload_ring_submit() call.
+ * At the end, the ring closes the sockets.  For example:
+ *
+ *   EF_TCP_SERVER_LOOPBACK=2 EF_TCP_CLIENT_LOOPBACK=4 \
+ *     onload ./sock_ring_bench -n 32 -i 100000
+ *
+ * Without Onload only the syscall figures are reported.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <onload/extensions.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define MAX_CONNS  1024
+
+static unsigned cfg_conns = 16;
+static unsigned cfg_iters = 100000;
+static unsigned cfg_size = 64;
+
+static int cli[MAX_CONNS], srv[MAX_CONNS];
+static char buf[MAX_CONNS][2048];
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  sock_ring_bench [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <n>        connections (default 16, max %d)\n",
+          MAX_CONNS);
+  fprintf(stderr, "  -i <n>        rounds (default 100000)\n");
+  fprintf(stderr, "  -s <bytes>    message size (default 64, max %d)\n",
+          (int) sizeof(buf[0]));
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void connect_all(void)
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  int lsock, one = 1;
+  unsigned i;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(bind(lsock, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(getsockname(lsock, (struct sockaddr*) &sa, &sa_len));
+  TRY(listen(lsock, MAX_CONNS));
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    TRY(cli[i] = socket(AF_INET, SOCK_STREAM, 0));
+    TRY(setsockopt(cli[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+    TRY(connect(cli[i], (struct sockaddr*) &sa, sizeof(sa)));
+    TRY(srv[i] = accept(lsock, NULL, NULL));
+  }
+  close(lsock);
+}
+
+
+static double run_sys(void)
+{
+  uint64_t t;
+  unsigned it, i;
+
+  t = now_ns();
+  for( it = 0; it < cfg_iters; ++it ) {
+    for( i = 0; i < cfg_conns; ++i )
+      TEST(send(cli[i], buf[i], cfg_size, 0) == cfg_size);
+    for( i = 0; i < cfg_conns; ++i )
+      TEST(recv(srv[i], buf[i], cfg_size, MSG_WAITALL) == cfg_size);
+  }
+  return (double) (now_ns() - t) / ((uint64_t) cfg_iters * cfg_conns * 2);
+}
+
+
+/* Returns the time per call, or a negative value if the ring API is not
+ * available. */
+static double run_ring(struct onload_ring* ring)
+{
+  struct onload_ring_sqe* sqe;
+  struct onload_ring_cqe* cqe;
+  uint64_t t;
+  unsigned it, i, n;
+
+  t = now_ns();
+  for( it = 0; it < cfg_iters; ++it ) {
+    for( i = 0; i < cfg_conns; ++i ) {
+      TEST(sqe = onload_ring_get_sqe(ring));
+      sqe->op = ONLOAD_RING_OP_SEND;
+      sqe->fd = cli[i];
+      sqe->buf = buf[i];
+      sqe->len = cfg_size;
+    }
+    for( i = 0; i < cfg_conns; ++i ) {
+      TEST(sqe = onload_ring_get_sqe(ring));
+      sqe->op = ONLOAD_RING_OP_RECV;
+      sqe->fd = srv[i];
+      sqe->buf = buf[i];
+      sqe->len = cfg_size;
+      sqe->op_flags = MSG_WAITALL;
+    }
+    n = onload_ring_submit(ring);
+    if( (int) n == -ENOSYS )
+      return -1;
+    TEST(n == cfg_conns * 2);
+    while( (cqe = onload_ring_peek_cqe(ring)) != NULL ) {
+      TEST(cqe->res == (int) cfg_size);
+      onload_ring_cqe_seen(ring);
+    }
+  }
+  return (double) (now_ns() - t) / ((uint64_t) cfg_iters * cfg_conns * 2);
+}
+
+
+static void close_all(struct onload_ring* ring, int use_ring)
+{
+  struct onload_ring_sqe* sqe;
+  struct onload_ring_cqe* cqe;
+  unsigned i;
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    if( ! use_ring ) {
+      close(cli[i]);
+      close(srv[i]);
+      continue;
+    }
+    TEST(sqe = onload_ring_get_sqe(ring));
+    sqe->op = ONLOAD_RING_OP_CLOSE;
+    sqe->fd = cli[i];
+    TEST(sqe = onload_ring_get_sqe(ring));
+    sqe->op = ONLOAD_RING_OP_CLOSE;
+    sqe->fd = srv[i];
+    TEST(onload_ring_submit(ring) == 2);
+    while( (cqe = onload_ring_peek_cqe(ring)) != NULL ) {
+      TEST(cqe->res == 0);
+      onload_ring_cqe_seen(ring);
+    }
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  static struct onload_ring_sqe sqes[MAX_CONNS * 2];
+  static struct onload_ring_cqe cqes[MAX_CONNS * 2];
+  struct onload_ring ring;
+  unsigned entries;
+  double sys_ns, ring_ns;
+  int c;
+
+  while( (c = getopt(argc, argv, "n:i:s:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_conns = atoi(optarg);
+      break;
+    case 'i':
+      cfg_iters = atoi(optarg);
+      break;
+    case 's':
+      cfg_size = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_conns == 0 || cfg_conns > MAX_CONNS ||
+      cfg_iters == 0 || cfg_size == 0 || cfg_size > sizeof(buf[0]) )
+    usage();
+
+  for( entries = 1; entries < cfg_conns * 2; entries <<= 1 )
+    ;
+  TRY(onload_ring_init(&ring, sqes, entries, cqes, entries));
+  connect_all();
+
+  /* Warm up both paths. */
+  run_sys();
+  ring_ns = run_ring(&ring);
+
+  sys_ns = run_sys();
+  if( ring_ns >= 0 )
+    ring_ns = run_ring(&ring);
+
+  printf("# conns=%u rounds=%u size=%u\n", cfg_conns, cfg_iters, cfg_size);
+  printf("syscall_ns_per_call: %.1f\n", sys_ns);
+  if( ring_ns >= 0 )
+    printf("ring_ns_per_call:    %.1f\n", ring_ns);
+  else
+    printf("ring_ns_per_call:    unsupported (not running under Onload)\n");
+
+  close_all(&ring, ring_ns >= 0);
+  return 0;
+}
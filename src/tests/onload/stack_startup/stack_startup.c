@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Stack creation latency.
+ *
+ * Run under Onload with the configuration to be measured, e.g.:
+ *
+ *   EF_MAX_PACKETS=262144 EF_PREALLOC_PACKETS=1 onload ./stack_startup -n 20
+ *
+ * Each iteration forks a child that creates a socket, which creates a new
+ * Onload stack, and reports how long the socket() call took.  The parent
+ * prints the minimum, median, mean and maximum.  Compare runs with
+ * EF_STACK_INIT_THREADS=1 and larger values, and with and without
+ * EF_PREFAULT_THREADS.  With -v each child also runs
+ * "onload_stackdump netif" before exiting, which shows the time taken by
+ * each phase of stack creation on its startup_usec line.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+static unsigned cfg_n = 10;
+static int cfg_type = SOCK_STREAM;
+static int cfg_verbose;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  onload stack_startup [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <n>        stacks to create (default 10)\n");
+  fprintf(stderr, "  -u            create a UDP socket rather than TCP\n");
+  fprintf(stderr, "  -v            run onload_stackdump netif in each "
+          "child\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static int cmp_u64(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+
+/* Creates a stack in a new process and returns the time taken in ns. */
+static uint64_t create_one(void)
+{
+  uint64_t t;
+  int pipefd[2], status, sock;
+  pid_t pid;
+
+  TRY(pipe(pipefd));
+  TRY(pid = fork());
+  if( pid == 0 ) {
+    close(pipefd[0]);
+    t = now_ns();
+    TRY(sock = socket(AF_INET, cfg_type, 0));
+    t = now_ns() - t;
+    if( cfg_verbose )
+      TEST(system("onload_stackdump netif | grep -E 'name=|startup_'") != -1);
+    TEST(write(pipefd[1], &t, sizeof(t)) == sizeof(t));
+    close(sock);
+    _exit(0);
+  }
+
+  close(pipefd[1]);
+  TEST(read(pipefd[0], &t, sizeof(t)) == sizeof(t));
+  close(pipefd[0]);
+  TRY(waitpid(pid, &status, 0));
+  TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return t;
+}
+
+
+int main(int argc, char* argv[])
+{
+  uint64_t* times;
+  uint64_t sum = 0;
+  unsigned i;
+  int c;
+
+  while( (c = getopt(argc, argv, "n:uv")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_n = atoi(optarg);
+      break;
+    case 'u':
+      cfg_type = SOCK_DGRAM;
+      break;
+    case 'v':
+      cfg_verbose = 1;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_n == 0 )
+    usage();
+
+  TEST(times = calloc(cfg_n, sizeof(*times)));
+  for( i = 0; i < cfg_n; ++i ) {
+    times[i] = create_one();
+    sum += times[i];
+    if( cfg_verbose )
+      printf("%u: %.3f ms\n", i, times[i] / 1e6);
+  }
+  qsort(times, cfg_n, sizeof(*times), cmp_u64);
+
+  printf("stacks: %u\n", cfg_n);
+  printf("min:    %.3f ms\n", times[0] / 1e6);
+  printf("median: %.3f ms\n", times[cfg_n / 2] / 1e6);
+  printf("mean:   %.3f ms\n", sum / cfg_n / 1e6);
+  printf("max:    %.3f ms\n", times[cfg_n - 1] / 1e6);
+  free(times);
+  return 0;
+}
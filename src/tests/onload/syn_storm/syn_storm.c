@@ -0,0 +1,440 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* SYN storm against a listening socket.
+ *
+ * Run a listener under Onload on one host and the injector, as root and
+ * without Onload, on another:
+ *
+ *   onload ./syn_storm -l -P 8123
+ *   ./syn_storm -i <listener-ip> -P 8123 -n 1000000 -r 500000
+ *
+ * The injector builds SYNs with raw sockets, walking through [-s] source
+ * ports on each of [-a] source addresses starting from its own address
+ * (or -S <addr>; additional addresses must route back to the injector),
+ * and sends [-n] of them at [-r] per second (0 = as fast as possible).
+ * It counts the SYN-ACKs that come back and reports how many SYNs were
+ * answered.  The injector's kernel would reset every SYN-ACK, turning the
+ * test into a SYN/RST exchange, so drop those resets first, e.g.:
+ *
+ *   iptables -A OUTPUT -p tcp --tcp-flags RST RST --dport 8123 -j DROP
+ *
+ * Compare the listener's synrecv_table_probes, synack_batched,
+ * tx_dma_doorbells and synrecv_purge counters in "onload_stackdump lots",
+ * and try with EF_TCP_SYNCOOKIES=1.
+ *
+ * With -C <bits> the injector only uses the source addresses and ports
+ * whose filter table hash (onload_hash3()) agrees with the first one in
+ * the low <bits> bits.  A synrecv table indexed by that hash would put all
+ * of these SYNs in one probe sequence, so synrecv_table_probes per SYN
+ * should be about the same with and without -C.  Each source address
+ * gives only 1 in 2^<bits> of its ports, so use -a, e.g.:
+ *
+ *   ./syn_storm -i <listener-ip> -P 8123 -a 256 -C 12
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <ci/tools.h>
+#define CI_CFG_IPV6 1
+#include <onload/hash.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+/* How long to wait for stragglers after the last SYN. */
+#define DRAIN_MS  500
+#define SPORT_MIN 1024
+
+
+static int cfg_listen;
+static const char* cfg_dst;
+static const char* cfg_src;
+static int cfg_port = 8123;
+static unsigned cfg_n = 1000000;
+static unsigned cfg_rate;
+static unsigned cfg_n_saddr = 1;
+static unsigned cfg_n_sport = 60000;
+static int cfg_backlog = 65535;
+static unsigned cfg_collide_bits;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  syn_storm -l [options]\n");
+  fprintf(stderr, "  syn_storm -i <listener-ip> [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -P <port>     TCP port (default 8123)\n");
+  fprintf(stderr, "  -b <n>        listener: listen() backlog "
+          "(default 65535)\n");
+  fprintf(stderr, "  -n <n>        injector: SYNs to send (default 1000000)\n");
+  fprintf(stderr, "  -r <rate>     injector: SYNs per second (default 0, "
+          "unlimited)\n");
+  fprintf(stderr, "  -S <addr>     injector: first source address\n");
+  fprintf(stderr, "  -a <n>        injector: source addresses (default 1)\n");
+  fprintf(stderr, "  -s <n>        injector: source ports per address "
+          "(default 60000)\n");
+  fprintf(stderr, "  -C <bits>     injector: only use 4-tuples whose filter "
+          "hashes collide\n                in the low <bits> bits\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static uint16_t csum_fold(uint32_t sum)
+{
+  while( sum >> 16 )
+    sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
+
+
+static uint32_t csum_partial(const void* p, int len, uint32_t sum)
+{
+  const uint16_t* w = p;
+  for( ; len > 1; len -= 2 )
+    sum += *w++;
+  if( len )
+    sum += *(const uint8_t*) w;
+  return sum;
+}
+
+
+static void listener(void)
+{
+  struct sockaddr_in sa;
+  uint64_t n_accepted = 0;
+  int sock, one = 1, fd;
+
+  TRY(sock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_ANY);
+  sa.sin_port = htons(cfg_port);
+  TRY(bind(sock, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(sock, cfg_backlog));
+  printf("listening on port %d\n", cfg_port);
+  fflush(stdout);
+
+  /* Handshakes are never completed by the injector, so this normally just
+   * keeps the listening socket (and the stack) alive.  Connections that
+   * are completed by other clients are accepted and closed. */
+  while( 1 ) {
+    TRY(fd = accept(sock, NULL, NULL));
+    close(fd);
+    if( ++n_accepted % 1000 == 0 ) {
+      printf("accepted %llu\n", (unsigned long long) n_accepted);
+      fflush(stdout);
+    }
+  }
+}
+
+
+struct syn_pkt {
+  struct iphdr  ip;
+  struct tcphdr tcp;
+  /* MSS option */
+  uint8_t       opts[4];
+} __attribute__((packed));
+
+
+static void syn_build(struct syn_pkt* p, uint32_t saddr, uint32_t daddr,
+                      uint16_t sport, uint16_t dport, uint32_t seq)
+{
+  struct {
+    uint32_t saddr, daddr;
+    uint8_t  zero, proto;
+    uint16_t len;
+  } __attribute__((packed)) ph;
+  uint32_t sum;
+
+  memset(p, 0, sizeof(*p));
+  p->ip.version = 4;
+  p->ip.ihl = sizeof(p->ip) / 4;
+  p->ip.tot_len = htons(sizeof(*p));
+  p->ip.ttl = 64;
+  p->ip.protocol = IPPROTO_TCP;
+  p->ip.saddr = saddr;
+  p->ip.daddr = daddr;
+  p->ip.check = csum_fold(csum_partial(&p->ip, sizeof(p->ip), 0));
+
+  p->tcp.source = sport;
+  p->tcp.dest = dport;
+  p->tcp.seq = htonl(seq);
+  p->tcp.doff = (sizeof(p->tcp) + sizeof(p->opts)) / 4;
+  p->tcp.syn = 1;
+  p->tcp.window = htons(65535);
+  p->opts[0] = TCPOPT_MAXSEG;
+  p->opts[1] = TCPOLEN_MAXSEG;
+  p->opts[2] = 1460 >> 8;
+  p->opts[3] = 1460 & 0xff;
+
+  ph.saddr = saddr;
+  ph.daddr = daddr;
+  ph.zero = 0;
+  ph.proto = IPPROTO_TCP;
+  ph.len = htons(sizeof(p->tcp) + sizeof(p->opts));
+  sum = csum_partial(&ph, sizeof(ph), 0);
+  sum = csum_partial(&p->tcp, sizeof(p->tcp) + sizeof(p->opts), sum);
+  p->tcp.check = csum_fold(sum);
+}
+
+
+struct tuple {
+  uint32_t saddr;
+  uint16_t sport;
+};
+
+
+/* The stack's filter table hash of the SYN as the listener sees it. */
+static unsigned filter_hash(uint32_t saddr, uint16_t sport,
+                            uint32_t daddr, uint16_t dport)
+{
+  return onload_hash3(CI_ADDR_FROM_IP4(daddr), dport,
+                      CI_ADDR_FROM_IP4(saddr), sport, IPPROTO_TCP);
+}
+
+
+/* Returns the source address and port pairs that are used with -C, and
+ * their number in [n_out]. */
+static struct tuple* collide_tuples(uint32_t saddr0, uint32_t daddr,
+                                    uint16_t dport, unsigned* n_out)
+{
+  unsigned mask = (1u << cfg_collide_bits) - 1;
+  unsigned target = filter_hash(saddr0, htons(SPORT_MIN), daddr, dport) &
+                    mask;
+  struct tuple* t = NULL;
+  unsigned n = 0, max = 0, a, s;
+
+  for( a = 0; a < cfg_n_saddr; ++a )
+    for( s = 0; s < cfg_n_sport; ++s ) {
+      uint32_t saddr = htonl(ntohl(saddr0) + a);
+      uint16_t sport = htons(SPORT_MIN + s);
+      if( (filter_hash(saddr, sport, daddr, dport) & mask) != target )
+        continue;
+      if( n == max ) {
+        max = max ? max * 2 : 1024;
+        TEST((t = realloc(t, max * sizeof(*t))) != NULL);
+      }
+      t[n].saddr = saddr;
+      t[n].sport = sport;
+      ++n;
+    }
+  *n_out = n;
+  return t;
+}
+
+
+/* Count the SYN-ACKs for our port that have arrived on [rx]. */
+static unsigned synack_drain(int rx, uint32_t daddr, uint16_t dport)
+{
+  char buf[256];
+  struct iphdr* ip = (void*) buf;
+  struct tcphdr* tcp;
+  unsigned n = 0;
+  int rc;
+
+  while( (rc = recv(rx, buf, sizeof(buf), MSG_DONTWAIT)) > 0 ) {
+    if( rc < (int) sizeof(*ip) || rc < ip->ihl * 4 + (int) sizeof(*tcp) )
+      continue;
+    tcp = (void*) (buf + ip->ihl * 4);
+    if( ip->saddr == daddr && tcp->source == dport && tcp->syn && tcp->ack )
+      ++n;
+  }
+  return n;
+}
+
+
+static void injector(void)
+{
+  struct sockaddr_in sa;
+  struct syn_pkt pkt;
+  uint32_t saddr0, daddr;
+  uint16_t dport = htons(cfg_port);
+  uint64_t t0, t1, t_end, n_synack = 0;
+  uint64_t n_tuples = (uint64_t) cfg_n_saddr * cfg_n_sport;
+  struct tuple* tuples = NULL;
+  unsigned i, a, s, n_collide = 0;
+  int tx, rx, one = 1, rcvbuf = 64 << 20;
+
+  TEST(inet_pton(AF_INET, cfg_dst, &daddr) == 1);
+  TRY(tx = socket(AF_INET, SOCK_RAW, IPPROTO_RAW));
+  TRY(setsockopt(tx, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one)));
+  TRY(rx = socket(AF_INET, SOCK_RAW, IPPROTO_TCP));
+  /* Best effort: the SYN-ACKs arrive about as fast as we send. */
+  setsockopt(rx, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = daddr;
+
+  if( cfg_src != NULL ) {
+    TEST(inet_pton(AF_INET, cfg_src, &saddr0) == 1);
+  }
+  else {
+    /* Let the kernel choose the source address for the route. */
+    struct sockaddr_in la;
+    socklen_t la_len = sizeof(la);
+    int us;
+    TRY(us = socket(AF_INET, SOCK_DGRAM, 0));
+    sa.sin_port = dport;
+    TRY(connect(us, (struct sockaddr*) &sa, sizeof(sa)));
+    TRY(getsockname(us, (struct sockaddr*) &la, &la_len));
+    saddr0 = la.sin_addr.s_addr;
+    close(us);
+    sa.sin_port = 0;
+  }
+
+  if( cfg_collide_bits != 0 ) {
+    tuples = collide_tuples(saddr0, daddr, dport, &n_collide);
+    TEST(n_collide != 0);
+    n_tuples = n_collide;
+    printf("injector: %u 4-tuples collide in the low %u bits of the "
+           "filter hash\n", n_collide, cfg_collide_bits);
+  }
+
+  t0 = now_ns();
+  for( i = 0, a = 0, s = 0; i < cfg_n; ++i ) {
+    if( cfg_rate != 0 )
+      while( now_ns() - t0 < (uint64_t) i * 1000000000ull / cfg_rate )
+        ;
+    if( tuples != NULL )
+      syn_build(&pkt, tuples[a].saddr, daddr, tuples[a].sport, dport,
+                (uint32_t) rand());
+    else
+      syn_build(&pkt, htonl(ntohl(saddr0) + a), daddr,
+                htons(SPORT_MIN + s), dport, (uint32_t) rand());
+    if( sendto(tx, &pkt, sizeof(pkt), 0,
+               (struct sockaddr*) &sa, sizeof(sa)) < 0 ) {
+      TEST(errno == ENOBUFS || errno == EAGAIN);
+      --i;
+      continue;
+    }
+    if( tuples != NULL ) {
+      if( ++a == n_collide )
+        a = 0;
+    }
+    else if( ++a == cfg_n_saddr ) {
+      a = 0;
+      if( ++s == cfg_n_sport )
+        s = 0;
+    }
+    if( (i & 63) == 0 )
+      n_synack += synack_drain(rx, daddr, dport);
+  }
+  t1 = now_ns();
+
+  t_end = t1 + DRAIN_MS * 1000000ull;
+  while( now_ns() < t_end ) {
+    struct pollfd pfd = { .fd = rx, .events = POLLIN };
+    poll(&pfd, 1, 10);
+    n_synack += synack_drain(rx, daddr, dport);
+  }
+
+  printf("injector: %u SYNs in %.3fs (%.0f per second)\n",
+         cfg_n, (t1 - t0) / 1e9, cfg_n / ((t1 - t0) / 1e9));
+  printf("injector: %llu SYN-ACKs (%.2f%% of SYNs answered)\n",
+         (unsigned long long) n_synack, 100.0 * n_synack / cfg_n);
+  if( n_tuples < cfg_n )
+    printf("injector: NB. only %llu distinct 4-tuples were used; repeated "
+           "SYNs may be answered from existing syn-recv state\n",
+           (unsigned long long) n_tuples);
+  free(tuples);
+  close(tx);
+  close(rx);
+}
+
+
+int main(int argc, char* argv[])
+{
+  int c;
+
+  while( (c = getopt(argc, argv, "li:P:b:n:r:S:a:s:C:")) != -1 )
+    switch( c ) {
+    case 'l':
+      cfg_listen = 1;
+      break;
+    case 'i':
+      cfg_dst = optarg;
+      break;
+    case 'P':
+      cfg_port = atoi(optarg);
+      break;
+    case 'b':
+      cfg_backlog = atoi(optarg);
+      break;
+    case 'n':
+      cfg_n = strtoul(optarg, NULL, 0);
+      break;
+    case 'r':
+      cfg_rate = strtoul(optarg, NULL, 0);
+      break;
+    case 'S':
+      cfg_src = optarg;
+      break;
+    case 'a':
+      cfg_n_saddr = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      cfg_n_sport = strtoul(optarg, NULL, 0);
+      break;
+    case 'C':
+      cfg_collide_bits = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_listen == (cfg_dst != NULL) ||
+      cfg_port <= 0 || cfg_port > 65535 || cfg_n == 0 ||
+      cfg_n_saddr == 0 || cfg_n_sport == 0 ||
+      cfg_n_sport > 65536 - SPORT_MIN || cfg_collide_bits > 16 )
+    usage();
+
+  if( cfg_listen )
+    listener();
+  else
+    injector();
+  return 0;
+}
@@ -0,0 +1,379 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Ping-pong latency and streaming bandwidth over a TCP loopback connection
+ * between two processes.
+ *
+ * Intended for comparing Onload's accelerated loopback paths without any
+ * NIC traffic, for example:
+ *
+ *   EF_TCP_SERVER_LOOPBACK=2 EF_TCP_CLIENT_LOOPBACK=4 \
+ *     onload ./tcp_loopback_bench -m pingpong
+ *   EF_TCP_SERVER_LOOPBACK=2 EF_TCP_CLIENT_LOOPBACK=4 EF_TCP_LOOPBACK_RING=32 \
+ *     onload ./tcp_loopback_bench -m pingpong
+ *
+ * The server side is a forked child.  In bandwidth mode the payload carries
+ * a byte pattern that the receiver checks, and the sender finishes with
+ * shutdown(SHUT_WR) so the receiver also checks end-of-stream ordering.
+ * With -p, each side waits in poll() before every receive.  With -c, the
+ * ping-pong also reports the L1D and last-level cache misses of the client
+ * per round trip, as counted by perf_event_open(), which is useful for
+ * judging the layout of the socket state.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+static int cfg_pingpong = 1;
+static int cfg_msg_size = 64;
+static int cfg_iter = 100000;
+static int cfg_bytes_mb = 1024;
+static int cfg_poll;
+static int cfg_rcvbuf;
+static int cfg_port = 0;
+static int cfg_cache_misses;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  tcp_loopback_bench [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -m pingpong|bw   test mode (default pingpong)\n");
+  fprintf(stderr, "  -s <bytes>       message size (default 64, or 65536 for bw)\n");
+  fprintf(stderr, "  -n <iter>        ping-pong iterations (default 100000)\n");
+  fprintf(stderr, "  -b <MiB>         bandwidth test volume (default 1024)\n");
+  fprintf(stderr, "  -r <bytes>       SO_RCVBUF for both sockets\n");
+  fprintf(stderr, "  -p               wait in poll() before each receive\n");
+  fprintf(stderr, "  -P <port>        port to use (default ephemeral)\n");
+  fprintf(stderr, "  -c               count cache misses per ping-pong\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static int perf_open(__u32 type, __u64 config)
+{
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_hv = 1;
+  /* Onload's fast paths run in user space, but count the kernel too when
+   * we're allowed, as the non-accelerated paths do their work there. */
+  fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if( fd < 0 && (errno == EACCES || errno == EPERM) ) {
+    attr.exclude_kernel = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  if( fd < 0 )
+    fprintf(stderr, "WARNING: perf_event_open(%u, %llu) failed (%s)\n",
+            type, (unsigned long long) config, strerror(errno));
+  return fd;
+}
+
+
+static uint64_t perf_read(int fd)
+{
+  uint64_t v;
+  TEST(read(fd, &v, sizeof(v)) == sizeof(v));
+  return v;
+}
+
+
+static void wait_readable(int fd)
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int rc;
+  do
+    rc = poll(&pfd, 1, -1);
+  while( rc < 0 && errno == EINTR );
+  TEST(rc == 1);
+  TEST(pfd.revents & (POLLIN | POLLHUP));
+}
+
+
+/* Receive exactly [len] bytes.  Returns 0 on end-of-stream before any. */
+static int recv_all(int fd, char* buf, int len)
+{
+  int got = 0, rc;
+  while( got < len ) {
+    if( cfg_poll )
+      wait_readable(fd);
+    rc = recv(fd, buf + got, len - got, 0);
+    if( rc == 0 ) {
+      TEST(got == 0);
+      return 0;
+    }
+    TRY(rc);
+    got += rc;
+  }
+  return got;
+}
+
+
+static void send_all(int fd, const char* buf, int len)
+{
+  int sent = 0, rc;
+  while( sent < len ) {
+    rc = send(fd, buf + sent, len - sent, 0);
+    TRY(rc);
+    sent += rc;
+  }
+}
+
+
+static void sock_opts(int fd)
+{
+  int one = 1;
+  TRY(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+  if( cfg_rcvbuf )
+    TRY(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &cfg_rcvbuf,
+                   sizeof(cfg_rcvbuf)));
+}
+
+
+static void fill_pattern(char* buf, int len, uint64_t off)
+{
+  int i;
+  for( i = 0; i < len; ++i )
+    buf[i] = (char) ((off + i) * 7 + 3);
+}
+
+
+static void check_pattern(const char* buf, int len, uint64_t off)
+{
+  int i;
+  for( i = 0; i < len; ++i )
+    if( buf[i] != (char) ((off + i) * 7 + 3) ) {
+      fprintf(stderr, "ERROR: data mismatch at offset %llu\n",
+              (unsigned long long) (off + i));
+      exit(1);
+    }
+}
+
+
+static void server(int lsock)
+{
+  char* buf = malloc(cfg_msg_size);
+  uint64_t off = 0;
+  int sock, rc;
+
+  TEST(buf != NULL);
+  TRY(sock = accept(lsock, NULL, NULL));
+  close(lsock);
+  sock_opts(sock);
+
+  if( cfg_pingpong ) {
+    while( recv_all(sock, buf, cfg_msg_size) > 0 )
+      send_all(sock, buf, cfg_msg_size);
+  }
+  else {
+    while( 1 ) {
+      if( cfg_poll )
+        wait_readable(sock);
+      TRY(rc = recv(sock, buf, cfg_msg_size, 0));
+      if( rc == 0 )
+        break;
+      check_pattern(buf, rc, off);
+      off += rc;
+    }
+    TEST(off == (uint64_t) cfg_bytes_mb << 20);
+    /* Tell the client we have seen all of the data and the FIN. */
+    send_all(sock, "k", 1);
+  }
+  close(sock);
+  exit(0);
+}
+
+
+static void client(int sock)
+{
+  char* buf = malloc(cfg_msg_size);
+  uint64_t t0, t1;
+  int i, l1d_fd = -1, llc_fd = -1;
+
+  TEST(buf != NULL);
+  sock_opts(sock);
+  memset(buf, 0x5a, cfg_msg_size);
+
+  if( cfg_pingpong ) {
+    /* Warm up. */
+    for( i = 0; i < 1000; ++i ) {
+      send_all(sock, buf, cfg_msg_size);
+      TEST(recv_all(sock, buf, cfg_msg_size) == cfg_msg_size);
+    }
+    if( cfg_cache_misses ) {
+      l1d_fd = perf_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+      llc_fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      if( l1d_fd >= 0 )
+        TRY(ioctl(l1d_fd, PERF_EVENT_IOC_ENABLE, 0));
+      if( llc_fd >= 0 )
+        TRY(ioctl(llc_fd, PERF_EVENT_IOC_ENABLE, 0));
+    }
+    t0 = now_ns();
+    for( i = 0; i < cfg_iter; ++i ) {
+      send_all(sock, buf, cfg_msg_size);
+      TEST(recv_all(sock, buf, cfg_msg_size) == cfg_msg_size);
+    }
+    t1 = now_ns();
+    printf("pingpong: size=%d iter=%d  mean RTT %.3f usec\n",
+           cfg_msg_size, cfg_iter, (t1 - t0) / 1000.0 / cfg_iter);
+    if( l1d_fd >= 0 ) {
+      printf("pingpong: L1D read misses per RTT %.2f\n",
+             (double) perf_read(l1d_fd) / cfg_iter);
+      close(l1d_fd);
+    }
+    if( llc_fd >= 0 ) {
+      printf("pingpong: LLC misses per RTT %.2f\n",
+             (double) perf_read(llc_fd) / cfg_iter);
+      close(llc_fd);
+    }
+  }
+  else {
+    uint64_t total = (uint64_t) cfg_bytes_mb << 20;
+    uint64_t off = 0;
+    char ack;
+    t0 = now_ns();
+    while( off < total ) {
+      int n = cfg_msg_size;
+      if( total - off < (uint64_t) n )
+        n = total - off;
+      fill_pattern(buf, n, off);
+      send_all(sock, buf, n);
+      off += n;
+    }
+    TRY(shutdown(sock, SHUT_WR));
+    TEST(recv_all(sock, &ack, 1) == 1);
+    t1 = now_ns();
+    printf("bandwidth: size=%d bytes=%llu  %.1f MiB/s\n", cfg_msg_size,
+           (unsigned long long) total,
+           (double) total / (1 << 20) / ((t1 - t0) / 1e9));
+  }
+  close(sock);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  int lsock, sock, c, one = 1, status, size_set = 0;
+  pid_t pid;
+
+  while( (c = getopt(argc, argv, "m:s:n:b:r:pP:c")) != -1 )
+    switch( c ) {
+    case 'm':
+      if( ! strcmp(optarg, "pingpong") )
+        cfg_pingpong = 1;
+      else if( ! strcmp(optarg, "bw") )
+        cfg_pingpong = 0;
+      else
+        usage();
+      break;
+    case 's':
+      cfg_msg_size = atoi(optarg);
+      size_set = 1;
+      break;
+    case 'n':
+      cfg_iter = atoi(optarg);
+      break;
+    case 'b':
+      cfg_bytes_mb = atoi(optarg);
+      break;
+    case 'r':
+      cfg_rcvbuf = atoi(optarg);
+      break;
+    case 'p':
+      cfg_poll = 1;
+      break;
+    case 'P':
+      cfg_port = atoi(optarg);
+      break;
+    case 'c':
+      cfg_cache_misses = 1;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_msg_size <= 0 || cfg_iter <= 0 ||
+      cfg_bytes_mb <= 0 )
+    usage();
+  if( ! cfg_pingpong && ! size_set )
+    cfg_msg_size = 64 * 1024;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sa.sin_port = htons(cfg_port);
+
+  TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  TRY(bind(lsock, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(lsock, 1));
+  TRY(getsockname(lsock, (struct sockaddr*) &sa, &sa_len));
+
+  TRY(pid = fork());
+  if( pid == 0 )
+    server(lsock);
+  close(lsock);
+
+  TRY(sock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(connect(sock, (struct sockaddr*) &sa, sizeof(sa)));
+  client(sock);
+
+  TRY(waitpid(pid, &status, 0));
+  TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return 0;
+}
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Ping-pong latency over a TCP loopback connection between two threads of
+ * one process, each blocking in recv().
+ *
+ * Intended for measuring the cost of waking a thread that is asleep in
+ * Onload, for example with and without futex wakeups:
+ *
+ *   EF_TCP_SERVER_LOOPBACK=2 EF_TCP_CLIENT_LOOPBACK=4 EF_POLL_USEC=0 \
+ *     onload ./thread_pingpong
+ *   EF_TCP_SERVER_LOOPBACK=2 EF_TCP_CLIENT_LOOPBACK=4 EF_POLL_USEC=0 \
+ *     EF_FUTEX_SLEEP_USEC=1000 onload ./thread_pingpong
+ *
+ * Reports the mean round-trip time and some percentiles.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+static int cfg_msg_size = 64;
+static int cfg_iter = 100000;
+static int cfg_port = 0;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  thread_pingpong [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -s <bytes>       message size (default 64)\n");
+  fprintf(stderr, "  -n <iter>        ping-pong iterations (default 100000)\n");
+  fprintf(stderr, "  -P <port>        port to use (default ephemeral)\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/* Receive exactly [len] bytes.  Returns 0 on end-of-stream before any. */
+static int recv_all(int fd, char* buf, int len)
+{
+  int got = 0, rc;
+  while( got < len ) {
+    rc = recv(fd, buf + got, len - got, 0);
+    if( rc == 0 ) {
+      TEST(got == 0);
+      return 0;
+    }
+    TRY(rc);
+    got += rc;
+  }
+  return got;
+}
+
+
+static void send_all(int fd, const char* buf, int len)
+{
+  int sent = 0, rc;
+  while( sent < len ) {
+    rc = send(fd, buf + sent, len - sent, 0);
+    TRY(rc);
+    sent += rc;
+  }
+}
+
+
+static void sock_opts(int fd)
+{
+  int one = 1;
+  TRY(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+}
+
+
+static void* server(void* arg)
+{
+  int lsock = (int) (intptr_t) arg;
+  char* buf = malloc(cfg_msg_size);
+  int sock;
+
+  TEST(buf != NULL);
+  TRY(sock = accept(lsock, NULL, NULL));
+  sock_opts(sock);
+  while( recv_all(sock, buf, cfg_msg_size) > 0 )
+    send_all(sock, buf, cfg_msg_size);
+  close(sock);
+  free(buf);
+  return NULL;
+}
+
+
+static int cmp_u64(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+
+static void client(int sock)
+{
+  char* buf = malloc(cfg_msg_size);
+  uint64_t* rtt = malloc(cfg_iter * sizeof(rtt[0]));
+  uint64_t t0, t1, sum = 0;
+  int i;
+
+  TEST(buf != NULL && rtt != NULL);
+  sock_opts(sock);
+  memset(buf, 0x5a, cfg_msg_size);
+
+  /* Warm up. */
+  for( i = 0; i < 1000; ++i ) {
+    send_all(sock, buf, cfg_msg_size);
+    TEST(recv_all(sock, buf, cfg_msg_size) == cfg_msg_size);
+  }
+  for( i = 0; i < cfg_iter; ++i ) {
+    t0 = now_ns();
+    send_all(sock, buf, cfg_msg_size);
+    TEST(recv_all(sock, buf, cfg_msg_size) == cfg_msg_size);
+    t1 = now_ns();
+    rtt[i] = t1 - t0;
+    sum += rtt[i];
+  }
+
+  qsort(rtt, cfg_iter, sizeof(rtt[0]), cmp_u64);
+  printf("thread_pingpong: size=%d iter=%d  mean RTT %.3f usec\n",
+         cfg_msg_size, cfg_iter, sum / 1000.0 / cfg_iter);
+  printf("thread_pingpong: min %.3f  50%% %.3f  99%% %.3f  99.9%% %.3f  "
+         "max %.3f usec\n", rtt[0] / 1000.0,
+         rtt[cfg_iter / 2] / 1000.0, rtt[cfg_iter / 100 * 99] / 1000.0,
+         rtt[cfg_iter / 1000 * 999] / 1000.0, rtt[cfg_iter - 1] / 1000.0);
+  free(rtt);
+  free(buf);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  int lsock, sock, c, one = 1;
+  pthread_t tid;
+
+  while( (c = getopt(argc, argv, "s:n:P:")) != -1 )
+    switch( c ) {
+    case 's':
+      cfg_msg_size = atoi(optarg);
+      break;
+    case 'n':
+      cfg_iter = atoi(optarg);
+      break;
+    case 'P':
+      cfg_port = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_msg_size <= 0 || cfg_iter <= 0 )
+    usage();
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sa.sin_port = htons(cfg_port);
+
+  TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  TRY(bind(lsock, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(lsock, 1));
+  TRY(getsockname(lsock, (struct sockaddr*) &sa, &sa_len));
+
+  TEST(pthread_create(&tid, NULL, server, (void*) (intptr_t) lsock) == 0);
+
+  TRY(sock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(connect(sock, (struct sockaddr*) &sa, sizeof(sa)));
+  client(sock);
+  close(sock);
+
+  TEST(pthread_join(tid, NULL) == 0);
+  close(lsock);
+  return 0;
+}
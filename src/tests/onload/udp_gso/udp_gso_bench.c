@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/* Bulk UDP throughput with and without UDP_SEGMENT and UDP_GRO.
+ *
+ * Run a receiver on one host and a sender on another, for example:
+ *
+ *   onload ./udp_gso_bench -r -G 9000
+ *   onload ./udp_gso_bench -c <receiver-ip> -s 1400 -b 4096         (per-datagram)
+ *   onload ./udp_gso_bench -c <receiver-ip> -s 1400 -g -b 4096      (UDP_SEGMENT)
+ *   onload ./udp_gso_bench -c <receiver-ip> -s 1400 -g -m -b 4096   (cmsg)
+ *
+ * The sender sends [-b] MiB of datagrams carrying [-s] bytes of payload.
+ * Without -g it makes one send() per datagram; with -g it hands up to
+ * [-l] bytes to each send() and lets UDP_SEGMENT split them.  -G on the
+ * receiver enables UDP_GRO.  Each datagram starts with a sequence number
+ * which the receiver uses to count loss, and the sender finishes with a
+ * burst of empty datagrams.  Try also with EF_UDP_SEND_UNLOCKED=1, and
+ * compare the tx_dma_doorbells, udp_send_gso_segs and udp_recv_gro_segs
+ * counters in "onload_stackdump lots".
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#ifndef SOL_UDP
+# define SOL_UDP      17
+#endif
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT  103
+#endif
+#ifndef UDP_GRO
+# define UDP_GRO      104
+#endif
+
+
+#define TEST(x)                                                  \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "ERROR: '%s' failed\n", #x);              \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__); \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define MAX_SEND  65000
+#define N_END     10
+
+
+static int cfg_receiver;
+static const char* cfg_host;
+static int cfg_port = 8123;
+static int cfg_seg = 1400;
+static int cfg_gso;
+static int cfg_gso_cmsg;
+static int cfg_send_len = 60000;
+static int cfg_bytes_mb = 1024;
+static int cfg_gro_buf;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  udp_gso_bench -r [options]\n");
+  fprintf(stderr, "  udp_gso_bench -c <host> [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -P <port>     UDP port (default 8123)\n");
+  fprintf(stderr, "  -s <bytes>    payload per datagram (default 1400)\n");
+  fprintf(stderr, "  -g            sender: use UDP_SEGMENT\n");
+  fprintf(stderr, "  -m            sender: pass UDP_SEGMENT as a cmsg\n");
+  fprintf(stderr, "  -l <bytes>    sender: bytes per send() with -g "
+          "(default 60000)\n");
+  fprintf(stderr, "  -b <MiB>      sender: volume to send (default 1024)\n");
+  fprintf(stderr, "  -G <bytes>    receiver: enable UDP_GRO, and receive "
+          "into a buffer of this size\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void receiver(void)
+{
+  int buf_len = cfg_gro_buf ? cfg_gro_buf : MAX_SEND;
+  char* buf = malloc(buf_len);
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  struct sockaddr_in sa;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  uint64_t bytes = 0, dgrams = 0, recvs = 0, seq_max = 0, t0 = 0, t1;
+  int sock, one = 1, rc, seg, off, n_end = 0;
+  uint32_t seq;
+
+  TEST(buf != NULL);
+  TRY(sock = socket(AF_INET, SOCK_DGRAM, 0));
+  TRY(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  if( cfg_gro_buf )
+    TRY(setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_ANY);
+  sa.sin_port = htons(cfg_port);
+  TRY(bind(sock, (struct sockaddr*) &sa, sizeof(sa)));
+
+  while( 1 ) {
+    iov.iov_base = buf;
+    iov.iov_len = buf_len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    TRY(rc = recvmsg(sock, &msg, 0));
+    if( rc == 0 ) {
+      if( dgrams != 0 && ++n_end == N_END )
+        break;
+      continue;
+    }
+    if( t0 == 0 )
+      t0 = now_ns();
+
+    seg = rc;
+    for( cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) )
+      if( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO )
+        memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+    TEST(seg > 0);
+
+    for( off = 0; off < rc; off += seg ) {
+      if( rc - off >= (int) sizeof(seq) ) {
+        memcpy(&seq, buf + off, sizeof(seq));
+        if( seq + 1 > seq_max )
+          seq_max = seq + 1;
+      }
+      ++dgrams;
+    }
+    bytes += rc;
+    ++recvs;
+  }
+  t1 = now_ns();
+
+  printf("receiver: %llu datagrams in %llu recvs (%.1f per recv), "
+         "%llu lost\n", (unsigned long long) dgrams,
+         (unsigned long long) recvs, (double) dgrams / recvs,
+         (unsigned long long) (seq_max - dgrams));
+  printf("receiver: %.1f MiB/s  %.0f datagrams/s\n",
+         (double) bytes / (1 << 20) / ((t1 - t0) / 1e9),
+         dgrams / ((t1 - t0) / 1e9));
+  close(sock);
+}
+
+
+static void sender(void)
+{
+  char* buf = malloc(MAX_SEND);
+  char cbuf[CMSG_SPACE(sizeof(uint16_t))];
+  struct sockaddr_in sa;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  uint64_t total = (uint64_t) cfg_bytes_mb << 20;
+  uint64_t off = 0, sends = 0, t0, t1;
+  uint32_t seq = 0;
+  int sock, rc, n, i, len;
+
+  TEST(buf != NULL);
+  memset(buf, 0x5a, MAX_SEND);
+  TRY(sock = socket(AF_INET, SOCK_DGRAM, 0));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(cfg_port);
+  TEST(inet_aton(cfg_host, &sa.sin_addr));
+  TRY(connect(sock, (struct sockaddr*) &sa, sizeof(sa)));
+  if( cfg_gso && ! cfg_gso_cmsg )
+    TRY(setsockopt(sock, SOL_UDP, UDP_SEGMENT, &cfg_seg, sizeof(cfg_seg)));
+
+  len = cfg_gso ? cfg_send_len - cfg_send_len % cfg_seg : cfg_seg;
+  TEST(len > 0);
+
+  t0 = now_ns();
+  while( off < total ) {
+    n = len;
+    if( total - off < (uint64_t) n )
+      n = total - off;
+    /* Stamp each datagram with its sequence number. */
+    for( i = 0; i < n; i += cfg_seg, ++seq )
+      if( n - i >= (int) sizeof(seq) )
+        memcpy(buf + i, &seq, sizeof(seq));
+
+    iov.iov_base = buf;
+    iov.iov_len = n;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if( cfg_gso_cmsg ) {
+      uint16_t gso_size = cfg_seg;
+      msg.msg_control = cbuf;
+      msg.msg_controllen = sizeof(cbuf);
+      cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(gso_size));
+      memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+    }
+    TRY(rc = sendmsg(sock, &msg, 0));
+    TEST(rc == n);
+    off += n;
+    ++sends;
+  }
+  t1 = now_ns();
+
+  for( i = 0; i < N_END; ++i ) {
+    usleep(10000);
+    TRY(send(sock, buf, 0, 0));
+  }
+
+  printf("sender: %u datagrams in %llu sends, %.1f MiB/s  "
+         "%.0f datagrams/s\n", seq, (unsigned long long) sends,
+         (double) total / (1 << 20) / ((t1 - t0) / 1e9),
+         seq / ((t1 - t0) / 1e9));
+  close(sock);
+}
+
+
+int main(int argc, char* argv[])
+{
+  int c;
+
+  while( (c = getopt(argc, argv, "rc:P:s:gml:b:G:")) != -1 )
+    switch( c ) {
+    case 'r':
+      cfg_receiver = 1;
+      break;
+    case 'c':
+      cfg_host = optarg;
+      break;
+    case 'P':
+      cfg_port = atoi(optarg);
+      break;
+    case 's':
+      cfg_seg = atoi(optarg);
+      break;
+    case 'g':
+      cfg_gso = 1;
+      break;
+    case 'm':
+      cfg_gso = cfg_gso_cmsg = 1;
+      break;
+    case 'l':
+      cfg_send_len = atoi(optarg);
+      break;
+    case 'b':
+      cfg_bytes_mb = atoi(optarg);
+      break;
+    case 'G':
+      cfg_gro_buf = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_receiver == (cfg_host != NULL) ||
+      cfg_seg < (int) sizeof(uint32_t) || cfg_seg > MAX_SEND ||
+      cfg_send_len <= 0 || cfg_send_len > MAX_SEND || cfg_bytes_mb <= 0 ||
+      cfg_gro_buf < 0 )
+    usage();
+
+  if( cfg_receiver )
+    receiver();
+  else
+    sender();
+  return 0;
+}
@@ -0,0 +1,795 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+** \brief  Plan placement of stacks, interrupts and application threads.
+**   \date  2026/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/* onload_affinity_plan reads the CPU and NUMA topology of the host, the
+ * NUMA node of each network interface, and the event rate of each Onload
+ * stack, and assigns:
+ *
+ * - each stack to a NUMA node: the node of the interface it uses if
+ *   possible, otherwise the least loaded node;
+ * - each stack's application threads to CPUs on that node, preferring
+ *   CPUs (and then physical cores) that no other stack's threads use;
+ * - each stack's interrupt core (EF_IRQ_CORE) and periodic timer CPU
+ *   (EF_PERIODIC_TIMER_CPU) to a CPU on the same node that is not running
+ *   application threads, spreading interrupt load across those CPUs.
+ *
+ * Stacks are placed busiest first.  The host description the planner works
+ * from can be captured with --capture and fed back in with --topology, so
+ * that a plan can be made (and checked) away from the machine it is for.
+ * The format is line based:
+ *
+ *   cpu <cpu> node <node> package <package> core <core>
+ *   intf <name> node <node>
+ *   stack <id> <name|-> intf <name|-> threads <n> load <events/sec>
+ *
+ * By default the plan is only printed.  --apply binds the threads of the
+ * processes using each stack to the planned CPUs.  The interrupt core and
+ * periodic timer CPU are fixed when a stack is created, so for those the
+ * planner prints the environment to use when the application is next
+ * started (--env prints only that).
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <sched.h>
+#include <dirent.h>
+#include <net/if.h>
+#include <ci/internal/ip.h>
+#include <cplane/cplane.h>
+#include "libstack.h"
+#include <ci/app.h>
+#include <onload/extensions.h>
+
+
+#define AP_MAX_CPUS      1024
+#define AP_MAX_NODES     64
+#define AP_MAX_INTFS     64
+#define AP_MAX_STACKS    1024
+#define AP_MAX_APP_CPUS  64
+
+
+struct ap_cpu {
+  int    present;
+  int    node;
+  int    package;
+  int    core;
+  int    reserved;
+  /* Planning state. */
+  int    app_users;
+  int    irq_users;
+  double app_load;
+  double irq_load;
+};
+
+
+struct ap_intf {
+  char   name[IF_NAMESIZE];
+  int    node;
+};
+
+
+struct ap_stack {
+  int       id;
+  char      name[CI_CFG_STACK_NAME_LEN + 1];
+  char      intf[IF_NAMESIZE];
+  int       n_threads;
+  double    load;
+  ci_uint64 evs;        /* events at first sample (live only) */
+  /* The plan. */
+  int       node;
+  int       irq_core;
+  int       n_app_cpus;
+  int       app_cpus[AP_MAX_APP_CPUS];
+};
+
+
+static struct ap_cpu   cpus[AP_MAX_CPUS];
+static int             cpus_n;  /* highest present cpu + 1 */
+static struct ap_intf  intfs[AP_MAX_INTFS];
+static int             intfs_n;
+static struct ap_stack stacks[AP_MAX_STACKS];
+static int             stacks_n;
+static double          node_load[AP_MAX_NODES];
+
+
+static const char* cfg_topology = NULL;
+static const char* cfg_reserve = "0";
+static int         cfg_capture;
+static int         cfg_apply;
+static int         cfg_env;
+static unsigned    cfg_msec = 1000;
+
+static ci_cfg_desc cfg_opts[] = {
+  {   0, "topology", CI_CFG_STR,  &cfg_topology,
+                        "plan from a captured description (dry run)" },
+  {   0, "capture",  CI_CFG_FLAG, &cfg_capture,
+                        "print a description of this host and its stacks" },
+  {   0, "reserve",  CI_CFG_STR,  &cfg_reserve,
+                        "CPUs not to use (default 0)" },
+  {   0, "msec",     CI_CFG_UINT, &cfg_msec,
+                        "interval over which to measure stack load" },
+  {   0, "apply",    CI_CFG_FLAG, &cfg_apply,
+                        "bind application threads to the planned CPUs" },
+  {   0, "env",      CI_CFG_FLAG, &cfg_env,
+                        "print only the environment for each stack" },
+};
+#define N_CFG_OPTS (sizeof(cfg_opts) / sizeof(cfg_opts[0]))
+
+
+static void usage(const char* msg)
+{
+  if( msg ) {
+    ci_log(" ");
+    ci_log("%s", msg);
+  }
+
+  ci_log(" ");
+  ci_log("usage:");
+  ci_log("  %s [options]", ci_appname);
+
+  ci_log(" ");
+  ci_log("options:");
+  ci_app_opt_usage(cfg_opts, N_CFG_OPTS);
+  ci_log(" ");
+  exit(-1);
+}
+
+
+/**********************************************************************
+ * CPU lists.
+ */
+
+/* Parse a list such as "0-3,8,10-11", calling [fn] for each CPU. */
+static int parse_cpulist(const char* s, void (*fn)(int cpu, void* arg),
+                         void* arg)
+{
+  char* end;
+  long a, b;
+
+  while( *s && *s != '\n' ) {
+    a = strtol(s, &end, 10);
+    if( end == s || a < 0 )
+      return -EINVAL;
+    b = a;
+    s = end;
+    if( *s == '-' ) {
+      ++s;
+      b = strtol(s, &end, 10);
+      if( end == s || b < a )
+        return -EINVAL;
+      s = end;
+    }
+    for( ; a <= b; ++a )
+      if( a < AP_MAX_CPUS )
+        fn(a, arg);
+    if( *s == ',' )
+      ++s;
+    else if( *s && *s != '\n' )
+      return -EINVAL;
+  }
+  return 0;
+}
+
+
+static void format_cpulist(char* buf, int len, const int* list, int n)
+{
+  int i, j, off = 0;
+
+  buf[0] = '\0';
+  for( i = 0; i < n; i = j ) {
+    for( j = i + 1; j < n && list[j] == list[j - 1] + 1; ++j )
+      ;
+    if( j - i > 1 )
+      off += snprintf(buf + off, len - off, "%s%d-%d", off ? ",":"",
+                      list[i], list[j - 1]);
+    else
+      off += snprintf(buf + off, len - off, "%s%d", off ? ",":"", list[i]);
+    if( off >= len )
+      break;
+  }
+}
+
+
+static void cpu_set_present(int cpu, void* arg)
+{
+  cpus[cpu].present = 1;
+  if( cpu >= cpus_n )
+    cpus_n = cpu + 1;
+}
+
+
+static void cpu_set_node(int cpu, void* arg)
+{
+  cpus[cpu].node = *(int*) arg;
+}
+
+
+static void cpu_set_reserved(int cpu, void* arg)
+{
+  cpus[cpu].reserved = 1;
+}
+
+
+/**********************************************************************
+ * Reading the live host.
+ */
+
+static int read_sysfs(const char* path, char* buf, int len)
+{
+  FILE* f = fopen(path, "r");
+  int rc = -1;
+  if( f != NULL ) {
+    if( fgets(buf, len, f) != NULL )
+      rc = 0;
+    fclose(f);
+  }
+  return rc;
+}
+
+
+static int read_sysfs_int(const char* path, int dflt)
+{
+  char buf[32];
+  return read_sysfs(path, buf, sizeof(buf)) == 0 ? atoi(buf) : dflt;
+}
+
+
+static void read_live_topology(void)
+{
+  char path[300], buf[4096];
+  struct dirent* ent;
+  DIR* dir;
+  int cpu, node;
+
+  if( read_sysfs("/sys/devices/system/cpu/online", buf, sizeof(buf)) != 0 ||
+      parse_cpulist(buf, cpu_set_present, NULL) != 0 ) {
+    ci_log("%s: ERROR: could not read online CPUs", ci_appname);
+    exit(1);
+  }
+  for( cpu = 0; cpu < cpus_n; ++cpu ) {
+    if( ! cpus[cpu].present )
+      continue;
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+             cpu);
+    cpus[cpu].package = read_sysfs_int(path, 0);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+    cpus[cpu].core = read_sysfs_int(path, cpu);
+  }
+
+  /* Without NUMA, everything is on node 0. */
+  if( (dir = opendir("/sys/devices/system/node")) != NULL ) {
+    while( (ent = readdir(dir)) != NULL ) {
+      if( sscanf(ent->d_name, "node%d", &node) != 1 ||
+          node < 0 || node >= AP_MAX_NODES )
+        continue;
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/node/node%d/cpulist", node);
+      if( read_sysfs(path, buf, sizeof(buf)) == 0 )
+        parse_cpulist(buf, cpu_set_node, &node);
+    }
+    closedir(dir);
+  }
+
+  if( (dir = opendir("/sys/class/net")) != NULL ) {
+    while( (ent = readdir(dir)) != NULL && intfs_n < AP_MAX_INTFS ) {
+      if( ent->d_name[0] == '.' || strlen(ent->d_name) >= IF_NAMESIZE )
+        continue;
+      /* Only interfaces backed by a device have a node. */
+      snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node",
+               ent->d_name);
+      if( read_sysfs(path, buf, sizeof(buf)) != 0 )
+        continue;
+      strcpy(intfs[intfs_n].name, ent->d_name);
+      intfs[intfs_n].node = atoi(buf);
+      ++intfs_n;
+    }
+    closedir(dir);
+  }
+}
+
+
+static struct ap_stack* stack_find(int id)
+{
+  int i;
+  for( i = 0; i < stacks_n; ++i )
+    if( stacks[i].id == id )
+      return &stacks[i];
+  return NULL;
+}
+
+
+static ci_uint64 stack_evs(ci_netif* ni)
+{
+  return (ci_uint64) ni->state->stats.rx_evs + ni->state->stats.tx_evs;
+}
+
+
+static int pid_n_threads(pid_t pid)
+{
+  char path[64];
+  struct dirent* ent;
+  DIR* dir;
+  int n = 0;
+
+  snprintf(path, sizeof(path), "/proc/%d/task", (int) pid);
+  if( (dir = opendir(path)) == NULL )
+    return 0;
+  while( (ent = readdir(dir)) != NULL )
+    if( ent->d_name[0] != '.' )
+      ++n;
+  closedir(dir);
+  return n;
+}
+
+
+static void stack_sample_first(ci_netif* ni)
+{
+  struct ap_stack* s;
+  const pid_t* pids;
+  int i, n_pids, intf_i, ifindex;
+
+  if( stacks_n == AP_MAX_STACKS )
+    return;
+  s = &stacks[stacks_n++];
+  s->id = NI_ID(ni);
+  if( ni->state->name[0] )
+    strncpy(s->name, ni->state->name, sizeof(s->name) - 1);
+  else
+    strcpy(s->name, "-");
+  strcpy(s->intf, "-");
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    ifindex = oo_cp_hwport_vlan_to_ifindex(ni->cplane,
+                                           ni->state->intf_i_to_hwport[intf_i],
+                                           0, NULL);
+    if( ifindex > 0 && if_indextoname(ifindex, s->intf) != NULL )
+      break;
+    strcpy(s->intf, "-");
+  }
+  n_pids = libstack_stack_pids(s->id, &pids);
+  for( i = 0; i < n_pids; ++i )
+    s->n_threads += pid_n_threads(pids[i]);
+  s->evs = stack_evs(ni);
+}
+
+
+static void stack_sample_second(ci_netif* ni)
+{
+  struct ap_stack* s = stack_find(NI_ID(ni));
+  if( s != NULL )
+    s->load = (double) (stack_evs(ni) - s->evs) * 1000 / cfg_msec;
+}
+
+
+static void read_live_stacks(void)
+{
+  if( libstack_init(NULL) != 0 )
+    exit(1);
+  list_all_stacks2(NULL, NULL, NULL, NULL);
+  for_each_stack(stack_sample_first, 0);
+  if( cfg_msec == 0 )
+    cfg_msec = 1;
+  usleep(cfg_msec * 1000);
+  for_each_stack(stack_sample_second, 0);
+}
+
+
+/**********************************************************************
+ * Captured descriptions.
+ */
+
+static void read_description(const char* path)
+{
+  char line[256], name[CI_CFG_STACK_NAME_LEN + 1], intf[IF_NAMESIZE];
+  int cpu, node, package, core, id, n_threads, line_no = 0;
+  struct ap_stack* s;
+  double load;
+  char dummy;
+  FILE* f;
+
+  if( (f = fopen(path, "r")) == NULL ) {
+    ci_log("%s: ERROR: could not open %s (%s)", ci_appname, path,
+           strerror(errno));
+    exit(1);
+  }
+  while( fgets(line, sizeof(line), f) != NULL ) {
+    ++line_no;
+    if( line[0] == '#' || line[strspn(line, " \t\n")] == '\0' )
+      continue;
+    if( sscanf(line, "cpu %d node %d package %d core %d %c",
+               &cpu, &node, &package, &core, &dummy) == 4 &&
+        cpu >= 0 && cpu < AP_MAX_CPUS && node >= 0 && node < AP_MAX_NODES ) {
+      cpu_set_present(cpu, NULL);
+      cpus[cpu].node = node;
+      cpus[cpu].package = package;
+      cpus[cpu].core = core;
+    }
+    else if( sscanf(line, "intf %15s node %d %c", intf, &node, &dummy) == 2 &&
+             intfs_n < AP_MAX_INTFS ) {
+      strcpy(intfs[intfs_n].name, intf);
+      intfs[intfs_n].node = node;
+      ++intfs_n;
+    }
+    else if( sscanf(line, "stack %d %" OO_STRINGIFY(CI_CFG_STACK_NAME_LEN)
+                    "s intf %15s threads %d load %lf %c", &id, name, intf,
+                    &n_threads, &load, &dummy) == 5 &&
+             stacks_n < AP_MAX_STACKS ) {
+      s = &stacks[stacks_n++];
+      s->id = id;
+      strcpy(s->name, name);
+      strcpy(s->intf, intf);
+      s->n_threads = n_threads;
+      s->load = load;
+    }
+    else {
+      ci_log("%s: ERROR: %s:%d: bad line: %s", ci_appname, path, line_no,
+             line);
+      exit(1);
+    }
+  }
+  fclose(f);
+}
+
+
+static void write_description(void)
+{
+  int i;
+
+  printf("# %s host description\n", ci_appname);
+  for( i = 0; i < cpus_n; ++i )
+    if( cpus[i].present )
+      printf("cpu %d node %d package %d core %d\n",
+             i, cpus[i].node, cpus[i].package, cpus[i].core);
+  for( i = 0; i < intfs_n; ++i )
+    printf("intf %s node %d\n", intfs[i].name, intfs[i].node);
+  for( i = 0; i < stacks_n; ++i )
+    printf("stack %d %s intf %s threads %d load %.0f\n", stacks[i].id,
+           stacks[i].name, stacks[i].intf, stacks[i].n_threads,
+           stacks[i].load);
+}
+
+
+/**********************************************************************
+ * Planning.
+ */
+
+static int cpu_usable(int cpu)
+{
+  return cpus[cpu].present && ! cpus[cpu].reserved;
+}
+
+
+static int intf_node(const char* name)
+{
+  int i;
+  for( i = 0; i < intfs_n; ++i )
+    if( ! strcmp(intfs[i].name, name) )
+      return intfs[i].node;
+  return -1;
+}
+
+
+static int node_n_usable(int node)
+{
+  int cpu, n = 0;
+  for( cpu = 0; cpu < cpus_n; ++cpu )
+    if( cpu_usable(cpu) && cpus[cpu].node == node )
+      ++n;
+  return n;
+}
+
+
+/* Number of application threads placed on the physical core of [cpu]. */
+static int core_app_users(int cpu)
+{
+  int i, n = 0;
+  for( i = 0; i < cpus_n; ++i )
+    if( cpus[i].present && cpus[i].package == cpus[cpu].package &&
+        cpus[i].core == cpus[cpu].core )
+      n += cpus[i].app_users;
+  return n;
+}
+
+
+static int in_list(int cpu, const int* list, int n)
+{
+  int i;
+  for( i = 0; i < n; ++i )
+    if( list[i] == cpu )
+      return 1;
+  return 0;
+}
+
+
+/* Is [a] a better CPU than [b] for an application thread? */
+static int app_cpu_better(int a, int b)
+{
+  if( cpus[a].app_users != cpus[b].app_users )
+    return cpus[a].app_users < cpus[b].app_users;
+  if( core_app_users(a) != core_app_users(b) )
+    return core_app_users(a) < core_app_users(b);
+  if( cpus[a].irq_users != cpus[b].irq_users )
+    return cpus[a].irq_users < cpus[b].irq_users;
+  return cpus[a].app_load < cpus[b].app_load;
+}
+
+
+/* Is [a] a better interrupt core than [b] for [s]? */
+static int irq_cpu_better(const struct ap_stack* s, int a, int b)
+{
+  int a_own = in_list(a, s->app_cpus, s->n_app_cpus);
+  int b_own = in_list(b, s->app_cpus, s->n_app_cpus);
+  if( a_own != b_own )
+    return b_own;
+  if( (cpus[a].app_users == 0) != (cpus[b].app_users == 0) )
+    return cpus[a].app_users == 0;
+  if( (core_app_users(a) == 0) != (core_app_users(b) == 0) )
+    return core_app_users(a) == 0;
+  if( cpus[a].irq_load != cpus[b].irq_load )
+    return cpus[a].irq_load < cpus[b].irq_load;
+  return cpus[a].app_load < cpus[b].app_load;
+}
+
+
+static int plan_node(const struct ap_stack* s)
+{
+  int node, best = -1;
+  double best_load = 0, load;
+
+  node = intf_node(s->intf);
+  if( node >= 0 && node < AP_MAX_NODES && node_n_usable(node) > 0 )
+    return node;
+  for( node = 0; node < AP_MAX_NODES; ++node ) {
+    int n = node_n_usable(node);
+    if( n == 0 )
+      continue;
+    load = node_load[node] / n;
+    if( best < 0 || load < best_load ) {
+      best = node;
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+
+static void plan_stack(struct ap_stack* s)
+{
+  int cpu, best, n_usable, n_app, i;
+
+  s->node = plan_node(s);
+  s->irq_core = -1;
+  s->n_app_cpus = 0;
+  if( s->node < 0 )
+    return;
+
+  /* Leave a CPU on the node for interrupts where there is one to spare. */
+  n_usable = node_n_usable(s->node);
+  n_app = CI_MAX(s->n_threads, 1);
+  n_app = CI_MIN(n_app, AP_MAX_APP_CPUS);
+  n_app = CI_MIN(n_app, n_usable > 1 ? n_usable - 1 : 1);
+
+  for( i = 0; i < n_app; ++i ) {
+    best = -1;
+    for( cpu = 0; cpu < cpus_n; ++cpu )
+      if( cpu_usable(cpu) && cpus[cpu].node == s->node &&
+          ! in_list(cpu, s->app_cpus, s->n_app_cpus) &&
+          (best < 0 || app_cpu_better(cpu, best)) )
+        best = cpu;
+    if( best < 0 )
+      break;
+    s->app_cpus[s->n_app_cpus++] = best;
+  }
+  for( i = 0; i < s->n_app_cpus; ++i ) {
+    cpus[s->app_cpus[i]].app_users += 1;
+    cpus[s->app_cpus[i]].app_load += s->load / s->n_app_cpus;
+  }
+
+  best = -1;
+  for( cpu = 0; cpu < cpus_n; ++cpu )
+    if( cpu_usable(cpu) && cpus[cpu].node == s->node &&
+        (best < 0 || irq_cpu_better(s, cpu, best)) )
+      best = cpu;
+  s->irq_core = best;
+  cpus[best].irq_users += 1;
+  cpus[best].irq_load += s->load;
+  node_load[s->node] += s->load;
+}
+
+
+static int stack_cmp_load(const void* pa, const void* pb)
+{
+  const struct ap_stack* a = pa;
+  const struct ap_stack* b = pb;
+  if( a->load != b->load )
+    return a->load < b->load ? 1 : -1;
+  return a->id - b->id;
+}
+
+
+static int stack_cmp_id(const void* pa, const void* pb)
+{
+  const struct ap_stack* a = pa;
+  const struct ap_stack* b = pb;
+  return a->id - b->id;
+}
+
+
+static int int_cmp(const void* pa, const void* pb)
+{
+  return *(const int*) pa - *(const int*) pb;
+}
+
+
+static void plan(void)
+{
+  int i;
+
+  if( parse_cpulist(cfg_reserve, cpu_set_reserved, NULL) != 0 )
+    usage("Bad --reserve CPU list");
+  qsort(stacks, stacks_n, sizeof(stacks[0]), stack_cmp_load);
+  for( i = 0; i < stacks_n; ++i ) {
+    plan_stack(&stacks[i]);
+    qsort(stacks[i].app_cpus, stacks[i].n_app_cpus, sizeof(int), int_cmp);
+  }
+  qsort(stacks, stacks_n, sizeof(stacks[0]), stack_cmp_id);
+}
+
+
+/**********************************************************************
+ * Output and applying.
+ */
+
+static void print_env(const struct ap_stack* s)
+{
+  char cpulist[256];
+
+  format_cpulist(cpulist, sizeof(cpulist), s->app_cpus, s->n_app_cpus);
+  printf("# stack %d %s\n", s->id, s->name);
+  if( strcmp(s->name, "-") )
+    printf("EF_NAME=%s ", s->name);
+  printf("EF_IRQ_CORE=%d EF_PERIODIC_TIMER_CPU=%d taskset -c %s\n",
+         s->irq_core, s->irq_core, cpulist);
+}
+
+
+static void print_plan(void)
+{
+  char cpulist[256];
+  const struct ap_stack* s;
+  int i;
+
+  printf("#stack name             intf             node irq_core "
+         "timer_cpu load       app_cpus\n");
+  for( i = 0; i < stacks_n; ++i ) {
+    s = &stacks[i];
+    if( s->node < 0 ) {
+      printf("%-6d %-16s %-16s no usable CPUs\n", s->id, s->name, s->intf);
+      continue;
+    }
+    format_cpulist(cpulist, sizeof(cpulist), s->app_cpus, s->n_app_cpus);
+    printf("%-6d %-16s %-16s %-4d %-8d %-9d %-10.0f %s\n", s->id, s->name,
+           s->intf, s->node, s->irq_core, s->irq_core, s->load, cpulist);
+  }
+}
+
+
+static int bind_pid(pid_t pid, const cpu_set_t* mask)
+{
+  char path[64];
+  struct dirent* ent;
+  DIR* dir;
+  int rc = 0;
+
+  snprintf(path, sizeof(path), "/proc/%d/task", (int) pid);
+  if( (dir = opendir(path)) == NULL )
+    return -errno;
+  while( (ent = readdir(dir)) != NULL ) {
+    if( ent->d_name[0] == '.' )
+      continue;
+    if( sched_setaffinity(atoi(ent->d_name), sizeof(*mask), mask) < 0 )
+      rc = -errno;
+  }
+  closedir(dir);
+  return rc;
+}
+
+
+static void apply_plan(void)
+{
+  const pid_t* pids;
+  const pid_t* other_pids;
+  cpu_set_t mask;
+  int i, j, k, m, n_pids, n_other, rc;
+
+  for( i = 0; i < stacks_n; ++i ) {
+    n_pids = libstack_stack_pids(stacks[i].id, &pids);
+    for( k = 0; k < n_pids; ++k ) {
+      /* A process using several stacks gets the union of their CPUs.  Only
+       * bind it when we reach the first of them.
+       */
+      int seen = 0;
+      CPU_ZERO(&mask);
+      for( j = 0; j < stacks_n; ++j ) {
+        n_other = libstack_stack_pids(stacks[j].id, &other_pids);
+        for( m = 0; m < n_other; ++m )
+          if( other_pids[m] == pids[k] )
+            break;
+        if( m == n_other )
+          continue;
+        if( j < i )
+          seen = 1;
+        for( m = 0; m < stacks[j].n_app_cpus; ++m )
+          CPU_SET(stacks[j].app_cpus[m], &mask);
+      }
+      if( seen || CPU_COUNT(&mask) == 0 )
+        continue;
+      rc = bind_pid(pids[k], &mask);
+      if( rc < 0 )
+        ci_log("%s: ERROR: could not bind pid %d (%s)", ci_appname,
+               (int) pids[k], strerror(-rc));
+      else
+        ci_log("%s: bound pid %d", ci_appname, (int) pids[k]);
+    }
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  int i;
+
+  ci_app_usage = usage;
+  ci_app_getopt("", &argc, argv, cfg_opts, N_CFG_OPTS);
+  --argc; ++argv;
+  if( argc != 0 )
+    usage(NULL);
+  if( cfg_topology != NULL && (cfg_apply || cfg_capture) )
+    usage("--topology cannot be combined with --apply or --capture");
+
+  if( cfg_topology != NULL ) {
+    read_description(cfg_topology);
+  }
+  else {
+    if( onload_is_present() ) {
+      ci_log("%s should not itself be run under onload acceleration.",
+             ci_appname);
+      return -1;
+    }
+    read_live_topology();
+    read_live_stacks();
+  }
+
+  if( cfg_capture ) {
+    write_description();
+    return 0;
+  }
+
+  plan();
+  if( cfg_env ) {
+    for( i = 0; i < stacks_n; ++i )
+      if( stacks[i].node >= 0 )
+        print_env(&stacks[i]);
+    return 0;
+  }
+  print_plan();
+  if( cfg_apply ) {
+    apply_plan();
+    printf("\nEF_IRQ_CORE and EF_PERIODIC_TIMER_CPU take effect when a stack"
+           " is created.\nStart each application with:\n");
+    for( i = 0; i < stacks_n; ++i )
+      if( stacks[i].node >= 0 )
+        print_env(&stacks[i]);
+  }
+  return 0;
+}
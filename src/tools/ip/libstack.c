@@ -371,6 +371,23 @@ static int libstack_mappings_init(void)
 }
 
 
+/* Returns the number of processes using the stack, and points [*pids_out]
+ * at their pids.  Returns 0 if the pids are not known (e.g. --nopids).
+ */
+int libstack_stack_pids(int stack_id, const pid_t** pids_out)
+{
+  struct stack_mapping* sm;
+
+  for( sm = stack_mappings; sm != NULL; sm = sm->next )
+    if( sm->stack_id == stack_id ) {
+      *pids_out = sm->pids;
+      return sm->n_pids;
+    }
+  *pids_out = NULL;
+  return 0;
+}
+
+
 void libstack_stack_mapping_print_pids(int stack_id)
 {
   const int buf_len = 61;
@@ -1103,6 +1120,13 @@ static int dump_via_buffers(oo_dump_request_fn_t dump_req_fn, void* arg,
 static void dump_sock_qs(ci_netif* ni, ci_tcp_state* ts)
 { ci_tcp_state_dump_qs(ni, S_SP(ts), cfg_dump); }
 
+static void dump_udp_sock_qs(ci_netif* ni, ci_udp_state* us)
+{
+  ci_log("%s: "NS_FMT"UDP", __FUNCTION__, NS_PRI_ARGS(ni, &us->s));
+  ci_sock_rx_pkts_dump(ni, &us->s, "", ci_log_dump_fn, NULL);
+  ci_udp_recvq_dump(ni, &us->recv_q, "", "recv_q:", ci_log_dump_fn, NULL);
+}
+
 
 static void for_each_tcp_socket(ci_netif* ni,
 				void (*fn)(ci_netif*, ci_tcp_state*))
@@ -1119,6 +1143,20 @@ static void for_each_tcp_socket(ci_netif* ni,
 }
 
 
+static void for_each_udp_socket(ci_netif* ni,
+				void (*fn)(ci_netif*, ci_udp_state*))
+{
+  int id;
+  for( id = 0; id < (int)ni->state->n_ep_bufs; ++id ) {
+    citp_waitable_obj* wo = SP_TO_WAITABLE_OBJ(ni, id);
+    if( wo->waitable.state != CI_TCP_STATE_UDP )
+      continue;
+    if( sockbuf_filter_matches(&sft, wo) )
+      fn(ni, &wo->udp);
+  }
+}
+
+
 /**********************************************************************
 ***********************************************************************
 **********************************************************************/
@@ -1492,6 +1530,216 @@ static void stack_time(ci_netif* ni)
   ci_stack_time_dump(ni, NULL, NULL);
 }
 
+static int stack_blog_enabled(ci_netif* ni)
+{
+  if( ni->state->blog_entries_n == 0 ) {
+    ci_log("%s: stack %d: binary log not enabled (EF_BINARY_LOG)",
+           __FUNCTION__, NI_ID(ni));
+    return 0;
+  }
+  return 1;
+}
+
+static void stack_blog(ci_netif* ni)
+{
+  ci_uint32 pos = 0, lost;
+
+  if( ! stack_blog_enabled(ni) )
+    return;
+  lost = ci_netif_blog_dump(ni, &pos, ci_log_dump_fn, NULL);
+  ci_log("%d: binary log: head=%u entries=%u lost=%u", NI_ID(ni), pos,
+         ni->state->blog_entries_n, lost);
+}
+
+static void stack_blog_follow(ci_netif* ni)
+{
+  ci_uint32 pos, lost;
+
+  if( ! stack_blog_enabled(ni) )
+    return;
+  /* Start with the records that are already in the log. */
+  pos = ni->state->blog_head - CI_MIN(ni->state->blog_head,
+                                      ni->state->blog_entries_n);
+  while( 1 ) {
+    lost = ci_netif_blog_dump(ni, &pos, ci_log_dump_fn, NULL);
+    if( lost )
+      ci_log("%d: binary log: lost %u records", NI_ID(ni), lost);
+    ci_sleep(cfg_watch_msec);
+  }
+}
+
+static int stack_ssnap_get(ci_netif* ni, ci_netif_ssnap* snap,
+                           unsigned* retries)
+{
+  int rc, i;
+
+  for( i = 0; i < 1000000; ++i ) {
+    if( (rc = ci_netif_ssnap_read(ni, snap)) != -EAGAIN )
+      break;
+    ++*retries;
+    ci_spinloop_pause();
+  }
+  if( rc == -ENOENT )
+    ci_log("%s: stack %d: stats snapshot not enabled (EF_STATS_SNAPSHOT)",
+           __FUNCTION__, NI_ID(ni));
+  else if( rc < 0 )
+    ci_log("%s: stack %d: snapshot stuck at generation %u", __FUNCTION__,
+           NI_ID(ni), ni->ssnap->generation);
+  return rc;
+}
+
+static void stack_ssnap(ci_netif* ni)
+{
+  ci_netif_ssnap snap;
+  unsigned retries = 0;
+  ci_uint64 now;
+
+  if( stack_ssnap_get(ni, &snap, &retries) < 0 )
+    return;
+  ci_frc64(&now);
+  ci_log("%d: stats snapshot: generation=%u age=%"CI_PRIu64"us retries=%u",
+         NI_ID(ni), snap.generation,
+         (now - snap.frc) * 1000 / CI_MAX(IPTIMER_STATE(ni)->khz, 1u),
+         retries);
+  ci_log("  sock_log: head=%u entries=%u", snap.sock_head, snap.sock_log_n);
+  ci_log("  n_ep_bufs=%u n_rx_pkts=%d n_async_pkts=%d n_free_pkts=%d "
+         "pkt_sets_n=%u", snap.n_ep_bufs, snap.n_rx_pkts, snap.n_async_pkts,
+         snap.n_free_pkts, snap.pkt_sets_n);
+#if CI_CFG_STATS_NETIF
+  ci_dump_stats(netif_stats_fields, N_NETIF_STATS_FIELDS, &snap.stats, 0,
+                NULL, NULL);
+#endif
+}
+
+/* Polls the snapshot as a monitor would, and reports the sockets that come
+ * and go, and the cost of each read. */
+static void stack_ssnap_follow(ci_netif* ni)
+{
+  ci_netif_ssnap snap;
+  ci_netif_ssnap_sock rec;
+  ci_uint32 pos, n_alloc, n_free, n_lost;
+  unsigned retries, khz = CI_MAX(IPTIMER_STATE(ni)->khz, 1u);
+  ci_uint64 t0, t1;
+
+  if( stack_ssnap_get(ni, &snap, &retries) < 0 )
+    return;
+  pos = snap.sock_head;
+  while( 1 ) {
+    ci_sleep(cfg_watch_msec);
+    retries = 0;
+    ci_frc64(&t0);
+    if( stack_ssnap_get(ni, &snap, &retries) < 0 )
+      return;
+    ci_frc64(&t1);
+
+    n_alloc = n_free = n_lost = 0;
+    if( snap.sock_head - pos > snap.sock_log_n ) {
+      ci_log("%d: socket log overflowed: sockets must be rescanned",
+             NI_ID(ni));
+      n_lost = snap.sock_head - pos;
+      pos = snap.sock_head;
+    }
+    for( ; pos != snap.sock_head; ++pos ) {
+      if( ! ci_netif_ssnap_sock_read(ni, pos, &rec) ) {
+        ++n_lost;
+        continue;
+      }
+      if( rec.op == OO_SSNAP_SOCK_ALLOC ) {
+        ++n_alloc;
+        if( ci_cfg_verbose )
+          ci_log("%d:%d alloc", NI_ID(ni), rec.sock_id);
+      }
+      else {
+        ++n_free;
+        if( ci_cfg_verbose )
+          ci_log("%d:%d free %s", NI_ID(ni), rec.sock_id,
+                 ci_tcp_state_str(rec.state));
+      }
+    }
+    ci_log("%d: generation=%u alloc=%u free=%u lost=%u read=%"CI_PRIu64"ns "
+           "retries=%u", NI_ID(ni), snap.generation, n_alloc, n_free, n_lost,
+           (t1 - t0) * 1000000 / khz, retries);
+  }
+}
+
+static ci_uint64 timespec_ns(const struct timespec* ts)
+{
+  return (ci_uint64) ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void stack_timesync(ci_netif* ni)
+{
+  const struct oo_timesync* ts = ni->timesync;
+  struct timespec t0, t1;
+  ci_uint64 frc, ns = 0, min_gap = ~0ull, gap, mid;
+  volatile ci_uint64 sink = 0;
+  ci_uint64 err_sum = 0, err_max = 0, err;
+  ci_int64 bias_sum = 0;
+  unsigned i, n = CI_MAX(cfg_samples, 10u), n_used = 0;
+
+  if( ts == NULL || oo_timesync_frc_to_ns(ts, 0, NULL, NULL) != 0 ) {
+    ci_log("%d: frc to ns mapping not available", NI_ID(ni));
+    return;
+  }
+  ci_log("%d: timesync: generation=%u clock_made=%"CI_PRIu64
+         " wall_ns=%"CI_PRIu64" mono_ns=%"CI_PRIu64, NI_ID(ni),
+         ts->generation_count, ts->clock_made, ts->wall_ns, ts->mono_ns);
+  ci_log("%d: timesync: frc_to_ns_mult=%"CI_PRIx64" (%.6f MHz) "
+         "stack khz=%u", NI_ID(ni), ts->frc_to_ns_mult,
+         (double) (1ull << 32) * 1000 / ts->frc_to_ns_mult,
+         IPTIMER_STATE(ni)->khz);
+
+  /* Cost of each way of reading the time. */
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for( i = 0; i < n; ++i ) {
+    clock_gettime(CLOCK_REALTIME, &t1);
+    sink += t1.tv_nsec;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ci_log("%d: clock_gettime(REALTIME): %.1f ns/call", NI_ID(ni),
+         (double) (timespec_ns(&t1) - timespec_ns(&t0)) / n);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for( i = 0; i < n; ++i ) {
+    ci_frc64(&frc);
+    oo_timesync_frc_to_ns(ts, frc, &ns, NULL);
+    sink += ns;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ci_log("%d: frc + timesync mapping: %.1f ns/call", NI_ID(ni),
+         (double) (timespec_ns(&t1) - timespec_ns(&t0)) / n);
+
+  /* Accuracy against the system clock.  Only use samples where reading
+   * the system clock was quick, so that we know when the frc was read.
+   */
+  for( i = 0; i < n; ++i ) {
+    clock_gettime(CLOCK_REALTIME, &t0);
+    ci_frc64(&frc);
+    clock_gettime(CLOCK_REALTIME, &t1);
+    gap = timespec_ns(&t1) - timespec_ns(&t0);
+    min_gap = CI_MIN(min_gap, gap);
+  }
+  for( i = 0; i < n; ++i ) {
+    clock_gettime(CLOCK_REALTIME, &t0);
+    ci_frc64(&frc);
+    clock_gettime(CLOCK_REALTIME, &t1);
+    gap = timespec_ns(&t1) - timespec_ns(&t0);
+    if( gap > min_gap * 2 )
+      continue;
+    mid = timespec_ns(&t0) + gap / 2;
+    oo_timesync_frc_to_ns(ts, frc, &ns, NULL);
+    err = ns > mid ? ns - mid : mid - ns;
+    err_sum += err;
+    err_max = CI_MAX(err_max, err);
+    bias_sum += (ci_int64) (ns - mid);
+    ++n_used;
+  }
+  if( n_used )
+    ci_log("%d: error vs REALTIME: mean=%"CI_PRIu64"ns max=%"CI_PRIu64"ns "
+           "bias=%"CI_PRId64"ns (samples=%u window=%"CI_PRIu64"ns)",
+           NI_ID(ni), err_sum / n_used, err_max,
+           bias_sum / (ci_int64) n_used, n_used, min_gap * 2);
+}
+
 static void stack_time_init(ci_netif* ni)
 {
   ci_ip_timer_state* ipts = IPTIMER_STATE(ni);
@@ -1525,8 +1773,10 @@ static void stack_clusters(ci_netif* ni)
 static void stack_qs(ci_netif* ni)
 {
   int unlock;
-  if( try_grab_stack_lock(ni, &unlock) )
+  if( try_grab_stack_lock(ni, &unlock) ) {
     for_each_tcp_socket(ni, dump_sock_qs);
+    for_each_udp_socket(ni, dump_udp_sock_qs);
+  }
   if( unlock )
     libstack_netif_unlock(ni);
 }
@@ -1709,6 +1959,44 @@ static void stack_sizeof(ci_netif* ni)
   log_sizeof(ci_ip_sock_stats);
   log_sizeof(ci_ip_sock_stats_count);
   log_sizeof(ci_ip_sock_stats_range);
+
+  /* Layout of the socket states.  Lines are counted from the start of the
+   * endpoint buffer, which is cache-line aligned. */
+# define log_field(t, f)                                                \
+  ci_log("%30s: offset %4d size %3d line %2d", #t"."#f,                 \
+         (int) CI_MEMBER_OFFSET(t, f), (int) CI_MEMBER_SIZE(t, f),      \
+         (int) OO_SOCK_FIELD_LINE(t, f))
+# define log_span(t, first, last)                                       \
+  ci_log("%30s: %d bytes lines %d-%d", #t" "#first".."#last,            \
+         (int) OO_SOCK_FIELDS_SPAN(t, first, last),                     \
+         (int) OO_SOCK_FIELD_LINE(t, first),                            \
+         (int) OO_SOCK_FIELD_END_LINE(t, last))
+  log_span(ci_sock_cmn, s_flags, space_for_hdrs);
+  log_field(ci_sock_cmn, s_flags);
+  log_field(ci_sock_cmn, rx_errno);
+  log_field(ci_sock_cmn, pkt);
+  log_field(ci_sock_cmn, laddr);
+  log_span(ci_tcp_state, tcpflags, tx_mag);
+  log_span(ci_tcp_state, tcpflags, t_last_sent);
+  log_field(ci_tcp_state, tcpflags);
+  log_field(ci_tcp_state, snd_nxt);
+  log_field(ci_tcp_state, rcv_added);
+  log_field(ci_tcp_state, tsrecent);
+  log_field(ci_tcp_state, cwnd);
+  log_field(ci_tcp_state, send);
+  log_field(ci_tcp_state, recv1);
+  log_field(ci_tcp_state, rob);
+  log_field(ci_tcp_state, loop_ring);
+  log_field(ci_tcp_state, tx_mag);
+  log_field(ci_tcp_state, recv2);
+  log_field(ci_tcp_state, rto_tid);
+  log_field(ci_tcp_state, stats);
+  log_span(ci_udp_state, udpflags, tx_count);
+  log_field(ci_udp_state, udpflags);
+  log_field(ci_udp_state, recv_q);
+  log_field(ci_udp_state, tx_async_q);
+  log_field(ci_udp_state, ephemeral_pkt);
+  log_field(ci_udp_state, stats);
 }
 
 static void stack_leak_pkts(ci_netif* ni)
@@ -2304,6 +2592,11 @@ static const stack_op_t stack_ops[] = {
   STACK_OP(analyse,            "analyse state over time"),
   STACK_OP(packets,            "show packets queued on netif"),
   STACK_OP(time,               "show stack timers"),
+  STACK_OP(blog,               "decode the stack's binary log"),
+  STACK_OP(blog_follow,        "decode the stack's binary log continuously"),
+  STACK_OP(ssnap,              "show the stack's stats snapshot"),
+  STACK_OP(ssnap_follow,       "poll the stats snapshot and its socket log"),
+  STACK_OP(timesync,           "show frc to ns mapping, its cost and error"),
   STACK_OP(time_init,          "(re-)initialize stack timers"),
   STACK_OP(timers,             "dump state of stack timers"),
   STACK_OP(filter_table,       "show stack software filter table"),
@@ -2324,7 +2617,7 @@ static const stack_op_t stack_ops[] = {
   STACK_OP(wake,               "force wakeup of sleepers"),
   STACK_OP(wakeall,            "force wakeup of everyone"),
   STACK_OP(rxpost,             "refill RX ring"),
-  STACK_OP(sizeof,             "sizes of datastructures"),
+  STACK_OP(sizeof,             "sizes of datastructures and socket layout"),
   STACK_OP(ev,                 "post a h/w event to stack"),
   STACK_OP(watch_stats,        "show running statistics"),
   STACK_OP(watch_more_stats,   "show more statistics"),
@@ -150,6 +150,7 @@ extern void sockets_watch(void);
 extern int /*rc*/ libstack_init(sa_sigaction_t* signal_handlers);
 extern void libstack_stack_mapping_print(void);
 extern void libstack_pid_mapping_print(void);
+extern int libstack_stack_pids(int stack_id, const pid_t** pids_out);
 extern int libstack_env_print(void);
 extern int libstack_threads_print(void);
 extern void libstack_end(void);
@@ -2,7 +2,8 @@
 # X-SPDX-Copyright-Text: (c) Solarflare Communications Inc
 APPS	:= onload_stackdump \
            onload_tcpdump.bin \
-           onload_fuser
+           onload_fuser \
+           onload_affinity_plan
 
 ifdef OFE_TREE
 APPS	+= onload_fe
@@ -22,6 +23,7 @@ TARGETS	:= $(APPS:%=$(AppPattern))
 onload_stackdump:= $(patsubst %,$(AppPattern),onload_stackdump)
 onload_tcpdump.bin := $(patsubst %,$(AppPattern),onload_tcpdump.bin)
 onload_fuser	:= $(patsubst %,$(AppPattern),onload_fuser)
+onload_affinity_plan := $(patsubst %,$(AppPattern),onload_affinity_plan)
 pio_buddy_test	:= $(patsubst %,$(AppPattern),pio_buddy_test)
 ifdef OFE_TREE
 onload_fe	:= $(patsubst %,$(AppPattern),onload_fe)
@@ -52,6 +54,9 @@ $(onload_tcpdump.bin): tcpdump_bin.o libstack.o $(MMAKE_LIB_DEPS)
 $(onload_fuser): fuser.o $(MMAKE_LIB_DEPS)
 	(libs="$(MMAKE_LIBS)"; $(MMakeLinkCApp))
 
+$(onload_affinity_plan): affinity_plan.o libstack.o $(MMAKE_LIB_DEPS) $(MMAKE_STACKDUMP_DEPS)
+	(libs="$(MMAKE_LIBS) $(MMAKE_STACKDUMP_LIBS)"; $(MMakeLinkCApp))
+
 $(pio_buddy_test): pio_buddy_test.o libstack.o $(MMAKE_LIB_DEPS)
 	(libs="$(MMAKE_LIBS)"; $(MMakeLinkCApp))
 
@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/****************************************************************************
+ * Java linkage for onload extention library.
+ *
+ * Copyright 2007-2012: Solarflare Communications Inc,
+ *                      9501 Jeronimo Road, Suite 250,
+ *                      Irvine, CA 92618, USA
+ *
+ * Maintained by Solarflare Communications <linux-net-drivers@solarflare.com>
+ *
+ ****************************************************************************
+ */
+
+/** Benchmarks comparing the per-buffer OnloadZeroCopy calls with the
+ * batched OnloadZeroCopyRing calls.
+ *
+ * Each benchmark is run the way JMH runs a throughput benchmark: a number of
+ * warmup iterations whose results are discarded, followed by measurement
+ * iterations of fixed duration.  The score is operations (buffers or
+ * messages) per second, with its mean and the error at 99.9% confidence
+ * over the measurement iterations.
+ *
+ * Usage:
+ *   onload java OnloadZeroCopyBench [-b burst] [-w warmups] [-i iterations]
+ *                                   [-t iteration_ms] [-p port] [benchmark...]
+ *
+ * The recv benchmarks receive UDP datagrams on the given port from a
+ * sender thread in this process (over the kernel, so they are received with
+ * ONLOAD_MSG_RECV_OS_INLINE).  The send benchmarks send over a TCP
+ * connection to this process, which is drained by a second thread.
+ */
+public class OnloadZeroCopyBench {
+
+  /** A benchmark: each call performs some operations and returns how many. */
+  abstract static class Bench {
+    final String name;
+    Bench( String name ) { this.name = name; }
+    void setup() throws Exception {}
+    abstract int run() throws Exception;
+    void teardown() throws Exception {}
+  }
+
+  static int burst = 32;
+  static int warmups = 5;
+  static int iterations = 10;
+  static int iteration_ms = 1000;
+  static int port = 5320;
+
+  /* Student's t for 99.9% two-sided confidence, by degrees of freedom. */
+  static final double[] T_999 = { 0, 636.6, 31.60, 12.92, 8.610, 6.869, 5.959,
+    5.408, 5.041, 4.781, 4.587, 4.437, 4.318, 4.221, 4.140, 4.073, 4.015,
+    3.965, 3.922, 3.883, 3.850 };
+
+  static double Iteration( Bench b ) throws Exception {
+    long ops = 0;
+    long start = System.nanoTime();
+    long end = start + iteration_ms * 1000000L;
+    long now;
+    do {
+      int n = b.run();
+      if ( n < 0 )
+        throw new RuntimeException( b.name + ": error " + n );
+      ops += n;
+      now = System.nanoTime();
+    } while ( now < end );
+    return ops * 1e9 / (now - start);
+  }
+
+  static void Run( Bench b ) throws Exception {
+    double[] score = new double[iterations];
+    double mean = 0, var = 0, err;
+    int i;
+
+    b.setup();
+    try {
+      for ( i = 0; i < warmups; ++i )
+        System.out.printf( "# %s warmup %d: %.0f ops/s%n", b.name, i + 1,
+                           Iteration( b ) );
+      for ( i = 0; i < iterations; ++i ) {
+        score[i] = Iteration( b );
+        mean += score[i];
+        System.out.printf( "# %s iteration %d: %.0f ops/s%n", b.name, i + 1,
+                           score[i] );
+      }
+    }
+    finally {
+      b.teardown();
+    }
+    mean /= iterations;
+    for ( i = 0; i < iterations; ++i )
+      var += (score[i] - mean) * (score[i] - mean);
+    if ( iterations > 1 ) {
+      var /= iterations - 1;
+      err = T_999[Math.min( iterations - 1, T_999.length - 1 )] *
+            Math.sqrt( var / iterations );
+    }
+    else {
+      err = Double.NaN;
+    }
+    System.out.printf( "%-24s %6d %14.0f %14.0f  ops/s%n", b.name, burst,
+                       mean, err );
+  }
+
+  /* ******************************* */
+  /* Buffer allocation and releasing */
+  /* ******************************* */
+
+  static java.net.DatagramSocket alloc_sock;
+  static int alloc_fd;
+
+  static void AllocSetup() throws Exception {
+    if ( alloc_sock == null ) {
+      alloc_sock = new java.net.DatagramSocket();
+      alloc_fd = OnloadZeroCopyRing.GetFd( alloc_sock );
+    }
+  }
+
+  static class ReleaseEach extends Bench {
+    OnloadZeroCopy[] bufs = new OnloadZeroCopy[burst];
+    ReleaseEach() { super( "release_each" ); }
+    void setup() throws Exception { AllocSetup(); }
+    int run() {
+      int rc = OnloadZeroCopy.Alloc( OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_UDP,
+                                     bufs, alloc_fd );
+      if ( rc < 0 )
+        return rc;
+      for ( OnloadZeroCopy b : bufs )
+        if ( (rc = OnloadZeroCopy.Release( b )) < 0 )
+          return rc;
+      return burst;
+    }
+  }
+
+  static class ReleaseArray extends Bench {
+    OnloadZeroCopy[] bufs = new OnloadZeroCopy[burst];
+    ReleaseArray() { super( "release_array" ); }
+    void setup() throws Exception { AllocSetup(); }
+    int run() {
+      int rc = OnloadZeroCopy.Alloc( OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_UDP,
+                                     bufs, alloc_fd );
+      if ( rc < 0 )
+        return rc;
+      return OnloadZeroCopy.Release( bufs );
+    }
+  }
+
+  static class ReleaseRing extends Bench {
+    OnloadZeroCopyRing ring = new OnloadZeroCopyRing( burst );
+    ReleaseRing() { super( "release_ring" ); }
+    void setup() throws Exception { AllocSetup(); }
+    int run() {
+      int rc = OnloadZeroCopyRing.Alloc( ring, burst,
+                        OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_UDP, alloc_fd );
+      if ( rc < 0 )
+        return rc;
+      return OnloadZeroCopyRing.Release( ring, burst );
+    }
+  }
+
+  /* ******* */
+  /* Receive */
+  /* ******* */
+
+  static class RecvBench extends Bench {
+    java.net.DatagramSocket rx;
+    Thread sender;
+    volatile boolean stop;
+    int fd;
+    RecvBench( String name ) { super( name ); }
+    void setup() throws Exception {
+      rx = new java.net.DatagramSocket( port );
+      fd = OnloadZeroCopyRing.GetFd( rx );
+      stop = false;
+      sender = new Thread() {
+        public void run() {
+          try {
+            java.net.DatagramSocket tx = new java.net.DatagramSocket();
+            byte[] payload = new byte[64];
+            java.net.DatagramPacket p = new java.net.DatagramPacket(
+              payload, payload.length,
+              java.net.InetAddress.getLoopbackAddress(), port );
+            while ( !stop )
+              tx.send( p );
+            tx.close();
+          }
+          catch ( java.io.IOException e ) {
+            System.err.println( "sender: " + e );
+          }
+        }
+      };
+      sender.setDaemon( true );
+      sender.start();
+    }
+    int run() { return 0; }
+    void teardown() throws Exception {
+      stop = true;
+      sender.join();
+      rx.close();
+    }
+  }
+
+  static class CallbackRecv extends RecvBench
+                            implements OnloadZeroCopy.Callback {
+    int n;
+    CallbackRecv() { super( "recv_callback" ); }
+    public int RecvCallback( OnloadZeroCopy[] data, int flags ) {
+      /* Touch the data as a real consumer would. */
+      data[0].buffer.get( 0 );
+      return ++n < burst ? OnloadZeroCopy.ONLOAD_ZC_CONTINUE :
+                           OnloadZeroCopy.ONLOAD_ZC_TERMINATE;
+    }
+    int run() {
+      n = 0;
+      int rc = OnloadZeroCopy.Recv( this,
+                                    OnloadZeroCopy.ONLOAD_MSG_DONTWAIT |
+                                    OnloadZeroCopy.ONLOAD_MSG_RECV_OS_INLINE,
+                                    fd );
+      return rc == -11 ? n : rc < 0 ? rc : n;
+    }
+  }
+
+  static class RecvRing extends RecvBench {
+    OnloadZeroCopyRing ring = new OnloadZeroCopyRing( burst );
+    RecvRing() { super( "recv_ring" ); }
+    int run() {
+      int n = OnloadZeroCopyRing.Recv( ring,
+                                       OnloadZeroCopy.ONLOAD_MSG_DONTWAIT |
+                                       OnloadZeroCopy.ONLOAD_MSG_RECV_OS_INLINE,
+                                       fd );
+      if ( n == -11 )
+        return 0;
+      if ( n <= 0 )
+        return n;
+      for ( int i = 0; i < n; ++i )
+        ring.views[i].get( 0 );
+      int rc = OnloadZeroCopyRing.Release( ring, n );
+      return rc < 0 ? rc : n;
+    }
+  }
+
+  /* **** */
+  /* Send */
+  /* **** */
+
+  static class SendBench extends Bench {
+    java.net.ServerSocket listener;
+    java.net.Socket tx, rx;
+    Thread drain;
+    int fd;
+    SendBench( String name ) { super( name ); }
+    void setup() throws Exception {
+      listener = new java.net.ServerSocket( port );
+      tx = new java.net.Socket( "localhost", port );
+      rx = listener.accept();
+      fd = OnloadZeroCopyRing.GetFd( tx );
+      final java.io.InputStream in = rx.getInputStream();
+      drain = new Thread() {
+        public void run() {
+          byte[] buf = new byte[65536];
+          try {
+            while ( in.read( buf ) >= 0 )
+              ;
+          }
+          catch ( java.io.IOException e ) {
+          }
+        }
+      };
+      drain.setDaemon( true );
+      drain.start();
+    }
+    int run() { return 0; }
+    void teardown() throws Exception {
+      tx.close();
+      drain.join();
+      rx.close();
+      listener.close();
+    }
+  }
+
+  static class SendArray extends SendBench {
+    OnloadZeroCopy[] bufs = new OnloadZeroCopy[burst];
+    OnloadZeroCopy[] one = new OnloadZeroCopy[1];
+    SendArray() { super( "send_array" ); }
+    int run() {
+      int rc = OnloadZeroCopy.Alloc( OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_TCP,
+                                     bufs, fd );
+      if ( rc < 0 )
+        return rc;
+      /* Send() sends its array as one message, so send each buffer as a
+       * message of its own to match the ring. */
+      for ( OnloadZeroCopy b : bufs ) {
+        b.buffer.limit( 64 );
+        one[0] = b;
+        if ( (rc = OnloadZeroCopy.Send( one, 0, fd )) < 0 )
+          return rc;
+      }
+      return burst;
+    }
+  }
+
+  static class SendRing extends SendBench {
+    OnloadZeroCopyRing ring = new OnloadZeroCopyRing( burst );
+    SendRing() { super( "send_ring" ); }
+    int run() {
+      int rc = OnloadZeroCopyRing.Alloc( ring, burst,
+                        OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_TCP, fd );
+      if ( rc < 0 )
+        return rc;
+      for ( int i = 0; i < burst; ++i ) {
+        ring.SetLen( i, 64 );
+        ring.SetFlags( i, 0 );
+      }
+      rc = OnloadZeroCopyRing.Send( ring, burst, 0 );
+      return rc < 0 ? rc : burst;
+    }
+  }
+
+  public static void main( String[] args ) throws Exception {
+    java.util.List<String> names = new java.util.ArrayList<String>();
+    for ( int i = 0; i < args.length; ++i ) {
+      if ( args[i].equals( "-b" ) )      burst = Integer.parseInt( args[++i] );
+      else if ( args[i].equals( "-w" ) ) warmups = Integer.parseInt( args[++i] );
+      else if ( args[i].equals( "-i" ) ) iterations = Integer.parseInt( args[++i] );
+      else if ( args[i].equals( "-t" ) ) iteration_ms = Integer.parseInt( args[++i] );
+      else if ( args[i].equals( "-p" ) ) port = Integer.parseInt( args[++i] );
+      else names.add( args[i] );
+    }
+    if ( !OnloadZeroCopy.IsZeroCopyEnabled() ) {
+      System.out.println( "Zerocopy not enabled." );
+      return;
+    }
+
+    Bench[] all = { new ReleaseEach(), new ReleaseArray(), new ReleaseRing(),
+                    new CallbackRecv(), new RecvRing(),
+                    new SendArray(), new SendRing() };
+    System.out.printf( "%-24s %6s %14s %14s  %s%n", "Benchmark", "Burst",
+                       "Score", "Error", "Units" );
+    for ( Bench b : all )
+      if ( names.isEmpty() || names.contains( b.name ) )
+        Run( b );
+    if ( alloc_sock != null )
+      alloc_sock.close();
+  }
+}
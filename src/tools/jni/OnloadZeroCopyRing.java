@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Solarflare Communications Inc */
+/****************************************************************************
+ * Java linkage for onload extention library.
+ *
+ * Copyright 2007-2012: Solarflare Communications Inc,
+ *                      9501 Jeronimo Road, Suite 250,
+ *                      Irvine, CA 92618, USA
+ *
+ * Maintained by Solarflare Communications <linux-net-drivers@solarflare.com>
+ *
+ ****************************************************************************
+ */
+
+/** Batched JNI wrapper for the Onload Zerocopy interface.
+ *
+ * OnloadZeroCopy creates a Java object per buffer and calls back into Java
+ * once per received message, so with small messages most of the time goes
+ * on crossing JNI.  A ring instead holds a descriptor array in a direct
+ * ByteBuffer that both Java and native code access in place, plus one
+ * ByteBuffer view per descriptor.  Recv(), Alloc(), Send() and Release()
+ * each process a whole burst of buffers in a single JNI call.  Recv() and
+ * Alloc() still create a direct ByteBuffer for each buffer they return, but
+ * no per-buffer objects or callbacks beyond that.
+ *
+ * Descriptor [i] occupies DESC_BYTES bytes at offset i * DESC_BYTES of
+ * desc, in native byte order:
+ *   DESC_HANDLE  long  zerocopy buffer handle, or 0 for the second and
+ *                      subsequent buffers of a received message
+ *   DESC_LEN     int   length of the data in the buffer
+ *   DESC_FD      int   socket the buffer belongs to
+ *   DESC_FLAGS   int   ONLOAD_ZC_MSG_SHARED and DESC_FLAG_* flags
+ *   DESC_RC      int   result of sending the message that starts here
+ * and views[i] covers the buffer's data.  A view is only valid until its
+ * buffer is passed back to Onload; Recv() and Alloc() replace it.
+ *
+ * A message spans one descriptor, plus any that follow it with
+ * DESC_FLAG_CONT set.  Only the first descriptor of a received message
+ * holds a handle, as the remaining buffers are released with it.
+ *
+ * NOTE: as with OnloadZeroCopy, don't touch a buffer after its ownership
+ * has passed to Onload, i.e. after Send() or Release().
+ */
+public class OnloadZeroCopyRing {
+  /** Size of a descriptor in bytes. */
+  public static final int DESC_BYTES  = 32;
+  /** Offset of the buffer handle (long) in a descriptor. */
+  public static final int DESC_HANDLE = 0;
+  /** Offset of the data length (int) in a descriptor. */
+  public static final int DESC_LEN    = 8;
+  /** Offset of the file descriptor (int) in a descriptor. */
+  public static final int DESC_FD     = 12;
+  /** Offset of the flags (int) in a descriptor. */
+  public static final int DESC_FLAGS  = 16;
+  /** Offset of the send result (int) in a descriptor. */
+  public static final int DESC_RC     = 20;
+
+  /** Descriptor flag: this buffer continues the message in the previous
+   * descriptor. */
+  public static final int DESC_FLAG_CONT  = 0x100;
+  /** Descriptor flag: the ring filled up, or a view couldn't be created,
+   * part way through this received message, and its remaining buffers were
+   * dropped. */
+  public static final int DESC_FLAG_TRUNC = 0x200;
+
+  /** The descriptor array. */
+  public final java.nio.ByteBuffer desc;
+  /** views[i] covers the data of the buffer in descriptor i. */
+  public final java.nio.ByteBuffer[] views;
+  /** Number of descriptors. */
+  public final int capacity;
+
+  /** Create a ring of [capacity] descriptors. */
+  public OnloadZeroCopyRing( int capacity ) {
+    this.capacity = capacity;
+    desc = java.nio.ByteBuffer.allocateDirect( capacity * DESC_BYTES );
+    desc.order( java.nio.ByteOrder.nativeOrder() );
+    /* Native code fills these in as it receives or allocates buffers. */
+    views = new java.nio.ByteBuffer[capacity];
+  }
+
+  public long GetHandle( int i ) { return desc.getLong( i*DESC_BYTES + DESC_HANDLE ); }
+  public int  GetLen( int i )    { return desc.getInt( i*DESC_BYTES + DESC_LEN ); }
+  public int  GetFd( int i )     { return desc.getInt( i*DESC_BYTES + DESC_FD ); }
+  public int  GetFlags( int i )  { return desc.getInt( i*DESC_BYTES + DESC_FLAGS ); }
+  public int  GetRc( int i )     { return desc.getInt( i*DESC_BYTES + DESC_RC ); }
+  /** Set the length of the data to send from descriptor i. */
+  public void SetLen( int i, int len ) { desc.putInt( i*DESC_BYTES + DESC_LEN, len ); }
+  /** Set the flags of descriptor i before sending; 0 or DESC_FLAG_CONT. */
+  public void SetFlags( int i, int flags ) { desc.putInt( i*DESC_BYTES + DESC_FLAGS, flags ); }
+
+  /** Find the native file descriptor of a socket, for use with the other
+   * methods.  Accepts the same socket types as OnloadZeroCopy.
+   * @return the file descriptor, or a negative error code.
+   */
+  public native static int GetFd( Object socket );
+
+  /** Receive a burst of messages into the ring.
+   * Fills descriptors from 0 onwards with the messages that are ready, and
+   * keeps ownership of their buffers: call Release() when done with them.
+   * NOTE: only datagram sockets are supported, as messages that don't fit
+   * in the ring are cut short; others fail with -EOPNOTSUPP.
+   * @param ring  the ring to fill.
+   * @param flags as for OnloadZeroCopy.Recv().
+   * @param fd    the socket to receive on.
+   * @return the number of descriptors filled, or a negative error code.
+   */
+  public native static int Recv( OnloadZeroCopyRing ring, int flags, int fd );
+
+  /** Allocate buffers for sending into descriptors 0 to n-1.
+   * Each descriptor's length is set to the capacity of the buffer; set it to
+   * the length of the data with SetLen() before sending.
+   * @param ring  the ring to fill.
+   * @param n     number of buffers to allocate.
+   * @param flags expects one of OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_*
+   * @param fd    the socket that will own these buffers.
+   * @return n, or a negative error code.
+   */
+  public native static int Alloc( OnloadZeroCopyRing ring, int n, int flags,
+                                  int fd );
+
+  /** Send the messages in descriptors 0 to n-1.
+   * Each message is sent on the socket of its first descriptor, and the
+   * result is stored in that descriptor's DESC_RC.  Ownership of the buffers
+   * of each message sent passes to Onload.
+   * @param ring  the ring holding the messages.
+   * @param n     number of descriptors.
+   * @param flags as for OnloadZeroCopy.Send().
+   * @return the number of messages processed, or a negative error code.
+   */
+  public native static int Send( OnloadZeroCopyRing ring, int n, int flags );
+
+  /** Release the buffers in descriptors 0 to n-1.
+   * @param ring the ring holding the buffers.
+   * @param n    number of descriptors.
+   * @return the number of buffers released, or a negative error code.
+   */
+  public native static int Release( OnloadZeroCopyRing ring, int n );
+
+  /** Simple unit test and example */
+  public static void main(String[] args) throws java.net.SocketException,
+                                                java.io.IOException
+  {
+    if ( OnloadZeroCopy.IsZeroCopyEnabled() ) {
+      boolean ok = true;
+      System.out.println( "Zerocopy enabled." );
+      System.out.println( "Testing.\n\n" );
+
+      java.net.DatagramSocket s = new java.net.DatagramSocket( 5314 );
+      java.net.ServerSocket s2 = new java.net.ServerSocket( 5315 );
+      java.net.Socket s3 = new java.net.Socket( "localhost", 5315 );
+      java.net.Socket connectedSocket = s2.accept();
+      java.io.InputStream r = connectedSocket.getInputStream();
+      OnloadZeroCopyRing ring = new OnloadZeroCopyRing( 32 );
+      int fd = OnloadZeroCopyRing.GetFd( s3 );
+
+      int got = OnloadZeroCopyRing.Alloc( ring,  4,
+                                 OnloadZeroCopy.ONLOAD_ZC_BUFFER_HDR_TCP, fd );
+      System.out.println( "\n        alloc got " + got );
+      System.out.println( "Expect: alloc got 4" );
+      ok &= got == 4;
+
+      if ( got == 4 ) {
+        for ( int i = 0; i < 4; ++i ) {
+          ring.views[i].clear();
+          ring.views[i].put( "TestData".getBytes() );
+          ring.SetLen( i, 8 );
+          ring.SetFlags( i, 0 );
+        }
+        int sent = OnloadZeroCopyRing.Send( ring, 2, 0 );
+        System.out.println( "\n        send returned " + sent );
+        System.out.println( "Expect: send returned 2" );
+        ok &= sent == 2 && ring.GetRc( 0 ) == 8 && ring.GetRc( 1 ) == 8;
+
+        System.out.println( "\n        " + r.available() + " bytes arrived at other end." );
+        System.out.println( "Expect: n bytes arrived at other end." );
+        ok &= r.available() > 0;
+
+        /* Move the two unsent buffers to the start of the ring. */
+        for ( int i = 0; i < 2; ++i )
+          ring.desc.putLong( i*DESC_BYTES + DESC_HANDLE, ring.GetHandle( i + 2 ) );
+        int released = OnloadZeroCopyRing.Release( ring, 2 );
+        System.out.println( "\n        release returns " + released );
+        System.out.println( "Expect: release returns 2" );
+        ok &= released == 2;
+      }
+
+      int rd = OnloadZeroCopyRing.Recv( ring, OnloadZeroCopy.ONLOAD_MSG_DONTWAIT,
+                                        OnloadZeroCopyRing.GetFd( s ) );
+      System.out.println( "\n        recv returns " + rd );
+      System.out.println( "Expect: recv returns 0" );
+      System.out.println( "or:     recv returns -11" );
+      ok &= rd==0 || rd==-11;
+
+      s.close();
+      s2.close();
+      s3.close();
+
+      if ( ok )
+        System.out.println( "\n\t\tTest Passed" );
+      else
+        System.out.println( "\n\t\tTest FAILED" );
+    } else {
+      System.out.println( "Zerocopy not enabled." );
+    }
+  }
+
+  /** OnloadZeroCopyRing relies upon the OnloadExt C library */
+  static{
+    System.loadLibrary("OnloadExt");
+  }
+};
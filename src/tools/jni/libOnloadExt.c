@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <errno.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
@@ -27,6 +28,7 @@
 
 #include "OnloadExt.h"
 #include "OnloadZeroCopy.h"
+#include "OnloadZeroCopyRing.h"
 #include "OnloadTemplateSend.h"
 #include "OnloadWireOrderDelivery.h"
 #include "OnloadWireOrderDelivery_FdEvent.h"
@@ -35,6 +37,8 @@
 struct native_zc_userdata {
 	JNIEnv*	env;
 	jobject	cb;
+	jmethodID mid;
+	jclass	cls;
 	int fd;
 };
 
@@ -92,6 +96,18 @@ Java_OnloadExt_ResetStackOptions (JNIEnv* env, jclass cls)
 #define CHECK_CONSTANT_ZC(_x) ( _x == OnloadZeroCopy_##_x )
 #define CHECK_CONSTANT_TMPL(_x) ( _x == OnloadTemplateSend_##_x )
 #define CHECK_CONSTANT_WODA(_x) ( _x == OnloadWireOrderDelivery_##_x )
+#define CHECK_DESC_FIELD(_f, _x) \
+	( offsetof(struct native_zc_desc, _f) == OnloadZeroCopyRing_##_x )
+
+/* Layout of a ring descriptor; see OnloadZeroCopyRing.java */
+struct native_zc_desc {
+	jlong	handle;
+	jint	len;
+	jint	fd;
+	jint	flags;
+	jint	rc;
+	jlong	reserved;
+};
 
 
 
@@ -141,6 +157,12 @@ static int AreContstantsOk()
 	&& CHECK_CONSTANT_ZC(ONLOAD_ZC_BUFFER_HDR_TCP)
 	&& CHECK_CONSTANT_ZC(ONLOAD_MSG_NOSIGNAL)
 	&& CHECK_CONSTANT_ZC(ONLOAD_MSG_NOSIGNAL)
+	&& sizeof(struct native_zc_desc) == OnloadZeroCopyRing_DESC_BYTES
+	&& CHECK_DESC_FIELD(handle, DESC_HANDLE)
+	&& CHECK_DESC_FIELD(len, DESC_LEN)
+	&& CHECK_DESC_FIELD(fd, DESC_FD)
+	&& CHECK_DESC_FIELD(flags, DESC_FLAGS)
+	&& CHECK_DESC_FIELD(rc, DESC_RC)
 	&& CHECK_CONSTANT_TMPL(ONLOAD_TEMPLATE_FLAGS_SEND_NOW)
 	&& CHECK_CONSTANT_TMPL(ONLOAD_TEMPLATE_FLAGS_DONTWAIT)
 	&& CHECK_CONSTANT_WODA(EPOLL_CTL_ADD)
@@ -717,8 +739,6 @@ native_zerocopy_recv_callback(struct onload_zc_recv_args *args, int flags)
 	JNIEnv* env;
 	jobject cb;
 	int fd;
-	jclass cls;
-	jmethodID mid;
 	jobjectArray array;
 	
 	ptr = (struct native_zc_userdata*) args->user_ptr;
@@ -726,20 +746,10 @@ native_zerocopy_recv_callback(struct onload_zc_recv_args *args, int flags)
 	cb = ptr->cb;
 	fd = ptr->fd;
 	
-	/* TODO: Cache these? */
-	cls = (*env)->GetObjectClass(env, cb);
-	mid = (*env)->GetMethodID(env, cls, "RecvCallback",
-					"([LOnloadZeroCopy;I)I");
-	if ( !mid )
-		return ONLOAD_ZC_TERMINATE;
-	jclass Class_ZeroCopy = (*env)->FindClass(env,"LOnloadZeroCopy;");
-	if ( !Class_ZeroCopy )
-		return ONLOAD_ZC_TERMINATE;
-	
 	/* args->msg.msghdr.msg_iovlen is usually 1;
 	   but we can't rely on that, so use an array. */
 	array = (*env)->NewObjectArray(env, args->msg.msghdr.msg_iovlen,
-						Class_ZeroCopy, NULL );
+						ptr->cls, NULL );
 	if ( !array )
 		return ONLOAD_ZC_TERMINATE;
 	
@@ -754,7 +764,7 @@ native_zerocopy_recv_callback(struct onload_zc_recv_args *args, int flags)
 		
 		(*env)->SetObjectArrayElement( env, array, i, zc );
 	}
-	return (*env)->CallIntMethod( env, cb, mid, array, flags );
+	return (*env)->CallIntMethod( env, cb, ptr->mid, array, flags );
 }
 
 JNIEXPORT jint JNICALL
@@ -767,6 +777,14 @@ Java_OnloadZeroCopy_Recv__LOnloadZeroCopy_Callback_2II(JNIEnv* env, jclass cls,
 	data.env = env;
 	data.cb = cb;
 	data.fd = fd;
+	/* Look these up once per call rather than once per message. */
+	data.mid = (*env)->GetMethodID(env, (*env)->GetObjectClass(env, cb),
+				"RecvCallback", "([LOnloadZeroCopy;I)I");
+	if ( !data.mid )
+		return -EINVAL;
+	data.cls = (*env)->FindClass(env,"LOnloadZeroCopy;");
+	if ( !data.cls )
+		return -EINVAL;
 	args.cb = native_zerocopy_recv_callback;
 	args.user_ptr = &data;
 	args.flags = flags & ONLOAD_ZC_RECV_FLAGS_MASK;
@@ -841,24 +859,45 @@ JNIEXPORT jint JNICALL
 Java_OnloadZeroCopy_Release___3LOnloadZeroCopy_2(JNIEnv* env, jclass cls,
 							jobjectArray buffers)
 {
-	jsize i;
+	jsize i, n_handles = 0;
 	jsize num = (*env)->GetArrayLength(env, buffers);
+	onload_zc_handle* handles;
+	jfieldID opaqueId = NULL, fdId = NULL;
+	jint fd = -1, buffer_fd, rval;
 	
 	if ( (*env)->ExceptionOccurred(env) )
 		return 0;
 	if ( num < 1 )
 		return -ENOMEM;
 
+	/* Release runs of buffers that belong to the same socket with a
+	   single call, rather than one call per buffer. */
+	handles = alloca( sizeof(onload_zc_handle) * num );
 	for( i=0; i<num; ++i ) {
-		jint rval = Java_OnloadZeroCopy_Release__LOnloadZeroCopy_2(
-			env, cls,
-			(*env)->GetObjectArrayElement( env, buffers, i ) );
-		if ( rval < 0 )
-			return rval;
-		if ( (*env)->ExceptionOccurred(env) )
-			return 0;
+		jobject buffer = (*env)->GetObjectArrayElement( env, buffers, i );
+		if ( !buffer )
+			return -EINVAL;
+		if ( !opaqueId ) {
+			opaqueId = GetFieldFromObject( env, buffer, "opaque", "J" );
+			fdId = GetFieldFromObject( env, buffer, "associated_fd",
+						   "I" );
+			if ( !opaqueId || !fdId )
+				return 0;
+		}
+		buffer_fd = (*env)->GetIntField( env, buffer, fdId );
+		if ( n_handles && buffer_fd != fd ) {
+			rval = onload_zc_release_buffers( fd, handles, n_handles );
+			if ( rval < 0 )
+				return rval;
+			n_handles = 0;
+		}
+		fd = buffer_fd;
+		handles[n_handles++] = (onload_zc_handle)
+			(*env)->GetLongField( env, buffer, opaqueId );
+		(*env)->DeleteLocalRef( env, buffer );
 	}
-	return num;
+	rval = onload_zc_release_buffers( fd, handles, n_handles );
+	return rval < 0 ? rval : num;
 }
 
 JNIEXPORT jint JNICALL
@@ -928,6 +967,296 @@ Java_OnloadZeroCopy_Send ( JNIEnv* env, jclass cls,
 }
 
 
+/* ************************ */
+/* Batched zerocopy (rings) */
+/* ************************ */
+
+/* State of a ring for the duration of one JNI call. */
+struct native_zc_ring {
+	JNIEnv*	env;
+	struct native_zc_desc* desc;
+	jobjectArray views;
+	jint	capacity;
+	jint	n;
+	jint	fd;
+	jint	rc;	/* Error that stopped a receive early */
+};
+
+/* Point views[i] at [len] bytes at [base], with a new direct ByteBuffer. */
+static int RingSetView( struct native_zc_ring* ring, jint i, void* base,
+			jint len )
+{
+	JNIEnv* env = ring->env;
+	jobject view;
+
+	view = (*env)->NewDirectByteBuffer( env, base, len );
+	if ( !view || (*env)->ExceptionOccurred(env) ) {
+		(*env)->ExceptionClear( env );
+		return -ENOMEM;
+	}
+	(*env)->SetObjectArrayElement( env, ring->views, i, view );
+	(*env)->DeleteLocalRef( env, view );
+	return 0;
+}
+
+static int RingGet( JNIEnv* env, jobject obj, struct native_zc_ring* ring )
+{
+	jobject desc;
+
+	desc = GetObjectFromObject( env, obj, "desc", "Ljava/nio/ByteBuffer;" );
+	if ( !desc )
+		return -EINVAL;
+	ring->views = GetObjectFromObject( env, obj, "views",
+					   "[Ljava/nio/ByteBuffer;" );
+	if ( !ring->views )
+		return -EINVAL;
+	ring->desc = (*env)->GetDirectBufferAddress( env, desc );
+	if ( !ring->desc )
+		return -EINVAL;
+	ring->capacity = (*env)->GetDirectBufferCapacity( env, desc ) /
+			 sizeof(struct native_zc_desc);
+	ring->env = env;
+	ring->n = 0;
+	ring->rc = 0;
+	return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_OnloadZeroCopyRing_GetFd ( JNIEnv* env, jclass cls, jobject socket )
+{
+	return GetFdFromUnknown( env, socket );
+}
+
+enum onload_zc_callback_rc
+native_zerocopy_ring_recv_callback(struct onload_zc_recv_args *args, int flags)
+{
+	struct native_zc_ring* ring = (struct native_zc_ring*) args->user_ptr;
+	struct native_zc_desc* d;
+	int i;
+
+	for ( i = 0; i < args->msg.msghdr.msg_iovlen; ++i ) {
+		if ( ring->n == ring->capacity ) {
+			/* The first buffer's handle releases the whole message,
+			 * so nothing leaks; the data is lost though. */
+			ring->desc[ring->n - i].flags |=
+				OnloadZeroCopyRing_DESC_FLAG_TRUNC;
+			break;
+		}
+		d = &ring->desc[ring->n];
+		d->handle = i == 0 ? (jlong) args->msg.iov[i].buf : 0;
+		d->len = args->msg.iov[i].iov_len;
+		d->fd = ring->fd;
+		d->flags = (flags & ONLOAD_ZC_MSG_SHARED) |
+			   (i ? OnloadZeroCopyRing_DESC_FLAG_CONT : 0);
+		d->rc = 0;
+		if ( RingSetView( ring, ring->n, args->msg.iov[i].iov_base,
+				  d->len ) < 0 ) {
+			/* Stop here, reporting what was lost as for a full
+			 * ring. */
+			ring->rc = -ENOMEM;
+			if ( i )
+				ring->desc[ring->n - i].flags |=
+					OnloadZeroCopyRing_DESC_FLAG_TRUNC;
+			break;
+		}
+		++ring->n;
+	}
+	/* A message is only in the ring if its first buffer is. */
+	if ( i == 0 )
+		return ONLOAD_ZC_TERMINATE;
+	if ( ring->n == ring->capacity || ring->rc )
+		return ONLOAD_ZC_KEEP | ONLOAD_ZC_TERMINATE;
+	return ONLOAD_ZC_KEEP;
+}
+
+JNIEXPORT jint JNICALL
+Java_OnloadZeroCopyRing_Recv ( JNIEnv* env, jclass cls, jobject obj,
+				jint flags, jint fd )
+{
+	struct onload_zc_recv_args args;
+	struct native_zc_ring ring;
+	socklen_t len = sizeof(int);
+	int rc, type;
+
+	rc = RingGet( env, obj, &ring );
+	if ( rc < 0 )
+		return rc;
+	if ( ring.capacity < 1 )
+		return -ENOMEM;
+	/* A full ring cuts messages short, which would lose stream data. */
+	if ( getsockopt( fd, SOL_SOCKET, SO_TYPE, &type, &len ) < 0 )
+		return -errno;
+	if ( type != SOCK_DGRAM )
+		return -EOPNOTSUPP;
+	ring.fd = fd;
+
+	memset( &args, 0, sizeof(args) );
+	args.cb = native_zerocopy_ring_recv_callback;
+	args.user_ptr = &ring;
+	args.flags = flags & ONLOAD_ZC_RECV_FLAGS_MASK;
+
+	rc = onload_zc_recv( fd, &args );
+	/* Messages already in the ring belong to the caller now, so report
+	 * them even if the receive then failed. */
+	if ( ring.n )
+		return ring.n;
+	return ring.rc ? ring.rc : rc;
+}
+
+JNIEXPORT jint JNICALL
+Java_OnloadZeroCopyRing_Alloc ( JNIEnv* env, jclass cls, jobject obj,
+				jint n, jint flags, jint fd )
+{
+	struct onload_zc_iovec* iovecs;
+	struct native_zc_ring ring;
+	int rc, i;
+
+	rc = RingGet( env, obj, &ring );
+	if ( rc < 0 )
+		return rc;
+	if ( n < 1 || n > ring.capacity )
+		return -EINVAL;
+
+	/* [n] comes from Java and may be large, so not alloca(). */
+	iovecs = malloc( sizeof(struct onload_zc_iovec) * n );
+	if ( !iovecs )
+		return -ENOMEM;
+	rc = onload_zc_alloc_buffers( fd, iovecs, n, flags );
+	if ( rc < 0 )
+		goto out;
+
+	for ( i = 0; i < n; ++i ) {
+		struct native_zc_desc* d = &ring.desc[i];
+		d->handle = (jlong) iovecs[i].buf;
+		d->len = iovecs[i].iov_len;
+		d->fd = fd;
+		d->flags = 0;
+		d->rc = 0;
+		if ( RingSetView( &ring, i, iovecs[i].iov_base, d->len ) < 0 ) {
+			/* The caller gets none of the buffers, so hand them
+			 * all back. */
+			for ( i = 0; i < n; ++i ) {
+				onload_zc_release_buffers( fd, &iovecs[i].buf, 1 );
+				ring.desc[i].handle = 0;
+			}
+			rc = -ENOMEM;
+			goto out;
+		}
+	}
+	rc = n;
+ out:
+	free( iovecs );
+	return rc;
+}
+
+JNIEXPORT jint JNICALL
+Java_OnloadZeroCopyRing_Send ( JNIEnv* env, jclass cls, jobject obj,
+				jint n, jint flags )
+{
+	struct onload_zc_mmsg* msgs;
+	struct onload_zc_iovec* iovecs;
+	struct native_zc_ring ring;
+	jobject view;
+	int rc, i, n_msgs = 0;
+
+	rc = RingGet( env, obj, &ring );
+	if ( rc < 0 )
+		return rc;
+	if ( n < 1 || n > ring.capacity ||
+	     (ring.desc[0].flags & OnloadZeroCopyRing_DESC_FLAG_CONT) )
+		return -EINVAL;
+
+	/* [n] comes from Java and may be large, so not alloca(). */
+	msgs = calloc( n, sizeof(struct onload_zc_mmsg) );
+	iovecs = malloc( sizeof(struct onload_zc_iovec) * n );
+	if ( !msgs || !iovecs ) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for ( i = 0; i < n; ++i ) {
+		struct native_zc_desc* d = &ring.desc[i];
+		view = (*env)->GetObjectArrayElement( env, ring.views, i );
+		/* No view means the descriptor has no buffer. */
+		if ( !view ) {
+			rc = -EINVAL;
+			goto out;
+		}
+		iovecs[i].iov_base = (*env)->GetDirectBufferAddress( env, view );
+		(*env)->DeleteLocalRef( env, view );
+		if ( !iovecs[i].iov_base || d->len < 1 ) {
+			rc = -EINVAL;
+			goto out;
+		}
+		iovecs[i].iov_len = d->len;
+		iovecs[i].buf = (onload_zc_handle) d->handle;
+		iovecs[i].iov_flags = 0;
+		if ( !(d->flags & OnloadZeroCopyRing_DESC_FLAG_CONT) ) {
+			msgs[n_msgs].msg.iov = &iovecs[i];
+			msgs[n_msgs].fd = d->fd;
+			++n_msgs;
+		}
+		++msgs[n_msgs - 1].msg.msghdr.msg_iovlen;
+	}
+
+	rc = onload_zc_send( msgs, n_msgs, flags );
+
+	for ( i = 0, n_msgs = 0; i < n; ++i )
+		if ( !(ring.desc[i].flags & OnloadZeroCopyRing_DESC_FLAG_CONT) )
+			ring.desc[i].rc = msgs[n_msgs++].rc;
+ out:
+	free( msgs );
+	free( iovecs );
+	return rc;
+}
+
+JNIEXPORT jint JNICALL
+Java_OnloadZeroCopyRing_Release ( JNIEnv* env, jclass cls, jobject obj,
+				  jint n )
+{
+	struct native_zc_ring ring;
+	onload_zc_handle* handles;
+	int rc, i, run, n_handles = 0, n_released = 0;
+
+	rc = RingGet( env, obj, &ring );
+	if ( rc < 0 )
+		return rc;
+	if ( n < 1 || n > ring.capacity )
+		return -EINVAL;
+
+	/* Release consecutive buffers on the same socket together.  [n]
+	 * comes from Java and may be large, so not alloca(). */
+	handles = malloc( sizeof(onload_zc_handle) * n );
+	if ( !handles )
+		return -ENOMEM;
+	for ( i = 0, run = 0; i < n; ++i ) {
+		if ( ring.desc[i].handle == 0 )
+			continue;
+		if ( n_handles && ring.desc[i].fd != ring.desc[run].fd ) {
+			rc = onload_zc_release_buffers( ring.desc[run].fd,
+							handles, n_handles );
+			if ( rc < 0 )
+				goto out;
+			n_handles = 0;
+		}
+		if ( n_handles == 0 )
+			run = i;
+		handles[n_handles++] = (onload_zc_handle) ring.desc[i].handle;
+		++n_released;
+	}
+	rc = n_released;
+	if ( n_handles ) {
+		rc = onload_zc_release_buffers( ring.desc[run].fd, handles,
+						n_handles );
+		if ( rc >= 0 )
+			rc = n_released;
+	}
+ out:
+	free( handles );
+	return rc;
+}
+
+
 /* ************** */
 /* Templated Send */
 /* ************** */
@@ -25,6 +25,7 @@ FTL_DECLARE(STRUCT_IP_STATS)
 #endif
 FTL_DECLARE(STRUCT_NETIF_DBG_MAX)
 FTL_DECLARE(STRUCT_NETIF_THRD_INFO)
+FTL_DECLARE(STRUCT_NETIF_INIT_TIMING)
 FTL_DECLARE(STRUCT_EF_VI_STATS)
 FTL_DECLARE(STRUCT_SOCKET_CACHE)
 FTL_DECLARE(STRUCT_NETIF_STATE)
@@ -296,6 +296,8 @@
   FTL_TFIELD_INT(ctx, ci_uint32, tx_dmaq_done_seq, ORM_OUTPUT_STACK) \
   FTL_TFIELD_STRUCT(ctx, ci_ni_dllist_t, tx_ready_list, ORM_OUTPUT_STACK) \
   FTL_TFIELD_INT(ctx, ci_int32, rx_frags, ORM_OUTPUT_STACK)         \
+  FTL_TFIELD_INT(ctx, ci_int32, rx_recycle, ORM_OUTPUT_STACK)       \
+  FTL_TFIELD_INT(ctx, ci_int32, rx_recycle_n, ORM_OUTPUT_STACK)     \
   FTL_TFIELD_INT(ctx, ci_uint32, pd_owner, ORM_OUTPUT_STACK)        \
   ON_CI_CFG_TIMESTAMPING( \
     FTL_TFIELD_STRUCT(ctx, oo_timespec,           \
@@ -484,6 +486,18 @@
     FTL_TFIELD_STRUCT(ctx, ci_netif_dbg_max_t, max, ORM_OUTPUT_STACK)     \
     FTL_TSTRUCT_END(ctx)
 
+#define STRUCT_NETIF_INIT_TIMING(ctx)                                   \
+  FTL_TSTRUCT_BEGIN(ctx, ci_netif_init_timing, )                        \
+  FTL_TFIELD_INT(ctx, ci_uint32, hw_resources, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint32, ep_table, ORM_OUTPUT_STACK)            \
+  FTL_TFIELD_INT(ctx, ci_uint32, pkt_alloc, ORM_OUTPUT_STACK)           \
+  FTL_TFIELD_INT(ctx, ci_uint32, rx_fill, ORM_OUTPUT_STACK)             \
+  FTL_TFIELD_INT(ctx, ci_uint32, kernel_total, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint32, prefault, ORM_OUTPUT_STACK)            \
+  FTL_TFIELD_INT(ctx, ci_uint16, pkt_sets, ORM_OUTPUT_STACK)            \
+  FTL_TFIELD_INT(ctx, ci_uint16, threads, ORM_OUTPUT_STACK)             \
+  FTL_TSTRUCT_END(ctx)
+
 #define STRUCT_EF_VI_STATS(ctx)                                         \
   FTL_TSTRUCT_BEGIN(ctx, ef_vi_stats, )                                  \
   FTL_TFIELD_INT(ctx, ci_uint32, rx_ev_lost, ORM_OUTPUT_STACK)             \
@@ -536,6 +550,7 @@
   FTL_TFIELD_INT(ctx, ci_uint32, mem_pressure, ORM_OUTPUT_STACK)          \
   FTL_TFIELD_INT(ctx, ci_int32, mem_pressure_pkt_pool, ORM_OUTPUT_STACK)  \
   FTL_TFIELD_INT(ctx, ci_int32, mem_pressure_pkt_pool_n, ORM_OUTPUT_STACK) \
+  FTL_TFIELD_INT(ctx, ci_int32, mem_pressure_sock_budget, ORM_OUTPUT_STACK) \
   FTL_TFIELD_INT(ctx, ci_int32, n_async_pkts, ORM_OUTPUT_STACK)           \
   FTL_TFIELD_INT(ctx, ci_int32, reserved_pktbufs, ORM_OUTPUT_STACK)       \
   FTL_TFIELD_STRUCT(ctx, ci_ni_dllist_t, deferred_list, ORM_OUTPUT_EXTRA) \
@@ -630,6 +645,7 @@
   FTL_TFIELD_INT(ctx, ci_uint32, packet_alloc_numa_nodes, ORM_OUTPUT_STACK)\
   FTL_TFIELD_INT(ctx, ci_uint32, sock_alloc_numa_nodes, ORM_OUTPUT_STACK) \
   FTL_TFIELD_INT(ctx, ci_uint32, interrupt_numa_nodes, ORM_OUTPUT_STACK)  \
+  FTL_TFIELD_STRUCT(ctx, ci_netif_init_timing, init_timing, ORM_OUTPUT_STACK) \
   ON_CI_CFG_FD_CACHING(                                                 \
     FTL_TFIELD_STRUCT(ctx, ci_socket_cache_t, active_cache, ORM_OUTPUT_EXTRA)   \
     FTL_TFIELD_INT(ctx, ci_uint32, active_cache_avail_stack, ORM_OUTPUT_STACK)  \
@@ -638,6 +654,17 @@
   FTL_TFIELD_INT(ctx, ci_uint32, cplane_pid, ORM_OUTPUT_STACK)          \
   FTL_TFIELD_INT(ctx, ci_uint16, rss_instance, ORM_OUTPUT_STACK)        \
   FTL_TFIELD_INT(ctx, ci_uint16, cluster_size, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint32, blog_entries_n, ORM_OUTPUT_STACK)      \
+  FTL_TFIELD_INT(ctx, ci_uint32, blog_head, ORM_OUTPUT_STACK)           \
+  FTL_TFIELD_INT(ctx, ci_uint32, ssnap_sock_log_n, ORM_OUTPUT_STACK)    \
+  FTL_TFIELD_INT(ctx, ci_uint32, ssnap_sock_head, ORM_OUTPUT_STACK)     \
+  FTL_TFIELD_INT(ctx, ci_uint64, ssnap_cycles, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint64, ssnap_last_frc, ORM_OUTPUT_STACK)      \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_ts_ring_n, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_ts_ring_added, ORM_OUTPUT_STACK)    \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_ts_ring_removed, ORM_OUTPUT_STACK)  \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_ts_ring_lost, ORM_OUTPUT_STACK)     \
+  FTL_TFIELD_INT(ctx, ci_uint32, sock_ready_words, ORM_OUTPUT_STACK)    \
   FTL_TFIELD_INT(ctx, oo_pkt_p, kernel_packets_head, ORM_OUTPUT_STACK)  \
   FTL_TFIELD_INT(ctx, oo_pkt_p, kernel_packets_tail, ORM_OUTPUT_STACK)  \
   FTL_TFIELD_INT(ctx, ci_uint32, kernel_packets_pending, ORM_OUTPUT_STACK) \
@@ -905,6 +932,8 @@ typedef struct oo_sock_cplane oo_sock_cplane_t;
   FTL_TFIELD_INT(ctx, ci_uint32, n_tx_msg_confirm, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
   FTL_TFIELD_INT(ctx, ci_uint32, n_tx_os_late, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
   FTL_TFIELD_INT(ctx, ci_uint32, n_tx_unconnect_late, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
+  FTL_TFIELD_INT(ctx, ci_uint32, n_tx_gso, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
+  FTL_TFIELD_INT(ctx, ci_uint32, n_rx_gro, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
   FTL_TSTRUCT_END(ctx)
 
 typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
@@ -926,6 +955,8 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
   FTL_TFIELD_INT(ctx, ci_uint32, tx_msg_warm, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))      \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_tmpl_send_fast, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_tmpl_send_slow, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_mag_hits, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))      \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_mag_misses, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
   FTL_TFIELD_INT(ctx, ci_uint32, rx_isn, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))           \
   FTL_TFIELD_INT(ctx, ci_uint16, tx_tmpl_active, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))   \
   FTL_TFIELD_INT(ctx, ci_uint16, rtos, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))             \
@@ -952,6 +983,7 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
   FTL_TFIELD_STRUCT(ctx, ci_sock_cmn, s, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                  \
   FTL_TFIELD_STRUCT(ctx, ci_ip_cached_hdrs, ephemeral_pkt, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
   FTL_TFIELD_INT(ctx, ci_uint32, udpflags, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
+  FTL_TFIELD_INT(ctx, ci_uint32, gso_size, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
   ON_CI_CFG_ZC_RECV_FILTER( \
     FTL_TFIELD_INT(ctx, ci_uint64, recv_q_filter, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
     FTL_TFIELD_INT(ctx, ci_uint64, recv_q_filter_arg, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
@@ -1218,8 +1250,6 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
     FTL_TFIELD_INT(ctx, ci_int32, n_listenq_new, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))        \
     FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_ni_dllist_t,       \
 			     listenq, CI_CFG_TCP_SYNACK_RETRANS_MAX + 1, ORM_OUTPUT_EXTRA, 1)    \
-    FTL_TFIELD_INT(ctx, ci_int32, bucket, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
-    FTL_TFIELD_INT(ctx, ci_uint32, n_buckets, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))           \
     ON_CI_CFG_FD_CACHING(                                                     \
       FTL_TFIELD_STRUCT(ctx, ci_socket_cache_t, epcache, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))\
       FTL_TFIELD_STRUCT(ctx, ci_ni_dllist_t,            \
@@ -386,6 +386,25 @@ static int orm_oo_stats_dump(const char* label, const ci_netif_stats* stats)
 }
 
 
+/* Returns the stack's counters.  The live counters may be read part way
+ * through an update, so prefer the stats snapshot when the stack has one
+ * (EF_STATS_SNAPSHOT).  [snap] provides the storage for the copy.
+ */
+static const ci_netif_stats* orm_netif_stats(ci_netif* ni,
+                                             ci_netif_ssnap* snap)
+{
+  int i, rc;
+
+  for( i = 0; i < 1000; ++i ) {
+    if( (rc = ci_netif_ssnap_read(ni, snap)) == 0 )
+      return &snap->stats;
+    if( rc != -EAGAIN )
+      break;
+  }
+  return &ni->state->stats;
+}
+
+
 static void orm_dump_struct_ci_netif_stats(char* label, const ci_netif_stats* stats, int flags)
 {
   if( ~flags & ORM_OUTPUT_STACK )
@@ -446,7 +465,8 @@ static void orm_dump_struct_ci_tcp_ext_stats_count(char* label, const ci_tcp_ext
 #define OO_STAT(desc, type, name, kind)                                 \
   stats_sum->name += stats->name;
 
-static void orm_oo_stats_sum(ci_netif_stats* stats_sum, ci_netif_stats* stats)
+static void orm_oo_stats_sum(ci_netif_stats* stats_sum,
+                             const ci_netif_stats* stats)
 {
 #include <ci/internal/stats_def.h>
 }
@@ -947,7 +967,8 @@ static int orm_netif_dump(ci_netif* ni, int id, int output_flags, bool cfg_flat,
     }
   }
   if (output_flags & ORM_OUTPUT_STATS) {
-    if( (rc = orm_oo_stats_dump("stats", &ni->state->stats)) != 0 ) {
+    ci_netif_ssnap snap;
+    if( (rc = orm_oo_stats_dump("stats", orm_netif_stats(ni, &snap))) != 0 ) {
       LOG("stats error code %d\n",rc);
       return rc;
     }
@@ -1110,8 +1131,10 @@ int orm_do_dump(const struct orm_cfg* cfg, int output_flags,
      * in the json array to match *_meta_dump() functions above. */
     for( i = 0; i < state.n_stacks; ++i ) {
       ci_netif* ni = &state.stacks[i]->os_ni;
-      if( output_flags & ORM_OUTPUT_STATS )
-        orm_oo_stats_sum(&stats_sum, &ni->state->stats);
+      if( output_flags & ORM_OUTPUT_STATS ) {
+        ci_netif_ssnap snap;
+        orm_oo_stats_sum(&stats_sum, orm_netif_stats(ni, &snap));
+      }
       if( output_flags & ORM_OUTPUT_MORE_STATS ) {
         more_stats_t more_stats;
         get_more_stats(ni, &more_stats);